@@ -0,0 +1,284 @@
+// Kicco972.net
+
+
+#include "AnelloRegistro.h"
+
+AnelloRegistro::AnelloRegistro()
+    : _configurazione{nullptr, 0, 0}, _testa(0), _generazione(0), _pronto(false), _byteScritti(0)
+{
+}
+
+bool AnelloRegistro::begin(const ConfigurazioneAnello& configurazione)
+{
+    _configurazione = configurazione;
+    _pronto = false;
+    if (!configurazione.base || configurazione.segmenti < 2 || configurazione.segmenti > MAX_SEGMENTI_ANELLO ||
+        configurazione.dimensioneSegmento < REGISTRO_INTESTAZIONE + REGISTRO_RECORD)
+        return false;
+
+    if (!leggiManifesto())
+    {
+        ricostruisci();
+        if (!scriviManifesto())
+            return false;
+    }
+    _pronto = true;
+    return true;
+}
+
+bool AnelloRegistro::aggiungi(const CampioneStorico* campioni, int numero)
+{
+    if (!_pronto)
+        return false;
+
+    FILE* f = nullptr;
+    long dimensione = 0;
+    bool ok = apriTesta(f, dimensione);
+
+    uint8_t buf[BLOCCO_SCRITTURA_STORICO * REGISTRO_RECORD];
+    int i = 0;
+    while (ok && i < numero)
+    {
+        long liberi = ((long)_configurazione.dimensioneSegmento - dimensione) / REGISTRO_RECORD;
+        if (liberi <= 0)
+        {
+            // Testa piena: si chiude e si ricicla il segmento più vecchio
+            ok = fclose(f) == 0;
+            f = nullptr;
+            ok = ok && ruota() && apriTesta(f, dimensione);
+            continue;
+        }
+
+        int blocco = numero - i;
+        if (blocco > BLOCCO_SCRITTURA_STORICO)
+            blocco = BLOCCO_SCRITTURA_STORICO;
+        if (blocco > liberi)
+            blocco = (int)liberi;
+        for (int j = 0; j < blocco; j++)
+            codificaRecordRegistro(campioni[i + j], buf + j * REGISTRO_RECORD);
+        ok = fwrite(buf, REGISTRO_RECORD, blocco, f) == (size_t)blocco;
+        dimensione += blocco * REGISTRO_RECORD;
+        _byteScritti += blocco * REGISTRO_RECORD;
+        i += blocco;
+    }
+
+    if (f && fclose(f) != 0)
+        ok = false;
+    return ok;
+}
+
+bool AnelloRegistro::ultimo(CampioneStorico& c)
+{
+    if (!_pronto)
+        return false;
+    int precedente = (_testa + _configurazione.segmenti - 1) % _configurazione.segmenti;
+    return ultimoNelSegmento(_testa, c) || ultimoNelSegmento(precedente, c);
+}
+
+void AnelloRegistro::percorsoInOrdine(int ordine, char* buf, int dimensione) const
+{
+    percorsoSegmento(_configurazione.base, (_testa + 1 + ordine) % _configurazione.segmenti, buf, dimensione);
+}
+
+int AnelloRegistro::getSegmenti() const
+{
+    return _configurazione.segmenti;
+}
+
+int AnelloRegistro::getTesta() const
+{
+    return _testa;
+}
+
+uint32_t AnelloRegistro::getRecordPerSegmento() const
+{
+    return registroRecordInteri(_configurazione.dimensioneSegmento);
+}
+
+uint32_t AnelloRegistro::getRitenzione() const
+{
+    return getRecordPerSegmento() * _configurazione.segmenti;
+}
+
+uint32_t AnelloRegistro::getGenerazione() const
+{
+    return _generazione;
+}
+
+uint32_t AnelloRegistro::getByteScritti() const
+{
+    return _byteScritti;
+}
+
+void AnelloRegistro::percorsoSegmento(const char* base, int indice, char* buf, int dimensione)
+{
+    snprintf(buf, dimensione, "%s_%02d.bin", base, indice);
+}
+
+// Apre la testa in accodamento. Un'intestazione o un record lasciati a metà da un reset
+// si completano: l'intestazione è nota, il record si chiude con 0xFF (CRC errato, verrà saltato)
+bool AnelloRegistro::apriTesta(FILE*& f, long& dimensione)
+{
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    percorsoSegmento(_configurazione.base, _testa, percorso, sizeof(percorso));
+    f = fopen(percorso, "a+");
+    if (!f)
+        return false;
+    if (fseek(f, 0, SEEK_END) != 0)
+        return false;
+    dimensione = ftell(f);
+
+    uint8_t buf[REGISTRO_RECORD];
+    int completamento = 0;
+    if (dimensione < REGISTRO_INTESTAZIONE)
+    {
+        uint8_t intestazione[REGISTRO_INTESTAZIONE];
+        codificaIntestazioneRegistro(intestazione, (uint16_t)_generazione);
+        completamento = REGISTRO_INTESTAZIONE - (int)dimensione;
+        memcpy(buf, intestazione + dimensione, completamento);
+    }
+    else if ((dimensione - REGISTRO_INTESTAZIONE) % REGISTRO_RECORD != 0)
+    {
+        completamento = REGISTRO_RECORD - (int)((dimensione - REGISTRO_INTESTAZIONE) % REGISTRO_RECORD);
+        memset(buf, 0xFF, completamento);
+    }
+    if (completamento > 0)
+    {
+        if (fwrite(buf, 1, completamento, f) != (size_t)completamento)
+            return false;
+        dimensione += completamento;
+        _byteScritti += completamento;
+    }
+    return true;
+}
+
+// Prima si tronca il segmento più vecchio, poi si sposta la testa nel manifesto:
+// un reset a metà lascia la vecchia testa piena, e la rotazione si ripete
+bool AnelloRegistro::ruota()
+{
+    int prossimo = (_testa + 1) % _configurazione.segmenti;
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    percorsoSegmento(_configurazione.base, prossimo, percorso, sizeof(percorso));
+    FILE* f = fopen(percorso, "w");
+    if (!f)
+        return false;
+    uint8_t intestazione[REGISTRO_INTESTAZIONE];
+    codificaIntestazioneRegistro(intestazione, (uint16_t)(_generazione + 1));
+    bool ok = fwrite(intestazione, 1, sizeof(intestazione), f) == sizeof(intestazione);
+    if (fclose(f) != 0 || !ok)
+        return false;
+    _byteScritti += sizeof(intestazione);
+
+    _testa = prossimo;
+    _generazione++;
+    return scriviManifesto();
+}
+
+bool AnelloRegistro::leggiManifesto()
+{
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    snprintf(percorso, sizeof(percorso), "%s.man", _configurazione.base);
+    FILE* f = fopen(percorso, "r");
+    if (!f)
+        return false;
+    uint8_t buf[MANIFESTO_ANELLO_DIMENSIONE];
+    size_t letti = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    if (letti != sizeof(buf) || memcmp(buf, MANIFESTO_ANELLO_MAGICO, 4) != 0 ||
+        storicoCrc16(0xFFFF, buf, MANIFESTO_ANELLO_DIMENSIONE - 2) != tramaLeggi16(buf + 16))
+        return false;
+
+    int segmenti = buf[4];
+    _testa = tramaLeggi16(buf + 6);
+    _generazione = tramaLeggi32(buf + 12);
+    if (segmenti == _configurazione.segmenti && tramaLeggi32(buf + 8) == _configurazione.dimensioneSegmento)
+        return _testa < segmenti;
+
+    // Configurazione cambiata: i segmenti in più si cancellano, la nuova dimensione vale dalla prossima rotazione
+    for (int i = _configurazione.segmenti; i < segmenti; i++)
+    {
+        percorsoSegmento(_configurazione.base, i, percorso, sizeof(percorso));
+        remove(percorso);
+    }
+    if (_testa >= _configurazione.segmenti)
+        _testa = _configurazione.segmenti - 1;
+    return scriviManifesto();
+}
+
+// File temporaneo e rename(): chi legge vede il vecchio manifesto o il nuovo, mai uno a metà
+bool AnelloRegistro::scriviManifesto()
+{
+    uint8_t buf[MANIFESTO_ANELLO_DIMENSIONE];
+    memcpy(buf, MANIFESTO_ANELLO_MAGICO, 4);
+    buf[4] = (uint8_t)_configurazione.segmenti;
+    buf[5] = 0;
+    tramaScrivi16(buf + 6, (uint16_t)_testa);
+    tramaScrivi32(buf + 8, _configurazione.dimensioneSegmento);
+    tramaScrivi32(buf + 12, _generazione);
+    tramaScrivi16(buf + 16, storicoCrc16(0xFFFF, buf, MANIFESTO_ANELLO_DIMENSIONE - 2));
+
+    char temporaneo[PERCORSO_ANELLO_MASSIMO];
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    snprintf(temporaneo, sizeof(temporaneo), "%s.tmp", _configurazione.base);
+    snprintf(percorso, sizeof(percorso), "%s.man", _configurazione.base);
+    FILE* f = fopen(temporaneo, "w");
+    if (!f)
+        return false;
+    bool ok = fwrite(buf, 1, sizeof(buf), f) == sizeof(buf);
+    if (fclose(f) != 0 || !ok)
+        return false;
+    _byteScritti += sizeof(buf);
+    return rename(temporaneo, percorso) == 0;
+}
+
+// Senza manifesto: la testa è il segmento con la generazione più recente (confronto a 16 bit,
+// le generazioni presenti distano al più MAX_SEGMENTI_ANELLO). Nessun segmento: anello nuovo
+void AnelloRegistro::ricostruisci()
+{
+    _testa = 0;
+    _generazione = 0;
+    bool trovato = false;
+    for (int i = 0; i < _configurazione.segmenti; i++)
+    {
+        char percorso[PERCORSO_ANELLO_MASSIMO];
+        percorsoSegmento(_configurazione.base, i, percorso, sizeof(percorso));
+        FILE* f = fopen(percorso, "r");
+        if (!f)
+            continue;
+        uint8_t intestazione[REGISTRO_INTESTAZIONE];
+        size_t letti = fread(intestazione, 1, sizeof(intestazione), f);
+        fclose(f);
+        if (!verificaIntestazioneRegistro(intestazione, (int)letti))
+            continue;
+        uint16_t generazione = tramaLeggi16(intestazione + 6);
+        if (!trovato || (int16_t)(generazione - (uint16_t)_generazione) > 0)
+        {
+            _testa = i;
+            _generazione = generazione;
+            trovato = true;
+        }
+    }
+}
+
+bool AnelloRegistro::ultimoNelSegmento(int indice, CampioneStorico& c)
+{
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    percorsoSegmento(_configurazione.base, indice, percorso, sizeof(percorso));
+    FILE* f = fopen(percorso, "r");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long record = registroRecordInteri(ftell(f));
+
+    bool trovato = false;
+    uint8_t buf[REGISTRO_RECORD];
+    for (int tentativi = 0; record > 0 && tentativi < RICERCA_ULTIMO_RECORD && !trovato; tentativi++)
+    {
+        record--;
+        if (fseek(f, registroPosizione(record), SEEK_SET) != 0 || fread(buf, 1, REGISTRO_RECORD, f) != REGISTRO_RECORD)
+            break;
+        trovato = decodificaRecordRegistro(buf, c);
+    }
+    fclose(f);
+    return trovato;
+}
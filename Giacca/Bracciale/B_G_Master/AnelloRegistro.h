@@ -0,0 +1,86 @@
+/*
+  AnelloRegistro.h
+  Registro circolare a segmenti per un canale (archivio, storico...).
+  Il canale è un insieme di file di dimensione fissa, base_00.bin ... base_NN.bin,
+  ognuno nel formato di FormatoRegistro.h, più un piccolo manifesto (base.man)
+  con il segmento di testa. Il manifesto si riscrive solo alla rotazione
+  (file temporaneo e rename(), atomico su LittleFS): all'avvio si apre solo
+  il segmento di testa, senza scorrere gli altri.
+  Pieno il segmento di testa, si ricicla il più vecchio: viene troncato e la
+  sua nuova intestazione porta la generazione, con cui si ritrova la testa se
+  il manifesto manca. Troncare libera i blocchi interi del segmento, che
+  l'allocatore di LittleFS riusa a rotazione su tutta la flash.
+  Ritenzione per canale: segmenti × record per segmento (ConfigurazioneAnello).
+  Solo C standard (stdio): su PC gira su una cartella qualsiasi.
+
+  Manifesto (little endian, MANIFESTO_ANELLO_DIMENSIONE byte):
+    0-3   "BGA1"
+    4     uint8   segmenti
+    5     uint8   riservato (0)
+    6-7   uint16  segmento di testa
+    8-11  uint32  dimensione di un segmento [byte]
+    12-15 uint32  generazione (rotazioni dalla creazione)
+    16-17 uint16  CRC-16/CCITT dei byte 0-15
+*/
+#ifndef ANELLO_REGISTRO_H
+#define ANELLO_REGISTRO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "FormatoRegistro.h"
+
+#define MANIFESTO_ANELLO_MAGICO "BGA1"
+#define MANIFESTO_ANELLO_DIMENSIONE 18
+#define MAX_SEGMENTI_ANELLO 64
+#define PERCORSO_ANELLO_MASSIMO 48
+#define RICERCA_ULTIMO_RECORD 8        // Record rovinati da un reset saltati cercando l'ultimo
+
+struct ConfigurazioneAnello {
+    const char* base;                  // Percorso senza estensione, es. "/fs/Storico"
+    uint32_t dimensioneSegmento;       // Byte per segmento, intestazione compresa
+    int segmenti;                      // Da 2 a MAX_SEGMENTI_ANELLO
+};
+
+class AnelloRegistro {
+public:
+    AnelloRegistro();
+
+    // Legge il manifesto (se manca o è rovinato lo ricostruisce dalle intestazioni dei segmenti).
+    // false se la configurazione non è valida o il supporto non risponde
+    bool begin(const ConfigurazioneAnello& configurazione);
+
+    // Accoda i record nel segmento di testa, ruotando quando è pieno. false se una scrittura fallisce
+    bool aggiungi(const CampioneStorico* campioni, int numero);
+
+    // Ultimo record valido (testa, o il segmento prima se la testa è appena ruotata). false se vuoto
+    bool ultimo(CampioneStorico& c);
+
+    // Segmenti in ordine di tempo: 0 = il più vecchio, getSegmenti() - 1 = la testa.
+    // Un segmento mai scritto non esiste: chi legge salta i file che non si aprono
+    void percorsoInOrdine(int ordine, char* buf, int dimensione) const;
+    int getSegmenti() const;
+    int getTesta() const;              // Indice del segmento di testa
+    uint32_t getRecordPerSegmento() const;
+    uint32_t getRitenzione() const;    // Record conservati al massimo
+    uint32_t getGenerazione() const;
+    uint32_t getByteScritti() const;   // Record, intestazioni e manifesti, dall'avvio
+
+    // Percorso del segmento indice (non in ordine di tempo) di un canale
+    static void percorsoSegmento(const char* base, int indice, char* buf, int dimensione);
+
+private:
+    ConfigurazioneAnello _configurazione;
+    int _testa;
+    uint32_t _generazione;
+    bool _pronto;
+    uint32_t _byteScritti;
+
+    bool apriTesta(FILE*& f, long& dimensione);
+    bool leggiManifesto();
+    bool scriviManifesto();
+    void ricostruisci();
+    bool ruota();
+    bool ultimoNelSegmento(int indice, CampioneStorico& c);
+};
+
+#endif
@@ -0,0 +1,136 @@
+// Kicco972.net
+
+
+#include "AssettoImu.h"
+#include <string.h>
+
+AssettoImu::AssettoImu(float frequenzaHz, float beta)
+    : _fusione(frequenzaHz, beta), _tara(Quaternione::identita()), _ultimoTempoUs(0), _primoCampione(true),
+      _magX(0), _magY(0), _magZ(0), _magValido(false), _usaMagnetometro(false),
+      _accBiasX(0), _accBiasY(0), _accBiasZ(0), _gyroBiasX(0), _gyroBiasY(0), _gyroBiasZ(0)
+{
+    memset(&_stato, 0, sizeof(_stato));
+    _stato.relativo = Quaternione::identita();
+}
+
+void AssettoImu::setFrequenza(float frequenzaHz)
+{
+    _fusione.setFrequenza(frequenzaHz);
+}
+
+float AssettoImu::getPeriodo() const
+{
+    return _fusione.getPeriodo();
+}
+
+void AssettoImu::fondi(const CampioneImu& c)
+{
+    _stato.accValido = c.accValido;
+    if (c.accValido)
+    {
+        // Applica la calibrazione (Tare) ai soli valori visualizzati:
+        // la fusione ha bisogno della gravità
+        _stato.ax = c.ax - _accBiasX;
+        _stato.ay = c.ay - _accBiasY;
+        _stato.az = c.az - _accBiasZ;
+    }
+
+    // Applica la calibrazione (Tare)
+    _stato.gx = c.gx - _gyroBiasX;
+    _stato.gy = c.gy - _gyroBiasY;
+    _stato.gz = c.gz - _gyroBiasZ;
+
+    // --- FUSIONE A QUATERNIONE (Madgwick) ---
+    // I campioni arrivano a periodo fisso: un passo del filtro per campione.
+    // Se la marca temporale rivela campioni persi, il buco viene colmato ripetendo il campione.
+    int passi = 1;
+    if (!_primoCampione)
+    {
+        float dt = (float)(c.tempoUs - _ultimoTempoUs) / 1000000.0f;
+        passi = (int)(dt / _fusione.getPeriodo() + 0.5f);
+        if (passi < 1)
+            passi = 1;
+        if (passi > MAX_PASSI_FUSIONE)
+            passi = MAX_PASSI_FUSIONE;
+    }
+    _ultimoTempoUs = c.tempoUs;
+    _primoCampione = false;
+
+    float gxr = _stato.gx * M3D_DEG_TO_RAD;
+    float gyr = _stato.gy * M3D_DEG_TO_RAD;
+    float gzr = _stato.gz * M3D_DEG_TO_RAD;
+    bool conMag = _usaMagnetometro && _magValido;
+
+    for (int i = 0; i < passi; i++)
+    {
+        if (conMag)
+            _fusione.aggiorna(gxr, gyr, gzr, c.ax, c.ay, c.az, _magX, _magY, _magZ);
+        else
+            _fusione.aggiornaImu(gxr, gyr, gzr, c.ax, c.ay, c.az);
+    }
+    _stato.campioniFusi++;
+
+    // Orientamento relativo alla tara: R = R_tara^T * R_attuale
+    _stato.relativo = _tara.coniugato() * _fusione.getQuaternione();
+
+    // Angoli solo per il testo: Asse X = Pitch, Asse Y = Roll, Asse Z = Yaw
+    Matrice3 r = _stato.relativo.toMatrice();
+    float s = -r.m[2][0];
+    if (s > 1.0f)
+        s = 1.0f;
+    if (s < -1.0f)
+        s = -1.0f;
+    _stato.pitch = atan2f(r.m[2][1], r.m[2][2]) * M3D_RAD_TO_DEG;
+    _stato.roll = asinf(s) * M3D_RAD_TO_DEG;
+    _stato.yaw = atan2f(r.m[1][0], r.m[0][0]) * M3D_RAD_TO_DEG;
+}
+
+void AssettoImu::tara()
+{
+    // 1. L'orientamento attuale diventa il nuovo "zero" (senza toccare lo stato del filtro)
+    _tara = _fusione.getQuaternione();
+    _stato.relativo = Quaternione::identita();
+    _stato.pitch = 0;
+    _stato.roll = 0;
+    _stato.yaw = 0;
+
+    // 2. Calibra i sensori: Imposta il valore attuale come "Zero" (Bias)
+    // Aggiungiamo il valore corrente al bias esistente per permettere tare successive.
+    if (_stato.accValido)
+    {
+        _accBiasX += _stato.ax;
+        _accBiasY += _stato.ay;
+        _accBiasZ += _stato.az;
+    }
+    _gyroBiasX += _stato.gx;
+    _gyroBiasY += _stato.gy;
+    _gyroBiasZ += _stato.gz;
+}
+
+void AssettoImu::setMagnetometro(float mx, float my, float mz, bool valido)
+{
+    _magX = mx;
+    _magY = my;
+    _magZ = mz;
+    _magValido = valido;
+}
+
+void AssettoImu::setUsaMagnetometro(bool attivo)
+{
+    _usaMagnetometro = attivo;
+}
+
+bool AssettoImu::isUsaMagnetometro() const
+{
+    return _usaMagnetometro;
+}
+
+const StatoAssetto& AssettoImu::getStato() const
+{
+    return _stato;
+}
+
+const FusioneAhrs& AssettoImu::getFusione() const
+{
+    return _fusione;
+}
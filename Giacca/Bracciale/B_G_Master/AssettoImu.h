@@ -0,0 +1,65 @@
+/*
+  AssettoImu.h
+  Dai campioni grezzi all'orientamento: calibrazione (tara), fusione a periodo
+  fisso e angoli relativi alla tara. Gira sul core che campiona l'IMU
+  (M7 in modalità singola, M4 in modalità doppio core).
+  Solo C++ standard (nessuna dipendenza Arduino), quindi compilabile anche su PC.
+*/
+#ifndef ASSETTO_IMU_H
+#define ASSETTO_IMU_H
+
+#include <stdint.h>
+#include "Matematica3D.h"
+#include "FusioneAhrs.h"
+#include "CampioneImu.h"
+
+#define FREQUENZA_FUSIONE 400.0f // ODR della FIFO del BMI270 (vedi SensoreImu)
+#define BETA_FUSIONE 0.1f
+#define MAX_PASSI_FUSIONE 40 // Buco massimo colmato tra due campioni (100 ms a 400 Hz)
+
+// Risultato della fusione, copiabile byte per byte (viaggia anche tra i core)
+struct StatoAssetto {
+    Quaternione relativo;         // Orientamento Device -> World relativo alla tara
+    float pitch, roll, yaw;       // Gradi, solo per il testo
+    float ax, ay, az;             // Accelerometro calibrato [g]
+    float gx, gy, gz;             // Giroscopio calibrato [gradi/s]
+    bool accValido;
+    uint32_t campioniFusi;        // Totale dall'avvio
+};
+
+class AssettoImu {
+public:
+    AssettoImu(float frequenzaHz = FREQUENZA_FUSIONE, float beta = BETA_FUSIONE);
+
+    void setFrequenza(float frequenzaHz); // Deve coincidere con l'ODR del sensore
+    float getPeriodo() const;
+
+    void fondi(const CampioneImu& c);     // Un campione: tara, fusione, angoli
+    void tara();                          // L'orientamento attuale diventa lo zero
+
+    // Magnetometro remoto (BMM150 del Nano Sense ricevuto via BLE), opzionale nella fusione
+    void setMagnetometro(float mx, float my, float mz, bool valido);
+    void setUsaMagnetometro(bool attivo);
+    bool isUsaMagnetometro() const;
+
+    const StatoAssetto& getStato() const;
+    const FusioneAhrs& getFusione() const;
+
+private:
+    FusioneAhrs _fusione;
+    Quaternione _tara;                    // Orientamento considerato "zero"
+    StatoAssetto _stato;
+    uint32_t _ultimoTempoUs;
+    bool _primoCampione;
+
+    // Ultimo campione del magnetometro remoto
+    float _magX, _magY, _magZ;
+    bool _magValido;
+    bool _usaMagnetometro;
+
+    // Biases for Sensor Calibration (Tare)
+    float _accBiasX, _accBiasY, _accBiasZ;
+    float _gyroBiasX, _gyroBiasY, _gyroBiasZ;
+};
+
+#endif
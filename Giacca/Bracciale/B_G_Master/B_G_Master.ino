@@ -4,6 +4,29 @@
 // di Kicco972, 2025
 // Google Gemini Pro
 
+#ifdef CORE_CM4
+
+// --- FIRMWARE M4 (modalità doppio core, vedi MemoriaCondivisa.h) ---
+// Caricare lo stesso sketch con target_core=cm4: l'M4 campiona e fonde l'IMU
+// e pubblica il risultato all'M7 in memoria condivisa.
+
+#include "ServizioImuM4.h"
+
+BloccoBus mutexWire1(HSEM_WIRE1); // Lato M4 del blocco su Wire1
+ServizioImuM4 servizioImu;
+
+void setup()
+{
+  servizioImu.begin();
+}
+
+void loop()
+{
+  servizioImu.update();
+}
+
+#else
+
 // --- INCLUSIONE LIBRERIE ---
 
 // Includi i moduli del progetto
@@ -15,6 +38,8 @@
 #include "WiFiGiga.h"        // Gestione WiFi
 #include "Stato.h"           // Includi la nuova gestione stati
 #include "Memoria.h"         // Gestione archiviazione dati
+#include "Compositore.h"     // Invalidazione delle aree dello schermo (dirty rectangle)
+#include "TabellaStatistiche.h" // Statistiche dei collegamenti BLE
 #include <Arduino_GigaDisplayTouch.h>
 #include <Arduino_GigaDisplay_GFX.h>
 
@@ -23,6 +48,8 @@
 // Oggetto Display Globale (condiviso tra Display.cpp e Imu3DVisualizer.cpp)
 GigaDisplay_GFX gigaDisplay;
 GigaDisplayRGB rgb;         // Oggetto per controllare il LED RGB integrato nel display shield
+Compositore compositore;    // Raccoglie le aree da ridisegnare e conta i pixel scritti per frame
+BloccoBus mutexWire1(HSEM_WIRE1); // Serializza l'accesso a Wire1 (touch e IMU, anche tra i core)
 
 // Crea gli oggetti globali per i moduli personalizzati
 Display display;            // Gestisce UI e pulsanti
@@ -32,6 +59,7 @@ Imu3DVisualizer imuViz;     // Gestisce la grafica 3D dell'IMU locale
 Bussola bussolaViz;         // Oggetto per la visualizzazione della Bussola
 Stato gestioneStato;        // Oggetto per gestire il LED di stato
 Memoria memoria;            // Oggetto per gestire l'archivio dati
+TabellaStatistiche statisticheViz; // Tabella delle statistiche BLE (schermata F2)
 
 // --- VARIABILI DI STATO ---
 
@@ -39,6 +67,7 @@ Memoria memoria;            // Oggetto per gestire l'archivio dati
 bool imuMode = false;       // true = visualizza sfera 3D, false = schermata base
 bool bussolaMode = false;   // Flag per modalità bussola (true = visualizza bussola)
 bool memoryMode = false;    // Flag per modalità visualizzazione memoria
+bool statisticheMode = false; // Flag per la schermata delle statistiche BLE
 bool imuOk = false;         // Flag per tracciare lo stato dell'hardware IMU
 
 // Variabili per il datalogger
@@ -55,9 +84,11 @@ void setup()
   // Inizializza i moduli hardware e software
   display.begin(); // Avvia display e touch
   myNetwork.begin(); // Avvia modulo BLE
-  myWifi.begin(); // Avvia connessione WiFi
+  myWifi.begin(); // Avvia il thread di rete: connessione e NTP senza bloccare il setup
   gestioneStato.begin(rgb); // Avvia gestione LED passando l'oggetto RGB del display
   memoria.begin(); // Avvia il filesystem (QSPI Flash)
+  myNetwork.setArchivioStorico(memoria); // Storico dei campioni del Sense su QSPI (anche fuori portata)
+  myNetwork.setOrologio(myWifi);         // Ora NTP per marcare i campioni delle periferiche all'acquisizione
 
   // Inizializza IMU (Sensore inerziale locale)
   if (!imuViz.begin())
@@ -102,6 +133,10 @@ void loop()
             display.setButtonLabel(Display::BUTTON_IMU, "Su");
             display.setButtonLabel(Display::BUTTON_BUSSOLA, "Giu");
             display.setButtonLabel(Display::BUTTON_LED, "Apri");
+            display.setButtonLabel(Display::BUTTON_F1, "Pag Su");
+            display.setButtonLabel(Display::BUTTON_F2, "Pag Giu");
+            display.setButtonLabel(Display::BUTTON_F3, memoria.getFileSortLabel());
+            display.setButtonLabel(Display::BUTTON_F4, "");
             display.drawButtons();
             
             memoria.drawContent(gigaDisplay);
@@ -114,6 +149,9 @@ void loop()
             display.setButtonLabel(Display::BUTTON_IMU, "Flash");
             display.setButtonLabel(Display::BUTTON_BUSSOLA, "USB");
             display.setButtonLabel(Display::BUTTON_LED, "Entra");
+            display.setButtonLabel(Display::BUTTON_F1, "Esporta");
+            display.setButtonLabel(Display::BUTTON_F2, "");
+            display.setButtonLabel(Display::BUTTON_F3, "");
             display.drawButtons();
             
             memoria.drawContent(gigaDisplay);
@@ -124,11 +162,12 @@ void loop()
             display.showBaseScreen();
             display.updateLedButton(myNetwork.getActuatorState());
         }
-    } else if (imuMode || bussolaMode) {
-        // Se siamo in una sottomaschera (IMU o Bussola), torna alla base
+    } else if (imuMode || bussolaMode || statisticheMode) {
+        // Se siamo in una sottomaschera (IMU, Bussola o Statistiche), torna alla base
         Serial.println("Torno alla schermata Base");
         imuMode = false;
         bussolaMode = false;
+        statisticheMode = false;
         
         display.showBaseScreen();
         display.updateLedButton(myNetwork.getActuatorState());
@@ -144,9 +183,14 @@ void loop()
     // Funzione Base: Apri IMU
     // Funzione Sub: Disponibile
     
-    if (imuMode || bussolaMode || memoryMode) {
+    if (imuMode || bussolaMode || memoryMode || statisticheMode) {
         // Pulsante disponibile nelle sottomaschere
-        if (memoryMode) {
+        if (imuMode) {
+            // Funzione IMU: alterna disegno diretto / canvas in RAM
+            imuViz.setCanvasMode(!imuViz.isCanvasMode());
+            display.setButtonLabel(Display::BUTTON_IMU, imuViz.isCanvasMode() ? "Canvas" : "Diretto");
+            display.redrawButton(Display::BUTTON_IMU);
+        } else if (memoryMode) {
             if (memoria.isViewingFileContent()) {
                 memoria.scrollFileContent(-1); // Scroll Su
                 memoria.drawContent(gigaDisplay);
@@ -158,12 +202,18 @@ void loop()
             memoria.selectDrive(0);
             memoria.drawContent(gigaDisplay);
             }
+        } else if (statisticheMode) {
+            // Funzione Statistiche: azzera i contatori
+            myNetwork.azzeraStatistiche();
         }
     } else {
         // Entra in modalità IMU
         Serial.println("Apro schermata IMU");
         imuMode = true;
         display.prepareSubScreen();
+        display.setButtonLabel(Display::BUTTON_IMU, imuViz.isCanvasMode() ? "Canvas" : "Diretto");
+        display.setButtonLabel(Display::BUTTON_BUSSOLA, imuViz.isUsaMagnetometro() ? "Mag ON" : "Mag OFF");
+        display.drawButtons();
         imuViz.drawBackground();
     }
     break;
@@ -173,8 +223,13 @@ void loop()
     // Funzione Base: Apri BUSSOLA
     // Funzione Sub: Disponibile
     
-    if (imuMode || bussolaMode || memoryMode) {
-        if (memoryMode) {
+    if (imuMode || bussolaMode || memoryMode || statisticheMode) {
+        if (imuMode) {
+            // Funzione IMU: include/esclude il magnetometro remoto dalla fusione
+            imuViz.setUsaMagnetometro(!imuViz.isUsaMagnetometro());
+            display.setButtonLabel(Display::BUTTON_BUSSOLA, imuViz.isUsaMagnetometro() ? "Mag ON" : "Mag OFF");
+            display.redrawButton(Display::BUTTON_BUSSOLA);
+        } else if (memoryMode) {
             if (memoria.isViewingFileContent()) {
                 memoria.scrollFileContent(1); // Scroll Giu
                 memoria.drawContent(gigaDisplay);
@@ -201,7 +256,7 @@ void loop()
     // Funzione Base: Toggle LED Remoto
     // Funzione Sub: Disponibile
     
-    if (imuMode || bussolaMode || memoryMode) {
+    if (imuMode || bussolaMode || memoryMode || statisticheMode) {
         if (memoryMode) {
             if (memoria.isViewingFileContent()) {
                 // Pulsante non usato o Page Down
@@ -212,17 +267,24 @@ void loop()
                 display.setButtonLabel(Display::BUTTON_IMU, "Su");
                 display.setButtonLabel(Display::BUTTON_BUSSOLA, "Giu");
                 display.setButtonLabel(Display::BUTTON_LED, "");
+                display.setButtonLabel(Display::BUTTON_F1, "Pag Su");
+                display.setButtonLabel(Display::BUTTON_F2, "Pag Giu");
+                display.setButtonLabel(Display::BUTTON_F3, "Inizio");
+                display.setButtonLabel(Display::BUTTON_F4, "Fine");
                 display.drawButtons();
                 memoria.drawContent(gigaDisplay);
             } else {
             // Funzione: ENTRA
             memoria.enterSelectedDrive();
             
-            // Pulisci etichette pulsanti (non servono nella lista file per ora)
+            // Imposta pulsanti per la lista file
             display.setButtonLabel(Display::BUTTON_SCAN, "Indietro"); // Assicura che il tasto Indietro sia visibile
             display.setButtonLabel(Display::BUTTON_IMU, "Su");
             display.setButtonLabel(Display::BUTTON_BUSSOLA, "Giu");
             display.setButtonLabel(Display::BUTTON_LED, "Apri");
+            display.setButtonLabel(Display::BUTTON_F1, "Pag Su");
+            display.setButtonLabel(Display::BUTTON_F2, "Pag Giu");
+            display.setButtonLabel(Display::BUTTON_F3, memoria.getFileSortLabel());
             display.drawButtons();
             
             memoria.drawContent(gigaDisplay);
@@ -231,17 +293,17 @@ void loop()
     } else {
         // Azione LED Base
         Serial.println("Pulsante 'LED' premuto!");
+        // Il pulsante cambia colore quando il Nano IoT conferma (vedi il loop della schermata base)
         myNetwork.toggleActuator();
-        display.updateLedButton(myNetwork.getActuatorState());
     }
     break;
 
   case Display::BUTTON_F1:
     // --- PULSANTE 5 (Basso-Sinistra) ---
     // Funzione Base: Apri MEMORIA
-    // Funzione Sub: Disponibile
+    // Funzione Sub: ESPORTA (Memoria, selezione drive), PAGINA SU (Memoria, lista e contenuto file)
     
-    if (!imuMode && !bussolaMode && !memoryMode) {
+    if (!imuMode && !bussolaMode && !memoryMode && !statisticheMode) {
         // Entra in modalità Memoria
         Serial.println("Apro schermata Memoria");
         memoryMode = true;
@@ -251,10 +313,66 @@ void loop()
         display.setButtonLabel(Display::BUTTON_IMU, "Flash");
         display.setButtonLabel(Display::BUTTON_BUSSOLA, "USB");
         display.setButtonLabel(Display::BUTTON_LED, "Entra");
+        display.setButtonLabel(Display::BUTTON_F1, "Esporta");
         display.drawButtons(); // Ridisegna per mostrare le nuove etichette
         
         // Contenuto
         memoria.drawContent(gigaDisplay);
+    } else if (memoryMode && memoria.isViewingFileContent()) {
+        memoria.pageFileContent(-1);
+        memoria.drawContent(gigaDisplay);
+    } else if (memoryMode && memoria.isViewingFiles()) {
+        memoria.moveFileSelection(-RIGHE_ELENCO_FILE);
+        memoria.drawContent(gigaDisplay);
+    } else if (memoryMode && !memoria.isViewingFiles()) {
+        // Archivio e storico della QSPI in CSV sulla chiavetta, a passi in memoria.update()
+        Serial.println("Pulsante 'Esporta' premuto!");
+        memoria.esporta();
+    }
+    break;
+
+  case Display::BUTTON_F2:
+    // --- PULSANTE 6 ---
+    // Funzione Base: Apri STATISTICHE BLE
+    // Funzione Sub: PAGINA GIU (Memoria, lista e contenuto file)
+
+    if (!imuMode && !bussolaMode && !memoryMode && !statisticheMode) {
+        Serial.println("Apro schermata Statistiche");
+        statisticheMode = true;
+        display.prepareSubScreen();
+        display.setButtonLabel(Display::BUTTON_IMU, "Azzera");
+        display.drawButtons();
+        statisticheViz.drawBackground();
+    } else if (memoryMode && memoria.isViewingFileContent()) {
+        memoria.pageFileContent(1);
+        memoria.drawContent(gigaDisplay);
+    } else if (memoryMode && memoria.isViewingFiles()) {
+        memoria.moveFileSelection(RIGHE_ELENCO_FILE);
+        memoria.drawContent(gigaDisplay);
+    }
+    break;
+
+  case Display::BUTTON_F3:
+    // --- PULSANTE 7 ---
+    // Funzione Sub: ORDINE (Memoria, lista file), INIZIO (Memoria, contenuto file)
+    if (memoryMode && memoria.isViewingFileContent()) {
+        memoria.scrollFileContentToStart();
+        memoria.drawContent(gigaDisplay);
+    } else if (memoryMode && memoria.isViewingFiles()) {
+        memoria.cycleFileSort();
+        display.setButtonLabel(Display::BUTTON_F3, memoria.getFileSortLabel());
+        display.drawButtons();
+        memoria.drawContent(gigaDisplay);
+    }
+    break;
+
+  case Display::BUTTON_F4:
+    // --- PULSANTE 8 ---
+    // Funzione Sub: FINE (Memoria, contenuto file)
+    if (memoryMode && memoria.isViewingFileContent()) {
+        // Con l'indice del file ancora in costruzione il salto avviene appena è pronto (needsRedraw)
+        memoria.scrollFileContentToEnd();
+        memoria.drawContent(gigaDisplay);
     }
     break;
 
@@ -264,17 +382,38 @@ void loop()
   }
 
   // 3. Aggiorna la logica di rete (gestisce connessioni, riceve dati, riconnessioni, etc.)
+  // Il traffico BLE segue la schermata: magnetometro solo dove serve (vedi PoliticaBle.h)
+  ContestoBle contesto = CONTESTO_BASE;
+  if (bussolaMode)
+    contesto = CONTESTO_BUSSOLA;
+  else if (imuMode && imuViz.isUsaMagnetometro())
+    contesto = CONTESTO_IMU;
+  else if (memoryMode)
+    contesto = CONTESTO_MEMORIA;
+  myNetwork.setContesto(contesto);
   myNetwork.update();
-  myWifi.update();            // Gestisce la riconnessione WiFi automatica
+  myWifi.update();            // Messaggi del thread di rete (connessione e NTP girano da soli)
+  memoria.update();           // Stato della chiavetta, esportazione a passi, report della QSPI
 
   // Aggiorna il lampeggio del LED di stato
   gestioneStato.update();
 
+  // Fonde i campioni IMU accumulati dal thread di campionamento (anche fuori dalla schermata IMU)
+  if (imuOk)
+  {
+    imuViz.aggiorna();
+  }
+
   // 4. Aggiorna il display in base alla modalità corrente
   if (imuMode)
   {
     // --- MODALITÀ IMU ---
-    // Disegna la sfera 3D ruotata in base ai dati dell'accelerometro locale
+    // Passa alla fusione l'ultimo campione del magnetometro remoto (usato solo se abilitato)
+    float mx, my, mz;
+    myNetwork.getLatestMag(mx, my, mz);
+    imuViz.setMagnetometro(mx, my, mz, myNetwork.isSenseConnected());
+
+    // Disegna la sfera 3D ruotata in base all'orientamento stimato dall'IMU locale
     imuViz.updateAndDraw();
   }
   else if (bussolaMode)
@@ -286,10 +425,20 @@ void loop()
     // Aggiorna la grafica della bussola
     bussolaViz.updateAndDraw(mx, my, mz);
   }
+  else if (statisticheMode)
+  {
+    // --- MODALITÀ STATISTICHE ---
+    // La tabella si aggiorna da sola due volte al secondo, solo nelle celle cambiate
+    statisticheViz.updateAndDraw(myNetwork);
+  }
   else if (memoryMode)
   {
     // --- MODALITÀ MEMORIA ---
-    // Schermata statica, non richiede aggiornamenti continui nel loop
+    // Schermata statica: si ridisegna solo quando l'indice del file aperto è pronto
+    if (memoria.needsRedraw())
+    {
+      memoria.drawContent(gigaDisplay);
+    }
   }
   else
   {
@@ -303,6 +452,9 @@ void loop()
     // Aggiorna Orologio (Data e Ora in alto a sinistra)
     display.updateClock(myWifi.getTimeString(), myWifi.getDateString());
 
+    // Pulsante LED: stato confermato dal Nano IoT, non quello richiesto
+    display.updateLedButton(myNetwork.getActuatorState());
+
     // Aggiorna la temperatura/umidità/pressione sul display se connesso a Sense
     if (myNetwork.isSenseConnected())
     {
@@ -310,6 +462,9 @@ void loop()
       display.updateHumidity(myNetwork.getLatestHumidity());
       display.updatePressure(myNetwork.getLatestPressure());
     }
+
+    // Pulisce una sola volta le aree invalidate e ridisegna i widget cambiati
+    display.disegnaFrame();
   }
 
   // 7. Gestione Archiviazione Dati (Ogni ora)
@@ -320,16 +475,16 @@ void loop()
 
       // Salva solo se abbiamo dati validi dal sensore Sense
       if (myNetwork.isSenseConnected()) {
-          bool esito = memoria.logData(myWifi.getDateString(), 
-                          myWifi.getTimeString(), 
+          bool esito = memoria.logData(time(NULL), 
                           myNetwork.getLatestTemperature(), 
                           myNetwork.getLatestHumidity(), 
                           myNetwork.getLatestPressure());
           
+          // Record binario su QSPI: sulla chiavetta arriva con "Esporta" (schermata Memoria)
           if (esito) {
-              Serial.println("Dati salvati correttamente su USB.");
+              Serial.println("Dati salvati nell'archivio su QSPI.");
           } else {
-              Serial.println("Errore salvataggio: Chiavetta USB non trovata o errore scrittura.");
+              Serial.println("Errore salvataggio: QSPI non disponibile.");
           }
       } else {
           Serial.println("Archiviazione saltata: Sensore Sense non connesso (Dati non validi).");
@@ -369,4 +524,6 @@ void loop()
   // Aggiorna l'icona sul display (LED Virtuale in alto a destra)
   display.updateStateIcon(coloreStato);
 
-}
\ No newline at end of file
+}
+
+#endif // CORE_CM4
@@ -1,32 +1,83 @@
 // Kicco972.net
 
 
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
 #include "BleNetwork.h"
+#include "TramaSensori.h"
+#include "ProtocolloAttuatore.h"
+#include <stdio.h>
+#include <time.h>
+#if defined(BLE_INTERVALLO_DINAMICO) || defined(BLE_MTU_ESTESO)
+#include <utility/ATT.h>
+#include <utility/HCI.h>
+#endif
+
+// Periferiche del giubbotto, in ordine di PerifericaBle. Per un secondo Sense
+// (l'altra manica) o un altro attuatore basta aggiungere il tipo qui sotto.
+static const TipoPeriferica *const CONFIGURAZIONE_PERIFERICHE[] = {
+    &TIPO_SENSE,
+    &TIPO_IOT,
+};
+
+static const int NUM_CONFIGURATE = sizeof(CONFIGURAZIONE_PERIFERICHE) / sizeof(CONFIGURAZIONE_PERIFERICHE[0]);
+static_assert(NUM_CONFIGURATE <= MAX_PERIFERICHE_BLE, "Troppe periferiche configurate");
+
+// Restituito per posizioni o canali inesistenti
+static const MisuraBle MISURA_VUOTA = {{0, 0, 0}, 0, 0, 0};
+static const ContatoriTrama CONTATORI_VUOTI = {true, 0, 0, 0, 0};
+
+BleNetwork* BleNetwork::_istanza = nullptr;
 
 // --- Costruttore ---
 BleNetwork::BleNetwork()
 {
     // Inizializzazione stati
-    _senseConnected = false;
-    _iotConnected = false;
-    _lastTemperature = 0.0;
-    _lastHumidity = 0.0;
-    _lastPressure = 0.0;
-    _magX = 0;
-    _magY = 0;
-    _magZ = 0;
+    _scanAttivo = false;
+    _cacheGattCaricata = false;
+    memset(_canali, 0, sizeof(_canali));
     _actuatorState = false;
+    _actuatorRichiesto = false;
+    _archivioPronto = false;
+    _arretratoInCorso = false;
+    _ultimoStoricoDiretto = 0;
+    _orologio = nullptr;
+
+    _numPeriferiche = NUM_CONFIGURATE;
+    _indiceSense = -1;
+    _indiceIoT = -1;
+    for (int i = 0; i < _numPeriferiche; i++)
+    {
+        PerifericaRegistrata &r = _periferiche[i];
+        r.tipo = CONFIGURAZIONE_PERIFERICHE[i];
+        r.connessione.begin(i, *this);
+        r.numSottoscrizioni = 0;
+        r.profiloDaApplicare = false;
+        r.passoProfilo = 0;
+        r.preferitaAttiva = false;
+        r.storicoDaChiedere = false;
+        r.canali = &_canali[i * MAX_CANALI_PERIFERICA];
+        r.contatori = CONTATORI_VUOTI;
+        r.inizioConnessione = 0;
+        r.durataScoperta = 0;
+        r.scopertaDaCache = false;
 
-    // Inizializziamo la nostra flag di scansione a false
-    _isScanning = false;
+        if (r.tipo == &TIPO_SENSE && _indiceSense < 0)
+            _indiceSense = i;
+        if (r.tipo == &TIPO_IOT && _indiceIoT < 0)
+            _indiceIoT = i;
+    }
 
-    // Definizione degli UUID
-    _uuidSenseCharTemp = "2A6E";
-    _uuidSenseCharHum = "2A6F";
-    _uuidSenseCharPress = "2A6D";
-    _uuidSenseCharMag = "2AA1";
+    _tempoUpdateAccumulato = 0;
+    _updateMisurati = 0;
+    _eventiRicevuti = 0;
+    _ultimoReport = 0;
+    _ultimoRssi = 0;
+    _prossimoRssi = 0;
 
-    _uuidIoTCharSwitch = "19B10001-E8F2-537E-4F6C-D104768A1214";
+    // Il gestore di evento è una funzione statica: raggiunge l'oggetto da qui
+    _istanza = this;
 }
 
 // --- Inizializzazione ---
@@ -39,6 +90,11 @@ void BleNetwork::begin()
             ;
     }
     Serial.println("Stato: Modulo BLE avviato correttamente.");
+
+#ifdef BLE_MTU_ESTESO
+    // Lo scambio dell'MTU avviene nella scoperta degli attributi (anche quella da cache GATT)
+    ATT.setMaxMtu(STORICO_PACCHETTO_MASSIMO + 3);
+#endif
 }
 
 // --- Gestione Scansione ---
@@ -46,279 +102,1111 @@ void BleNetwork::begin()
 void BleNetwork::startScan()
 {
     // Evita scansioni inutili se siamo già connessi a tutto
-    if (_senseConnected && _iotConnected) {
+    bool tutteAttive = true;
+    for (int i = 0; i < _numPeriferiche; i++)
+        tutteAttive = tutteAttive && _periferiche[i].connessione.isAttiva();
+    if (tutteAttive) {
         Serial.println("Info: Già connesso a tutti i dispositivi.");
         return;
     }
 
-    // Controllo la mia variabile interna invece di BLE.isScanning()
-    if (!_isScanning)
-    {
-        Serial.println("Comando: Avvio scansione manuale...");
-        BLE.scan(true);
-        _isScanning = true; // Aggiorno lo stato
-    }
+    Serial.println("Comando: Avvio ricerca con riconnessione automatica...");
+    for (int i = 0; i < _numPeriferiche; i++)
+        _periferiche[i].connessione.abilita();
 }
 
 void BleNetwork::stopScan()
 {
-    // Controllo la mia variabile interna
-    if (_isScanning)
+    // Le periferiche già collegate restano, ma non vengono più ricollegate
+    for (int i = 0; i < _numPeriferiche; i++)
+        _periferiche[i].connessione.disabilita();
+    if (_scanAttivo)
     {
         BLE.stopScan();
+        _scanAttivo = false;
         Serial.println("Comando: Scansione interrotta.");
-        _isScanning = false; // Aggiorno lo stato
     }
 }
 
-// Getter pubblico per sapere se stiamo scansionando
+// Getter pubblico per sapere se stiamo cercando periferiche (anche tra un tentativo e l'altro)
 bool BleNetwork::isScanning()
 {
-    return _isScanning; // Ritorno la variabile locale, NON chiamo la libreria
+    for (int i = 0; i < _numPeriferiche; i++)
+    {
+        StatoConnessione s = _periferiche[i].connessione.getStato();
+        if (s != CONN_INATTIVA && s != CONN_ATTIVA)
+            return true;
+    }
+    return false;
 }
 
 // --- Loop Principale (Update) ---
 void BleNetwork::update()
 {
-    // 1. Uso la variabile interna per sapere se devo cercare dispositivi
-    if (_isScanning)
+    unsigned long inizio = micros();
+
+    // Consegna gli eventi in arrivo: le notifiche arrivano a onNotifica()
+    BLE.poll();
+
+    // 1. Scansione condivisa: consegna le periferiche trovate alle macchine in ricerca
+    gestisciScansione();
+
+    // 2. Un passo per macchina (connect, discover o una sottoscrizione al massimo)
+    unsigned long adesso = millis();
+    for (int i = 0; i < _numPeriferiche; i++)
+        _periferiche[i].connessione.update(adesso);
+
+    // 3. Profilo della schermata: al cambio va riapplicato a tutte le periferiche collegate
+    if (_politica.update(adesso))
     {
-        scanAndConnect();
+        Serial.print("BLE: profilo ");
+        Serial.println(_politica.getProfilo().nome);
+        for (int i = 0; i < _numPeriferiche; i++)
+        {
+            _periferiche[i].profiloDaApplicare = true;
+            _periferiche[i].passoProfilo = 0;
+        }
+    }
+    for (int i = 0; i < _numPeriferiche; i++)
+    {
+        PerifericaRegistrata &r = _periferiche[i];
+        if (r.profiloDaApplicare && r.connessione.isAttiva())
+            applicaProfilo(r);
     }
 
-    // 2. Gestione Dispositivo Sense
-    if (_senseConnected)
+#ifdef BLE_CONFRONTO_POLLING
+    pollCaratteristiche();
+#endif
+
+    // 4. Comandi agli attuatori: invii senza risposta, ripetuti finché non arriva la conferma
+    aggiornaComandi(adesso);
+
+    // 5. Statistiche: chiusura della finestra di frequenza e una lettura RSSI
+    _statistiche.update(adesso);
+    campionaRssi(adesso);
+
+    // 6. Storico: conferme del recupero e un blocco di campioni su flash
+    aggiornaStorico(adesso);
+
+    // 7. Orologio delle periferiche: uno scambio alla volta, senza risposta
+    aggiornaTempo(adesso);
+
+    misuraUpdate(micros() - inizio);
+}
+
+void BleNetwork::misuraUpdate(unsigned long durata)
+{
+    _tempoUpdateAccumulato += durata;
+    _updateMisurati++;
+
+    // Report periodico del costo del percorso BLE nel loop
+    if (millis() - _ultimoReport >= 5000)
     {
-        if (!_senseDevice.connected())
+#ifdef BLE_CONFRONTO_POLLING
+        Serial.print("BLE [polling]: update medio ");
+#else
+        Serial.print("BLE [eventi]: update medio ");
+#endif
+        Serial.print(_tempoUpdateAccumulato / _updateMisurati);
+        Serial.print(" us su ");
+        Serial.print(_updateMisurati);
+        Serial.print(" loop, ");
+        Serial.print(_eventiRicevuti);
+        Serial.print(" notifiche, profilo ");
+        Serial.print(_politica.getProfilo().nome);
+
+        // Trame di tutte le periferiche con la caratteristica preferita
+        uint32_t ricevute = 0;
+        uint32_t perse = 0;
+        bool trame = false;
+        for (int i = 0; i < _numPeriferiche; i++)
         {
-            Serial.println("Avviso: Connessione con Sense persa!");
-            _senseConnected = false;
-            // Opzionale: Riavviare scansione qui se si vuole auto-reconnect immediato
+            if (_periferiche[i].preferitaAttiva)
+            {
+                trame = true;
+                ricevute += _periferiche[i].contatori.ricevute;
+                perse += _periferiche[i].contatori.perse;
+            }
         }
-        else
+        if (trame)
         {
-            pollSense();
+            Serial.print(", trame ");
+            Serial.print(ricevute);
+            Serial.print(" (perse ");
+            Serial.print(perse);
+            Serial.print(")");
         }
-    }
 
-    // 3. Gestione Dispositivo IoT
-    if (_iotConnected)
-    {
-        if (!_iotDevice.connected())
+        // Latenza dei comandi dalla pressione alla conferma (dall'avvio)
+        const StatisticheComandi &c = _comandi.getStatistiche();
+        if (c.confermati > 0 || c.falliti > 0)
+        {
+            Serial.print(", comandi ");
+            Serial.print(c.confermati);
+            Serial.print(" (latenza ");
+            Serial.print(_comandi.getLatenzaMediaMs());
+            Serial.print(" ms, min ");
+            Serial.print(c.latenzaMinimaMs);
+            Serial.print(" max ");
+            Serial.print(c.latenzaMassimaMs);
+            Serial.print(", ripetuti ");
+            Serial.print(c.ripetuti);
+            Serial.print(", falliti ");
+            Serial.print(c.falliti);
+            Serial.print(")");
+        }
+
+        if (_unione.getScritti() > 0)
         {
-            Serial.println("Avviso: Connessione con IoT persa!");
-            _iotConnected = false;
+            Serial.print(", storico ");
+            Serial.print(_unione.getScritti());
+            Serial.print(" campioni (doppioni ");
+            Serial.print(_unione.getDoppioni());
+            Serial.print(")");
         }
+
+        // Orologio delle periferiche sincronizzate rispetto a quello del Master
+        for (int i = 0; i < _numPeriferiche; i++)
+        {
+            const SincronizzazioneTempo &t = _periferiche[i].tempo;
+            if (!t.isSincronizzata())
+                continue;
+            char nome[16];
+            getNome(i, nome, sizeof(nome));
+            Serial.print(", ");
+            Serial.print(nome);
+            Serial.print(" scarto ");
+            Serial.print(t.getErroreUs() / 1000.0f, 1);
+            Serial.print(" ms (ritardo ");
+            Serial.print(t.getRitardoMs());
+            Serial.print(" ms, deriva ");
+            Serial.print(t.getDerivaPpm(), 1);
+            Serial.print(" ppm)");
+        }
+        Serial.println();
+
+        _tempoUpdateAccumulato = 0;
+        _updateMisurati = 0;
+        _eventiRicevuti = 0;
+        _ultimoReport = millis();
     }
 }
 
 // --- Logica di Connessione ---
-void BleNetwork::scanAndConnect()
+void BleNetwork::gestisciScansione()
 {
+    // connect() non va chiamata a scansione attiva: si ferma finché una macchina è al lavoro
+    bool inRicerca = false;
+    bool occupata = false;
+    for (int i = 0; i < _numPeriferiche; i++)
+    {
+        inRicerca = inRicerca || _periferiche[i].connessione.isInRicerca();
+        occupata = occupata || _periferiche[i].connessione.isOccupata();
+    }
+    bool serveScansione = inRicerca && !occupata;
+
+    if (serveScansione && !_scanAttivo)
+    {
+        BLE.scan(true);
+        _scanAttivo = true;
+    }
+    else if (!serveScansione && _scanAttivo)
+    {
+        BLE.stopScan();
+        _scanAttivo = false;
+    }
+
+    if (!_scanAttivo)
+        return;
+
     BLEDevice peripheral = BLE.available();
+    if (!peripheral)
+        return;
+
+    int posizione = cercaPosizione(peripheral);
+    if (posizione < 0)
+        return;
 
-    if (peripheral)
+    _periferiche[posizione].dispositivo = peripheral;
+    _periferiche[posizione].connessione.trovata();
+    BLE.stopScan();
+    _scanAttivo = false;
+}
+
+// Posizione in ricerca del tipo pubblicizzato dalla periferica (-1 = nessuna)
+int BleNetwork::cercaPosizione(BLEDevice &p)
+{
+    if (!p.hasAdvertisedServiceUuid())
+        return -1;
+
+    // Un dispositivo già assegnato resta alla sua posizione (anche durante l'attesa)
+    for (int i = 0; i < _numPeriferiche; i++)
+    {
+        const PerifericaRegistrata &r = _periferiche[i];
+        StatoConnessione s = r.connessione.getStato();
+        if (s != CONN_INATTIVA && s != CONN_RICERCA && r.dispositivo == p)
+            return -1;
+    }
+
+    for (int k = 0; k < p.advertisedServiceUuidCount(); k++)
     {
-        // Caso A: NanoSense
-        if (peripheral.localName() == "NanoSense" && !_senseConnected)
+        String servizio = p.advertisedServiceUuid(k);
+        for (int i = 0; i < _numPeriferiche; i++)
         {
-            // Importante: usare il metodo della classe che gestisce anche la flag _isScanning
-            stopScan();
+            const PerifericaRegistrata &r = _periferiche[i];
+            if (r.connessione.isInRicerca() && stessoUuid(servizio.c_str(), r.tipo->uuidServizio))
+                return i;
+        }
+    }
+    return -1;
+}
 
-            if (connectToSense(peripheral))
-            {
-                _senseConnected = true;
-                Serial.println(">> Successo: Dispositivo Sense Connesso");
-            }
-            else
-            {
-                Serial.println(">> Errore: Connessione a Sense fallita");
-            }
+void BleNetwork::stampaNome(int id)
+{
+    char nome[24];
+    getNome(id, nome, sizeof(nome));
+    Serial.print(nome);
+}
 
-            // Riavvia usando il metodo della classe
-            // Riavvia la scansione SOLO se l'altro dispositivo (IoT) non è ancora connesso
-            if (!_iotConnected)
-                startScan();
-        }
-        // Caso B: NanoIoT
-        else if (peripheral.localName() == "NanoIoT" && !_iotConnected)
+void BleNetwork::getNome(int periferica, char *buffer, int dimensione)
+{
+    if (periferica < 0 || periferica >= _numPeriferiche)
+    {
+        snprintf(buffer, dimensione, "?");
+        return;
+    }
+
+    // Con più periferiche dello stesso tipo si aggiunge il numero (Sense 2, ...)
+    const TipoPeriferica *tipo = _periferiche[periferica].tipo;
+    int numero = 1;
+    for (int i = 0; i < periferica; i++)
+    {
+        if (_periferiche[i].tipo == tipo)
+            numero++;
+    }
+    if (numero > 1)
+        snprintf(buffer, dimensione, "%s %d", tipo->nome, numero);
+    else
+        snprintf(buffer, dimensione, "%s", tipo->nome);
+}
+
+// --- DriverBle: un'operazione bloccante per chiamata ---
+
+bool BleNetwork::connetti(int id)
+{
+    _periferiche[id].inizioConnessione = millis();
+    return _periferiche[id].dispositivo.connect();
+}
+
+bool BleNetwork::scopriAttributi(int id)
+{
+    if (!_cacheGattCaricata)
+    {
+        _cacheGattCaricata = true;
+        if (_cacheGatt.carica(PERCORSO_CACHE_GATT))
         {
-            stopScan(); // Usa il metodo interno
+            Serial.print("Info: cache GATT caricata, periferiche note: ");
+            Serial.println(_cacheGatt.getNumeroVoci());
+        }
+    }
 
-            if (connectToIoT(peripheral))
-            {
-                _iotConnected = true;
-                Serial.println(">> Successo: Dispositivo IoT Connesso");
-            }
-            else
-            {
-                Serial.println(">> Errore: Connessione a IoT fallita");
-            }
+    PerifericaRegistrata &r = _periferiche[id];
+    BLEDevice &p = r.dispositivo;
+    String indirizzo = p.address();
+    unsigned long inizio = millis();
+
+    // Periferica nota: basta scoprire il servizio salvato, se la disposizione non è cambiata
+    r.scopertaDaCache = false;
+    const VoceCacheGatt *voce = _cacheGatt.cerca(indirizzo.c_str());
+    if (voce && p.discoverService(voce->servizio))
+    {
+        risolviCaratteristiche(r);
+        r.scopertaDaCache = firmaAttributi(r) == voce->firma;
+        if (!r.scopertaDaCache)
+            Serial.println("Info: cache GATT non valida, scoperta completa.");
+    }
 
-            // Riavvia la scansione SOLO se l'altro dispositivo (Sense) non è ancora connesso
-            if (!_senseConnected)
-                startScan();
+    if (!r.scopertaDaCache)
+    {
+        if (!p.discoverAttributes())
+        {
+            _cacheGatt.dimentica(indirizzo.c_str());
+            return false;
         }
+        risolviCaratteristiche(r);
+        memorizzaAttributi(r, indirizzo);
     }
+
+    scegliSottoscrizioni(r);
+    r.durataScoperta = millis() - inizio;
+    return true;
 }
 
-// Helper per connettere Sense
-bool BleNetwork::connectToSense(BLEDevice p)
+int BleNetwork::numeroSottoscrizioni(int id)
 {
-    if (!p.connect())
-    {
+    return _periferiche[id].numSottoscrizioni;
+}
+
+bool BleNetwork::sottoscrivi(int id, int indice)
+{
+    PerifericaRegistrata &r = _periferiche[id];
+    if (indice >= r.numSottoscrizioni)
         return false;
+
+    // Solo i canali che il profilo attivo usa (il resto al prossimo cambio di profilo)
+    if (!isRichiesta(r, indice))
+        return true;
+    r.sottoscritte[indice] = abilitaNotifiche(r.caratteristiche[r.sottoscrizioni[indice]]);
+    return r.sottoscritte[indice];
+}
+
+bool BleNetwork::isConnessa(int id)
+{
+    return _periferiche[id].dispositivo.connected();
+}
+
+void BleNetwork::disconnetti(int id)
+{
+    _periferiche[id].dispositivo.disconnect();
+}
+
+void BleNetwork::cambioStato(int id, StatoConnessione vecchio, StatoConnessione nuovo)
+{
+    const PerifericaRegistrata &r = _periferiche[id];
+
+    if (nuovo == CONN_ATTIVA)
+    {
+        _statistiche.connessa(id, millis());
+        // L'arretrato si chiede a profilo applicato (sottoscrizioni fatte), vedi aggiornaStorico()
+        _periferiche[id].storicoDaChiedere = cercaCaratteristica(_periferiche[id], CARATT_RICHIESTA_STORICO) >= 0;
+        // La periferica può essere ripartita: il suo millis() non vale più lo scarto di prima
+        _periferiche[id].tempo.azzera();
     }
-    if (!p.discoverAttributes())
+    else if (vecchio == CONN_ATTIVA)
     {
-        p.disconnect();
-        return false;
+        _statistiche.disconnessa(id, millis());
+        // I campioni già ricevuti restano validi, il resto arriva alla prossima connessione
+        _periferiche[id].storicoDaChiedere = false;
+        if (_storico.getPeriferica() == id)
+            _storico.annulla(millis());
     }
 
-    // Sottoscrizione alle caratteristiche per ricevere le notifiche
-    BLECharacteristic tChar = p.characteristic(_uuidSenseCharTemp);
-    if (tChar && tChar.canSubscribe())
+    if (nuovo == CONN_ATTIVA)
+    {
+        Serial.print(">> Successo: Dispositivo ");
+        stampaNome(id);
+        Serial.print(" Connesso in ");
+        Serial.print(millis() - r.inizioConnessione);
+        Serial.print(" ms (scoperta ");
+        Serial.print(r.durataScoperta);
+        Serial.println(r.scopertaDaCache ? " ms da cache GATT)" : " ms completa)");
+
+        // Periodi del Sense e intervallo di connessione secondo la schermata attiva
+        _periferiche[id].profiloDaApplicare = true;
+        _periferiche[id].passoProfilo = 0;
+    }
+    else if (nuovo == CONN_ATTESA)
     {
-        tChar.subscribe();
+        Serial.print(vecchio == CONN_ATTIVA ? "Avviso: Connessione con " : ">> Errore: Connessione a ");
+        stampaNome(id);
+        Serial.print(vecchio == CONN_ATTIVA ? " persa!" : " fallita");
+        Serial.print(" Nuovo tentativo tra ");
+        Serial.print(r.connessione.getAttesaMs());
+        Serial.println(" ms");
     }
+    else if (nuovo == CONN_INATTIVA && vecchio == CONN_ATTIVA)
+    {
+        Serial.print("Avviso: Connessione con ");
+        stampaNome(id);
+        Serial.println(" persa!");
+    }
+}
+
+// Ricerca per UUID una sola volta: le caratteristiche restano nella posizione
+void BleNetwork::risolviCaratteristiche(PerifericaRegistrata &r)
+{
+    for (int k = 0; k < r.tipo->numCaratteristiche; k++)
+        r.caratteristiche[k] = r.dispositivo.characteristic(r.tipo->caratteristiche[k].uuid);
+}
 
-    BLECharacteristic hChar = p.characteristic(_uuidSenseCharHum);
-    if (hChar && hChar.canSubscribe())
+// Sceglie le sottoscrizioni tra le caratteristiche risolte
+void BleNetwork::scegliSottoscrizioni(PerifericaRegistrata &r)
+{
+    const TipoPeriferica &tipo = *r.tipo;
+    bool conPreferita = false;
+
+    // La caratteristica preferita (trama unica) se la periferica la offre, altrimenti le separate
+    int preferita = -1;
+    for (int k = 0; k < tipo.numCaratteristiche; k++)
     {
-        hChar.subscribe();
+        uint8_t flag = tipo.caratteristiche[k].flag;
+        conPreferita = conPreferita || (flag & CARATT_PREFERITA);
+        if (preferita < 0 && (flag & CARATT_PREFERITA) && r.caratteristiche[k] && r.caratteristiche[k].canSubscribe())
+            preferita = k;
     }
 
-    BLECharacteristic pChar = p.characteristic(_uuidSenseCharPress);
-    if (pChar && pChar.canSubscribe())
+    r.numSottoscrizioni = 0;
+    for (int k = 0; k < MAX_CARATTERISTICHE_TIPO; k++)
+        r.sottoscritte[k] = false;
+    r.preferitaAttiva = preferita >= 0;
+    if (r.preferitaAttiva)
+        r.sottoscrizioni[r.numSottoscrizioni++] = preferita;
+
+    // Storico e tempo non sono sostituiti dalla preferita: portano dati che la trama non ha
+    for (int k = 0; k < tipo.numCaratteristiche; k++)
     {
-        pChar.subscribe();
+        uint8_t flag = tipo.caratteristiche[k].flag;
+        if ((flag & CARATT_NOTIFICA) && !(flag & CARATT_PREFERITA) &&
+            (!r.preferitaAttiva || (flag & (CARATT_STORICO | CARATT_TEMPO))))
+            r.sottoscrizioni[r.numSottoscrizioni++] = k;
     }
 
-    BLECharacteristic mChar = p.characteristic(_uuidSenseCharMag);
-    if (mChar && mChar.canSubscribe())
+    if (conPreferita)
     {
-        mChar.subscribe();
+        Serial.print("Info: ");
+        Serial.print(tipo.nome);
+        Serial.println(r.preferitaAttiva ? " con trama unica." : " con caratteristiche separate.");
     }
 
-    _senseDevice = p;
-    return true;
+    // Nuova connessione: i conteggi ripartono da zero (i valori restano i più recenti noti)
+    r.contatori = CONTATORI_VUOTI;
+    for (int i = 0; i < MAX_CANALI_PERIFERICA; i++)
+    {
+        r.canali[i].aggiornamenti = 0;
+        r.canali[i].tempoPeriferica = 0;
+    }
 }
 
-// Helper per connettere IoT
-bool BleNetwork::connectToIoT(BLEDevice p)
+// Firma delle caratteristiche del tipo, nell'ordine della tabella (vedi CacheGatt.h)
+uint32_t BleNetwork::firmaAttributi(PerifericaRegistrata &r)
 {
-    if (!p.connect())
+    uint32_t firma = CacheGatt::FIRMA_INIZIALE;
+    for (int k = 0; k < r.tipo->numCaratteristiche; k++)
     {
-        return false;
+        BLECharacteristic &c = r.caratteristiche[k];
+        firma = CacheGatt::aggiungiFirma(firma, r.tipo->caratteristiche[k].uuid, c, c ? c.properties() : 0);
     }
-    if (!p.discoverAttributes())
+    return firma;
+}
+
+void BleNetwork::memorizzaAttributi(PerifericaRegistrata &r, const String &indirizzo)
+{
+    if (!r.dispositivo.hasService(r.tipo->uuidServizio))
     {
-        p.disconnect();
+        _cacheGatt.dimentica(indirizzo.c_str());
+        return;
+    }
+    _cacheGatt.memorizza(indirizzo.c_str(), r.tipo->uuidServizio, firmaAttributi(r));
+
+    // Si scrive su flash solo quando la voce è cambiata
+    if (_cacheGatt.isModificata() && !_cacheGatt.salva(PERCORSO_CACHE_GATT))
+        Serial.println("Avviso: impossibile salvare la cache GATT su QSPI.");
+}
+
+bool BleNetwork::abilitaNotifiche(BLECharacteristic &c)
+{
+    if (!c || !c.canSubscribe())
         return false;
+#ifndef BLE_CONFRONTO_POLLING
+    c.setEventHandler(BLEUpdated, onNotifica);
+#endif
+    return c.subscribe();
+}
+
+// --- Profilo della schermata (vedi PoliticaBle.h) ---
+
+void BleNetwork::setContesto(ContestoBle contesto)
+{
+    _politica.setContesto(contesto, millis());
+}
+
+const ProfiloBle &BleNetwork::getProfilo()
+{
+    return _politica.getProfilo();
+}
+
+// La sottoscrizione serve se trasporta almeno un canale del profilo (solo il Sense segue il contesto)
+bool BleNetwork::isRichiesta(PerifericaRegistrata &r, int indice)
+{
+    uint8_t richiesti = r.tipo == &TIPO_SENSE ? _politica.getProfilo().canali : 0xFF;
+    return (r.tipo->caratteristiche[r.sottoscrizioni[indice]].canali & richiesti) != 0;
+}
+
+// Un passo per update(): prima controllo e intervallo (senza attesa di risposta),
+// poi una sottoscrizione da aggiungere o togliere alla volta
+void BleNetwork::applicaProfilo(PerifericaRegistrata &r)
+{
+    if (r.passoProfilo == 0)
+    {
+        r.passoProfilo = 1;
+        if (r.tipo == &TIPO_SENSE)
+        {
+            const ProfiloBle &p = _politica.getProfilo();
+            scriviControllo(r);
+            aggiornaIntervallo(r, p.intervalloMin, p.intervalloMax, p.timeout);
+        }
+        else
+        {
+            aggiornaIntervallo(r, INTERVALLO_COMANDI_MIN, INTERVALLO_COMANDI_MAX, TIMEOUT_COMANDI);
+        }
+        return;
     }
-    _iotDevice = p;
-    return true;
+
+    for (int s = 0; s < r.numSottoscrizioni; s++)
+    {
+        bool richiesta = isRichiesta(r, s);
+        if (richiesta == r.sottoscritte[s])
+            continue;
+
+        BLECharacteristic &c = r.caratteristiche[r.sottoscrizioni[s]];
+        if (richiesta)
+            r.sottoscritte[s] = abilitaNotifiche(c);
+        else
+            r.sottoscritte[s] = !(c && c.unsubscribe());
+        if (r.sottoscritte[s] != richiesta)
+            break; // Caratteristica che non risponde: si riprova al prossimo profilo
+        return;
+    }
+    r.profiloDaApplicare = false;
+}
+
+void BleNetwork::scriviControllo(PerifericaRegistrata &r)
+{
+    for (int k = 0; k < r.tipo->numCaratteristiche; k++)
+    {
+        if (!(r.tipo->caratteristiche[k].flag & CARATT_CONTROLLO) || !r.caratteristiche[k])
+            continue;
+
+        const ProfiloBle &p = _politica.getProfilo();
+        ControlloSense controllo;
+        controlloSenseDefault(controllo); // Bande morte e intervallo massimo di TramaSensori.h
+        controllo.magnetometro = p.periodoMagMs != 0 && (p.canali & (1 << SENSE_MAGNETOMETRO));
+        controllo.periodoMagMs = p.periodoMagMs != 0 ? p.periodoMagMs : PERIODO_MAG_DEFAULT_MS;
+        controllo.periodoAmbienteMs = p.periodoAmbienteMs;
+
+        uint8_t buffer[CONTROLLO_SENSE_DIMENSIONE];
+        int lunghezza = codificaControlloSense(controllo, buffer, sizeof(buffer));
+        r.caratteristiche[k].writeValue(buffer, lunghezza, false); // Senza risposta: non blocca il loop
+    }
+}
+
+bool BleNetwork::aggiornaIntervallo(PerifericaRegistrata &r, uint16_t minimo, uint16_t massimo, uint16_t timeout)
+{
+#ifdef BLE_INTERVALLO_DINAMICO
+    uint16_t handle = handleConnessione(r);
+    if (handle == 0xffff)
+        return false;
+
+    // La richiesta è asincrona: il controller la applica dopo qualche evento di connessione
+    return HCI.leConnUpdate(handle, minimo, massimo, 0, timeout) == 0;
+#else
+    return false;
+#endif
+}
+
+// Handle HCI della connessione (0xffff = sconosciuto)
+uint16_t BleNetwork::handleConnessione(PerifericaRegistrata &r)
+{
+#if defined(BLE_INTERVALLO_DINAMICO) || defined(BLE_MTU_ESTESO)
+    // address() è "aa:bb:cc:dd:ee:ff", con il byte più significativo per primo
+    String testo = r.dispositivo.address();
+    if (testo.length() != 17)
+        return 0xffff;
+    uint8_t indirizzo[6];
+    for (int i = 0; i < 6; i++)
+        indirizzo[5 - i] = (uint8_t)strtoul(testo.substring(i * 3, i * 3 + 2).c_str(), nullptr, 16);
+
+    // BLEDevice non espone il tipo di indirizzo: si provano pubblico e casuale
+    uint16_t handle = ATT.connectionHandle(0x00, indirizzo);
+    if (handle == 0xffff)
+        handle = ATT.connectionHandle(0x01, indirizzo);
+    return handle;
+#else
+    return 0xffff;
+#endif
 }
 
 // --- Lettura e Scrittura Dati ---
 
-void BleNetwork::pollSense()
+void BleNetwork::onNotifica(BLEDevice d, BLECharacteristic c)
 {
-    BLECharacteristic tChar = _senseDevice.characteristic(_uuidSenseCharTemp);
-    BLECharacteristic hChar = _senseDevice.characteristic(_uuidSenseCharHum);
-    BLECharacteristic pChar = _senseDevice.characteristic(_uuidSenseCharPress);
-    BLECharacteristic mChar = _senseDevice.characteristic(_uuidSenseCharMag);
+    _istanza->registraNotifica(d, c);
+}
 
-    if (tChar && tChar.valueUpdated())
+void BleNetwork::registraNotifica(BLEDevice &d, BLECharacteristic &c)
+{
+    // Costo limitato: confronto degli indirizzi, poi le poche sottoscrizioni della periferica
+    for (int i = 0; i < _numPeriferiche; i++)
     {
-        float temp = 0.0;
-        tChar.readValue(&temp, sizeof(temp));
+        PerifericaRegistrata &r = _periferiche[i];
+        if (!(r.dispositivo == d))
+            continue;
+        for (int s = 0; s < r.numSottoscrizioni; s++)
+        {
+            int k = r.sottoscrizioni[s];
+            if (stessoUuid(c.uuid(), r.tipo->caratteristiche[k].uuid))
+            {
+                decodifica(r, k, c.value(), c.valueLength());
+                return;
+            }
+        }
+        return;
+    }
+}
+
+void BleNetwork::decodifica(PerifericaRegistrata &r, int indice, const uint8_t *dati, int lunghezza)
+{
+    const CaratteristicaTipo &ct = r.tipo->caratteristiche[indice];
+    int id = &r - _periferiche;
+    unsigned long adesso = millis();
 
-        _lastTemperature = temp;
-        Serial.print("Dati: Temperatura aggiornata -> ");
-        Serial.print(_lastTemperature);
-        Serial.println(" °C");
+    // Arretrato del Sense: qui solo la ricezione, la conferma parte da aggiornaStorico()
+    if (ct.flag & CARATT_STORICO)
+    {
+        if (_storico.getPeriferica() == id)
+            _storico.ricevi(dati, lunghezza, (uint32_t)time(NULL), adesso);
+        _eventiRicevuti++;
+        _statistiche.notifica(id, indice, adesso);
+        return;
     }
 
-    if (hChar && hChar.valueUpdated())
+    // Risposta allo scambio dell'orologio: l'ora del Master va presa subito, all'arrivo (T4)
+    uint64_t epochMs;
+    if ((ct.flag & CARATT_TEMPO) && _orologio && _orologio->getEpochMs(epochMs))
     {
-        float hum = 0.0;
-        hChar.readValue(&hum, sizeof(hum));
+        r.tempo.risposta(dati, lunghezza, epochMs, adesso);
+        _eventiRicevuti++;
+        _statistiche.notifica(id, indice, adesso);
+        return;
+    }
+
+    if (!ct.decoder)
+        return;
+    uint32_t perse = r.contatori.perse;
+    ct.decoder(ct, dati, lunghezza, adesso, r.canali, r.contatori);
+    _eventiRicevuti++;
+    _statistiche.notifica(id, indice, adesso);
+    _statistiche.perse(id, r.contatori.perse - perse);
+    if (ct.flag & CARATT_CONFERMA)
+        confermaComando(id, r.canali[ct.canale]);
 
-        _lastHumidity = hum;
-        Serial.print("Dati: Umidità aggiornata -> ");
-        Serial.print(_lastHumidity);
-        Serial.println(" %");
+    if (ct.etichetta)
+    {
+        Serial.print("Dati: ");
+        Serial.print(ct.etichetta);
+        Serial.print(" aggiornata -> ");
+        Serial.print(r.canali[ct.canale].valori[0]);
+        Serial.print(" ");
+        Serial.println(ct.unita);
     }
+}
+
+// Una periferica collegata per volta: HCI.readRssi() attende la risposta del controller
+void BleNetwork::campionaRssi(unsigned long adessoMs)
+{
+    if (adessoMs - _ultimoRssi < PERIODO_RSSI_MS)
+        return;
+    _ultimoRssi = adessoMs;
 
-    if (pChar && pChar.valueUpdated())
+    for (int n = 0; n < _numPeriferiche; n++)
     {
-        float press = 0.0;
-        pChar.readValue(&press, sizeof(press));
+        int id = _prossimoRssi;
+        _prossimoRssi = (_prossimoRssi + 1) % _numPeriferiche;
+        if (_periferiche[id].connessione.isAttiva())
+        {
+            _statistiche.campioneRssi(id, _periferiche[id].dispositivo.rssi());
+            return;
+        }
+    }
+}
 
-        _lastPressure = press;
-        Serial.print("Dati: Pressione aggiornata -> ");
-        Serial.print(_lastPressure);
-        Serial.println(" kPa");
+#ifdef BLE_CONFRONTO_POLLING
+// Percorso precedente, solo per il confronto: una ricerca per UUID per caratteristica ad ogni loop
+void BleNetwork::pollCaratteristiche()
+{
+    for (int i = 0; i < _numPeriferiche; i++)
+    {
+        PerifericaRegistrata &r = _periferiche[i];
+        if (!r.connessione.isAttiva())
+            continue;
+        for (int s = 0; s < r.numSottoscrizioni; s++)
+        {
+            int k = r.sottoscrizioni[s];
+            BLECharacteristic c = r.dispositivo.characteristic(r.tipo->caratteristiche[k].uuid);
+            if (c && c.valueUpdated())
+                decodifica(r, k, c.value(), c.valueLength());
+        }
     }
+}
+#endif
+
+bool BleNetwork::scriviComando(int periferica, const uint8_t *dati, int lunghezza)
+{
+    if (periferica < 0 || periferica >= _numPeriferiche)
+        return false;
+
+    PerifericaRegistrata &r = _periferiche[periferica];
+    if (!r.connessione.isAttiva())
+    {
+        Serial.print("Errore: Impossibile scrivere, ");
+        stampaNome(periferica);
+        Serial.println(" non connesso.");
+        return false;
+    }
+
+    int k = cercaCaratteristica(r, CARATT_COMANDO);
+    return k >= 0 && r.caratteristiche[k].writeValue(dati, lunghezza);
+}
+
+// Prima caratteristica risolta con il flag (-1 = nessuna)
+int BleNetwork::cercaCaratteristica(PerifericaRegistrata &r, uint8_t flag)
+{
+    for (int k = 0; k < r.tipo->numCaratteristiche; k++)
+    {
+        if ((r.tipo->caratteristiche[k].flag & flag) && r.caratteristiche[k])
+            return k;
+    }
+    return -1;
+}
+
+// --- Coda dei comandi (vedi CodaComandi.h) ---
+
+// La periferica conferma i comandi se lo stato è sottoscritto
+bool BleNetwork::haConferme(PerifericaRegistrata &r)
+{
+    for (int s = 0; s < r.numSottoscrizioni; s++)
+    {
+        if ((r.tipo->caratteristiche[r.sottoscrizioni[s]].flag & CARATT_CONFERMA) && r.sottoscritte[s])
+            return true;
+    }
+    return false;
+}
+
+bool BleNetwork::puoInviare(int periferica)
+{
+    return isPerifericaAttiva(periferica);
+}
+
+EsitoInvio BleNetwork::invia(const ComandoAttuatore &comando)
+{
+    PerifericaRegistrata &r = _periferiche[comando.periferica];
+    int k = cercaCaratteristica(r, CARATT_COMANDO);
+    if (k < 0)
+        return INVIO_FALLITO;
+
+    if (haConferme(r))
+    {
+        // Senza risposta: non blocca il loop, la conferma arriva con la notifica dello stato
+        MessaggioAttuatore m = {comando.id, comando.valore};
+        uint8_t buffer[MESSAGGIO_ATTUATORE_DIMENSIONE];
+        int lunghezza = codificaMessaggioAttuatore(m, buffer, sizeof(buffer));
+        return r.caratteristiche[k].writeValue(buffer, lunghezza, false) ? INVIO_IN_ATTESA : INVIO_FALLITO;
+    }
+
+    // Firmware precedente, senza stato: la risposta alla scrittura di un byte vale come conferma
+    if (!r.caratteristiche[k].writeValue(&comando.valore, 1))
+        return INVIO_FALLITO;
+    if (comando.periferica == _indiceIoT)
+        _actuatorState = comando.valore != 0;
+    Serial.print("Azione: Comando confermato (scrittura con risposta) in ");
+    Serial.print(millis() - comando.richiestoMs);
+    Serial.println(" ms");
+    return INVIO_CONFERMATO;
+}
+
+// Notifica dello stato: valore reale dell'uscita e id dell'ultimo comando applicato
+void BleNetwork::confermaComando(int id, const MisuraBle &stato)
+{
+    if (id == _indiceIoT)
+        _actuatorState = stato.valori[0] != 0;
+
+    if (_comandi.conferma(id, (uint8_t)stato.valori[1], stato.tempoMs))
+    {
+        Serial.print("Azione: Comando ");
+        Serial.print(stato.valori[0] != 0 ? "ON" : "OFF");
+        Serial.print(" confermato in ");
+        Serial.print(_comandi.getStatistiche().ultimaLatenzaMs);
+        Serial.println(" ms");
+    }
+}
+
+void BleNetwork::aggiornaComandi(unsigned long adessoMs)
+{
+    uint32_t falliti = _comandi.getStatistiche().falliti;
+    _comandi.update(adessoMs, *this);
+    if (_comandi.getStatistiche().falliti != falliti)
+        Serial.println("Avviso: Comando all'attuatore non confermato, rinuncio.");
+}
+
+// --- Storico (vedi RicevitoreStorico.h e UnioneStorico.h) ---
+
+void BleNetwork::setArchivioStorico(ScrittoreStorico &archivio)
+{
+    _unione.begin(archivio);
+    _archivioPronto = true;
+}
+
+bool BleNetwork::isStoricoInCorso()
+{
+    return _arretratoInCorso;
+}
+
+void BleNetwork::aggiornaStorico(unsigned long adessoMs)
+{
+    if (!_archivioPronto)
+        return;
+
+    // Senza NTP l'ora dei campioni non ha senso: si aspetta (il Sense intanto li conserva)
+    bool orologio = time(NULL) >= (time_t)EPOCH_VALIDO_MINIMO;
+
+    // 1. Un recupero alla volta, a profilo applicato (sottoscrizione dello storico fatta)
+    if (orologio && !_arretratoInCorso)
+    {
+        for (int i = 0; i < _numPeriferiche; i++)
+        {
+            PerifericaRegistrata &r = _periferiche[i];
+            if (r.storicoDaChiedere && r.connessione.isAttiva() && !r.profiloDaApplicare)
+            {
+                iniziaStorico(i, adessoMs);
+                break;
+            }
+        }
+    }
+
+    // 2. Conferma cumulativa preparata nel gestore di evento
+    RichiestaStorico conferma;
+    int id = _storico.getPeriferica();
+    if (_storico.confermaDaInviare(conferma) && isPerifericaAttiva(id))
+        scriviRichiestaStorico(_periferiche[id], conferma);
+
+    // 3. Campioni ricevuti verso la flash, al più un blocco per loop
+    CampioneStorico c;
+    for (int n = 0; n < BLOCCO_SCRITTURA_STORICO && _storico.estrai(c); n++)
+        _unione.arretrato(c);
+
+    // 4. Fine (o interruzione) del recupero, a coda vuota
+    if (_arretratoInCorso && !_storico.isAttivo() && _storico.getNumeroInCoda() == 0)
+        chiudiStorico();
 
-    if (mChar && mChar.valueUpdated())
+    // 5. Diretta del Sense, un campione per periodo. Prima del recupero i campioni
+    //    dal vivo sarebbero più recenti dell'arretrato e lo farebbero scartare come doppione
+    if (orologio && isSenseConnected() && !_periferiche[_indiceSense].storicoDaChiedere &&
+        adessoMs - _ultimoStoricoDiretto >= PERIODO_STORICO_MS)
     {
-        float data[3];
-        mChar.readValue(data, 12);
-        _magX = data[0];
-        _magY = data[1];
-        _magZ = data[2];
+        const MisuraBle &t = getMisura(SENSE_TEMPERATURA);
+        if (t.aggiornamenti > 0)
+        {
+            // Ora dell'acquisizione se il Sense è sincronizzato, altrimenti quella dell'archiviazione
+            uint64_t epochMs;
+            uint32_t epoch = getEpochMs(_indiceSense, SENSE_TEMPERATURA, epochMs) ? (uint32_t)(epochMs / 1000) : (uint32_t)time(NULL);
+            CampioneStorico d = {epoch, t.valori[0], getLatestHumidity(), getLatestPressure()};
+            _unione.diretto(d);
+            _ultimoStoricoDiretto = adessoMs;
+        }
     }
+
+    if (!_unione.update())
+        Serial.println("Avviso: impossibile scrivere lo storico su QSPI.");
 }
 
-void BleNetwork::writeIoT(bool state)
+void BleNetwork::iniziaStorico(int id, unsigned long adessoMs)
 {
-    if (!_iotConnected)
+    PerifericaRegistrata &r = _periferiche[id];
+    r.storicoDaChiedere = false;
+
+    // Firmware senza storico o sottoscrizione rifiutata: nessun recupero
+    bool sottoscritto = false;
+    for (int s = 0; s < r.numSottoscrizioni; s++)
+    {
+        if ((r.tipo->caratteristiche[r.sottoscrizioni[s]].flag & CARATT_STORICO) && r.sottoscritte[s])
+            sottoscritto = true;
+    }
+    if (!sottoscritto)
+        return;
+
+    RichiestaStorico richiesta;
+    _storico.inizia(id, dimensionePacchettoStorico(r), FINESTRA_STORICO_DEFAULT, adessoMs, richiesta);
+    if (!scriviRichiestaStorico(r, richiesta))
     {
-        Serial.println("Errore: Impossibile scrivere, IoT non connesso.");
+        _storico.annulla(adessoMs);
         return;
     }
+    _unione.iniziaArretrato();
+    _arretratoInCorso = true;
+
+    // Intervallo breve per la durata del recupero, poi torna quello del profilo (chiudiStorico)
+    aggiornaIntervallo(r, INTERVALLO_STORICO_MIN, INTERVALLO_STORICO_MAX, TIMEOUT_STORICO);
+
+    Serial.print("Storico: recupero dell'arretrato da ");
+    stampaNome(id);
+    Serial.print(", pacchetti da ");
+    Serial.print(richiesta.dimensionePacchetto);
+    Serial.print(" byte, finestra ");
+    Serial.println(richiesta.finestra);
+}
+
+void BleNetwork::chiudiStorico()
+{
+    _arretratoInCorso = false;
+    const StatisticheStorico &s = _storico.getStatistiche();
+    _unione.fineArretrato(s.completato);
+
+    Serial.print(s.completato ? "Storico: recuperati " : "Avviso: recupero dello storico interrotto, ricevuti ");
+    Serial.print(s.campioni);
+    Serial.print(" campioni in ");
+    Serial.print(s.fineMs - s.inizioMs);
+    Serial.print(" ms (");
+    Serial.print(_storico.getVelocitaByteS());
+    Serial.print(" B/s, scartati ");
+    Serial.print(s.scartati);
+    Serial.print(", fuori ordine ");
+    Serial.print(s.fuoriOrdine);
+    Serial.println(")");
 
-    BLECharacteristic sChar = _iotDevice.characteristic(_uuidIoTCharSwitch);
-    if (sChar)
+    int id = _storico.getPeriferica();
+    if (isPerifericaAttiva(id))
     {
-        byte val = state ? 1 : 0;
-        sChar.writeValue(&val, 1);
+        _periferiche[id].profiloDaApplicare = true;
+        _periferiche[id].passoProfilo = 0;
     }
 }
 
+bool BleNetwork::scriviRichiestaStorico(PerifericaRegistrata &r, const RichiestaStorico &richiesta)
+{
+    int k = cercaCaratteristica(r, CARATT_RICHIESTA_STORICO);
+    if (k < 0)
+        return false;
+    uint8_t buffer[RICHIESTA_STORICO_DIMENSIONE];
+    int lunghezza = codificaRichiestaStorico(richiesta, buffer, sizeof(buffer));
+    return r.caratteristiche[k].writeValue(buffer, lunghezza, false); // Senza risposta: non blocca il loop
+}
+
+// Payload ATT negoziato (MTU - 3), 20 byte senza MTU esteso
+uint16_t BleNetwork::dimensionePacchettoStorico(PerifericaRegistrata &r)
+{
+#ifdef BLE_MTU_ESTESO
+    uint16_t handle = handleConnessione(r);
+    uint16_t mtu = handle != 0xffff ? ATT.mtu(handle) : 0;
+    if (mtu > 3 + STORICO_PACCHETTO_MINIMO)
+        return mtu - 3;
+#endif
+    return STORICO_PACCHETTO_MINIMO;
+}
+
+// --- Orologio delle periferiche (vedi SincronizzazioneTempo.h) ---
+
+void BleNetwork::setOrologio(OrologioMaster &orologio)
+{
+    _orologio = &orologio;
+}
+
+void BleNetwork::aggiornaTempo(unsigned long adessoMs)
+{
+    uint64_t epochMs;
+    if (!_orologio || !_orologio->getEpochMs(epochMs))
+        return;
+
+    for (int i = 0; i < _numPeriferiche; i++)
+    {
+        PerifericaRegistrata &r = _periferiche[i];
+        if (!r.connessione.isAttiva() || r.profiloDaApplicare)
+            continue;
+
+        // Senza sottoscrizione la risposta non arriverebbe (firmware precedente o profilo senza canali)
+        bool sottoscritto = false;
+        for (int s = 0; s < r.numSottoscrizioni; s++)
+        {
+            if ((r.tipo->caratteristiche[r.sottoscrizioni[s]].flag & CARATT_TEMPO) && r.sottoscritte[s])
+                sottoscritto = true;
+        }
+        if (!sottoscritto)
+            continue;
+
+        uint8_t buffer[RICHIESTA_TEMPO_DIMENSIONE];
+        int lunghezza;
+        if (r.tempo.richiesta(adessoMs, epochMs, buffer, lunghezza))
+        {
+            int k = cercaCaratteristica(r, CARATT_TEMPO);
+            r.caratteristiche[k].writeValue(buffer, lunghezza, false); // Senza risposta: T1 resta vicino all'invio
+        }
+    }
+}
+
+bool BleNetwork::getEpochMs(int periferica, int canale, uint64_t &epochMs)
+{
+    if (periferica < 0 || periferica >= _numPeriferiche || canale < 0 || canale >= MAX_CANALI_PERIFERICA)
+        return false;
+    const PerifericaRegistrata &r = _periferiche[periferica];
+    uint32_t tempo = r.canali[canale].tempoPeriferica;
+    if (tempo == 0 || !r.tempo.isSincronizzata())
+        return false;
+    epochMs = r.tempo.epochDa(tempo);
+    return true;
+}
+
 // --- Metodi Pubblici ---
 
 float BleNetwork::getLatestTemperature()
 {
-    return _lastTemperature;
+    return getMisura(SENSE_TEMPERATURA).valori[0];
 }
 
 float BleNetwork::getLatestHumidity()
 {
-    return _lastHumidity;
+    return getMisura(SENSE_UMIDITA).valori[0];
 }
 
 float BleNetwork::getLatestPressure()
 {
-    return _lastPressure;
+    return getMisura(SENSE_PRESSIONE).valori[0];
 }
 
 void BleNetwork::getLatestMag(float &x, float &y, float &z)
 {
-    x = _magX;
-    y = _magY;
-    z = _magZ;
+    const MisuraBle &m = getMisura(SENSE_MAGNETOMETRO);
+    x = m.valori[0];
+    y = m.valori[1];
+    z = m.valori[2];
+}
+
+const MisuraBle &BleNetwork::getMisura(GrandezzaSense g)
+{
+    return getCanale(_indiceSense, g);
+}
+
+bool BleNetwork::isTramaAttiva()
+{
+    return _indiceSense >= 0 && _periferiche[_indiceSense].preferitaAttiva;
+}
+
+uint32_t BleNetwork::getTrameRicevute()
+{
+    return getContatori(_indiceSense).ricevute;
+}
+
+uint32_t BleNetwork::getTramePerse()
+{
+    return getContatori(_indiceSense).perse;
 }
 
 void BleNetwork::toggleActuator()
 {
-    _actuatorState = !_actuatorState;
-    writeIoT(_actuatorState);
+    if (_indiceIoT < 0)
+        return;
 
-    Serial.print("Azione: Comando interruttore inviato -> ");
-    Serial.println(_actuatorState ? "ON" : "OFF");
+    // Pressioni rapide: si parte dall'ultimo stato richiesto, in coda resta solo l'ultimo comando
+    bool base = _comandi.isInCoda(_indiceIoT) ? _actuatorRichiesto : _actuatorState;
+    _actuatorRichiesto = !base;
+    if (!_comandi.accoda(_indiceIoT, _actuatorRichiesto ? 1 : 0, millis()))
+    {
+        Serial.println("Errore: Coda dei comandi piena.");
+        return;
+    }
+
+    Serial.print("Azione: Comando interruttore accodato -> ");
+    Serial.println(_actuatorRichiesto ? "ON" : "OFF");
+    if (!isIoTConnected())
+        Serial.println("Avviso: IoT non connesso, il comando attende la riconnessione.");
 }
 
 bool BleNetwork::getActuatorState()
@@ -326,5 +1214,65 @@ bool BleNetwork::getActuatorState()
     return _actuatorState;
 }
 
-bool BleNetwork::isSenseConnected() { return _senseConnected; }
-bool BleNetwork::isIoTConnected() { return _iotConnected; }
\ No newline at end of file
+bool BleNetwork::isComandoInCorso()
+{
+    return _comandi.isInCoda(_indiceIoT);
+}
+
+const StatisticheComandi &BleNetwork::getStatisticheComandi()
+{
+    return _comandi.getStatistiche();
+}
+
+bool BleNetwork::isSenseConnected() { return isPerifericaAttiva(_indiceSense); }
+bool BleNetwork::isIoTConnected() { return isPerifericaAttiva(_indiceIoT); }
+
+int BleNetwork::getNumeroPeriferiche()
+{
+    return _numPeriferiche;
+}
+
+const TipoPeriferica *BleNetwork::getTipo(int periferica)
+{
+    if (periferica < 0 || periferica >= _numPeriferiche)
+        return nullptr;
+    return _periferiche[periferica].tipo;
+}
+
+bool BleNetwork::isPerifericaAttiva(int periferica)
+{
+    if (periferica < 0 || periferica >= _numPeriferiche)
+        return false;
+    return _periferiche[periferica].connessione.isAttiva();
+}
+
+const MisuraBle &BleNetwork::getCanale(int periferica, int canale)
+{
+    if (periferica < 0 || periferica >= _numPeriferiche || canale < 0 || canale >= MAX_CANALI_PERIFERICA)
+        return MISURA_VUOTA;
+    return _periferiche[periferica].canali[canale];
+}
+
+const ContatoriTrama &BleNetwork::getContatori(int periferica)
+{
+    if (periferica < 0 || periferica >= _numPeriferiche)
+        return CONTATORI_VUOTI;
+    return _periferiche[periferica].contatori;
+}
+
+const ConnessionePeriferica &BleNetwork::getConnessione(int periferica)
+{
+    return _periferiche[periferica].connessione;
+}
+
+const StatisticheBle &BleNetwork::getStatistiche()
+{
+    return _statistiche;
+}
+
+void BleNetwork::azzeraStatistiche()
+{
+    _statistiche.azzera(millis());
+}
+
+#endif // CORE_CM4
@@ -1,22 +1,81 @@
 /*
   BleNetwork.h
-  Gestisce la connessione multipla con Nano Sense e Nano IoT
+  Gestisce la connessione multipla con le periferiche Nano (Sense, IoT, ...)
+  I tipi di periferica sono descritti in RegistroBle.h, la configurazione
+  del giubbotto in BleNetwork.cpp.
 */
 #ifndef BLE_NETWORK_H
 #define BLE_NETWORK_H
 
 #include <Arduino.h>
 #include <ArduinoBLE.h>
+#include "RegistroBle.h"
+#include "ConnessionePeriferica.h"
+#include "CacheGatt.h"
+#include "PoliticaBle.h"
+#include "StatisticheBle.h"
+#include "CodaComandi.h"
+#include "RicevitoreStorico.h"
+#include "UnioneStorico.h"
+#include "SincronizzazioneTempo.h"
 
-class BleNetwork {
+// Decommentare per tornare al vecchio polling (ricerca per UUID ad ogni loop)
+// e confrontare il tempo medio di update() stampato su Serial
+// #define BLE_CONFRONTO_POLLING
+
+// Cambia l'intervallo di connessione con il profilo (HCI.leConnUpdate di ArduinoBLE).
+// Commentare con versioni di ArduinoBLE che non espongono ATT.connectionHandle()
+#define BLE_INTERVALLO_DINAMICO
+
+// MTU fino a STORICO_PACCHETTO_MASSIMO + 3 per il recupero dell'arretrato del Sense
+// (ATT.setMaxMtu() e ATT.mtu() di ArduinoBLE, handle come sopra). Commentato: pacchetti da 20 byte
+#define BLE_MTU_ESTESO
+
+// Una lettura dell'RSSI ogni PERIODO_RSSI_MS, a turno tra le periferiche collegate
+#define PERIODO_RSSI_MS 500
+
+// Posizioni nella configurazione di default (CONFIGURAZIONE_PERIFERICHE in BleNetwork.cpp)
+enum PerifericaBle {
+    PERIFERICA_SENSE,
+    PERIFERICA_IOT
+};
+
+// Una periferica della configurazione: tipo, dispositivo trovato e stato della connessione
+struct PerifericaRegistrata {
+    const TipoPeriferica* tipo;
+    BLEDevice dispositivo;
+    ConnessionePeriferica connessione;
+
+    // Caratteristiche risolte una sola volta alla connessione, nell'ordine della tabella del tipo
+    BLECharacteristic caratteristiche[MAX_CARATTERISTICHE_TIPO];
+    uint8_t sottoscrizioni[MAX_CARATTERISTICHE_TIPO]; // Indici nella tabella, una per update()
+    bool sottoscritte[MAX_CARATTERISTICHE_TIPO];      // Stato attuale (segue il profilo)
+    int numSottoscrizioni;
+    bool profiloDaApplicare;         // Controllo, intervallo e sottoscrizioni, un passo per update()
+    int passoProfilo;
+    bool preferitaAttiva;            // Sottoscritta la caratteristica CARATT_PREFERITA
+    bool storicoDaChiedere;          // Arretrato del Sense ancora da recuperare in questa connessione
+    SincronizzazioneTempo tempo;     // Scarto e deriva dell'orologio (vedi SincronizzazioneTempo.h)
+
+    MisuraBle* canali;               // MAX_CANALI_PERIFERICA canali nell'archivio comune
+    ContatoriTrama contatori;
+
+    // Tempi dell'ultima connessione
+    unsigned long inizioConnessione;
+    unsigned long durataScoperta;
+    bool scopertaDaCache;
+};
+
+class BleNetwork : public DriverBle, public MittenteComandi {
   public:
     // Costruttore
     BleNetwork();
 
     // Inizializzazione
     void begin();
-    
-    // Funzioni per il controllo manuale della scansione
+
+    // Controllo manuale della ricerca: dopo startScan() le periferiche
+    // perse vengono ricollegate da sole fino a stopScan()
     void startScan();
     void stopScan();
     bool isScanning();
@@ -24,48 +83,136 @@ class BleNetwork {
     // Da chiamare nel loop() continuamente
     void update();
 
-    // Metodi per interagire con i dati
+    // Schermata attiva: decide canali, periodi del Sense e intervallo di connessione
+    void setContesto(ContestoBle contesto);
+    const ProfiloBle& getProfilo();
+
+    // Metodi per interagire con i dati (primo Sense e primo IoT della configurazione)
     float getLatestTemperature();
     float getLatestHumidity();
     float getLatestPressure();
     void getLatestMag(float& x, float& y, float& z); // Restituisce i 3 valori
-    void toggleActuator();
-    bool getActuatorState(); // Restituisce lo stato dell'attuatore
+    const MisuraBle& getMisura(GrandezzaSense g);   // Valore con marca temporale
+    bool isTramaAttiva();                           // Il Sense invia la trama unica
+    uint32_t getTrameRicevute();
+    uint32_t getTramePerse();                       // Buchi nella sequenza dalla connessione
+    void toggleActuator();   // Accoda il comando: parte senza attendere, con conferma e ripetizioni
+    bool getActuatorState(); // Stato confermato dal Nano IoT (il LED reale)
+    bool isComandoInCorso(); // Comando all'attuatore non ancora confermato
+    const StatisticheComandi& getStatisticheComandi();
 
     // Stato delle connessioni (per debug/led)
     bool isSenseConnected();
     bool isIoTConnected();
 
+    // Accesso generico, per posizione nella configurazione
+    int getNumeroPeriferiche();
+    const TipoPeriferica* getTipo(int periferica);
+    bool isPerifericaAttiva(int periferica);
+    const MisuraBle& getCanale(int periferica, int canale);
+    const ContatoriTrama& getContatori(int periferica);
+    const ConnessionePeriferica& getConnessione(int periferica);
+    bool scriviComando(int periferica, const uint8_t* dati, int lunghezza);
+    void getNome(int periferica, char* buffer, int dimensione); // "Sense", "Sense 2", ...
+
+    // Storico su flash dei campioni del Sense, compreso l'arretrato registrato fuori portata
+    void setArchivioStorico(ScrittoreStorico& archivio);
+    bool isStoricoInCorso();                        // Recupero dell'arretrato in corso
+
+    // Ora del Master (NTP) per le periferiche che marcano i campioni all'acquisizione
+    void setOrologio(OrologioMaster& orologio);
+    // Istante di acquisizione del canale in ms dal 1970 (ora locale). false se la periferica
+    // non marca i campioni o non è ancora sincronizzata
+    bool getEpochMs(int periferica, int canale, uint64_t& epochMs);
+
+    // Statistiche dei collegamenti (schermata F2)
+    const StatisticheBle& getStatistiche();
+    void azzeraStatistiche();
+
+    // DriverBle: operazioni chiamate dalle macchine a stati, un passo per update()
+    bool connetti(int id);
+    bool scopriAttributi(int id);
+    int numeroSottoscrizioni(int id);
+    bool sottoscrivi(int id, int indice);
+    bool isConnessa(int id);
+    void disconnetti(int id);
+    void cambioStato(int id, StatoConnessione vecchio, StatoConnessione nuovo);
+
+    // MittenteComandi: scrittura dei comandi accodati
+    bool puoInviare(int periferica);
+    EsitoInvio invia(const ComandoAttuatore& comando);
+
   private:
-    // Oggetti per le periferiche
-    BLEDevice _senseDevice;
-    BLEDevice _iotDevice;
-
-    // Variabili di stato
-    bool _senseConnected;
-    bool _iotConnected;
-    bool _isScanning;
-    
-    // Dati salvati
-    float _lastTemperature;
-    float _lastHumidity;
-    float _lastPressure;
-    float _magX, _magY, _magZ;
-    bool _actuatorState;
-
-    // UUIDs
-    const char* _uuidSenseCharTemp;
-    const char* _uuidSenseCharHum;
-    const char* _uuidSenseCharPress;
-    const char* _uuidSenseCharMag;
-    const char* _uuidIoTCharSwitch;
+    PerifericaRegistrata _periferiche[MAX_PERIFERICHE_BLE];
+    int _numPeriferiche;
+    int _indiceSense;                // Primo Sense / primo IoT della configurazione (-1 = nessuno)
+    int _indiceIoT;
+    bool _scanAttivo;                // Una sola scansione, condivisa da tutte le periferiche
+    PoliticaBle _politica;
+    StatisticheBle _statistiche;
+    unsigned long _ultimoRssi;
+    int _prossimoRssi;               // Prossima periferica da leggere
+
+    // Archivio comune dei canali (scritto dai decoder nei gestori di evento BLEUpdated)
+    MisuraBle _canali[MAX_PERIFERICHE_BLE * MAX_CANALI_PERIFERICA];
+    bool _actuatorState;             // Ultimo stato confermato
+    bool _actuatorRichiesto;         // Ultimo stato richiesto (diverso finché il comando è in volo)
+    CodaComandi _comandi;
+
+    // Storico (vedi RicevitoreStorico.h e UnioneStorico.h): un recupero alla volta
+    RicevitoreStorico _storico;
+    UnioneStorico _unione;
+    bool _archivioPronto;
+    bool _arretratoInCorso;
+    unsigned long _ultimoStoricoDiretto;
+
+    OrologioMaster* _orologio;       // nullptr = nessuna sincronizzazione
+
+    // Cache GATT su QSPI (vedi CacheGatt.h): caricata al primo uso, /fs/ è montato da Memoria
+    CacheGatt _cacheGatt;
+    bool _cacheGattCaricata;
+
+    // Tempo speso in update() (percorso BLE del loop)
+    unsigned long _tempoUpdateAccumulato;
+    uint32_t _updateMisurati;
+    uint32_t _eventiRicevuti;
+    unsigned long _ultimoReport;
 
     // Metodi interni (privati)
-    void scanAndConnect();
-    bool connectToSense(BLEDevice p);
-    bool connectToIoT(BLEDevice p);
-    void pollSense();
-    void writeIoT(bool state);
+    void gestisciScansione();
+    int cercaPosizione(BLEDevice& p);
+    void risolviCaratteristiche(PerifericaRegistrata& r);
+    void scegliSottoscrizioni(PerifericaRegistrata& r);
+    uint32_t firmaAttributi(PerifericaRegistrata& r);
+    void memorizzaAttributi(PerifericaRegistrata& r, const String& indirizzo);
+    bool abilitaNotifiche(BLECharacteristic& c);
+    bool isRichiesta(PerifericaRegistrata& r, int indice);
+    void applicaProfilo(PerifericaRegistrata& r);
+    void scriviControllo(PerifericaRegistrata& r);
+    bool aggiornaIntervallo(PerifericaRegistrata& r, uint16_t minimo, uint16_t massimo, uint16_t timeout);
+    uint16_t handleConnessione(PerifericaRegistrata& r);
+    void registraNotifica(BLEDevice& d, BLECharacteristic& c);
+    void decodifica(PerifericaRegistrata& r, int indice, const uint8_t* dati, int lunghezza);
+    int cercaCaratteristica(PerifericaRegistrata& r, uint8_t flag);
+    bool haConferme(PerifericaRegistrata& r);
+    void confermaComando(int id, const MisuraBle& stato);
+    void aggiornaComandi(unsigned long adessoMs);
+    void aggiornaStorico(unsigned long adessoMs);
+    void iniziaStorico(int id, unsigned long adessoMs);
+    void chiudiStorico();
+    bool scriviRichiestaStorico(PerifericaRegistrata& r, const RichiestaStorico& richiesta);
+    uint16_t dimensionePacchettoStorico(PerifericaRegistrata& r);
+    void aggiornaTempo(unsigned long adessoMs);
+    void stampaNome(int id);
+    void campionaRssi(unsigned long adessoMs);
+    void misuraUpdate(unsigned long durata);
+#ifdef BLE_CONFRONTO_POLLING
+    void pollCaratteristiche();
+#endif
+
+    // Gestore di evento di ArduinoBLE (puntatore a funzione: passa dall'istanza unica)
+    static BleNetwork* _istanza;
+    static void onNotifica(BLEDevice d, BLECharacteristic c);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,40 @@
+/*
+  BusCondiviso.h
+  Blocco per un bus I2C usato da più thread e, in modalità doppio core, da entrambi i core.
+  Dentro un core serializza con un rtos::Mutex; tra M7 e M4 usa un semaforo hardware (HSEM).
+  Stessa interfaccia lock()/unlock() di rtos::Mutex.
+*/
+#ifndef BUS_CONDIVISO_H
+#define BUS_CONDIVISO_H
+
+#include <mbed.h>
+#include "MemoriaCondivisa.h"
+
+class BloccoBus {
+public:
+    explicit BloccoBus(uint32_t idSemaforo) : _idSemaforo(idSemaforo) {}
+
+    void lock()
+    {
+        _mutex.lock();
+#if USA_CORE_M4 && (defined(CORE_CM7) || defined(CORE_CM4))
+        // L'altro core tiene il bus per una transazione al massimo: si cede la CPU e si riprova
+        while (HAL_HSEM_FastTake(_idSemaforo) != HAL_OK)
+            rtos::ThisThread::yield();
+#endif
+    }
+
+    void unlock()
+    {
+#if USA_CORE_M4 && (defined(CORE_CM7) || defined(CORE_CM4))
+        HAL_HSEM_Release(_idSemaforo, 0);
+#endif
+        _mutex.unlock();
+    }
+
+private:
+    rtos::Mutex _mutex;
+    uint32_t _idSemaforo;
+};
+
+#endif
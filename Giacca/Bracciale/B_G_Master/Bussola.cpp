@@ -1,7 +1,11 @@
 // Kicco972.net
 
 
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
 #include "Bussola.h"
+#include "Compositore.h"
 #include <math.h>
 
 #define CENTRO_X 400
@@ -11,7 +15,7 @@
 #define NERO 0x0000
 #define ROSSO 0xf800
 
-Bussola::Bussola() {}
+Bussola::Bussola() : _agoX(-1), _agoY(-1), _headingDecimi(-1), _campoX(0), _campoY(0), _campoZ(0) {}
 
 void Bussola::begin() {}
 
@@ -32,6 +36,21 @@ void Bussola::drawBackground()
     gigaDisplay.print("E");
     gigaDisplay.setCursor(CENTRO_X - RAGGIO - 40, CENTRO_Y - 10);
     gigaDisplay.print("W");
+
+    // Etichette statiche del pannello informazioni
+    gigaDisplay.setTextSize(3);
+    gigaDisplay.setCursor(20, 20);
+    gigaDisplay.print("Angolo:");
+    gigaDisplay.setTextSize(2);
+    gigaDisplay.setCursor(20, 100);
+    gigaDisplay.print("Campo (uT):");
+
+    // Lo schermo è stato appena pulito: forza il ridisegno completo al prossimo frame
+    compositore.reset();
+    _agoX = -1;
+    _agoY = -1;
+    _headingDecimi = -1;
+    _campoX = -32768; // Valore impossibile per forzare il ridisegno del campo
 }
 
 void Bussola::updateAndDraw(float x, float y, float z)
@@ -49,45 +68,79 @@ void Bussola::updateAndDraw(float x, float y, float z)
     if (headingDeg < 0)
         headingDeg += 360;
 
-    // Pulisci l'interno della bussola
-    gigaDisplay.fillCircle(CENTRO_X, CENTRO_Y, RAGGIO - 5, NERO);
-
-    // Disegna la lancetta che punta al Nord
+    // Punta della lancetta che punta al Nord
     // L'angolo atan2(y,x) è la direzione del vettore magnetico.
     // Se il nord è davanti (X), y=0, angle=0.
-    drawNeedle(heading, ROSSO);
-
-    // Info Testuali
-    // Pulisci area in alto a sinistra
-    gigaDisplay.fillRect(10, 10, 320, 160, NERO);
+    int x2 = CENTRO_X + (int)(cos(heading) * (RAGGIO - 20));
+    int y2 = CENTRO_Y + (int)(sin(heading) * (RAGGIO - 20));
+    int decimi = (int)(headingDeg * 10.0 + 0.5);
+
+    bool agoCambiato = (x2 != _agoX || y2 != _agoY);
+    bool angoloCambiato = (decimi != _headingDecimi);
+    bool campoCambiato = ((int)x != _campoX || (int)y != _campoY || (int)z != _campoZ);
+
+    // Invece di pulire tutto il quadrante e il pannello testo ad ogni frame,
+    // invalidiamo solo le aree effettivamente cambiate
+    if (agoCambiato && _agoX >= 0)
+    {
+        // Riquadro della vecchia lancetta (incluso il perno centrale di raggio 5)
+        int x0 = min(CENTRO_X - 5, _agoX);
+        int y0 = min(CENTRO_Y - 5, _agoY);
+        int x1 = max(CENTRO_X + 5, _agoX);
+        int y1 = max(CENTRO_Y + 5, _agoY);
+        compositore.invalida(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    }
+    if (angoloCambiato)
+        compositore.invalida(20, 50, 24 * 7, 32); // Valore (size 4, max "359.9°")
+    if (campoCambiato)
+        compositore.invalida(20, 130, 12 * 22, 16); // Riga campo (size 2)
+
+    compositore.flush(NERO);
+
+    // Le aree del testo non toccano il quadrante: la lancetta si ridisegna solo se si è mossa
+    if (agoCambiato)
+    {
+        drawNeedle(x2, y2, ROSSO);
+        _agoX = x2;
+        _agoY = y2;
+    }
 
     gigaDisplay.setTextColor(BIANCO);
-    gigaDisplay.setTextSize(3); // Etichetta più visibile
-    gigaDisplay.setCursor(20, 20);
-    gigaDisplay.print("Angolo:");
 
-    gigaDisplay.setTextSize(4); // Valore molto grande
-    gigaDisplay.setCursor(20, 50);
-    gigaDisplay.print(headingDeg, 1);
-    gigaDisplay.print((char)247); // Simbolo gradi
-
-    // Visualizzazione Campo Magnetico
-    gigaDisplay.setTextSize(2);
-    gigaDisplay.setCursor(20, 100);
-    gigaDisplay.print("Campo (uT):");
-    gigaDisplay.setCursor(20, 130);
-    gigaDisplay.print("X:"); gigaDisplay.print((int)x);
-    gigaDisplay.print(" Y:"); gigaDisplay.print((int)y);
-    gigaDisplay.print(" Z:"); gigaDisplay.print((int)z);
+    if (angoloCambiato)
+    {
+        gigaDisplay.setTextSize(4); // Valore molto grande
+        gigaDisplay.setCursor(20, 50);
+        gigaDisplay.print(headingDeg, 1);
+        gigaDisplay.print((char)247); // Simbolo gradi
+        compositore.aggiungiTesto(7, 4);
+    }
+
+    if (campoCambiato)
+    {
+        // Visualizzazione Campo Magnetico
+        gigaDisplay.setTextSize(2);
+        gigaDisplay.setCursor(20, 130);
+        gigaDisplay.print("X:"); gigaDisplay.print((int)x);
+        gigaDisplay.print(" Y:"); gigaDisplay.print((int)y);
+        gigaDisplay.print(" Z:"); gigaDisplay.print((int)z);
+        compositore.aggiungiTesto(22, 2);
+        _campoX = (int)x;
+        _campoY = (int)y;
+        _campoZ = (int)z;
+    }
+    _headingDecimi = decimi;
+
+    compositore.fineFrame("Bussola");
 }
 
-void Bussola::drawNeedle(float angle, uint16_t color)
+void Bussola::drawNeedle(int x2, int y2, uint16_t color)
 {
-    // Calcola la punta della lancetta
-    int x2 = CENTRO_X + (int)(cos(angle) * (RAGGIO - 20));
-    int y2 = CENTRO_Y + (int)(sin(angle) * (RAGGIO - 20));
-
     // Disegna linea e centro
     gigaDisplay.drawLine(CENTRO_X, CENTRO_Y, x2, y2, color);
     gigaDisplay.fillCircle(CENTRO_X, CENTRO_Y, 5, color);
-}
\ No newline at end of file
+    compositore.aggiungiLinea(CENTRO_X, CENTRO_Y, x2, y2);
+    compositore.aggiungiPixel(81); // Perno: cerchio pieno di raggio 5
+}
+
+#endif // CORE_CM4
@@ -14,7 +14,13 @@ public:
     void updateAndDraw(float x, float y, float z);
 
 private:
-    void drawNeedle(float angle, uint16_t color);
+    // Ultimo stato disegnato (per ridisegnare solo ciò che cambia)
+    int _agoX;             // Punta della lancetta
+    int _agoY;
+    int _headingDecimi;    // Angolo visualizzato in decimi di grado
+    int _campoX, _campoY, _campoZ;
+
+    void drawNeedle(int x2, int y2, uint16_t color);
 };
 
-#endif
\ No newline at end of file
+#endif
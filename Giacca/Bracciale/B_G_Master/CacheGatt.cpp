@@ -0,0 +1,189 @@
+// Kicco972.net
+
+
+#include "CacheGatt.h"
+#include <stdio.h>
+#include <string.h>
+
+// Intestazione del file: il controllo copre intestazione e voci
+#define MAGIA_CACHE_GATT 0x43544147 // "GATC"
+#define VERSIONE_CACHE_GATT 1
+
+struct IntestazioneCacheGatt {
+    uint32_t magia;
+    uint16_t versione;
+    uint16_t dimensioneVoce; // Un cambio della struttura invalida il file
+    uint32_t numVoci;
+};
+
+CacheGatt::CacheGatt() : _numVoci(0), _contatoreUso(0), _modificata(false)
+{
+    memset(_voci, 0, sizeof(_voci));
+}
+
+bool CacheGatt::carica(const char* percorso)
+{
+    _numVoci = 0;
+    _contatoreUso = 0;
+    _modificata = false;
+
+    FILE* f = fopen(percorso, "rb");
+    if (!f)
+        return false;
+
+    IntestazioneCacheGatt intestazione;
+    VoceCacheGatt voci[MAX_VOCI_CACHE_GATT];
+    uint32_t controllo = 0;
+    bool ok = fread(&intestazione, sizeof(intestazione), 1, f) == 1 &&
+              intestazione.magia == MAGIA_CACHE_GATT &&
+              intestazione.versione == VERSIONE_CACHE_GATT &&
+              intestazione.dimensioneVoce == sizeof(VoceCacheGatt) &&
+              intestazione.numVoci <= MAX_VOCI_CACHE_GATT &&
+              fread(voci, sizeof(VoceCacheGatt), intestazione.numVoci, f) == intestazione.numVoci &&
+              fread(&controllo, sizeof(controllo), 1, f) == 1;
+    fclose(f);
+
+    if (!ok)
+        return false;
+    uint32_t atteso = fnv1a(FIRMA_INIZIALE, &intestazione, sizeof(intestazione));
+    atteso = fnv1a(atteso, voci, intestazione.numVoci * sizeof(VoceCacheGatt));
+    if (atteso != controllo)
+        return false;
+
+    for (uint32_t i = 0; i < intestazione.numVoci; i++)
+    {
+        _voci[i] = voci[i];
+        // Stringhe sempre terminate anche se il file è stato scritto male
+        _voci[i].indirizzo[sizeof(_voci[i].indirizzo) - 1] = 0;
+        _voci[i].servizio[sizeof(_voci[i].servizio) - 1] = 0;
+        if (_voci[i].uso > _contatoreUso)
+            _contatoreUso = _voci[i].uso;
+    }
+    _numVoci = intestazione.numVoci;
+    return true;
+}
+
+bool CacheGatt::salva(const char* percorso)
+{
+    FILE* f = fopen(percorso, "wb");
+    if (!f)
+        return false;
+
+    IntestazioneCacheGatt intestazione;
+    memset(&intestazione, 0, sizeof(intestazione));
+    intestazione.magia = MAGIA_CACHE_GATT;
+    intestazione.versione = VERSIONE_CACHE_GATT;
+    intestazione.dimensioneVoce = sizeof(VoceCacheGatt);
+    intestazione.numVoci = _numVoci;
+    uint32_t controllo = fnv1a(FIRMA_INIZIALE, &intestazione, sizeof(intestazione));
+    controllo = fnv1a(controllo, _voci, _numVoci * sizeof(VoceCacheGatt));
+
+    bool ok = fwrite(&intestazione, sizeof(intestazione), 1, f) == 1 &&
+              fwrite(_voci, sizeof(VoceCacheGatt), _numVoci, f) == (size_t)_numVoci &&
+              fwrite(&controllo, sizeof(controllo), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+    if (ok)
+        _modificata = false;
+    return ok;
+}
+
+const VoceCacheGatt* CacheGatt::cerca(const char* indirizzo)
+{
+    for (int i = 0; i < _numVoci; i++)
+    {
+        if (strcmp(_voci[i].indirizzo, indirizzo) == 0)
+        {
+            // Solo in RAM: l'ordine d'uso non vale una scrittura su flash
+            _voci[i].uso = ++_contatoreUso;
+            return &_voci[i];
+        }
+    }
+    return nullptr;
+}
+
+void CacheGatt::memorizza(const char* indirizzo, const char* servizio, uint32_t firma)
+{
+    VoceCacheGatt* v = nullptr;
+    for (int i = 0; i < _numVoci && !v; i++)
+    {
+        if (strcmp(_voci[i].indirizzo, indirizzo) == 0)
+            v = &_voci[i];
+    }
+
+    if (v && strcmp(v->servizio, servizio) == 0 && v->firma == firma)
+    {
+        v->uso = ++_contatoreUso;
+        return; // Già uguale: niente da salvare
+    }
+
+    if (!v)
+    {
+        if (_numVoci < MAX_VOCI_CACHE_GATT)
+        {
+            v = &_voci[_numVoci++];
+        }
+        else
+        {
+            // Tabella piena: sostituisce la voce usata meno di recente
+            v = &_voci[0];
+            for (int i = 1; i < _numVoci; i++)
+            {
+                if (_voci[i].uso < v->uso)
+                    v = &_voci[i];
+            }
+        }
+    }
+
+    memset(v, 0, sizeof(VoceCacheGatt));
+    strncpy(v->indirizzo, indirizzo, sizeof(v->indirizzo) - 1);
+    strncpy(v->servizio, servizio, sizeof(v->servizio) - 1);
+    v->firma = firma;
+    v->uso = ++_contatoreUso;
+    _modificata = true;
+}
+
+void CacheGatt::dimentica(const char* indirizzo)
+{
+    for (int i = 0; i < _numVoci; i++)
+    {
+        if (strcmp(_voci[i].indirizzo, indirizzo) == 0)
+        {
+            _voci[i] = _voci[--_numVoci];
+            _modificata = true;
+            return;
+        }
+    }
+}
+
+int CacheGatt::getNumeroVoci() const
+{
+    return _numVoci;
+}
+
+bool CacheGatt::isModificata() const
+{
+    return _modificata;
+}
+
+uint32_t CacheGatt::aggiungiFirma(uint32_t firma, const char* uuid, bool presente, uint8_t proprieta)
+{
+    // Gli UUID sono confrontati senza distinzione tra maiuscole e minuscole
+    for (const char* c = uuid; *c; c++)
+    {
+        char minuscolo = (*c >= 'A' && *c <= 'Z') ? (char)(*c - 'A' + 'a') : *c;
+        firma = fnv1a(firma, &minuscolo, 1);
+    }
+    uint8_t coda[2] = {(uint8_t)(presente ? 1 : 0), (uint8_t)(presente ? proprieta : 0)};
+    return fnv1a(firma, coda, sizeof(coda));
+}
+
+uint32_t CacheGatt::fnv1a(uint32_t h, const void* dati, int lunghezza)
+{
+    const uint8_t* p = (const uint8_t*)dati;
+    for (int i = 0; i < lunghezza; i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
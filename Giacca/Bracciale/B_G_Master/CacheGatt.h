@@ -0,0 +1,56 @@
+/*
+  CacheGatt.h
+  Cache degli attributi GATT delle periferiche già viste, salvata su QSPI.
+  Per ogni indirizzo tiene il servizio che contiene le caratteristiche usate
+  e una firma della loro disposizione (UUID e proprietà): alla riconnessione
+  basta scoprire quel solo servizio e confrontare la firma, invece di
+  discoverAttributes() su tutto il database.
+  Il file contiene solo le voci usate (il loro numero è nell'intestazione):
+  cambiare MAX_VOCI_CACHE_GATT non invalida i file già salvati, purché non
+  abbiano più voci del nuovo massimo.
+  Solo C++ standard (stdio), compilabile anche su PC.
+*/
+#ifndef CACHE_GATT_H
+#define CACHE_GATT_H
+
+#include <stdint.h>
+#include "RegistroBle.h"
+
+#define MAX_VOCI_CACHE_GATT MAX_PERIFERICHE_BLE // Una voce per ogni periferica collegabile
+#define PERCORSO_CACHE_GATT "/fs/gatt.bin"
+
+struct VoceCacheGatt {
+    char indirizzo[18];   // "aa:bb:cc:dd:ee:ff"
+    char servizio[37];    // UUID del servizio con le caratteristiche usate
+    uint32_t firma;       // Vedi aggiungiFirma()
+    uint32_t uso;         // Per sostituire la voce usata meno di recente
+};
+
+class CacheGatt {
+public:
+    CacheGatt();
+
+    bool carica(const char* percorso); // false se il file manca o è corrotto (cache vuota)
+    bool salva(const char* percorso);
+
+    const VoceCacheGatt* cerca(const char* indirizzo);
+    void memorizza(const char* indirizzo, const char* servizio, uint32_t firma);
+    void dimentica(const char* indirizzo);
+    int getNumeroVoci() const;
+    bool isModificata() const;         // Cambiata dall'ultimo carica()/salva()
+
+    // Firma della disposizione: si parte da FIRMA_INIZIALE e si aggiunge ogni caratteristica
+    // usata, nello stesso ordine (le mancanti con presente = false)
+    static const uint32_t FIRMA_INIZIALE = 2166136261u;
+    static uint32_t aggiungiFirma(uint32_t firma, const char* uuid, bool presente, uint8_t proprieta);
+
+private:
+    VoceCacheGatt _voci[MAX_VOCI_CACHE_GATT];
+    int _numVoci;
+    uint32_t _contatoreUso;
+    bool _modificata;
+
+    static uint32_t fnv1a(uint32_t h, const void* dati, int lunghezza);
+};
+
+#endif
@@ -0,0 +1,18 @@
+/*
+  CampioneImu.h
+  Campione inerziale con marca temporale, scambiato tra campionatore e fusione.
+  Solo C++ standard (nessuna dipendenza Arduino).
+*/
+#ifndef CAMPIONE_IMU_H
+#define CAMPIONE_IMU_H
+
+#include <stdint.h>
+
+struct CampioneImu {
+    uint32_t tempoUs;   // Istante di acquisizione (micros())
+    float ax, ay, az;   // Accelerometro [g]
+    float gx, gy, gz;   // Giroscopio [gradi/s]
+    bool accValido;     // false se la lettura dell'accelerometro è fallita
+};
+
+#endif
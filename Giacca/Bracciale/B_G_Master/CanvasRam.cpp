@@ -0,0 +1,115 @@
+// Kicco972.net
+
+
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
+#include "CanvasRam.h"
+#include <SDRAM.h>
+
+CanvasRam::CanvasRam(int16_t w, int16_t h) : Adafruit_GFX(w, h), _buffer(nullptr), _sdram(false) {}
+
+CanvasRam::~CanvasRam()
+{
+    if (!_buffer)
+        return;
+    if (_sdram)
+        SDRAM.free(_buffer);
+    else
+        free(_buffer);
+}
+
+bool CanvasRam::begin()
+{
+    if (_buffer)
+        return true;
+
+    size_t dimensione = (size_t)WIDTH * HEIGHT * sizeof(uint16_t);
+
+    // La SDRAM è già inizializzata dalla libreria del display (vi risiede il framebuffer)
+    _buffer = (uint16_t *)SDRAM.malloc(dimensione);
+    _sdram = (_buffer != nullptr);
+
+    // Ripiego sulla RAM interna
+    if (!_buffer)
+        _buffer = (uint16_t *)malloc(dimensione);
+
+    if (!_buffer)
+    {
+        Serial.println("Canvas: Errore allocazione buffer!");
+        return false;
+    }
+
+    Serial.print("Canvas: Buffer di ");
+    Serial.print((unsigned long)dimensione);
+    Serial.println(_sdram ? " byte in SDRAM" : " byte in RAM interna");
+    fillScreen(0x0000);
+    return true;
+}
+
+bool CanvasRam::isPronto() { return _buffer != nullptr; }
+bool CanvasRam::inSdram() { return _sdram; }
+uint16_t *CanvasRam::getBuffer() { return _buffer; }
+
+void CanvasRam::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+    // Il canvas non usa la rotazione: coordinate dirette e ritaglio ai bordi
+    if (!_buffer || x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT)
+        return;
+    _buffer[(int32_t)y * WIDTH + x] = color;
+}
+
+void CanvasRam::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+    if (!_buffer || y < 0 || y >= HEIGHT)
+        return;
+    if (x < 0)
+    {
+        w += x;
+        x = 0;
+    }
+    if (x + w > WIDTH)
+        w = WIDTH - x;
+    uint16_t *p = &_buffer[(int32_t)y * WIDTH + x];
+    for (int16_t i = 0; i < w; i++)
+        p[i] = color;
+}
+
+void CanvasRam::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+    if (!_buffer || x < 0 || x >= WIDTH)
+        return;
+    if (y < 0)
+    {
+        h += y;
+        y = 0;
+    }
+    if (y + h > HEIGHT)
+        h = HEIGHT - y;
+    uint16_t *p = &_buffer[(int32_t)y * WIDTH + x];
+    for (int16_t i = 0; i < h; i++)
+        p[(int32_t)i * WIDTH] = color;
+}
+
+void CanvasRam::fillScreen(uint16_t color)
+{
+    if (!_buffer)
+        return;
+    uint32_t n = (uint32_t)WIDTH * HEIGHT;
+    for (uint32_t i = 0; i < n; i++)
+        _buffer[i] = color;
+}
+
+void CanvasRam::blit(GigaDisplay_GFX &destinazione, int16_t x, int16_t y)
+{
+    if (!_buffer)
+        return;
+
+    // Il buffering sospende il refresh del pannello durante la copia:
+    // il frame appare tutto insieme, senza tearing
+    destinazione.startBuffering();
+    destinazione.drawRGBBitmap(x, y, _buffer, WIDTH, HEIGHT);
+    destinazione.endBuffering();
+}
+
+#endif // CORE_CM4
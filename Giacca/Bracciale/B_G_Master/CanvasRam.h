@@ -0,0 +1,36 @@
+#ifndef CANVAS_RAM_H
+#define CANVAS_RAM_H
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include <Arduino_GigaDisplay_GFX.h>
+
+// Superficie di disegno fuori schermo (RGB565) per il double buffering.
+// Si disegna con le normali primitive Adafruit_GFX e poi si copia sul pannello
+// in un unico trasferimento con blit(). Il buffer viene allocato nella SDRAM
+// esterna del Giga quando disponibile, altrimenti nella RAM interna.
+class CanvasRam : public Adafruit_GFX {
+public:
+    CanvasRam(int16_t w, int16_t h);
+    ~CanvasRam();
+
+    bool begin();       // Alloca il buffer (una sola volta)
+    bool isPronto();    // true se il buffer è allocato
+    bool inSdram();     // true se il buffer sta nella SDRAM esterna
+
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override;
+    void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override;
+    void fillScreen(uint16_t color) override;
+
+    // Copia l'intero buffer sul display nella posizione (x, y)
+    void blit(GigaDisplay_GFX& destinazione, int16_t x, int16_t y);
+
+    uint16_t* getBuffer();
+
+private:
+    uint16_t* _buffer;
+    bool _sdram;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+  CasellaCondivisa.h
+  Casella postale a singolo scrittore con contatore di sequenza (seqlock),
+  pensata per passare l'ultimo valore da un core all'altro in memoria condivisa.
+  Lo scrittore non aspetta mai; il lettore riprova se ha letto durante una scrittura.
+  La sequenza è pari a riposo, dispari durante la scrittura; sequenza / 2 è
+  il numero di messaggi pubblicati, così il lettore sa anche quanti ne ha persi.
+  Solo C++ standard (std::atomic), nessuna dipendenza Arduino o mbed:
+  sul PC i due core possono essere simulati con due thread.
+*/
+#ifndef CASELLA_CONDIVISA_H
+#define CASELLA_CONDIVISA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+template <typename T>
+class CasellaCondivisa {
+    static_assert(std::is_trivially_copyable<T>::value, "Il messaggio viene copiato byte per byte");
+
+public:
+    CasellaCondivisa() : _sequenza(0) { memset(&_valore, 0, sizeof(_valore)); }
+
+    // Lato scrittore (un solo core)
+    void pubblica(const T& valore)
+    {
+        uint32_t s = _sequenza.load(std::memory_order_relaxed);
+        _sequenza.store(s + 1, std::memory_order_relaxed); // Dispari: scrittura in corso
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&_valore, &valore, sizeof(T));
+        _sequenza.store(s + 2, std::memory_order_release);
+    }
+
+    // Lato lettore. Restituisce false se non c'è niente di nuovo rispetto a ultimaSequenza
+    // o se non riesce a ottenere una copia coerente in MAX_TENTATIVI. Aggiorna ultimaSequenza.
+    bool leggi(T& valore, uint32_t& ultimaSequenza) const
+    {
+        for (int tentativo = 0; tentativo < MAX_TENTATIVI; tentativo++)
+        {
+            uint32_t s1 = _sequenza.load(std::memory_order_acquire);
+            if (s1 & 1)
+                continue; // Lo scrittore sta copiando
+            if (s1 == ultimaSequenza)
+                return false;
+            memcpy(&valore, &_valore, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_sequenza.load(std::memory_order_relaxed) == s1)
+            {
+                ultimaSequenza = s1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Messaggi pubblicati finora
+    uint32_t getPubblicati() const { return _sequenza.load(std::memory_order_acquire) / 2; }
+
+    static const int MAX_TENTATIVI = 8;
+
+private:
+    std::atomic<uint32_t> _sequenza;
+    T _valore;
+};
+
+#endif
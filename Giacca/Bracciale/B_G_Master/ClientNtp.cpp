@@ -0,0 +1,125 @@
+// Kicco972.net
+
+
+#include "ClientNtp.h"
+#include <string.h>
+
+static uint32_t leggi32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Marca NTP (secondi dal 1900 e frazione 1/2^32) in ms dal 1970.
+// Con il bit alto dei secondi a 0 si è oltre il 2036 (era successiva): vale fino al 2104
+static uint64_t marcaInMs(const uint8_t* p)
+{
+    uint64_t secondi = leggi32(p);
+    if (!(secondi & 0x80000000UL))
+        secondi += 0x100000000ULL;
+    uint64_t frazione = ((uint64_t)leggi32(p + 4) * 1000) >> 32;
+    return (secondi - SECONDI_1900_1970) * 1000 + frazione;
+}
+
+ClientNtp::ClientNtp()
+    : _trasporto(nullptr), _server(nullptr), _inAttesa(false), _inviataMs(0), _richieste(0), _scartati(0)
+{
+    memset(_origine, 0, sizeof(_origine));
+}
+
+void ClientNtp::begin(TrasportoUdp& trasporto, const char* server)
+{
+    _trasporto = &trasporto;
+    _server = server;
+}
+
+bool ClientNtp::richiedi(uint32_t adessoMs)
+{
+    _inAttesa = false;
+    if (!_trasporto)
+        return false;
+
+    // Le risposte a richieste precedenti ancora nel buffer non devono sembrare nuove
+    uint8_t vecchio[PACCHETTO_NTP];
+    while (_trasporto->ricevi(vecchio, sizeof(vecchio)) > 0)
+        _scartati++;
+
+    uint8_t pacchetto[PACCHETTO_NTP];
+    memset(pacchetto, 0, sizeof(pacchetto));
+    pacchetto[0] = 0b11100011;   // LI = 3 (non sincronizzato), versione 4, modo 3 (client)
+    pacchetto[2] = 6;            // Intervallo di interrogazione
+    pacchetto[3] = 0xEC;         // Precisione
+
+    // La marca di trasmissione è solo un identificativo: l'ora vera non la sappiamo ancora
+    _richieste++;
+    uint32_t marca[2] = {_richieste, adessoMs};
+    for (int i = 0; i < 8; i++)
+        _origine[i] = (uint8_t)(marca[i / 4] >> (24 - 8 * (i % 4)));
+    memcpy(pacchetto + 40, _origine, 8);
+
+    if (!_trasporto->invia(_server, PORTA_NTP, pacchetto, sizeof(pacchetto)))
+        return false;
+    _inviataMs = adessoMs;
+    _inAttesa = true;
+    return true;
+}
+
+EsitoNtp ClientNtp::controlla(uint32_t adessoMs, RisultatoNtp& risultato)
+{
+    if (!_inAttesa)
+        return NTP_NESSUNA_RICHIESTA;
+
+    uint8_t pacchetto[PACCHETTO_NTP + 20]; // Anche con estensioni o autenticazione
+    int lunghezza;
+    while ((lunghezza = _trasporto->ricevi(pacchetto, sizeof(pacchetto))) > 0)
+    {
+        if (decodifica(pacchetto, lunghezza, _origine, _inviataMs, adessoMs, risultato))
+        {
+            _inAttesa = false;
+            return NTP_SINCRONIZZATO;
+        }
+        _scartati++;
+    }
+
+    if (adessoMs - _inviataMs >= TIMEOUT_NTP_MS)
+    {
+        _inAttesa = false;
+        return NTP_SCADUTO;
+    }
+    return NTP_IN_ATTESA;
+}
+
+bool ClientNtp::decodifica(const uint8_t* pacchetto, int lunghezza, const uint8_t* origine,
+                           uint32_t inviataMs, uint32_t ricevutaMs, RisultatoNtp& risultato)
+{
+    if (lunghezza < PACCHETTO_NTP)
+        return false;
+    uint8_t salto = pacchetto[0] >> 6;
+    uint8_t modo = pacchetto[0] & 0x07;
+    uint8_t strato = pacchetto[1];
+    // Modo server, server sincronizzato (strato 0 = "kiss of death"), risposta alla nostra richiesta
+    if (modo != 4 || salto == 3 || strato == 0 || strato > 15 || memcmp(pacchetto + 24, origine, 8) != 0)
+        return false;
+
+    uint64_t ricezioneServer = marcaInMs(pacchetto + 32);   // T2
+    uint64_t trasmissioneServer = marcaInMs(pacchetto + 40); // T3
+    if (leggi32(pacchetto + 40) == 0 || trasmissioneServer < ricezioneServer)
+        return false;
+
+    uint32_t giro = ricevutaMs - inviataMs;
+    uint32_t nelServer = (uint32_t)(trasmissioneServer - ricezioneServer);
+    risultato.ritardoMs = giro > nelServer ? giro - nelServer : 0;
+    risultato.epochMs = trasmissioneServer + risultato.ritardoMs / 2;
+    risultato.millisRicezione = ricevutaMs;
+    risultato.strato = strato;
+    return true;
+}
+
+bool ClientNtp::isInAttesa() const
+{
+    return _inAttesa;
+}
+
+uint32_t ClientNtp::getScartati() const
+{
+    return _scartati;
+}
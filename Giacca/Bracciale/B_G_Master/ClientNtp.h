@@ -0,0 +1,72 @@
+/*
+  ClientNtp.h
+  Protocollo NTP (modo client, RFC 5905) senza dipendenze dalla rete:
+  i pacchetti passano da TrasportoUdp (WiFiUDP sulla Giga, un socket
+  qualsiasi su PC, anche verso un server finto in locale).
+  Una richiesta alla volta: la risposta vale solo se riporta la nostra
+  marca di trasmissione (origine), quindi risposte vecchie o estranee
+  si scartano. Il tempo passato nel server (T3 - T2) si toglie dal giro,
+  così metà del ritardo rimasto è la correzione dell'ora ricevuta.
+  Solo C++ standard, compilabile anche su PC.
+*/
+#ifndef CLIENT_NTP_H
+#define CLIENT_NTP_H
+
+#include <stdint.h>
+
+#define PORTA_NTP 123
+#define PACCHETTO_NTP 48
+#define TIMEOUT_NTP_MS 1000
+#define SECONDI_1900_1970 2208988800UL
+
+// Invio e ricezione UDP. Il nome del server si risolve in invia() (DNS compreso)
+class TrasportoUdp {
+public:
+    virtual ~TrasportoUdp() {}
+    virtual bool invia(const char* server, uint16_t porta, const uint8_t* dati, int lunghezza) = 0;
+    virtual int ricevi(uint8_t* dati, int dimensione) = 0;  // 0 = nessun pacchetto
+};
+
+enum EsitoNtp {
+    NTP_NESSUNA_RICHIESTA,
+    NTP_IN_ATTESA,
+    NTP_SINCRONIZZATO,
+    NTP_SCADUTO
+};
+
+struct RisultatoNtp {
+    uint64_t epochMs;          // UTC, ms dal 1970, all'istante millisRicezione
+    uint32_t millisRicezione;  // millis() all'arrivo della risposta
+    uint32_t ritardoMs;        // Giro meno il tempo passato nel server
+    uint8_t strato;
+};
+
+class ClientNtp {
+public:
+    ClientNtp();
+    void begin(TrasportoUdp& trasporto, const char* server);
+
+    // Invia una richiesta (scarta quella in attesa). false se DNS o invio falliscono
+    bool richiedi(uint32_t adessoMs);
+
+    // Risposta alla richiesta in corso, se arrivata. I pacchetti non validi si contano e si scartano
+    EsitoNtp controlla(uint32_t adessoMs, RisultatoNtp& risultato);
+
+    bool isInAttesa() const;
+    uint32_t getScartati() const;   // Risposte non valide o non nostre
+
+    // Controlli della risposta, pubblici per le prove con un server finto
+    static bool decodifica(const uint8_t* pacchetto, int lunghezza, const uint8_t* origine,
+                           uint32_t inviataMs, uint32_t ricevutaMs, RisultatoNtp& risultato);
+
+private:
+    TrasportoUdp* _trasporto;
+    const char* _server;
+    bool _inAttesa;
+    uint32_t _inviataMs;
+    uint32_t _richieste;
+    uint8_t _origine[8];      // Marca di trasmissione della richiesta, torna come origine
+    uint32_t _scartati;
+};
+
+#endif
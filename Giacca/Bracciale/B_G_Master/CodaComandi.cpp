@@ -0,0 +1,150 @@
+// Kicco972.net
+
+
+#include "CodaComandi.h"
+#include <string.h>
+
+CodaComandi::CodaComandi() : _numComandi(0), _prossimoId(1)
+{
+    memset(_comandi, 0, sizeof(_comandi));
+    memset(&_statistiche, 0, sizeof(_statistiche));
+}
+
+bool CodaComandi::accoda(int periferica, uint8_t valore, unsigned long adessoMs)
+{
+    int i = cerca(periferica);
+    if (i >= 0)
+    {
+        // Il comando precedente non serve più: un nuovo id rende inutile la sua conferma
+        _statistiche.sostituiti++;
+    }
+    else
+    {
+        if (_numComandi >= MAX_COMANDI_IN_CODA)
+            return false;
+        i = _numComandi++;
+    }
+
+    ComandoAttuatore& c = _comandi[i];
+    c.periferica = (uint8_t)periferica;
+    c.id = nuovoId();
+    c.valore = valore;
+    c.tentativi = 0;
+    c.inviato = false;
+    c.richiestoMs = adessoMs;
+    c.inviatoMs = 0;
+    return true;
+}
+
+void CodaComandi::update(unsigned long adessoMs, MittenteComandi& mittente)
+{
+    int i = 0;
+    while (i < _numComandi)
+    {
+        ComandoAttuatore& c = _comandi[i];
+        if (c.inviato && adessoMs - c.inviatoMs < TIMEOUT_CONFERMA_MS)
+        {
+            i++;
+            continue;
+        }
+
+        // Nessuna conferma dopo l'ultimo tentativo, o periferica assente troppo a lungo
+        if (c.tentativi >= MAX_TENTATIVI_COMANDO || adessoMs - c.richiestoMs >= SCADENZA_COMANDO_MS)
+        {
+            _statistiche.falliti++;
+            rimuovi(i);
+            continue;
+        }
+
+        // A periferica scollegata il comando aspetta senza consumare tentativi
+        if (!mittente.puoInviare(c.periferica))
+        {
+            i++;
+            continue;
+        }
+
+        if (c.tentativi > 0)
+            _statistiche.ripetuti++;
+        c.tentativi++;
+        c.inviato = true;
+        c.inviatoMs = adessoMs;
+        if (mittente.invia(c) == INVIO_CONFERMATO)
+        {
+            chiudi(i, adessoMs);
+            continue;
+        }
+        i++;
+    }
+}
+
+bool CodaComandi::conferma(int periferica, uint8_t id, unsigned long adessoMs)
+{
+    int i = cerca(periferica);
+    if (i < 0 || id == 0 || _comandi[i].id != id || !_comandi[i].inviato)
+        return false;
+    chiudi(i, adessoMs);
+    return true;
+}
+
+bool CodaComandi::isInCoda(int periferica) const
+{
+    return cerca(periferica) >= 0;
+}
+
+int CodaComandi::getNumeroComandi() const
+{
+    return _numComandi;
+}
+
+const StatisticheComandi& CodaComandi::getStatistiche() const
+{
+    return _statistiche;
+}
+
+uint32_t CodaComandi::getLatenzaMediaMs() const
+{
+    if (_statistiche.confermati == 0)
+        return 0;
+    return _statistiche.latenzaTotaleMs / _statistiche.confermati;
+}
+
+int CodaComandi::cerca(int periferica) const
+{
+    for (int i = 0; i < _numComandi; i++)
+    {
+        if (_comandi[i].periferica == periferica)
+            return i;
+    }
+    return -1;
+}
+
+// Mantiene l'ordine di arrivo: i comandi più vecchi partono per primi
+void CodaComandi::rimuovi(int indice)
+{
+    for (int i = indice; i < _numComandi - 1; i++)
+        _comandi[i] = _comandi[i + 1];
+    _numComandi--;
+}
+
+void CodaComandi::chiudi(int indice, unsigned long adessoMs)
+{
+    uint32_t latenza = adessoMs - _comandi[indice].richiestoMs;
+    StatisticheComandi& s = _statistiche;
+    if (s.confermati == 0 || latenza < s.latenzaMinimaMs)
+        s.latenzaMinimaMs = latenza;
+    if (latenza > s.latenzaMassimaMs)
+        s.latenzaMassimaMs = latenza;
+    s.latenzaTotaleMs += latenza;
+    s.ultimaLatenzaMs = latenza;
+    s.confermati++;
+    rimuovi(indice);
+}
+
+// 0 è riservato allo stato senza comando
+uint8_t CodaComandi::nuovoId()
+{
+    uint8_t id = _prossimoId++;
+    if (_prossimoId == 0)
+        _prossimoId = 1;
+    return id;
+}
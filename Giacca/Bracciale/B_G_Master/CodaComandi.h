@@ -0,0 +1,88 @@
+/*
+  CodaComandi.h
+  Coda limitata dei comandi agli attuatori BLE (Nano IoT).
+  I comandi partono senza risposta, anche più di uno in volo, e restano in coda
+  finché la periferica non conferma l'identificativo (vedi ProtocolloAttuatore.h).
+  Senza conferma entro TIMEOUT_CONFERMA_MS il comando viene ripetuto.
+  Conta solo l'ultimo valore richiesto: un nuovo comando per la stessa periferica
+  sostituisce quello in coda o in volo (la conferma del vecchio viene ignorata).
+  La scrittura passa da MittenteComandi: solo C++ standard, su PC si può
+  pilotare con un mittente simulato.
+*/
+#ifndef CODA_COMANDI_H
+#define CODA_COMANDI_H
+
+#include <stdint.h>
+
+#define MAX_COMANDI_IN_CODA 4          // Periferiche con un comando in sospeso
+#define TIMEOUT_CONFERMA_MS 250        // Attesa della conferma prima di ripetere
+#define MAX_TENTATIVI_COMANDO 4
+#define SCADENZA_COMANDO_MS 5000       // Anche a periferica scollegata: poi si rinuncia
+
+enum EsitoInvio {
+    INVIO_FALLITO,      // Scrittura rifiutata: si riprova allo scadere del timeout
+    INVIO_IN_ATTESA,    // Scritto, la conferma arriverà con una notifica
+    INVIO_CONFERMATO    // Confermato subito (firmware senza conferme, scrittura con risposta)
+};
+
+struct ComandoAttuatore {
+    uint8_t periferica;
+    uint8_t id;                 // 1-255
+    uint8_t valore;
+    uint8_t tentativi;          // Invii fatti
+    bool inviato;
+    unsigned long richiestoMs;  // Pressione del tasto: da qui si misura la latenza
+    unsigned long inviatoMs;    // Ultimo invio
+};
+
+// Scrittura sul modulo BLE (BleNetwork)
+class MittenteComandi {
+public:
+    virtual ~MittenteComandi() {}
+    virtual bool puoInviare(int periferica) = 0;  // Collegata e pronta
+    virtual EsitoInvio invia(const ComandoAttuatore& comando) = 0;
+};
+
+// Esito dei comandi dall'avvio
+struct StatisticheComandi {
+    uint32_t confermati;
+    uint32_t sostituiti;        // Superati da un comando più recente
+    uint32_t ripetuti;          // Invii oltre il primo
+    uint32_t falliti;           // Tentativi esauriti o scaduti
+    uint32_t latenzaTotaleMs;   // Somma delle latenze dei confermati
+    uint32_t latenzaMinimaMs;
+    uint32_t latenzaMassimaMs;
+    uint32_t ultimaLatenzaMs;
+};
+
+class CodaComandi {
+public:
+    CodaComandi();
+
+    // Accoda (o sostituisce) il comando per la periferica. false se la coda è piena
+    bool accoda(int periferica, uint8_t valore, unsigned long adessoMs);
+
+    // Invia i comandi nuovi e ripete quelli senza conferma
+    void update(unsigned long adessoMs, MittenteComandi& mittente);
+
+    // Conferma ricevuta dalla periferica. true se chiude un comando in coda
+    bool conferma(int periferica, uint8_t id, unsigned long adessoMs);
+
+    bool isInCoda(int periferica) const;
+    int getNumeroComandi() const;
+    const StatisticheComandi& getStatistiche() const;
+    uint32_t getLatenzaMediaMs() const;
+
+private:
+    ComandoAttuatore _comandi[MAX_COMANDI_IN_CODA];  // Ordine di arrivo
+    int _numComandi;
+    uint8_t _prossimoId;
+    StatisticheComandi _statistiche;
+
+    int cerca(int periferica) const;
+    void rimuovi(int indice);
+    void chiudi(int indice, unsigned long adessoMs);
+    uint8_t nuovoId();
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+  CodaSpsc.h
+  Coda circolare lock-free a singolo produttore / singolo consumatore.
+  Il produttore (es. thread di campionamento) chiama solo inserisci(),
+  il consumatore (es. loop della UI) chiama solo estrai().
+  Solo C++ standard (std::atomic), nessuna dipendenza Arduino o mbed.
+*/
+#ifndef CODA_SPSC_H
+#define CODA_SPSC_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint32_t N>
+class CodaSpsc {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "La capacità deve essere una potenza di 2");
+
+public:
+    CodaSpsc() : _testa(0), _coda(0), _persi(0) {}
+
+    // Lato produttore. Restituisce false (e conta l'elemento perso) se la coda è piena.
+    bool inserisci(const T& valore)
+    {
+        uint32_t testa = _testa.load(std::memory_order_relaxed);
+        uint32_t coda = _coda.load(std::memory_order_acquire);
+        if (testa - coda >= N)
+        {
+            _persi.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _buffer[testa & (N - 1)] = valore;
+        // release: il consumatore vede l'elemento scritto prima del nuovo indice
+        _testa.store(testa + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Lato consumatore. Restituisce false se la coda è vuota.
+    bool estrai(T& valore)
+    {
+        uint32_t coda = _coda.load(std::memory_order_relaxed);
+        uint32_t testa = _testa.load(std::memory_order_acquire);
+        if (coda == testa)
+            return false;
+        valore = _buffer[coda & (N - 1)];
+        _coda.store(coda + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Numero di elementi in attesa (indicativo se letto mentre l'altro lato lavora)
+    uint32_t dimensione() const
+    {
+        return _testa.load(std::memory_order_acquire) - _coda.load(std::memory_order_acquire);
+    }
+
+    uint32_t capacita() const { return N; }
+
+    // Elementi scartati perché la coda era piena
+    uint32_t getPersi() const { return _persi.load(std::memory_order_relaxed); }
+
+private:
+    T _buffer[N];
+    std::atomic<uint32_t> _testa; // Prossima posizione da scrivere (solo produttore)
+    std::atomic<uint32_t> _coda;  // Prossima posizione da leggere (solo consumatore)
+    std::atomic<uint32_t> _persi;
+};
+
+#endif
@@ -0,0 +1,183 @@
+// Kicco972.net
+
+
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
+#include "Compositore.h"
+
+#define LARGHEZZA_SCHERMO 800
+#define ALTEZZA_SCHERMO 480
+
+Compositore::Compositore() : _numRegioni(0), _pixelFrame(0), _pixelUltimoFrame(0), _pixelAccumulati(0), _frameAccumulati(0), _ultimoReport(0) {}
+
+void Compositore::invalida(int x, int y, int w, int h)
+{
+    Rettangolo r = {(int16_t)x, (int16_t)y, (int16_t)w, (int16_t)h};
+    invalida(r);
+}
+
+void Compositore::invalida(const Rettangolo& r)
+{
+    Rettangolo nuovo = r;
+    // Scarta le aree vuote o completamente fuori schermo
+    if (!ritaglia(nuovo))
+        return;
+    aggiungiRegione(nuovo);
+}
+
+void Compositore::aggiungiRegione(Rettangolo r)
+{
+    // Unisce la nuova regione con tutte quelle che tocca.
+    // Dopo ogni unione si riparte da capo perché il rettangolo è cresciuto
+    // e potrebbe ora sovrapporsi a regioni prima separate.
+    bool unita = true;
+    while (unita)
+    {
+        unita = false;
+        for (int i = 0; i < _numRegioni; i++)
+        {
+            Rettangolo u = unione(r, _regioni[i]);
+            // Si uniscono le regioni sovrapposte, oppure quelle adiacenti quando
+            // l'unione non costa più pixel della somma delle due
+            if (siSovrappongono(r, _regioni[i]) || area(u) <= area(r) + area(_regioni[i]))
+            {
+                r = u;
+                _regioni[i] = _regioni[--_numRegioni]; // Rimuove (ordine non rilevante)
+                unita = true;
+                break;
+            }
+        }
+    }
+
+    if (_numRegioni < MAX_REGIONI)
+    {
+        _regioni[_numRegioni++] = r;
+        return;
+    }
+
+    // Lista piena: unisce con la regione che cresce di meno
+    int migliore = 0;
+    uint32_t crescitaMin = 0xFFFFFFFF;
+    for (int i = 0; i < _numRegioni; i++)
+    {
+        uint32_t crescita = area(unione(r, _regioni[i])) - area(_regioni[i]);
+        if (crescita < crescitaMin)
+        {
+            crescitaMin = crescita;
+            migliore = i;
+        }
+    }
+    Rettangolo u = unione(r, _regioni[migliore]);
+    _regioni[migliore] = _regioni[--_numRegioni];
+    aggiungiRegione(u);
+}
+
+void Compositore::flush(uint16_t sfondo)
+{
+    for (int i = 0; i < _numRegioni; i++)
+    {
+        const Rettangolo& r = _regioni[i];
+        gigaDisplay.fillRect(r.x, r.y, r.w, r.h, sfondo);
+        _pixelFrame += area(r);
+    }
+    _numRegioni = 0;
+}
+
+void Compositore::reset()
+{
+    _numRegioni = 0;
+}
+
+void Compositore::aggiungiPixel(uint32_t n)
+{
+    _pixelFrame += n;
+}
+
+void Compositore::aggiungiLinea(int x0, int y0, int x1, int y1)
+{
+    // Bresenham scrive un pixel per passo sull'asse maggiore
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+    _pixelFrame += (uint32_t)((dx > dy ? dx : dy) + 1);
+}
+
+void Compositore::aggiungiTesto(int caratteri, int size)
+{
+    // Font di default Adafruit: cella 6x8 scalata per size (stima per eccesso)
+    _pixelFrame += (uint32_t)caratteri * 6 * size * 8 * size;
+}
+
+void Compositore::fineFrame(const char* schermata)
+{
+    _pixelUltimoFrame = _pixelFrame;
+    _pixelFrame = 0;
+    _pixelAccumulati += _pixelUltimoFrame;
+    _frameAccumulati++;
+
+    unsigned long adesso = millis();
+    if (adesso - _ultimoReport >= 5000)
+    {
+        Serial.print("Compositore [");
+        Serial.print(schermata);
+        Serial.print("]: ");
+        Serial.print(_pixelAccumulati / _frameAccumulati);
+        Serial.print(" px/frame medi su ");
+        Serial.print(_frameAccumulati);
+        Serial.println(" frame");
+
+        _pixelAccumulati = 0;
+        _frameAccumulati = 0;
+        _ultimoReport = adesso;
+    }
+}
+
+uint32_t Compositore::getPixelUltimoFrame()
+{
+    return _pixelUltimoFrame;
+}
+
+int Compositore::getNumRegioni()
+{
+    return _numRegioni;
+}
+
+// --- Geometria ---
+
+bool Compositore::siSovrappongono(const Rettangolo& a, const Rettangolo& b)
+{
+    return a.x < b.x + b.w && b.x < a.x + a.w &&
+           a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+Rettangolo Compositore::unione(const Rettangolo& a, const Rettangolo& b)
+{
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = (a.x + a.w) > (b.x + b.w) ? (a.x + a.w) : (b.x + b.w);
+    int y1 = (a.y + a.h) > (b.y + b.h) ? (a.y + a.h) : (b.y + b.h);
+    Rettangolo u = {(int16_t)x0, (int16_t)y0, (int16_t)(x1 - x0), (int16_t)(y1 - y0)};
+    return u;
+}
+
+uint32_t Compositore::area(const Rettangolo& r)
+{
+    return (uint32_t)r.w * (uint32_t)r.h;
+}
+
+bool Compositore::ritaglia(Rettangolo& r)
+{
+    int x0 = r.x < 0 ? 0 : r.x;
+    int y0 = r.y < 0 ? 0 : r.y;
+    int x1 = (r.x + r.w) > LARGHEZZA_SCHERMO ? LARGHEZZA_SCHERMO : (r.x + r.w);
+    int y1 = (r.y + r.h) > ALTEZZA_SCHERMO ? ALTEZZA_SCHERMO : (r.y + r.h);
+    if (x1 <= x0 || y1 <= y0)
+        return false;
+    r.x = x0;
+    r.y = y0;
+    r.w = x1 - x0;
+    r.h = y1 - y0;
+    return true;
+}
+
+#endif // CORE_CM4
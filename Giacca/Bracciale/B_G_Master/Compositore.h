@@ -0,0 +1,61 @@
+#ifndef COMPOSITORE_H
+#define COMPOSITORE_H
+
+#include <Arduino.h>
+#include <Arduino_GigaDisplay_GFX.h>
+
+// Riferimento all'oggetto display globale definito nel .ino
+extern GigaDisplay_GFX gigaDisplay;
+
+// Area rettangolare dello schermo (coordinate Landscape 800x480)
+struct Rettangolo {
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+};
+
+// Livello di invalidazione davanti a GigaDisplay_GFX.
+// Le schermate segnano le aree "sporche" con invalida(), le regioni sovrapposte
+// vengono unite e flush() le pulisce una sola volta per frame.
+// Tiene anche il conto dei pixel scritti per frame per confrontare le schermate.
+class Compositore {
+public:
+    static const int MAX_REGIONI = 16;
+
+    Compositore();
+    void invalida(int x, int y, int w, int h);
+    void invalida(const Rettangolo& r);
+    void flush(uint16_t sfondo);            // Pulisce le regioni unite e svuota la lista
+    void reset();                           // Scarta le regioni (es. dopo un fillScreen)
+
+    // Conteggio dei pixel disegnati in primo piano dalle schermate
+    void aggiungiPixel(uint32_t n);
+    void aggiungiLinea(int x0, int y0, int x1, int y1);
+    void aggiungiTesto(int caratteri, int size);
+
+    void fineFrame(const char* schermata);  // Chiude il frame e stampa la media ogni 5 s
+    uint32_t getPixelUltimoFrame();
+    int getNumRegioni();
+
+private:
+    Rettangolo _regioni[MAX_REGIONI];
+    int _numRegioni;
+
+    uint32_t _pixelFrame;        // Pixel scritti nel frame corrente
+    uint32_t _pixelUltimoFrame;  // Pixel scritti nell'ultimo frame chiuso
+    uint32_t _pixelAccumulati;   // Somma per la media del periodo di report
+    uint32_t _frameAccumulati;
+    unsigned long _ultimoReport;
+
+    static bool siSovrappongono(const Rettangolo& a, const Rettangolo& b);
+    static Rettangolo unione(const Rettangolo& a, const Rettangolo& b);
+    static uint32_t area(const Rettangolo& r);
+    static bool ritaglia(Rettangolo& r);
+    void aggiungiRegione(Rettangolo r);
+};
+
+// Istanza globale condivisa da tutte le schermate (definita nel .ino)
+extern Compositore compositore;
+
+#endif
@@ -0,0 +1,188 @@
+// Kicco972.net
+
+
+#include "ConnessionePeriferica.h"
+
+ConnessionePeriferica::ConnessionePeriferica()
+    : _id(0), _driver(nullptr), _stato(CONN_INATTIVA), _abilitata(false), _passo(0),
+      _tentativi(0), _riconnessioni(0), _inizioAttesa(0), _attesaMs(0)
+{
+}
+
+void ConnessionePeriferica::begin(int id, DriverBle& driver)
+{
+    _id = id;
+    _driver = &driver;
+}
+
+void ConnessionePeriferica::abilita()
+{
+    _abilitata = true;
+    if (_stato == CONN_INATTIVA)
+    {
+        _tentativi = 0;
+        vaiA(CONN_RICERCA);
+    }
+}
+
+void ConnessionePeriferica::disabilita()
+{
+    _abilitata = false;
+    if (_stato == CONN_RICERCA || _stato == CONN_ATTESA)
+        vaiA(CONN_INATTIVA);
+}
+
+void ConnessionePeriferica::trovata()
+{
+    if (_stato == CONN_RICERCA)
+        vaiA(CONN_CONNESSIONE);
+}
+
+void ConnessionePeriferica::update(unsigned long adessoMs)
+{
+    if (!_driver)
+        return;
+
+    switch (_stato)
+    {
+    case CONN_INATTIVA:
+    case CONN_RICERCA:
+        break; // La ricerca è condotta da chi gestisce la scansione
+
+    case CONN_CONNESSIONE:
+        if (_driver->connetti(_id))
+            vaiA(CONN_SCOPERTA);
+        else
+            fallimento(adessoMs);
+        break;
+
+    case CONN_SCOPERTA:
+        if (_driver->scopriAttributi(_id))
+        {
+            _passo = 0;
+            vaiA(CONN_SOTTOSCRIZIONE);
+        }
+        else
+        {
+            _driver->disconnetti(_id);
+            fallimento(adessoMs);
+        }
+        break;
+
+    case CONN_SOTTOSCRIZIONE:
+        if (!_driver->isConnessa(_id))
+        {
+            fallimento(adessoMs);
+        }
+        else if (_passo < _driver->numeroSottoscrizioni(_id))
+        {
+            // Una caratteristica senza notifiche non impedisce il collegamento
+            _driver->sottoscrivi(_id, _passo);
+            _passo++;
+        }
+        else
+        {
+            _tentativi = 0;
+            vaiA(CONN_ATTIVA);
+        }
+        break;
+
+    case CONN_ATTIVA:
+        if (!_driver->isConnessa(_id))
+        {
+            _riconnessioni++;
+            fallimento(adessoMs);
+        }
+        break;
+
+    case CONN_ATTESA:
+        if (adessoMs - _inizioAttesa >= _attesaMs)
+            vaiA(CONN_RICERCA);
+        break;
+    }
+}
+
+void ConnessionePeriferica::fallimento(unsigned long adessoMs)
+{
+    if (!_abilitata)
+    {
+        vaiA(CONN_INATTIVA);
+        return;
+    }
+
+    // Attesa esponenziale: 0.5 s, 1 s, 2 s, ... fino a 30 s
+    _tentativi++;
+    uint32_t esponente = _tentativi - 1;
+    if (esponente > 6)
+        esponente = 6;
+    _attesaMs = ATTESA_MINIMA_MS << esponente;
+    if (_attesaMs > ATTESA_MASSIMA_MS)
+        _attesaMs = ATTESA_MASSIMA_MS;
+    _inizioAttesa = adessoMs;
+    vaiA(CONN_ATTESA);
+}
+
+void ConnessionePeriferica::vaiA(StatoConnessione nuovo)
+{
+    StatoConnessione vecchio = _stato;
+    _stato = nuovo;
+    if (vecchio != nuovo && _driver)
+        _driver->cambioStato(_id, vecchio, nuovo);
+}
+
+StatoConnessione ConnessionePeriferica::getStato() const
+{
+    return _stato;
+}
+
+bool ConnessionePeriferica::isAttiva() const
+{
+    return _stato == CONN_ATTIVA;
+}
+
+bool ConnessionePeriferica::isInRicerca() const
+{
+    return _stato == CONN_RICERCA;
+}
+
+bool ConnessionePeriferica::isOccupata() const
+{
+    return _stato == CONN_CONNESSIONE || _stato == CONN_SCOPERTA || _stato == CONN_SOTTOSCRIZIONE;
+}
+
+uint32_t ConnessionePeriferica::getTentativi() const
+{
+    return _tentativi;
+}
+
+uint32_t ConnessionePeriferica::getRiconnessioni() const
+{
+    return _riconnessioni;
+}
+
+unsigned long ConnessionePeriferica::getAttesaMs() const
+{
+    return _attesaMs;
+}
+
+const char* ConnessionePeriferica::nomeStato(StatoConnessione s)
+{
+    switch (s)
+    {
+    case CONN_INATTIVA:
+        return "inattiva";
+    case CONN_RICERCA:
+        return "ricerca";
+    case CONN_CONNESSIONE:
+        return "connessione";
+    case CONN_SCOPERTA:
+        return "scoperta";
+    case CONN_SOTTOSCRIZIONE:
+        return "sottoscrizione";
+    case CONN_ATTIVA:
+        return "attiva";
+    case CONN_ATTESA:
+        return "attesa";
+    }
+    return "?";
+}
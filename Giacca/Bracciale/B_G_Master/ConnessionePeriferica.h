@@ -0,0 +1,77 @@
+/*
+  ConnessionePeriferica.h
+  Macchina a stati della connessione con una periferica BLE.
+  Ogni chiamata a update() esegue al massimo un'operazione sul modulo BLE
+  (connessione, scoperta degli attributi o una sottoscrizione), così il loop
+  non resta fermo per tutta la sequenza. Dopo un errore o una perdita del
+  collegamento riprova da sola, con attesa esponenziale.
+  Il modulo BLE è raggiunto solo tramite DriverBle: solo C++ standard,
+  su PC si può pilotare con un driver simulato.
+*/
+#ifndef CONNESSIONE_PERIFERICA_H
+#define CONNESSIONE_PERIFERICA_H
+
+#include <stdint.h>
+
+enum StatoConnessione {
+    CONN_INATTIVA,       // Nessun tentativo (ricerca non abilitata)
+    CONN_RICERCA,        // In attesa che la scansione trovi la periferica
+    CONN_CONNESSIONE,    // Trovata: connect() al prossimo update
+    CONN_SCOPERTA,       // Connessa: discoverAttributes() al prossimo update
+    CONN_SOTTOSCRIZIONE, // Una sottoscrizione per update
+    CONN_ATTIVA,         // Collegamento pronto
+    CONN_ATTESA          // Backoff prima di tornare in ricerca
+};
+
+// Operazioni sul modulo BLE, identificate dal numero della periferica
+class DriverBle {
+public:
+    virtual ~DriverBle() {}
+    virtual bool connetti(int id) = 0;
+    virtual bool scopriAttributi(int id) = 0;     // Anche la preparazione delle caratteristiche
+    virtual int numeroSottoscrizioni(int id) = 0; // Valido dopo scopriAttributi()
+    virtual bool sottoscrivi(int id, int indice) = 0;
+    virtual bool isConnessa(int id) = 0;
+    virtual void disconnetti(int id) = 0;
+    virtual void cambioStato(int, StatoConnessione, StatoConnessione) {} // id, vecchio, nuovo
+};
+
+class ConnessionePeriferica {
+public:
+    static const unsigned long ATTESA_MINIMA_MS = 500;
+    static const unsigned long ATTESA_MASSIMA_MS = 30000;
+
+    ConnessionePeriferica();
+    void begin(int id, DriverBle& driver);
+
+    void abilita();                // Avvia la ricerca e i tentativi automatici
+    void disabilita();             // Niente più tentativi (un collegamento attivo resta)
+    void trovata();                // La scansione ha trovato la periferica (solo in CONN_RICERCA)
+    void update(unsigned long adessoMs);
+
+    StatoConnessione getStato() const;
+    bool isAttiva() const;
+    bool isInRicerca() const;
+    bool isOccupata() const;       // Connessione, scoperta o sottoscrizioni in corso
+    uint32_t getTentativi() const; // Fallimenti consecutivi
+    uint32_t getRiconnessioni() const;
+    unsigned long getAttesaMs() const;
+
+    static const char* nomeStato(StatoConnessione s);
+
+private:
+    int _id;
+    DriverBle* _driver;
+    StatoConnessione _stato;
+    bool _abilitata;
+    int _passo;                    // Prossima sottoscrizione
+    uint32_t _tentativi;
+    uint32_t _riconnessioni;
+    unsigned long _inizioAttesa;   // Istante del passo fallito
+    unsigned long _attesaMs;
+
+    void vaiA(StatoConnessione nuovo);
+    void fallimento(unsigned long adessoMs);
+};
+
+#endif
@@ -1,7 +1,11 @@
 // Kicco972.net
 
 
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
 #include "Display.h"
+#include "Compositore.h"
 
 // Definizione dei colori
 #define CIANO 0x07FF
@@ -36,13 +40,24 @@ namespace
         {Display::BUTTON_LED, 595, 330, 180, 60, "LED"},
         // Riga 2 (Y=400) - Pulsanti Extra
         {Display::BUTTON_F1, 25, 400, 180, 60, "Memoria"},
-        {Display::BUTTON_F2, 215, 400, 180, 60, "F 2"},
+        {Display::BUTTON_F2, 215, 400, 180, 60, "Statistiche"},
         {Display::BUTTON_F3, 405, 400, 180, 60, "F 3"},
         {Display::BUTTON_F4, 595, 400, 180, 60, "F 4"}};
     const int NUM_BUTTONS = sizeof(buttons) / sizeof(Button);
+
+    // Area di stato (Centro-Destra, evita sovrapposizione con Temp che finisce a 420)
+    const int STATUS_X = 420;
+    const int STATUS_Y = 80; // Spostato in alto (era 130)
+
+    // Area WiFi Status (Allineato con Hum)
+    const int WIFI_X = 420;
+    const int WIFI_STATUS_Y = 140; // Spostato in alto (era 190)
+    const int WIFI_INFO_Y = 200;   // Spostato in alto (era 250)
+    const int WIFI_W = 380;        // Spazio rimanente (800 - 420)
 }
 
-Display::Display() : _lastStatusMessage(""), _lastTempDisplayed(-999.0), _lastHumDisplayed(-999.0), _lastPressDisplayed(-999.0), _lastStateColor(0), _buttonPressed(false), _lastWifiConnected(false), _lastIp(""), _lastRssi(-999), _lastTimeDisplayed("") {}
+Display::Display() : _lastStatusMessage(""), _lastTempDisplayed(-999.0), _lastHumDisplayed(-999.0), _lastPressDisplayed(-999.0), _lastStateColor(0), _buttonPressed(false), _lastWifiConnected(false), _lastIp(""), _lastRssi(-999), _lastTimeDisplayed(""), _lastDateDisplayed(""), _lastLedState(-1),
+                     _statoDaDisegnare(false), _wifiDaDisegnare(false), _orologioDaDisegnare(false), _tempDaDisegnare(false), _humDaDisegnare(false), _pressDaDisegnare(false) {}
 
 void Display::begin()
 {
@@ -60,7 +75,7 @@ void Display::showBaseScreen()
     setButtonLabel(BUTTON_BUSSOLA, "Bussola");
     setButtonLabel(BUTTON_LED, "LED");
     setButtonLabel(BUTTON_F1, "Memoria");
-    setButtonLabel(BUTTON_F2, "");
+    setButtonLabel(BUTTON_F2, "Statistiche");
     setButtonLabel(BUTTON_F3, "");
     setButtonLabel(BUTTON_F4, "");
 
@@ -86,11 +101,16 @@ void Display::showBaseScreen()
     _lastIp = "";
     _lastRssi = -999;
     _lastTimeDisplayed = "";
+    _lastLedState = -1;
+
+    // Lo schermo è appena stato pulito: nessuna area da invalidare
+    compositore.reset();
 }
 
 void Display::prepareSubScreen()
 {
     gigaDisplay.fillScreen(NERO);
+    compositore.reset();
     
     // Configurazione standard pulsanti sottomaschera
     setButtonLabel(BUTTON_SCAN, "Indietro"); // Il primo pulsante è sempre Indietro
@@ -130,8 +150,29 @@ void Display::setButtonLabel(ButtonId id, const char *label)
     }
 }
 
+void Display::redrawButton(ButtonId id)
+{
+    for (int i = 0; i < NUM_BUTTONS; ++i)
+    {
+        if (buttons[i].id == id)
+        {
+            gigaDisplay.fillRect(buttons[i].x, buttons[i].y, buttons[i].w, buttons[i].h, NERO);
+            gigaDisplay.drawRect(buttons[i].x, buttons[i].y, buttons[i].w, buttons[i].h, BIANCO);
+            gigaDisplay.setTextColor(BIANCO);
+            gigaDisplay.setTextSize(2);
+            gigaDisplay.setCursor(buttons[i].x + 20, buttons[i].y + 20);
+            gigaDisplay.print(buttons[i].label);
+            break;
+        }
+    }
+}
+
 void Display::updateLedButton(bool isOn)
 {
+    if ((int)isOn == _lastLedState)
+        return;
+    _lastLedState = isOn;
+
     for (int i = 0; i < NUM_BUTTONS; ++i)
     {
         if (buttons[i].id == BUTTON_LED)
@@ -154,7 +195,9 @@ void Display::updateLedButton(bool isOn)
 Display::ButtonId Display::checkTouch()
 {
     GDTpoint_t points[1];
+    mutexWire1.lock();
     uint8_t contacts = _touchDetector.getTouchPoints(points);
+    mutexWire1.unlock();
 
     // Controlla se lo schermo è stato premuto
     if (contacts > 0)
@@ -251,23 +294,12 @@ void Display::updateStatus(bool isScanning, bool isSenseConnected, bool isIoTCon
     // Aggiorna il display solo se il messaggio è cambiato per evitare sfarfallio
     if (newMessage != _lastStatusMessage)
     {
-        // Definisce l'area in cui disegnare lo stato
-        const int STATUS_X = 420; // Centro-Destra (evita sovrapposizione con Temp che finisce a 420)
-        const int STATUS_Y = 80; // Spostato in alto (era 130)
-        const int STATUS_W = 380; // Spazio rimanente (800 - 420)
-        const int STATUS_H = 50;  // Stessa altezza del box Temp
-
-        // Pulisci l'area di stato
-        gigaDisplay.fillRect(STATUS_X, STATUS_Y, STATUS_W, STATUS_H, NERO);
+        // Invalida solo il testo precedente (size 3: 18x24 px per carattere)
+        compositore.invalida(STATUS_X, STATUS_Y + 10, _lastStatusMessage.length() * 18, 24);
 
-        // Scrivi il nuovo messaggio
-        gigaDisplay.setTextColor(BIANCO);
-        gigaDisplay.setTextSize(3);
-        gigaDisplay.setCursor(STATUS_X, STATUS_Y + 10);
-        gigaDisplay.print(newMessage);
-
-        // Memorizza il nuovo messaggio
+        // Memorizza il nuovo messaggio, verrà disegnato in disegnaFrame()
         _lastStatusMessage = newMessage;
+        _statoDaDisegnare = true;
     }
 }
 
@@ -276,118 +308,166 @@ void Display::updateWifiStatus(bool isConnected, String ip, int rssi)
     // Aggiorna solo se cambia qualcosa (con isteresi per RSSI)
     if (isConnected != _lastWifiConnected || ip != _lastIp || abs(rssi - _lastRssi) > 2)
     {
+        // Invalida le righe già disegnate (-999 = niente disegnato dopo il cambio schermata)
+        if (_lastRssi != -999)
+        {
+            compositore.invalida(WIFI_X, WIFI_STATUS_Y + 10, 17 * 18, 24); // "WiFi: Disconnesso"
+            if (_lastWifiConnected)
+                compositore.invalida(WIFI_X, WIFI_INFO_Y + 10, WIFI_W, 24);
+        }
+
         _lastWifiConnected = isConnected;
         _lastIp = ip;
         _lastRssi = rssi;
+        _wifiDaDisegnare = true;
+    }
+}
 
-        // Area WiFi Status (Allineato con Hum Y=190)
-        const int WIFI_STATUS_Y = 140; // Spostato in alto (era 190)
-        const int WIFI_INFO_Y = 200; // Spostato in alto (era 250)
-        const int X = 420;
-        const int W = 380;
-        const int H = 50;
+void Display::updateClock(String timeStr, String dateStr)
+{
+    // Aggiorna solo se il minuto è cambiato
+    if (timeStr != _lastTimeDisplayed)
+    {
+        // Area Orologio (In alto a sinistra, molto piccolo): "HH:MM  DD/MM/YYYY" in size 2
+        if (_lastTimeDisplayed.length() > 0)
+            compositore.invalida(10, 10, 17 * 12, 16);
 
-        // Pulisci le aree
-        gigaDisplay.fillRect(X, WIFI_STATUS_Y, W, H, NERO);
-        gigaDisplay.fillRect(X, WIFI_INFO_Y, W, H, NERO);
+        _lastTimeDisplayed = timeStr;
+        _lastDateDisplayed = dateStr;
+        _orologioDaDisegnare = true;
+    }
+}
 
+void Display::updateTemperature(float temp)
+{
+    // Aggiorna solo se cambia significativamente (0.01 gradi)
+    if (abs(temp - _lastTempDisplayed) > 0.01)
+    {
+        // Area Temperatura: solo la riga di testo (size 3, max "Temp: -99.99 C")
+        if (_lastTempDisplayed != -999.0)
+            compositore.invalida(30, 90, 14 * 18, 24);
+        _lastTempDisplayed = temp;
+        _tempDaDisegnare = true;
+    }
+}
+
+void Display::updateHumidity(float hum)
+{
+    // Aggiorna solo se cambia significativamente (0.01 %)
+    if (abs(hum - _lastHumDisplayed) > 0.01)
+    {
+        // Area Umidità (sotto la temperatura, max "Hum:  100.00 %")
+        if (_lastHumDisplayed != -999.0)
+            compositore.invalida(30, 150, 14 * 18, 24);
+        _lastHumDisplayed = hum;
+        _humDaDisegnare = true;
+    }
+}
+
+void Display::updatePressure(float press)
+{
+    // Aggiorna solo se cambia significativamente (0.01 kPa)
+    if (abs(press - _lastPressDisplayed) > 0.01)
+    {
+        // Area Pressione (sotto l'umidità, max "Pres: 999.99 kPa")
+        if (_lastPressDisplayed != -999.0)
+            compositore.invalida(30, 210, 16 * 18, 24);
+        _lastPressDisplayed = press;
+        _pressDaDisegnare = true;
+    }
+}
+
+void Display::disegnaFrame()
+{
+    // 1. Una sola pulizia per tutte le aree invalidate dagli update*()
+    compositore.flush(NERO);
+
+    // 2. Ridisegna soltanto i widget cambiati
+    if (_statoDaDisegnare)
+    {
+        gigaDisplay.setTextColor(BIANCO);
+        gigaDisplay.setTextSize(3);
+        gigaDisplay.setCursor(STATUS_X, STATUS_Y + 10);
+        gigaDisplay.print(_lastStatusMessage);
+        compositore.aggiungiTesto(_lastStatusMessage.length(), 3);
+        _statoDaDisegnare = false;
+    }
+
+    if (_wifiDaDisegnare)
+    {
         gigaDisplay.setTextColor(BIANCO);
         gigaDisplay.setTextSize(3);
 
         // Riga 1: Stato WiFi
-        gigaDisplay.setCursor(X, WIFI_STATUS_Y + 10);
-        if (isConnected) {
+        gigaDisplay.setCursor(WIFI_X, WIFI_STATUS_Y + 10);
+        if (_lastWifiConnected) {
             gigaDisplay.print("WiFi: Connesso");
         } else {
             gigaDisplay.print("WiFi: Disconnesso");
         }
+        compositore.aggiungiTesto(17, 3);
 
         // Riga 2: IP e RSSI (solo se connesso)
-        if (isConnected) {
-             gigaDisplay.setCursor(X, WIFI_INFO_Y + 10);
-             gigaDisplay.print(ip);
+        if (_lastWifiConnected) {
+             gigaDisplay.setCursor(WIFI_X, WIFI_INFO_Y + 10);
+             gigaDisplay.print(_lastIp);
              gigaDisplay.print(" ");
-             gigaDisplay.print(rssi);
+             gigaDisplay.print(_lastRssi);
              gigaDisplay.print("dB");
+             compositore.aggiungiTesto(_lastIp.length() + 7, 3);
         }
+        _wifiDaDisegnare = false;
     }
-}
 
-void Display::updateClock(String timeStr, String dateStr)
-{
-    // Aggiorna solo se il minuto è cambiato
-    if (timeStr != _lastTimeDisplayed)
+    if (_orologioDaDisegnare)
     {
-        _lastTimeDisplayed = timeStr;
-
-        // Area Orologio (In alto a sinistra, molto piccolo)
-        // Coordinate: X=10, Y=10. Larghezza sufficiente per "HH:MM DD/MM/YYYY"
-        gigaDisplay.fillRect(10, 10, 250, 25, NERO);
-
         gigaDisplay.setTextColor(GRIGIO_CHIARO); // Colore discreto
         gigaDisplay.setTextSize(2); // Piccolo
         gigaDisplay.setCursor(10, 10);
-        gigaDisplay.print(timeStr);
+        gigaDisplay.print(_lastTimeDisplayed);
         gigaDisplay.print("  ");
-        gigaDisplay.print(dateStr);
+        gigaDisplay.print(_lastDateDisplayed);
+        compositore.aggiungiTesto(17, 2);
+        _orologioDaDisegnare = false;
     }
-}
 
-void Display::updateTemperature(float temp)
-{
-    // Aggiorna solo se cambia significativamente (0.01 gradi)
-    if (abs(temp - _lastTempDisplayed) > 0.01)
+    if (_tempDaDisegnare)
     {
-        _lastTempDisplayed = temp;
-
-        // Area Temperatura (in alto a sinistra/centro)
-        gigaDisplay.fillRect(20, 80, 400, 50, NERO); // Spostato in alto (era 130)
-
         gigaDisplay.setTextColor(VERDE);
         gigaDisplay.setTextSize(3);
         gigaDisplay.setCursor(30, 90);
         gigaDisplay.print("Temp: ");
-        gigaDisplay.print(temp, 2);
+        gigaDisplay.print(_lastTempDisplayed, 2);
         gigaDisplay.print(" C");
+        compositore.aggiungiTesto(14, 3);
+        _tempDaDisegnare = false;
     }
-}
 
-void Display::updateHumidity(float hum)
-{
-    // Aggiorna solo se cambia significativamente (0.01 %)
-    if (abs(hum - _lastHumDisplayed) > 0.01)
+    if (_humDaDisegnare)
     {
-        _lastHumDisplayed = hum;
-
-        // Area Umidità (sotto la temperatura)
-        gigaDisplay.fillRect(20, 140, 400, 50, NERO); // Spostato in alto (era 190)
-
         gigaDisplay.setTextColor(CIANO);
         gigaDisplay.setTextSize(3);
         gigaDisplay.setCursor(30, 150);
         gigaDisplay.print("Hum:  ");
-        gigaDisplay.print(hum, 2);
+        gigaDisplay.print(_lastHumDisplayed, 2);
         gigaDisplay.print(" %");
+        compositore.aggiungiTesto(14, 3);
+        _humDaDisegnare = false;
     }
-}
 
-void Display::updatePressure(float press)
-{
-    // Aggiorna solo se cambia significativamente (0.01 kPa)
-    if (abs(press - _lastPressDisplayed) > 0.01)
+    if (_pressDaDisegnare)
     {
-        _lastPressDisplayed = press;
-
-        // Area Pressione (sotto l'umidità)
-        gigaDisplay.fillRect(20, 200, 400, 50, NERO); // Spostato in alto (era 250)
-
         gigaDisplay.setTextColor(MAGENTA); // Colore diverso per distinguere
         gigaDisplay.setTextSize(3);
         gigaDisplay.setCursor(30, 210);
         gigaDisplay.print("Pres: ");
-        gigaDisplay.print(press, 2);
+        gigaDisplay.print(_lastPressDisplayed, 2);
         gigaDisplay.print(" kPa");
+        compositore.aggiungiTesto(16, 3);
+        _pressDaDisegnare = false;
     }
+
+    compositore.fineFrame("Base");
 }
 
 void Display::updateStateIcon(uint16_t color)
@@ -407,3 +487,5 @@ void Display::resetStateIcon()
 {
     _lastStateColor = 0x1234; // Imposta un valore impossibile per forzare l'aggiornamento
 }
+
+#endif // CORE_CM4
@@ -3,11 +3,15 @@
 
 #include <Arduino.h>
 #include <Arduino_GigaDisplay_GFX.h>
+#include "BusCondiviso.h"
 #include <Arduino_GigaDisplayTouch.h>
 
 // Riferimento all'oggetto display globale definito nel .ino
 extern GigaDisplay_GFX gigaDisplay;
 
+// Il touch condivide Wire1 con l'IMU (vedi SensoreImu)
+extern BloccoBus mutexWire1;
+
 class Display {
 public:
     enum ButtonId {
@@ -29,7 +33,8 @@ public:
     ButtonId checkTouch();
     void drawButtons(); // Metodo reso pubblico per ridisegnare i pulsanti in altre schermate
     void setButtonLabel(ButtonId id, const char* label); // Nuovo metodo per cambiare etichetta
-    void updateLedButton(bool isOn); // Aggiorna il colore del pulsante LED
+    void redrawButton(ButtonId id); // Pulisce e ridisegna un solo pulsante (dopo un cambio etichetta)
+    void updateLedButton(bool isOn); // Aggiorna il colore del pulsante LED (solo se cambiato)
     
     void updateStatus(bool isScanning, bool isSenseConnected, bool isIoTConnected);
     void updateWifiStatus(bool isConnected, String ip, int rssi); // Nuovo metodo WiFi
@@ -37,6 +42,7 @@ public:
     void updateTemperature(float temp);
     void updateHumidity(float hum);
     void updatePressure(float press);
+    void disegnaFrame(); // Pulisce le aree invalidate e ridisegna i widget cambiati (una volta per frame)
     
     void updateStateIcon(uint16_t color); // Disegna il LED virtuale
     void resetStateIcon(); // Forza il ridisegno (utile al cambio schermata)
@@ -53,6 +59,16 @@ private:
     String _lastIp;
     int _lastRssi;
     String _lastTimeDisplayed;
+    String _lastDateDisplayed;
+    int _lastLedState;              // -1 = da ridisegnare
+
+    // Widget della schermata base in attesa di ridisegno (vedi disegnaFrame)
+    bool _statoDaDisegnare;
+    bool _wifiDaDisegnare;
+    bool _orologioDaDisegnare;
+    bool _tempDaDisegnare;
+    bool _humDaDisegnare;
+    bool _pressDaDisegnare;
 };
 
 #endif
\ No newline at end of file
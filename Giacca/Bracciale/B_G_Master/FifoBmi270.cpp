@@ -0,0 +1,166 @@
+// Kicco972.net
+
+
+#include "FifoBmi270.h"
+
+// Header dei frame (datasheet BMI270, "FIFO frames")
+#define HEADER_MODO_MASCHERA 0xC0
+#define HEADER_MODO_DATI 0x80
+#define HEADER_MODO_CONTROLLO 0x40
+#define HEADER_AUX 0x10
+#define HEADER_GYR 0x08
+#define HEADER_ACC 0x04
+#define HEADER_VUOTO 0x80      // Letto oltre la fine dei dati disponibili
+#define HEADER_SALTO 0x40      // Frame persi per FIFO piena (1 byte: quanti)
+#define HEADER_SENSORTIME 0x44 // 3 byte di sensortime
+#define HEADER_CONFIG 0x48     // Cambio di configurazione (4 byte)
+#define HEADER_SCARTO 0x50     // Campioni scartati (1 byte)
+
+#define BYTE_AUX 8
+#define BYTE_SENSORE 6
+
+DecoderFifoBmi270::DecoderFifoBmi270()
+    : _byteConsumati(0), _fifoVuota(false), _haSensorTime(false), _sensorTime(0), _frameSaltati(0), _frameScartati(0)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        _ultimoAcc[i] = 0;
+        _ultimoGyr[i] = 0;
+    }
+}
+
+int DecoderFifoBmi270::decodifica(const uint8_t* dati, int lunghezza, FrameFifoBmi270* frame, int maxFrame)
+{
+    int pos = 0;
+    int n = 0;
+    _fifoVuota = false;
+    _haSensorTime = false;
+
+    while (pos < lunghezza && n < maxFrame)
+    {
+        uint8_t header = dati[pos];
+
+        if (header == HEADER_VUOTO)
+        {
+            // Il resto del blocco è riempitivo: si considera tutto consumato
+            _fifoVuota = true;
+            pos = lunghezza;
+            break;
+        }
+
+        if ((header & HEADER_MODO_MASCHERA) == HEADER_MODO_DATI)
+        {
+            int dimensione = 1;
+            if (header & HEADER_AUX)
+                dimensione += BYTE_AUX;
+            if (header & HEADER_GYR)
+                dimensione += BYTE_SENSORE;
+            if (header & HEADER_ACC)
+                dimensione += BYTE_SENSORE;
+            if (pos + dimensione > lunghezza)
+                break; // Frame troncato
+
+            // Ordine dei dati nel frame: aux, giroscopio, accelerometro
+            const uint8_t* p = dati + pos + 1;
+            if (header & HEADER_AUX)
+                p += BYTE_AUX;
+
+            FrameFifoBmi270& f = frame[n];
+            f.gyr = (header & HEADER_GYR) != 0;
+            f.acc = (header & HEADER_ACC) != 0;
+            if (f.gyr)
+            {
+                for (int i = 0; i < 3; i++)
+                    _ultimoGyr[i] = leggiInt16(p + 2 * i);
+                p += BYTE_SENSORE;
+            }
+            if (f.acc)
+            {
+                for (int i = 0; i < 3; i++)
+                    _ultimoAcc[i] = leggiInt16(p + 2 * i);
+            }
+            f.gx = _ultimoGyr[0];
+            f.gy = _ultimoGyr[1];
+            f.gz = _ultimoGyr[2];
+            f.ax = _ultimoAcc[0];
+            f.ay = _ultimoAcc[1];
+            f.az = _ultimoAcc[2];
+
+            // Un frame con il solo aux non porta dati utili qui
+            if (f.gyr || f.acc)
+                n++;
+            pos += dimensione;
+            continue;
+        }
+
+        int dimensione;
+        switch (header & 0xFC) // I due bit bassi sono tag di interrupt
+        {
+        case HEADER_SALTO:
+        case HEADER_SCARTO:
+            dimensione = 2;
+            break;
+        case HEADER_SENSORTIME:
+            dimensione = 4;
+            break;
+        case HEADER_CONFIG:
+            dimensione = 5;
+            break;
+        default:
+            // Header sconosciuto: non si può sapere dove inizia il frame dopo
+            _frameScartati++;
+            _byteConsumati = lunghezza;
+            return n;
+        }
+        if (pos + dimensione > lunghezza)
+            break;
+
+        if ((header & 0xFC) == HEADER_SALTO)
+            _frameSaltati += dati[pos + 1];
+        else if ((header & 0xFC) == HEADER_SENSORTIME)
+        {
+            _sensorTime = (uint32_t)dati[pos + 1] | ((uint32_t)dati[pos + 2] << 8) | ((uint32_t)dati[pos + 3] << 16);
+            _haSensorTime = true;
+        }
+        pos += dimensione;
+    }
+
+    _byteConsumati = pos;
+    return n;
+}
+
+int DecoderFifoBmi270::getByteConsumati()
+{
+    return _byteConsumati;
+}
+
+bool DecoderFifoBmi270::isFifoVuota()
+{
+    return _fifoVuota;
+}
+
+bool DecoderFifoBmi270::haSensorTime()
+{
+    return _haSensorTime;
+}
+
+uint32_t DecoderFifoBmi270::getSensorTime()
+{
+    return _sensorTime;
+}
+
+uint32_t DecoderFifoBmi270::getFrameSaltati()
+{
+    return _frameSaltati;
+}
+
+uint32_t DecoderFifoBmi270::getFrameScartati()
+{
+    return _frameScartati;
+}
+
+int16_t DecoderFifoBmi270::leggiInt16(const uint8_t* p)
+{
+    // Little endian, LSB per primo
+    return (int16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8));
+}
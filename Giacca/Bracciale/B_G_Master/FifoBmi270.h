@@ -0,0 +1,68 @@
+/*
+  FifoBmi270.h
+  Decodifica dei frame della FIFO hardware del BMI270 (modalità con header).
+  Lavora solo su byte già letti dal registro FIFO_DATA: nessun accesso all'I2C,
+  nessuna dipendenza Arduino, quindi può essere alimentato anche con dump
+  catturati e compilato su PC.
+*/
+#ifndef FIFO_BMI270_H
+#define FIFO_BMI270_H
+
+#include <stdint.h>
+
+// Registri del BMI270 usati per la FIFO
+#define BMI270_REG_FIFO_LENGTH_0 0x24
+#define BMI270_REG_FIFO_DATA 0x26
+#define BMI270_REG_ACC_CONF 0x40
+#define BMI270_REG_ACC_RANGE 0x41
+#define BMI270_REG_GYR_CONF 0x42
+#define BMI270_REG_GYR_RANGE 0x43
+#define BMI270_REG_FIFO_CONFIG_0 0x48
+#define BMI270_REG_FIFO_CONFIG_1 0x49
+#define BMI270_REG_CMD 0x7E
+#define BMI270_CMD_FIFO_FLUSH 0xB0
+
+// Scale con i range impostati (±4 g, ±2000 °/s, come la libreria Arduino)
+#define BMI270_LSB_PER_G 8192.0f
+#define BMI270_LSB_PER_DPS 16.384f
+
+// Un frame dati: giroscopio e/o accelerometro grezzi (assi del sensore)
+struct FrameFifoBmi270 {
+    int16_t ax, ay, az;
+    int16_t gx, gy, gz;
+    bool acc; // true se il frame conteneva l'accelerometro
+    bool gyr; // true se il frame conteneva il giroscopio
+};
+
+class DecoderFifoBmi270 {
+public:
+    DecoderFifoBmi270();
+
+    // Decodifica un blocco letto da FIFO_DATA e scrive al massimo maxFrame frame dati.
+    // Restituisce il numero di frame scritti. Un frame troncato in fondo al blocco
+    // non viene consumato: il sensore lo ripresenta intero alla lettura successiva.
+    int decodifica(const uint8_t* dati, int lunghezza, FrameFifoBmi270* frame, int maxFrame);
+
+    int getByteConsumati();        // Byte usati dall'ultima decodifica
+    bool isFifoVuota();            // L'ultima decodifica ha incontrato il marcatore di FIFO vuota
+    bool haSensorTime();           // L'ultima decodifica conteneva un frame di sensortime
+    uint32_t getSensorTime();      // Sensortime a 24 bit (1 LSB = 39.0625 us)
+    uint32_t getFrameSaltati();    // Totale frame persi dal sensore per FIFO piena
+    uint32_t getFrameScartati();   // Totale header sconosciuti (decodifica interrotta)
+
+private:
+    int _byteConsumati;
+    bool _fifoVuota;
+    bool _haSensorTime;
+    uint32_t _sensorTime;
+    uint32_t _frameSaltati;
+    uint32_t _frameScartati;
+
+    // Ultimi valori noti, per completare frame con un solo sensore
+    int16_t _ultimoAcc[3];
+    int16_t _ultimoGyr[3];
+
+    static int16_t leggiInt16(const uint8_t* p);
+};
+
+#endif
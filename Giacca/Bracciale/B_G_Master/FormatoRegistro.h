@@ -0,0 +1,98 @@
+/*
+  FormatoRegistro.h
+  Registro binario dei campioni ambientali su QSPI: record di dimensione fissa,
+  12 byte contro i ~45 di una riga del CSV. Il CSV si ottiene solo quando
+  serve, esportando verso la chiavetta (vedi Memoria::esporta()).
+  Solo C++ standard, header-only, compilabile anche su PC.
+
+  File (little endian):
+    0-3   "BGR1"
+    4     uint8   versione (REGISTRO_VERSIONE)
+    5     uint8   dimensione di un record [byte]
+    6-7   uint16  generazione del segmento (AnelloRegistro.h), 0 per un file singolo
+    8-    record
+
+  Record (REGISTRO_RECORD byte):
+    0-3   uint32  epoch in ora locale (come time(NULL), vedi WiFiGiga)
+    4-5   int16   temperatura [0.01 °C]     (-32768 = non valida)
+    6-7   uint16  umidità [0.01 %]          (65535 = non valida)
+    8-9   uint16  pressione [2 Pa]          (65535 = non valida)
+    10-11 uint16  CRC-16/CCITT dei byte 0-9 (vedi ProtocolloStorico.h)
+
+  Un record con il CRC errato (scrittura interrotta da un reset) si salta:
+  la posizione di ogni record si ricava dall'indice, senza separatori.
+*/
+#ifndef FORMATO_REGISTRO_H
+#define FORMATO_REGISTRO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "ProtocolloStorico.h"
+#include "UnioneStorico.h"
+
+#define REGISTRO_MAGICO "BGR1"
+#define REGISTRO_VERSIONE 1
+#define REGISTRO_INTESTAZIONE 8
+#define REGISTRO_RECORD 12
+
+#define REGISTRO_TEMPERATURA_NULLA 0x8000
+#define REGISTRO_NULLO 0xFFFF
+
+inline void codificaIntestazioneRegistro(uint8_t* buf, uint16_t generazione = 0)
+{
+    memcpy(buf, REGISTRO_MAGICO, 4);
+    buf[4] = REGISTRO_VERSIONE;
+    buf[5] = REGISTRO_RECORD;
+    tramaScrivi16(buf + 6, generazione);
+}
+
+inline bool verificaIntestazioneRegistro(const uint8_t* buf, int lunghezza)
+{
+    return lunghezza >= REGISTRO_INTESTAZIONE && memcmp(buf, REGISTRO_MAGICO, 4) == 0 &&
+           buf[4] == REGISTRO_VERSIONE && buf[5] == REGISTRO_RECORD;
+}
+
+// Record interi in un file della dimensione data (un record troncato non conta)
+inline long registroRecordInteri(long dimensione)
+{
+    return dimensione <= REGISTRO_INTESTAZIONE ? 0 : (dimensione - REGISTRO_INTESTAZIONE) / REGISTRO_RECORD;
+}
+
+inline long registroPosizione(long indice)
+{
+    return REGISTRO_INTESTAZIONE + indice * REGISTRO_RECORD;
+}
+
+inline void codificaRecordRegistro(const CampioneStorico& c, uint8_t* buf)
+{
+    // NaN (sensore guasto) ha un valore riservato: non deve diventare un fondo scala
+    tramaScrivi32(buf, c.epoch);
+    tramaScrivi16(buf + 4, !isnan(c.temperatura)
+                               ? (uint16_t)(int16_t)tramaArrotonda(c.temperatura, 100.0f, -32767, 32767)
+                               : REGISTRO_TEMPERATURA_NULLA);
+    tramaScrivi16(buf + 6, !isnan(c.umidita)
+                               ? (uint16_t)tramaArrotonda(c.umidita, 100.0f, 0, 65534)
+                               : REGISTRO_NULLO);
+    tramaScrivi16(buf + 8, !isnan(c.pressione)
+                               ? (uint16_t)tramaArrotonda(c.pressione, 500.0f, 0, 65534)
+                               : REGISTRO_NULLO);
+    tramaScrivi16(buf + 10, storicoCrc16(0xFFFF, buf, REGISTRO_RECORD - 2));
+}
+
+// false se il CRC è errato
+inline bool decodificaRecordRegistro(const uint8_t* buf, CampioneStorico& c)
+{
+    if (storicoCrc16(0xFFFF, buf, REGISTRO_RECORD - 2) != tramaLeggi16(buf + 10))
+        return false;
+    uint16_t t = tramaLeggi16(buf + 4);
+    uint16_t h = tramaLeggi16(buf + 6);
+    uint16_t p = tramaLeggi16(buf + 8);
+    c.epoch = tramaLeggi32(buf);
+    c.temperatura = t == REGISTRO_TEMPERATURA_NULLA ? NAN : (int16_t)t / 100.0f;
+    c.umidita = h == REGISTRO_NULLO ? NAN : h / 100.0f;
+    c.pressione = p == REGISTRO_NULLO ? NAN : p / 500.0f;
+    return true;
+}
+
+#endif
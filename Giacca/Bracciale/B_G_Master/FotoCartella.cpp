@@ -0,0 +1,99 @@
+// Kicco972.net
+
+
+#include "FotoCartella.h"
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+FotoCartella::FotoCartella()
+    : _voci(nullptr), _massimo(0), _nomi(nullptr), _spazio(0), _numero(0), _omesse(0), _usati(0), _ordine(ORDINE_NOME)
+{
+}
+
+void FotoCartella::begin(VoceCartella* voci, int massimo, char* nomi, uint32_t spazio)
+{
+    _voci = voci;
+    _massimo = voci && nomi ? massimo : 0;
+    _nomi = nomi;
+    _spazio = spazio;
+    azzera();
+}
+
+void FotoCartella::azzera()
+{
+    _numero = 0;
+    _omesse = 0;
+    _usati = 0;
+}
+
+bool FotoCartella::aggiungi(const char* nome, uint32_t dimensione, uint32_t data)
+{
+    uint32_t lunghezza = strlen(nome) + 1;
+    if (_numero == _massimo || _usati + lunghezza > _spazio)
+    {
+        _omesse++;
+        return false;
+    }
+    memcpy(_nomi + _usati, nome, lunghezza);
+    _voci[_numero].nome = _usati;
+    _voci[_numero].dimensione = dimensione;
+    _voci[_numero].data = data;
+    _usati += lunghezza;
+    _numero++;
+    return true;
+}
+
+void FotoCartella::ordina(OrdineCartella ordine)
+{
+    _ordine = ordine;
+    const char* nomi = _nomi;
+    // A parità di data o dimensione decide il nome: l'ordine non dipende da quello della readdir
+    std::sort(_voci, _voci + _numero, [ordine, nomi](const VoceCartella& a, const VoceCartella& b) {
+        if (ordine == ORDINE_DATA && a.data != b.data)
+            return a.data > b.data;
+        if (ordine == ORDINE_DIMENSIONE && a.dimensione != b.dimensione)
+            return a.dimensione > b.dimensione;
+        return strcasecmp(nomi + a.nome, nomi + b.nome) < 0;
+    });
+}
+
+int FotoCartella::cerca(const char* nome) const
+{
+    for (int i = 0; i < _numero; i++)
+    {
+        if (strcmp(_nomi + _voci[i].nome, nome) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int FotoCartella::getNumero() const
+{
+    return _numero;
+}
+
+int FotoCartella::getOmesse() const
+{
+    return _omesse;
+}
+
+const char* FotoCartella::getNome(int indice) const
+{
+    return _nomi + _voci[indice].nome;
+}
+
+uint32_t FotoCartella::getDimensione(int indice) const
+{
+    return _voci[indice].dimensione;
+}
+
+uint32_t FotoCartella::getData(int indice) const
+{
+    return _voci[indice].data;
+}
+
+OrdineCartella FotoCartella::getOrdine() const
+{
+    return _ordine;
+}
@@ -0,0 +1,61 @@
+/*
+  FotoCartella.h
+  Fotografia di una cartella per l'elenco file di Memoria: nome, dimensione e
+  data di ogni file, letti una volta sola all'ingresso (chi la riempie fa la
+  readdir e le stat). Spostare la selezione e disegnare una riga non toccano
+  più il filesystem; la fotografia si rifà solo quando Memoria la invalida
+  (scritture nostre, chiavetta tolta o reinserita).
+  I nomi stanno tutti in un unico spazio, senza allocazioni per voce; le
+  memorie le fornisce chi la usa (Memoria le prende in SDRAM).
+  Solo C++ standard, compilabile anche su PC.
+*/
+#ifndef FOTO_CARTELLA_H
+#define FOTO_CARTELLA_H
+
+#include <stdint.h>
+
+enum OrdineCartella {
+    ORDINE_NOME,
+    ORDINE_DATA,        // Più recenti in cima
+    ORDINE_DIMENSIONE,  // Più grandi in cima
+    NUMERO_ORDINI
+};
+
+struct VoceCartella {
+    uint32_t nome;      // Posizione del nome nello spazio dei nomi
+    uint32_t dimensione;
+    uint32_t data;      // st_mtime
+};
+
+class FotoCartella {
+public:
+    FotoCartella();
+
+    // Memorie per massimo voci e spazio byte di nomi (terminatori compresi)
+    void begin(VoceCartella* voci, int massimo, char* nomi, uint32_t spazio);
+
+    void azzera();      // Nuova lettura: vuota e valida
+    // false se le voci o lo spazio dei nomi sono finiti (la voce si conta in getOmesse())
+    bool aggiungi(const char* nome, uint32_t dimensione, uint32_t data);
+    void ordina(OrdineCartella ordine);
+    int cerca(const char* nome) const; // Indice della voce con quel nome, -1 se non c'è
+
+    int getNumero() const;
+    int getOmesse() const;
+    const char* getNome(int indice) const;
+    uint32_t getDimensione(int indice) const;
+    uint32_t getData(int indice) const;
+    OrdineCartella getOrdine() const;
+
+private:
+    VoceCartella* _voci;
+    int _massimo;
+    char* _nomi;
+    uint32_t _spazio;
+    int _numero;
+    int _omesse;
+    uint32_t _usati;
+    OrdineCartella _ordine;
+};
+
+#endif
@@ -0,0 +1,169 @@
+// Kicco972.net
+
+
+#include "FusioneAhrs.h"
+
+// Inverso della radice quadrata (0 se il vettore è nullo)
+static float invRadice(float x)
+{
+    return (x > 0.0f) ? 1.0f / sqrtf(x) : 0.0f;
+}
+
+FusioneAhrs::FusioneAhrs(float frequenzaHz, float beta) : _q(Quaternione::identita()), _beta(beta), _periodo(1.0f / frequenzaHz) {}
+
+void FusioneAhrs::setFrequenza(float frequenzaHz)
+{
+    _periodo = 1.0f / frequenzaHz;
+}
+
+float FusioneAhrs::getPeriodo() const
+{
+    return _periodo;
+}
+
+void FusioneAhrs::setBeta(float beta)
+{
+    _beta = beta;
+}
+
+void FusioneAhrs::reset()
+{
+    _q = Quaternione::identita();
+}
+
+void FusioneAhrs::aggiornaImu(float gx, float gy, float gz, float ax, float ay, float az)
+{
+    float q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+
+    // Derivata del quaternione dovuta al giroscopio
+    float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    // Correzione con la gravità (solo se l'accelerometro ha una lettura valida)
+    float n = invRadice(ax * ax + ay * ay + az * az);
+    if (n > 0.0f)
+    {
+        ax *= n;
+        ay *= n;
+        az *= n;
+
+        float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+        float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+        float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+        float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+        // Passo di discesa del gradiente
+        float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+
+        float ns = invRadice(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        qDot0 -= _beta * s0 * ns;
+        qDot1 -= _beta * s1 * ns;
+        qDot2 -= _beta * s2 * ns;
+        qDot3 -= _beta * s3 * ns;
+    }
+
+    // Integrazione con il periodo fisso
+    _q.w = q0 + qDot0 * _periodo;
+    _q.x = q1 + qDot1 * _periodo;
+    _q.y = q2 + qDot2 * _periodo;
+    _q.z = q3 + qDot3 * _periodo;
+    _q.normalizza();
+}
+
+void FusioneAhrs::aggiorna(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
+{
+    float nm = invRadice(mx * mx + my * my + mz * mz);
+    float na = invRadice(ax * ax + ay * ay + az * az);
+
+    // Senza magnetometro (o accelerometro) valido si ricade nella versione a 6 assi
+    if (nm == 0.0f || na == 0.0f)
+    {
+        aggiornaImu(gx, gy, gz, ax, ay, az);
+        return;
+    }
+
+    float q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+
+    float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    ax *= na;
+    ay *= na;
+    az *= na;
+    mx *= nm;
+    my *= nm;
+    mz *= nm;
+
+    float _2q0mx = 2.0f * q0 * mx, _2q0my = 2.0f * q0 * my, _2q0mz = 2.0f * q0 * mz, _2q1mx = 2.0f * q1 * mx;
+    float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+    float _2q0q2 = 2.0f * q0 * q2, _2q2q3 = 2.0f * q2 * q3;
+    float q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+    float q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+    float q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+
+    // Direzione di riferimento del campo magnetico terrestre (solo componenti orizzontale e verticale)
+    float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+    float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+    float _2bx = sqrtf(hx * hx + hy * hy);
+    float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+    float _4bx = 2.0f * _2bx;
+    float _4bz = 2.0f * _2bz;
+
+    // Errori tra direzioni stimate e misurate (gravità e campo magnetico)
+    float ex = 2.0f * q1q3 - _2q0q2 - ax;
+    float ey = 2.0f * q0q1 + _2q2q3 - ay;
+    float ez = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+    float fx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+    float fy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+    float fz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+    // Passo di discesa del gradiente
+    float s0 = -_2q2 * ex + _2q1 * ey - _2bz * q2 * fx + (-_2bx * q3 + _2bz * q1) * fy + _2bx * q2 * fz;
+    float s1 = _2q3 * ex + _2q0 * ey - 4.0f * q1 * ez + _2bz * q3 * fx + (_2bx * q2 + _2bz * q0) * fy + (_2bx * q3 - _4bz * q1) * fz;
+    float s2 = -_2q0 * ex + _2q3 * ey - 4.0f * q2 * ez + (-_4bx * q2 - _2bz * q0) * fx + (_2bx * q1 + _2bz * q3) * fy + (_2bx * q0 - _4bz * q2) * fz;
+    float s3 = _2q1 * ex + _2q2 * ey + (-_4bx * q3 + _2bz * q1) * fx + (-_2bx * q0 + _2bz * q2) * fy + _2bx * q1 * fz;
+
+    float ns = invRadice(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+    qDot0 -= _beta * s0 * ns;
+    qDot1 -= _beta * s1 * ns;
+    qDot2 -= _beta * s2 * ns;
+    qDot3 -= _beta * s3 * ns;
+
+    _q.w = q0 + qDot0 * _periodo;
+    _q.x = q1 + qDot1 * _periodo;
+    _q.y = q2 + qDot2 * _periodo;
+    _q.z = q3 + qDot3 * _periodo;
+    _q.normalizza();
+}
+
+const Quaternione& FusioneAhrs::getQuaternione() const
+{
+    return _q;
+}
+
+Matrice3 FusioneAhrs::getMatrice() const
+{
+    return _q.toMatrice();
+}
+
+void FusioneAhrs::getEulero(float& xDeg, float& yDeg, float& zDeg) const
+{
+    // Scomposizione R = Rz * Ry * Rx
+    Matrice3 r = _q.toMatrice();
+    float s = -r.m[2][0];
+    if (s > 1.0f)
+        s = 1.0f;
+    if (s < -1.0f)
+        s = -1.0f;
+    const float RAD_DEG = 57.29577951308232f;
+    xDeg = atan2f(r.m[2][1], r.m[2][2]) * RAD_DEG;
+    yDeg = asinf(s) * RAD_DEG;
+    zDeg = atan2f(r.m[1][0], r.m[0][0]) * RAD_DEG;
+}
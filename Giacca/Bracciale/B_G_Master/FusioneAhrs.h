@@ -0,0 +1,39 @@
+/*
+  FusioneAhrs.h
+  Filtro di orientamento a quaternione (algoritmo di Madgwick) con periodo di campionamento fisso.
+  Accetta giroscopio + accelerometro e, opzionalmente, magnetometro.
+  Solo C++ standard (nessuna dipendenza Arduino), quindi compilabile e verificabile anche su PC.
+*/
+#ifndef FUSIONE_AHRS_H
+#define FUSIONE_AHRS_H
+
+#include "Matematica3D.h"
+
+class FusioneAhrs {
+public:
+    // frequenzaHz: frequenza fissa con cui verrà chiamato aggiorna*()
+    // beta: guadagno della correzione (più alto = converge prima ma più rumore)
+    FusioneAhrs(float frequenzaHz = 200.0f, float beta = 0.1f);
+
+    void setFrequenza(float frequenzaHz);
+    float getPeriodo() const;
+    void setBeta(float beta);
+    void reset(); // Torna all'orientamento identità
+
+    // Giroscopio in rad/s; accelerometro e magnetometro in unità qualsiasi (vengono normalizzati)
+    void aggiornaImu(float gx, float gy, float gz, float ax, float ay, float az);
+    void aggiorna(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
+
+    const Quaternione& getQuaternione() const;
+    Matrice3 getMatrice() const; // Rotazione corpo -> mondo
+
+    // Angoli attorno a X, Y, Z in gradi, stessa convenzione di Matrice3::daEulero
+    void getEulero(float& xDeg, float& yDeg, float& zDeg) const;
+
+private:
+    Quaternione _q;
+    float _beta;
+    float _periodo;
+};
+
+#endif
@@ -1,12 +1,34 @@
 // Kicco972.net
 
 
-#include "Imu3DVisualizer.h"
-
-// Instantiate the IMU on Wire1 (Correct for GIGA Display Shield)
-BoschSensorClass imu(Wire1);
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
 
-Imu3DVisualizer::Imu3DVisualizer() {}
+#include "Imu3DVisualizer.h"
+#include "Compositore.h"
+#if USA_CORE_M4 && defined(CORE_CM7)
+#include <RPC.h>
+#endif
+
+// Centro e raggio della sfera (spostata a destra per lasciare spazio al testo a sinistra)
+#define SFERA_CX 600
+#define SFERA_CY 240
+#define SFERA_R 100
+
+// Regione della sfera copiata dal canvas (termina sopra la prima riga di pulsanti, Y=330)
+#define CANVAS_X 460
+#define CANVAS_Y 120
+#define CANVAS_W 340
+#define CANVAS_H 210
+
+// Attesa del primo messaggio dell'M4 prima di ripiegare sul campionamento locale
+#define ATTESA_M4_MS 2000
+
+Imu3DVisualizer::Imu3DVisualizer() : _orientamento(Matrice3::identita()), _canvas(CANVAS_W, CANVAS_H), _vista(Matrice3::daEulero(VISTA_PITCH, VISTA_ROLL, VISTA_YAW))
+{
+  memset(&_comando, 0, sizeof(_comando));
+  memset(&_statoImu, 0, sizeof(_statoImu));
+}
 
 bool Imu3DVisualizer::begin()
 {
@@ -20,8 +42,30 @@ bool Imu3DVisualizer::begin()
   gigaDisplay.setTextColor(BIANCO);
   gigaDisplay.println("IMU Init...");
 
+#if USA_CORE_M4
+  // 2. Modalità doppio core: campionamento e fusione sull'M4
+  if (avviaM4())
+  {
+    if (!_statoImu.sensoreOk)
+    {
+      Serial.println("ERROR: IMU begin() failed on the M4!");
+      gigaDisplay.setTextColor(ROSSO);
+      gigaDisplay.setCursor(10, 60);
+      gigaDisplay.println("IMU FAIL!");
+      return false;
+    }
+    Serial.println("IMU: campionamento e fusione sull'M4.");
+    gigaDisplay.setTextColor(VERDE);
+    gigaDisplay.setCursor(10, 60);
+    gigaDisplay.println("IMU OK (M4)!");
+    delay(1000);
+    return true;
+  }
+  Serial.println("IMU: l'M4 non risponde, campionamento in locale.");
+#endif
+
   // 3. Start IMU
-  if (!imu.begin())
+  if (!_sensore.begin())
   {
     Serial.println("ERROR: IMU begin() failed on Wire1!");
     gigaDisplay.setTextColor(ROSSO);
@@ -36,7 +80,20 @@ bool Imu3DVisualizer::begin()
   gigaDisplay.println("IMU OK!");
   delay(1000);
 
-  lastUpdateMicros = micros();
+#ifdef IMU_BENCHMARK_FUSIONE
+  benchmarkFusione();
+#endif
+
+  // 4. La fusione gira all'ODR effettivo (FIFO hardware a 400 Hz o letture singole a 100 Hz)
+  _assetto.setFrequenza(_sensore.getFrequenza());
+  if (_sensore.isFifoAttiva())
+    Serial.println("IMU: FIFO hardware attiva a 400 Hz.");
+  else
+    Serial.println("IMU: FIFO non configurata, letture singole a 100 Hz.");
+
+  // Avvia il thread di campionamento: la frequenza non dipende più dal loop di disegno
+  if (!_sensore.avviaThread())
+    Serial.println("IMU: Thread di campionamento non avviato, lettura dal loop.");
 
   // Nota: Non disegniamo più l'UI qui perché verrà gestita dal Master
   // quando si passa alla modalità IMU.
@@ -50,31 +107,35 @@ bool accSuccess = false;
 
 void Imu3DVisualizer::tare()
 {
-  // 1. Resetta l'orientamento (Integratori) a zero
-  pitch = 0;
-  roll = 0;
-  yaw = 0;
-  
-  // Resetta gli offset visivi (ora gestiti resettando direttamente le variabili sopra)
-  pitchOffset = 0;
-  rollOffset = 0;
-  yawOffset = 0;
-
-  // 2. Calibra i sensori: Imposta il valore attuale come "Zero" (Bias)
-  // Aggiungiamo il valore corrente al bias esistente per permettere tare successive
-  if (accSuccess) {
-      accBiasX += dbg_ax;
-      accBiasY += dbg_ay;
-      accBiasZ += dbg_az;
+  // L'orientamento attuale diventa il nuovo "zero" e i valori attuali diventano i bias
+  // (vedi AssettoImu::tara). Sull'M4 la richiesta parte con il prossimo comando.
+  if (_suM4)
+  {
+    _comando.numeroTara++;
+    return;
   }
-  gyroBiasX += dbg_gx;
-  gyroBiasY += dbg_gy;
-  gyroBiasZ += dbg_gz;
-
-  // Resetta anche i filtri di smoothing per fermare eventuali inerzie residue
-  filt_gx = 0.0;
-  filt_gy = 0.0;
-  filt_gz = 0.0;
+  _assetto.tara();
+  pubblicaLocale();
+}
+
+void Imu3DVisualizer::setMagnetometro(float mx, float my, float mz, bool valido)
+{
+  _comando.magX = mx;
+  _comando.magY = my;
+  _comando.magZ = mz;
+  _comando.magValido = valido;
+  _assetto.setMagnetometro(mx, my, mz, valido);
+}
+
+void Imu3DVisualizer::setUsaMagnetometro(bool attivo)
+{
+  _comando.usaMagnetometro = attivo;
+  _assetto.setUsaMagnetometro(attivo);
+}
+
+bool Imu3DVisualizer::isUsaMagnetometro()
+{
+  return _comando.usaMagnetometro;
 }
 
 void Imu3DVisualizer::drawBackground()
@@ -92,290 +153,289 @@ void Imu3DVisualizer::drawBackground()
   gigaDisplay.print("RPY DEG:");
   gigaDisplay.setCursor(10, 110);
   gigaDisplay.print("INTENSITA': ");
+
+  // Lo schermo è stato appena pulito: niente da cancellare al primo frame
+  _ultimoFrameValido = false;
+  compositore.reset();
 }
 
-void Imu3DVisualizer::readImuData()
+bool Imu3DVisualizer::avviaM4()
 {
-  float ax, ay, az;
-  float gx, gy, gz;
-
-  // --- FORCE READ (Bypass available() check for debugging) ---
-  // If these return false, the variables ax/ay/az remain untouched.
-  // We initialize them to 0 to ensure we aren't using garbage memory.
-  ax = 0;
-  ay = 0;
-  az = 0;
-
-  // Attempt to read Accelerometer
-  // The library returns 1 (true) on success, 0 (false) on failure
-  if (imu.readAcceleration(ax, ay, az))
-  {
-    // Applica la calibrazione (Tare)
-    ax -= accBiasX;
-    ay -= accBiasY;
-    az -= accBiasZ;
-
-    accSuccess = true;
-    dbg_ax = ax;
-    dbg_ay = ay;
-    dbg_az = az; // Store for display
-  }
-  else
+#if USA_CORE_M4 && defined(CORE_CM7)
+  // L'area va preparata prima che l'M4 parta: l'M4 aspetta la firma
+  preparaAreaCondivisa();
+  _area = areaCondivisa();
+  RPC.begin(); // Avvia l'M4 (lo sketch deve essere stato caricato anche con target_core=cm4)
+
+  unsigned long inizio = millis();
+  while (millis() - inizio < ATTESA_M4_MS)
   {
-    accSuccess = false;
+    if (_area->statoImu.leggi(_statoImu, _sequenzaStato))
+    {
+      _suM4 = true;
+      applicaStato(_statoImu);
+      return true;
+    }
+    delay(10);
   }
 
-  // Attempt to read Gyroscope
-  if (imu.readGyroscope(gx, gy, gz))
+  // Nessuna risposta: se l'M4 partisse in ritardo non deve toccare Wire1
+  _comando.fermaM4 = true;
+  _area->comandoImu.pubblica(_comando);
+#endif
+  return false;
+}
+
+void Imu3DVisualizer::aggiorna()
+{
+  if (_suM4)
   {
-    // Applica la calibrazione (Tare)
-    gx -= gyroBiasX;
-    gy -= gyroBiasY;
-    gz -= gyroBiasZ;
-
-    // --- FILTRO LOW PASS (Smoothing) ---
-    // Riduce la sensibilità ai movimenti rapidi e il jitter
-    float alphaSmooth = 0.1; // 10% nuovo dato, 90% storico (Molto fluido/lento)
-    filt_gx = (filt_gx * (1.0 - alphaSmooth)) + (gx * alphaSmooth);
-    filt_gy = (filt_gy * (1.0 - alphaSmooth)) + (gy * alphaSmooth);
-    filt_gz = (filt_gz * (1.0 - alphaSmooth)) + (gz * alphaSmooth);
-
-    // Usa i valori filtrati per l'integrazione
-    gx = filt_gx;
-    gy = filt_gy;
-    gz = filt_gz;
-
-    dbg_gx = gx;
-    dbg_gy = gy;
-    dbg_gz = gz; // Store for display
-
-    // Calculate Delta Time safely
-    unsigned long currentMicros = micros();
-    // Force float division
-    float dt = (float)(currentMicros - lastUpdateMicros) / 1000000.0f;
-    lastUpdateMicros = currentMicros;
-
-    // Simple integration without deadzone to see if raw values exist
-    // Integrazione Giroscopio per orientamento (dps * secondi = gradi)
-    // Modifica: Asse X = Pitch, Asse Y = Roll, Asse Z = Yaw
-    pitch += gx * dt; // X -> Pitch
-    roll += gy * dt;  // Y -> Roll
-    yaw += gz * dt;
-
-    // --- FILTRO COMPLEMENTARE ---
-    // "Calcola il basso": Usiamo l'accelerometro (Gravità) per correggere il drift del giroscopio.
-    // L'accelerometro rileva la gravità (circa 9.81 m/s^2 o 1g sull'asse Z a riposo), che indica il "Sotto".
-    if (accSuccess)
+    // Comandi all'M4 (tara, magnetometro) e ultimo risultato pubblicato
+    _area->comandoImu.pubblica(_comando);
+
+    uint32_t precedente = _sequenzaStato;
+    StatoImuCondiviso s;
+    if (_area->statoImu.leggi(s, _sequenzaStato))
     {
-      // Calcolo angoli da accelerometro secondo la nuova mappatura
-      // Pitch (X): Rotazione attorno asse X -> atan2(ay, az)
-      float acc_pitch = atan2(ay, az) * RAD_TO_DEG;
-      // Roll (Y): Rotazione attorno asse Y -> atan2(-ax, ...)
-      float acc_roll = atan2(-ax, sqrt(ay * ay + az * az)) * RAD_TO_DEG;
-
-      float alpha = 0.98; // 98% Giroscopio, 2% Accelerometro
-      pitch = alpha * pitch + (1.0 - alpha) * acc_pitch;
-      roll = alpha * roll + (1.0 - alpha) * acc_roll;
+      // La sequenza avanza di 2 per messaggio: i salti sono risultati sovrascritti
+      _messaggiPersi += (_sequenzaStato - precedente) / 2 - 1;
+      applicaStato(s);
     }
+    return;
+  }
+
+  // Senza thread (avvio fallito) i campioni vengono letti qui
+  if (!_sensore.isThreadAttivo())
+    _sensore.campiona();
+
+  // Consumatore: fonde tutti i campioni arrivati dall'ultimo frame
+  CampioneImu c;
+  bool nuovi = false;
+  while (_sensore.estrai(c))
+  {
+    _assetto.fondi(c);
+    nuovi = true;
   }
+  if (nuovi)
+    pubblicaLocale();
 }
 
-Point3D Imu3DVisualizer::rotatePoint(Point3D p, float pitchDeg, float rollDeg, float yawDeg)
+void Imu3DVisualizer::pubblicaLocale()
 {
-  float pRad = pitchDeg * DEG_TO_RAD;
-  float rRad = rollDeg * DEG_TO_RAD;
-  float yRad = yawDeg * DEG_TO_RAD;
-
-  // X Rotation
-  float y1 = p.y * cos(pRad) - p.z * sin(pRad);
-  float z1 = p.y * sin(pRad) + p.z * cos(pRad);
-  float x1 = p.x;
-
-  // Y Rotation
-  float x2 = x1 * cos(rRad) + z1 * sin(rRad);
-  float z2 = -x1 * sin(rRad) + z1 * cos(rRad);
-  float y2 = y1;
-
-  // Z Rotation
-  float x3 = x2 * cos(yRad) - y2 * sin(yRad);
-  float y3 = x2 * sin(yRad) + y2 * cos(yRad);
-  float z3 = z2;
-
-  return {x3, y3, z3};
+  // Stesso messaggio che arriverebbe dall'M4: un solo percorso verso il disegno
+  StatoImuCondiviso s;
+  s.assetto = _assetto.getStato();
+  s.sensoreOk = true;
+  s.fifoAttiva = _sensore.isFifoAttiva();
+  s.campioniPersi = _sensore.getPersi();
+  s.frameSaltati = _sensore.getFrameSaltati();
+  s.burstFifo = _sensore.getBurst();
+  applicaStato(s);
 }
 
-void Imu3DVisualizer::drawSphere()
+void Imu3DVisualizer::applicaStato(const StatoImuCondiviso &s)
 {
-  int cx = 600; // Spostato a destra
-  int cy = 240; // Centro verticale (480/2)
-  int r = 100;
+  _statoImu = s;
+  const StatoAssetto &a = s.assetto;
 
-  // 1. Pulisci l'intera area della sfera per il nuovo frame
-  // Questo rimuove assi, vettori e la sfera precedente
-  gigaDisplay.fillCircle(cx, cy, r + 5, NERO);
+  _orientamento = a.relativo.toMatrice();
+  pitch = a.pitch;
+  roll = a.roll;
+  yaw = a.yaw;
 
-  // 2. Disegna Sfera Wireframe (3 Cerchi Ortogonali Rotanti)
-  uint16_t sphereColor = GRIGIO_SCURO;
-  float step = 15.0; // Risoluzione della sfera
+  accSuccess = a.accValido;
+  if (accSuccess)
+  {
+    dbg_ax = a.ax;
+    dbg_ay = a.ay;
+    dbg_az = a.az; // Store for display
+  }
+  dbg_gx = a.gx;
+  dbg_gy = a.gy;
+  dbg_gz = a.gz;
+}
+
+void Imu3DVisualizer::proiettaSfera(FrameSfera &f)
+{
+  int cx = SFERA_CX;
+  int cy = SFERA_CY;
 
-  // Calcola gli angoli effettivi sottraendo l'offset di tara
-  float p_imu = pitch - pitchOffset;
-  float r_imu = roll - rollOffset;
-  float y_imu = yaw - yawOffset;
+  // Una sola matrice per frame: rotazione IMU dal quaternione (Device -> World), poi vista fissa
+  // (World -> Screen), già scalata per il raggio. Ogni punto costa 9 moltiplicazioni-somme.
+  Matrice3 totale = (_vista * _orientamento) * (float)SFERA_R;
 
+  // 1. Sfera Wireframe (3 Cerchi Ortogonali Rotanti)
   for (int axis = 0; axis < 3; axis++)
   {
-    float prev_x = 0, prev_y = 0;
-    bool first = true;
-    for (float a = 0; a <= 360; a += step)
+    for (int i = 0; i < FrameSfera::PUNTI_CERCHIO; i++)
     {
-      float rad = a * DEG_TO_RAD;
-      float c = cos(rad) * r;
-      float s = sin(rad) * r;
-
-      Point3D p;
-      if (axis == 0)
-        p = {0, c, s}; // Piano YZ
-      else if (axis == 1)
-        p = {c, 0, s}; // Piano XZ
-      else
-        p = {c, s, 0}; // Piano XY
-
-      // 1. Applica rotazione IMU (Device -> World)
-      Point3D p_world = rotatePoint(p, p_imu, r_imu, y_imu);
-      // 2. Applica rotazione Vista Fissa (World -> Screen)
-      Point3D rot = rotatePoint(p_world, -30, -70, -60);
-      int sx = cx + (int)rot.x;
-      int sy = cy + (int)rot.y;
-
-      if (!first)
-        gigaDisplay.drawLine((int)prev_x, (int)prev_y, sx, sy, sphereColor);
-      prev_x = sx;
-      prev_y = sy;
-      first = false;
+      Point3D rot = totale * MESH_SFERA[axis][i];
+      f.cerchi[axis][i] = {(int16_t)(cx + (int)rot.x), (int16_t)(cy + (int)rot.y)};
     }
   }
 
-  // --- Asse X (N-S) Rosso ---
-  Point3D pN = {(float)r, 0, 0};
-  Point3D pS = {-(float)r, 0, 0};
-
-  // Rotazione N
-  Point3D pN_w = rotatePoint(pN, p_imu, r_imu, y_imu);
-  Point3D pN_rot = rotatePoint(pN_w, -30, -70, -60);
-  int nx = cx + (int)pN_rot.x;
-  int ny = cy + (int)pN_rot.y;
-
-  // Rotazione S
-  Point3D pS_w = rotatePoint(pS, p_imu, r_imu, y_imu);
-  Point3D pS_rot = rotatePoint(pS_w, -30, -70, -60);
-  int sx_pt = cx + (int)pS_rot.x;
-  int sy_pt = cy + (int)pS_rot.y;
-
-  gigaDisplay.drawLine(nx, ny, sx_pt, sy_pt, ROSSO);
-  gigaDisplay.setTextColor(ROSSO);
-  gigaDisplay.setCursor(nx + 10, ny);
-  gigaDisplay.print("x");
-
-  // --- Asse Y (W-E) Verde ---
-  Point3D pW = {0, (float)r, 0};
-  Point3D pE = {0, -(float)r, 0};
-
-  // Rotazione W
-  Point3D pW_w = rotatePoint(pW, p_imu, r_imu, y_imu);
-  Point3D pW_rot = rotatePoint(pW_w, -30, -70, -60);
-  int wx = cx + (int)pW_rot.x;
-  int wy = cy + (int)pW_rot.y;
-
-  // Rotazione E
-  Point3D pE_w = rotatePoint(pE, p_imu, r_imu, y_imu);
-  Point3D pE_rot = rotatePoint(pE_w, -30, -70, -60);
-  int ex = cx + (int)pE_rot.x;
-  int ey = cy + (int)pE_rot.y;
-
-  gigaDisplay.drawLine(wx, wy, ex, ey, VERDE);
-  gigaDisplay.setTextColor(VERDE);
-  gigaDisplay.setCursor(wx + 10, wy);
-  gigaDisplay.print("y");
-
-  // --- Asse Z (Alto-Basso) Blu ---
-  Point3D pAlto = {0, 0, (float)r};
-  Point3D pBasso = {0, 0, -(float)r};
-
-  // Rotazione Alto
-  Point3D pAlto_w = rotatePoint(pAlto, p_imu, r_imu, y_imu);
-  Point3D pAlto_rot = rotatePoint(pAlto_w, -30, -70, -60);
-  int ax = cx + (int)pAlto_rot.x;
-  int ay = cy + (int)pAlto_rot.y;
-
-  // Rotazione Basso
-  Point3D pBasso_w = rotatePoint(pBasso, p_imu, r_imu, y_imu);
-  Point3D pBasso_rot = rotatePoint(pBasso_w, -30, -70, -60);
-  int bx = cx + (int)pBasso_rot.x;
-  int by = cy + (int)pBasso_rot.y;
-
-  gigaDisplay.drawLine(ax, ay, bx, by, BLE);
-  gigaDisplay.setTextColor(BLE);
-  gigaDisplay.setCursor(ax + 10, ay);
-  gigaDisplay.print("z");
-
-  // --- Punti Cardinali Fissi (N = +X) ---
-  gigaDisplay.setTextColor(BIANCO);
-  gigaDisplay.setTextSize(2);
+  // 2. Punti Cardinali Fissi (stessa rotazione isometrica della sfera)
+  for (int i = 0; i < 6; i++)
+  {
+    Point3D rot = totale * MESH_CARDINALI[i];
+    f.cardinali[i] = {(int16_t)(cx + (int)rot.x), (int16_t)(cy + (int)rot.y)};
+  }
 
-  Point3D cardinalPoints[] = {
-      {(float)r, 0, 0},  // N (+X)
-      {-(float)r, 0, 0}, // S (-X)
-      {0, (float)r, 0},  // W (+Y)
-      {0, -(float)r, 0}, // E (-Y)
-      {0, 0, (float)r},  // Alto (+Z)
-      {0, 0, -(float)r}  // Basso (-Z)
-  };
+  // 3. Vettore accelerazione
+  // Scaliamo il vettore accelerazione (1g = 100px raggio)
+  // MODIFICA: Non applichiamo la rotazione IMU per lasciare il vettore "libero"
+  // Visualizziamo direttamente le componenti misurate nel sistema di vista
+  float accScale = 100.0;
+  Point3D accVec = {dbg_ax * accScale, dbg_ay * accScale, dbg_az * accScale};
+  Point3D accRot = _vista * accVec;
+  f.acc = {(int16_t)(cx + (int)accRot.x), (int16_t)(cy + (int)accRot.y)};
+}
+
+void Imu3DVisualizer::disegnaGeometria(Adafruit_GFX &g, const FrameSfera &f, bool cancella, int16_t ox, int16_t oy)
+{
+  // Con cancella = true ridisegna la stessa geometria in nero:
+  // si scrivono solo i pixel delle linee invece di riempire tutto il cerchio.
+  // (ox, oy) trasla le coordinate schermo in quelle della superficie g.
   const char *cardinalLabels[] = {"N", "S", "W", "E", "Alto", "Basso"};
+  const char *axisLabels[] = {"x", "y", "z"};
+  const uint16_t axisColors[] = {ROSSO, VERDE, BLE};
+
+  // Solo il disegno diretto sul pannello conta nei pixel del compositore
+  bool suPannello = (&g == &gigaDisplay);
+
+  // --- Sfera Wireframe ---
+  uint16_t sphereColor = cancella ? NERO : GRIGIO_SCURO;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    for (int i = 1; i < FrameSfera::PUNTI_CERCHIO; i++)
+    {
+      const Punto2D &a = f.cerchi[axis][i - 1];
+      const Punto2D &b = f.cerchi[axis][i];
+      g.drawLine(a.x + ox, a.y + oy, b.x + ox, b.y + oy, sphereColor);
+      if (suPannello)
+        compositore.aggiungiLinea(a.x, a.y, b.x, b.y);
+    }
+  }
+
+  g.setTextSize(2);
+
+  // --- Assi X (N-S) Rosso, Y (W-E) Verde, Z (Alto-Basso) Blu ---
+  for (int i = 0; i < 3; i++)
+  {
+    const Punto2D &a = f.cardinali[2 * i];
+    const Punto2D &b = f.cardinali[2 * i + 1];
+    uint16_t colore = cancella ? NERO : axisColors[i];
+    g.drawLine(a.x + ox, a.y + oy, b.x + ox, b.y + oy, colore);
+    g.setTextColor(colore);
+    g.setCursor(a.x + 10 + ox, a.y + oy);
+    g.print(axisLabels[i]);
+    if (suPannello)
+    {
+      compositore.aggiungiLinea(a.x, a.y, b.x, b.y);
+      compositore.aggiungiTesto(1, 2);
+    }
+  }
 
+  // --- Punti Cardinali ---
+  g.setTextColor(cancella ? NERO : BIANCO);
   for (int i = 0; i < 6; i++)
   {
-    // Stessa rotazione isometrica della sfera
-    // 1. Applica rotazione IMU
-    Point3D p_world = rotatePoint(cardinalPoints[i], p_imu, r_imu, y_imu);
-    // 2. Applica rotazione Vista
-    Point3D rot = rotatePoint(p_world, -30, -70, -60);
-    int sx = cx + (int)rot.x;
-    int sy = cy + (int)rot.y;
     // Centra il testo in base alla lunghezza (circa 12px per carattere con size 2)
     int len = strlen(cardinalLabels[i]);
-    gigaDisplay.setCursor(sx - (len * 6), sy - 6);
-    gigaDisplay.print(cardinalLabels[i]);
+    g.setCursor(f.cardinali[i].x - (len * 6) + ox, f.cardinali[i].y - 6 + oy);
+    g.print(cardinalLabels[i]);
+    if (suPannello)
+      compositore.aggiungiTesto(len, 2);
   }
 
-  // --- Acceleration Vector Logic ---
-  // Scaliamo il vettore accelerazione (1g = 100px raggio)
-  float accScale = 100.0;
-  Point3D accVec = {dbg_ax * accScale, dbg_ay * accScale, dbg_az * accScale};
-  
-  // Ruota vettore accelerazione (Body -> Screen)
-  // MODIFICA: Non applichiamo la rotazione IMU per lasciare il vettore "libero"
-  // Visualizziamo direttamente le componenti misurate nel sistema di vista
-  Point3D accRot = rotatePoint(accVec, -30, -70, -60);
+  // --- Vettore accelerazione (Giallo) ---
+  g.drawLine(SFERA_CX + ox, SFERA_CY + oy, f.acc.x + ox, f.acc.y + oy, cancella ? NERO : GIALLO);
+  if (suPannello)
+    compositore.aggiungiLinea(SFERA_CX, SFERA_CY, f.acc.x, f.acc.y);
+}
+
+void Imu3DVisualizer::benchmarkFusione()
+{
+  // Costo di un passo del filtro, per verificare il margine a qualche centinaio di Hz
+  const int PASSI = 2000;
+  FusioneAhrs f(FREQUENZA_FUSIONE, BETA_FUSIONE);
+
+  unsigned long t0 = micros();
+  for (int i = 0; i < PASSI; i++)
+    f.aggiornaImu(0.01f * (i % 7), -0.02f, 0.03f, 0.05f, -0.02f, 0.98f);
+  unsigned long t6 = micros() - t0;
+
+  t0 = micros();
+  for (int i = 0; i < PASSI; i++)
+    f.aggiorna(0.01f * (i % 7), -0.02f, 0.03f, 0.05f, -0.02f, 0.98f, 22.0f, -5.0f, -40.0f);
+  unsigned long t9 = micros() - t0;
+
+  Serial.print("Benchmark fusione (");
+  Serial.print(PASSI);
+  Serial.println(" passi):");
+  Serial.print("  6 assi: ");
+  Serial.print((float)t6 / PASSI, 2);
+  Serial.println(" us/passo");
+  Serial.print("  9 assi: ");
+  Serial.print((float)t9 / PASSI, 2);
+  Serial.println(" us/passo");
+}
 
-  int newAccX = cx + (int)accRot.x;
-  int newAccY = cy + (int)accRot.y;
+void Imu3DVisualizer::drawSphere()
+{
+  unsigned long inizioFrame = micros();
 
-  gigaDisplay.setTextSize(2);
+  // 1. Proietta la geometria del nuovo frame
+  FrameSfera nuovo;
+  proiettaSfera(nuovo);
 
-  // Disegna nuovo vettore accelerazione (Giallo)
-  gigaDisplay.drawLine(cx, cy, newAccX, newAccY, GIALLO);
+  if (_canvasMode)
+  {
+    // 2a. Modalità canvas: tutto il frame viene composto in RAM
+    _canvas.fillScreen(NERO);
+    disegnaGeometria(_canvas, nuovo, false, -CANVAS_X, -CANVAS_Y);
+  }
+  else if (_ultimoFrameValido)
+  {
+    // 2b. Modalità diretta: cancella il frame precedente ridisegnandolo in nero
+    // (sostituisce il vecchio fillCircle di raggio 105 ad ogni frame)
+    disegnaGeometria(gigaDisplay, _ultimoFrame, true, 0, 0);
+  }
 
   // --- DEBUG DASHBOARD (Update every 100ms) ---
   static unsigned long lastTxt = 0;
-  if (millis() - lastTxt > 100)
+  bool aggiornaTesto = (millis() - lastTxt > 100);
+  if (aggiornaTesto)
   {
     lastTxt = millis();
+    // Invalida solo le tre righe di valori (size 2 = 16 px di altezza)
+    // Larghezza 360 per non cancellare la sfera
+    compositore.invalida(120, 30, 360, 16);
+    compositore.invalida(120, 70, 360, 16);
+    compositore.invalida(120, 110, 360, 16);
+  }
+  compositore.flush(NERO);
 
-    // Clear value areas
-    // Riduciamo la larghezza per non cancellare la sfera
-    // MODIFICA: Aumentata larghezza a 360 per evitare sovrapposizione testo
-    gigaDisplay.fillRect(120, 30, 360, 120, NERO);
+  // 3. Porta il nuovo frame sul pannello
+  if (_canvasMode)
+  {
+    // Un solo trasferimento per l'intera regione della sfera
+    _canvas.blit(gigaDisplay, CANVAS_X, CANVAS_Y);
+    compositore.aggiungiPixel((uint32_t)CANVAS_W * CANVAS_H);
+  }
+  else
+  {
+    // Disegna il nuovo frame e lo memorizza per la cancellazione successiva
+    disegnaGeometria(gigaDisplay, nuovo, false, 0, 0);
+    _ultimoFrame = nuovo;
+    _ultimoFrameValido = true;
+  }
+
+  if (aggiornaTesto)
+  {
+    float p_imu = pitch;
+    float r_imu = roll;
+    float y_imu = yaw;
 
     gigaDisplay.setTextSize(2);
 
@@ -409,11 +469,94 @@ void Imu3DVisualizer::drawSphere()
     gigaDisplay.setTextColor(GIALLO);
     gigaDisplay.print(magnitude, 2);
     gigaDisplay.print(" g");
+
+    compositore.aggiungiTesto(30 + 20 + 6, 2);
+  }
+
+  compositore.fineFrame("IMU");
+  misuraFrame(micros() - inizioFrame);
+}
+
+void Imu3DVisualizer::misuraFrame(unsigned long durata)
+{
+  _tempoFrameAccumulato += durata;
+  _frameMisurati++;
+
+  // Report periodico del tempo medio di frame nella modalità attiva
+  if (millis() - _ultimoReportTempo >= 5000)
+  {
+    Serial.print("IMU [");
+    Serial.print(_canvasMode ? "canvas" : "diretto");
+    Serial.print("]: frame medio ");
+    Serial.print(_tempoFrameAccumulato / _frameMisurati);
+    Serial.print(" us su ");
+    Serial.print(_frameMisurati);
+    Serial.print(" frame, ");
+    Serial.print(_statoImu.assetto.campioniFusi - _campioniUltimoReport);
+    Serial.print(_suM4 ? " campioni fusi (M4), " : " campioni fusi, ");
+    Serial.print(_statoImu.campioniPersi);
+    Serial.print(" persi in totale");
+    if (_statoImu.fifoAttiva)
+    {
+      Serial.print(", FIFO: ");
+      Serial.print(_statoImu.burstFifo - _burstUltimoReport);
+      Serial.print(" burst, ");
+      Serial.print(_statoImu.frameSaltati);
+      Serial.print(" frame saltati");
+    }
+    if (_suM4)
+    {
+      Serial.print(", messaggi M4 sovrascritti: ");
+      Serial.print(_messaggiPersi);
+    }
+    Serial.println();
+    _campioniUltimoReport = _statoImu.assetto.campioniFusi;
+    _burstUltimoReport = _statoImu.burstFifo;
+
+    _tempoFrameAccumulato = 0;
+    _frameMisurati = 0;
+    _ultimoReportTempo = millis();
   }
 }
 
+void Imu3DVisualizer::setCanvasMode(bool attivo)
+{
+  if (attivo == _canvasMode)
+    return;
+
+  if (attivo)
+  {
+    // Il buffer viene allocato solo al primo utilizzo
+    if (!_canvas.begin())
+      return;
+
+    // Rimuove il frame disegnato direttamente, anche la parte fuori dalla regione del canvas
+    if (_ultimoFrameValido)
+      disegnaGeometria(gigaDisplay, _ultimoFrame, true, 0, 0);
+  }
+  else
+  {
+    // Pulisce la regione lasciata dall'ultimo blit
+    gigaDisplay.fillRect(CANVAS_X, CANVAS_Y, CANVAS_W, CANVAS_H, NERO);
+  }
+
+  _ultimoFrameValido = false;
+  _canvasMode = attivo;
+
+  // Riparte la misura per non mescolare le due modalità
+  _tempoFrameAccumulato = 0;
+  _frameMisurati = 0;
+  _ultimoReportTempo = millis();
+}
+
+bool Imu3DVisualizer::isCanvasMode()
+{
+  return _canvasMode;
+}
+
 void Imu3DVisualizer::updateAndDraw()
 {
-  readImuData();
   drawSphere();
-}
\ No newline at end of file
+}
+
+#endif // CORE_CM4
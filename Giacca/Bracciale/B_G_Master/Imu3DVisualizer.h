@@ -2,9 +2,18 @@
 #define IMU3DVISUALIZER_H
 
 #include <Arduino.h>
-#include <Arduino_BMI270_BMM150.h>
 #include <Arduino_GigaDisplay_GFX.h> 
-#include <Wire.h>
+#include "CanvasRam.h"
+#include "Matematica3D.h"
+#include "MeshSfera.h"
+#include "SensoreImu.h"
+#include "AssettoImu.h"
+#include "MemoriaCondivisa.h"
+
+// Decommentare per stampare su Serial, all'avvio, il costo di un passo del filtro
+// di fusione (6 e 9 assi). Il confronto trigonometria per punto / matrice per frame
+// gira su PC (TestPc/BenchRotazione.cpp)
+// #define IMU_BENCHMARK_FUSIONE
 
 // Definizione dei colori
 #define CIANO 0x07FF
@@ -23,50 +32,82 @@
 // Reference to the display object defined in the main sketch
 extern GigaDisplay_GFX gigaDisplay; 
 
-struct Point3D {
-    float x;
-    float y;
-    float z;
+// Punto proiettato sullo schermo
+struct Punto2D {
+    int16_t x;
+    int16_t y;
+};
+
+// Geometria di un frame della sfera già proiettata sullo schermo
+struct FrameSfera {
+    static const int PUNTI_CERCHIO = PUNTI_CERCHIO_SFERA;
+    Punto2D cerchi[3][PUNTI_CERCHIO];    // Wireframe: piani YZ, XZ, XY
+    Punto2D cardinali[6];                // N, S, W, E, Alto, Basso (anche estremi degli assi)
+    Punto2D acc;                         // Punta del vettore accelerazione
 };
 
 class Imu3DVisualizer {
 public:
     Imu3DVisualizer();
     bool begin();
-    void updateAndDraw();
+    void aggiorna();      // Fonde i campioni arrivati (o legge il risultato dell'M4), da chiamare ad ogni loop
+    void updateAndDraw(); // Disegna la sfera con l'orientamento corrente
     void drawBackground(); // Nuovo metodo per disegnare gli elementi statici
     void tare(); // Imposta l'orientamento attuale come zero
 
+    // Modalità canvas: la sfera viene disegnata in un buffer in RAM e copiata in un colpo solo
+    void setCanvasMode(bool attivo);
+    bool isCanvasMode();
+
+    // Magnetometro remoto (BMM150 del Nano Sense ricevuto via BLE), opzionale nella fusione
+    void setMagnetometro(float mx, float my, float mz, bool valido);
+    void setUsaMagnetometro(bool attivo);
+    bool isUsaMagnetometro();
+
 private:
-    // Current orientation
+    // Current orientation (relativa alla tara, solo per la visualizzazione numerica)
     float pitch = 0.0;
     float roll = 0.0;
     float yaw = 0.0;
 
-    // Offsets for Tare
-    float pitchOffset = 0.0;
-    float rollOffset = 0.0;
-    float yawOffset = 0.0;
-
-    // Biases for Sensor Calibration (Tare)
-    float accBiasX = 0.0;
-    float accBiasY = 0.0;
-    float accBiasZ = 0.0;
-    float gyroBiasX = 0.0;
-    float gyroBiasY = 0.0;
-    float gyroBiasZ = 0.0;
-
-    // Variabili per il filtro Low Pass del giroscopio (Smoothing)
-    float filt_gx = 0.0;
-    float filt_gy = 0.0;
-    float filt_gz = 0.0;
-
-    // Timing for physics integration
-    unsigned long lastUpdateMicros = 0;
-
-    Point3D rotatePoint(Point3D p, float pitch, float roll, float yaw);
-    void readImuData();
+    Matrice3 _orientamento;               // Rotazione Device -> World relativa alla tara
+
+    // Campionamento e fusione: sull'M7 (thread + coda) oppure sull'M4 (caselle in SRAM4)
+    SensoreImu _sensore;
+    AssettoImu _assetto;
+    bool _suM4 = false;
+    AreaCondivisa* _area = nullptr;
+    ComandoImuCondiviso _comando;         // Tara e magnetometro (inviati all'M4 o applicati qui)
+    uint32_t _sequenzaStato = 0;          // Ultimo messaggio letto dall'M4
+    uint32_t _messaggiPersi = 0;          // Messaggi dell'M4 sovrascritti prima di essere letti
+    StatoImuCondiviso _statoImu;          // Ultimo risultato, da qualunque core arrivi
+    uint32_t _campioniUltimoReport = 0;
+    uint32_t _burstUltimoReport = 0;
+
+    // Ultimo frame disegnato: viene cancellato ridisegnandolo in nero
+    FrameSfera _ultimoFrame;
+    bool _ultimoFrameValido = false;
+
+    // Double buffering della regione della sfera
+    CanvasRam _canvas;
+    bool _canvasMode = false;
+
+    // Misura del tempo di frame (per confrontare le due modalità)
+    unsigned long _tempoFrameAccumulato = 0;
+    uint32_t _frameMisurati = 0;
+    unsigned long _ultimoReportTempo = 0;
+
+    // Rotazione fissa della vista (World -> Screen), costruita una sola volta
+    Matrice3 _vista;
+
+    void benchmarkFusione();
+    bool avviaM4();
+    void applicaStato(const StatoImuCondiviso& s);
+    void pubblicaLocale();
     void drawSphere();
+    void proiettaSfera(FrameSfera& f);
+    void disegnaGeometria(Adafruit_GFX& g, const FrameSfera& f, bool cancella, int16_t ox, int16_t oy);
+    void misuraFrame(unsigned long durata);
 };
 
 #endif // IMU3DVISUALIZER_H
\ No newline at end of file
@@ -0,0 +1,118 @@
+// Kicco972.net
+
+
+#include "IndiceRighe.h"
+#include <stdio.h>
+#include <string.h>
+
+IndiceRighe::IndiceRighe()
+    : _numeroVoci(0), _passo(PASSO_INDICE_INIZIALE), _righe(0), _letti(0), _completo(true), _rigaAperta(false)
+{
+    _percorso[0] = '\0';
+}
+
+void IndiceRighe::begin(const char* percorso)
+{
+    strncpy(_percorso, percorso, sizeof(_percorso) - 1);
+    _percorso[sizeof(_percorso) - 1] = '\0';
+    _voci[0] = 0;
+    _numeroVoci = 1;
+    _passo = PASSO_INDICE_INIZIALE;
+    _righe = 0;
+    _letti = 0;
+    _completo = false;
+    _rigaAperta = false;
+}
+
+bool IndiceRighe::costruisci(long byteMassimi)
+{
+    if (_completo)
+        return false;
+
+    // Il file si riapre a ogni pezzo: intanto può essere scritto da altri (es. esportazione)
+    FILE* f = fopen(_percorso, "r");
+    if (!f || fseek(f, _letti, SEEK_SET) != 0)
+    {
+        // File sparito: l'indice resta quello costruito fin qui
+        if (f)
+            fclose(f);
+        _completo = true;
+        return true;
+    }
+
+    char buf[512];
+    long daLeggere = byteMassimi;
+    while (daLeggere > 0)
+    {
+        size_t letti = fread(buf, 1, daLeggere < (long)sizeof(buf) ? (size_t)daLeggere : sizeof(buf), f);
+        if (letti == 0)
+        {
+            _completo = true;
+            break;
+        }
+        for (size_t i = 0; i < letti; i++)
+        {
+            if (buf[i] == '\n')
+                nuovaRiga((uint32_t)(_letti + i + 1));
+        }
+        _rigaAperta = buf[letti - 1] != '\n';
+        _letti += letti;
+        daLeggere -= letti;
+    }
+    fclose(f);
+    return _completo;
+}
+
+bool IndiceRighe::isCompleto() const
+{
+    return _completo;
+}
+
+uint32_t IndiceRighe::getRighe() const
+{
+    // L'ultima riga senza '\n' conta solo a file finito: prima potrebbe essere ancora da leggere
+    return _righe + (_completo && _rigaAperta ? 1 : 0);
+}
+
+long IndiceRighe::getByteLetti() const
+{
+    return _letti;
+}
+
+uint32_t IndiceRighe::getPasso() const
+{
+    return _passo;
+}
+
+long IndiceRighe::cerca(uint32_t riga, uint32_t& rigaVoce) const
+{
+    if (_numeroVoci == 0)
+    {
+        rigaVoce = 0;
+        return 0;
+    }
+    uint32_t voce = riga / _passo;
+    if (voce >= (uint32_t)_numeroVoci)
+        voce = _numeroVoci - 1;
+    rigaVoce = voce * _passo;
+    return _voci[voce];
+}
+
+// Fine riga trovato: la riga successiva comincia a posizione
+void IndiceRighe::nuovaRiga(uint32_t posizione)
+{
+    _righe++;
+    if (_righe % _passo != 0)
+        return;
+    if (_numeroVoci == VOCI_INDICE_RIGHE)
+    {
+        // Voci esaurite: una su due, passo doppio
+        for (int i = 0; i < VOCI_INDICE_RIGHE / 2; i++)
+            _voci[i] = _voci[2 * i];
+        _numeroVoci = VOCI_INDICE_RIGHE / 2;
+        _passo *= 2;
+        if (_righe % _passo != 0)
+            return;
+    }
+    _voci[_numeroVoci++] = posizione;
+}
@@ -0,0 +1,53 @@
+/*
+  IndiceRighe.h
+  Indice rado delle righe di un file di testo, per il visualizzatore di Memoria.
+  Una voce ogni "passo" righe con la posizione in byte dell'inizio riga: una
+  pagina qualsiasi si raggiunge con un solo fseek() e al più passo - 1 righe
+  da saltare, invece di leggere il file dall'inizio.
+  Si costruisce a pezzi (costruisci(), una volta per loop) dopo l'apertura;
+  finché non è completo copre solo la parte già letta. Con le voci esaurite
+  se ne tiene una su due e il passo raddoppia: la RAM resta VOCI_INDICE_RIGHE
+  posizioni qualunque sia la dimensione del file.
+  Solo C standard (stdio), compilabile anche su PC.
+*/
+#ifndef INDICE_RIGHE_H
+#define INDICE_RIGHE_H
+
+#include <stdint.h>
+
+#define VOCI_INDICE_RIGHE 2048         // 8 KB di RAM
+#define PASSO_INDICE_INIZIALE 8        // Righe tra due voci finché il file è piccolo
+#define PERCORSO_INDICE_MASSIMO 64
+
+class IndiceRighe {
+public:
+    IndiceRighe();
+
+    // Nuovo file: l'indice riparte da zero (il file si apre solo in costruisci())
+    void begin(const char* percorso);
+
+    // Legge al più byteMassimi dal punto raggiunto. true se questa chiamata ha completato l'indice
+    bool costruisci(long byteMassimi);
+
+    bool isCompleto() const;
+    uint32_t getRighe() const;         // Righe contate fin qui (tutte con l'indice completo)
+    long getByteLetti() const;
+    uint32_t getPasso() const;
+
+    // Voce più vicina non oltre riga: posizione in byte e numero della riga che comincia lì
+    long cerca(uint32_t riga, uint32_t& rigaVoce) const;
+
+private:
+    char _percorso[PERCORSO_INDICE_MASSIMO];
+    uint32_t _voci[VOCI_INDICE_RIGHE]; // _voci[i]: inizio della riga i * _passo
+    int _numeroVoci;
+    uint32_t _passo;
+    uint32_t _righe;                   // Fine riga trovati
+    long _letti;
+    bool _completo;
+    bool _rigaAperta;                  // Ultimo byte letto diverso da '\n'
+
+    void nuovaRiga(uint32_t posizione);
+};
+
+#endif
@@ -0,0 +1,153 @@
+/*
+  Matematica3D.h
+  Piccolo livello di algebra lineare per la grafica 3D e la fusione IMU:
+  vettore 3D, matrice di rotazione 3x3 e quaternione.
+  Solo C++ standard (nessuna dipendenza Arduino), quindi compilabile anche su PC.
+*/
+#ifndef MATEMATICA_3D_H
+#define MATEMATICA_3D_H
+
+#include <math.h>
+
+#define M3D_DEG_TO_RAD 0.017453292519943295f
+#define M3D_RAD_TO_DEG 57.29577951308232f
+
+struct Point3D {
+    float x;
+    float y;
+    float z;
+};
+
+// Matrice 3x3 (righe x colonne). Ruotare un punto costa 9 moltiplicazioni-somme.
+struct Matrice3 {
+    float m[3][3];
+
+    static Matrice3 identita()
+    {
+        Matrice3 r = {{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+        return r;
+    }
+
+    // Rotazioni elementari (angolo in radianti)
+    static Matrice3 rotazioneX(float rad)
+    {
+        float c = cosf(rad), s = sinf(rad);
+        Matrice3 r = {{{1, 0, 0}, {0, c, -s}, {0, s, c}}};
+        return r;
+    }
+
+    static Matrice3 rotazioneY(float rad)
+    {
+        float c = cosf(rad), s = sinf(rad);
+        Matrice3 r = {{{c, 0, s}, {0, 1, 0}, {-s, 0, c}}};
+        return r;
+    }
+
+    static Matrice3 rotazioneZ(float rad)
+    {
+        float c = cosf(rad), s = sinf(rad);
+        Matrice3 r = {{{c, -s, 0}, {s, c, 0}, {0, 0, 1}}};
+        return r;
+    }
+
+    // Stessa convenzione del vecchio rotatePoint (vedi TestPc/BenchRotazione.cpp): prima X (pitch), poi Y (roll), poi Z (yaw)
+    static Matrice3 daEulero(float pitchDeg, float rollDeg, float yawDeg)
+    {
+        return rotazioneZ(yawDeg * M3D_DEG_TO_RAD) *
+               rotazioneY(rollDeg * M3D_DEG_TO_RAD) *
+               rotazioneX(pitchDeg * M3D_DEG_TO_RAD);
+    }
+
+    Matrice3 operator*(const Matrice3& b) const
+    {
+        Matrice3 r;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+        return r;
+    }
+
+    Matrice3 operator*(float k) const
+    {
+        Matrice3 r;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                r.m[i][j] = m[i][j] * k;
+        return r;
+    }
+
+    Point3D operator*(const Point3D& p) const
+    {
+        Point3D r = {
+            m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z,
+            m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z,
+            m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z};
+        return r;
+    }
+
+    Matrice3 trasposta() const
+    {
+        Matrice3 r;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                r.m[i][j] = m[j][i];
+        return r;
+    }
+};
+
+// Quaternione unitario per rappresentare l'orientamento senza gimbal lock
+struct Quaternione {
+    float w;
+    float x;
+    float y;
+    float z;
+
+    static Quaternione identita()
+    {
+        Quaternione q = {1, 0, 0, 0};
+        return q;
+    }
+
+    Quaternione operator*(const Quaternione& b) const
+    {
+        Quaternione r = {
+            w * b.w - x * b.x - y * b.y - z * b.z,
+            w * b.x + x * b.w + y * b.z - z * b.y,
+            w * b.y - x * b.z + y * b.w + z * b.x,
+            w * b.z + x * b.y - y * b.x + z * b.w};
+        return r;
+    }
+
+    Quaternione coniugato() const
+    {
+        Quaternione r = {w, -x, -y, -z};
+        return r;
+    }
+
+    void normalizza()
+    {
+        float n = sqrtf(w * w + x * x + y * y + z * z);
+        if (n > 0.0f)
+        {
+            float k = 1.0f / n;
+            w *= k;
+            x *= k;
+            y *= k;
+            z *= k;
+        }
+    }
+
+    // Matrice di rotazione equivalente (corpo -> mondo)
+    Matrice3 toMatrice() const
+    {
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+        Matrice3 r = {{{1 - 2 * (yy + zz), 2 * (xy - wz), 2 * (xz + wy)},
+                       {2 * (xy + wz), 1 - 2 * (xx + zz), 2 * (yz - wx)},
+                       {2 * (xz - wy), 2 * (yz + wx), 1 - 2 * (xx + yy)}}};
+        return r;
+    }
+};
+
+#endif
@@ -1,120 +1,327 @@
 // Kicco972.net
 
 
-#include "Memoria.h"
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
 
-Memoria::Memoria() : _msd(nullptr), _fsUSB(nullptr), _qspi(nullptr), _fsQSPI(nullptr), _mounted(false), _selectedDrive(0), _viewingFiles(false), _viewingFileContent(false), _fileListIndex(0), _fileListScroll(0), _contentScrollLine(0), _lastFileCount(0) {}
+#include "Memoria.h"
+#include "Compositore.h"
+#include <SDRAM.h>
+
+// Canali su QSPI, nell'ordine di CANALE_*. fileSingolo: il registro di un file solo
+// delle versioni precedenti, che diventa il primo segmento dell'anello
+static const struct {
+    ConfigurazioneAnello anello;
+    const char* esportazione;
+    const char* fileSingolo;
+} CANALI[NUMERO_CANALI] = {
+    {{BASE_ARCHIVIO, SEGMENTO_ARCHIVIO, SEGMENTI_ARCHIVIO}, ESPORTAZIONE_ARCHIVIO, "/fs/Archivio.bin"},
+    {{BASE_STORICO, SEGMENTO_STORICO, SEGMENTI_STORICO}, ESPORTAZIONE_STORICO, "/fs/Storico.bin"},
+};
+
+Memoria::Memoria() : _qspi(nullptr), _profilo(nullptr), _fsQSPI(nullptr), _usbMontata(false), _versioneUsb(0), _ridisegnoUsb(false), _qspiMontata(false), _canaleEsportato(-1), _primoSegmento(0), _segmentoEsportato(0), _prossimoRecord(0), _recordDaEsportare(0), _recordEsportati(0), _recordScartati(0), _inizioEsportazione(0), _recordScritti(0), _byteCsv(0), _recordReport(0), _ultimoReport(0), _selectedDrive(0), _viewingFiles(false), _viewingFileContent(false), _fileListIndex(0), _fileListScroll(0), _contentScrollLine(0), _cartellaDrive(-1), _cartellaValida(false), _rigaPrecedente(-1), _fileRegistro(false), _righeFile(0), _dimensioneFile(0), _fineRichiesta(false), _ridisegno(false) {}
 
 bool Memoria::begin() {
-    // Istanzia il driver per USB Mass Storage e il FileSystem FAT
-    if (!_msd) _msd = new USBHostMSD();
-    if (!_fsUSB) _fsUSB = new mbed::FATFileSystem("usb");
-
-    // Inizializza anche la memoria interna QSPI
-    initQSPI();
-
+    // Inizializza anche la memoria interna QSPI: è lì l'archivio, la chiavetta serve solo per esportare
+    _qspiMontata = initQSPI();
+
+    // Fotografia delle cartelle in SDRAM, già inizializzata dalla libreria del display (vedi CanvasRam)
+    VoceCartella* voci = (VoceCartella*)SDRAM.malloc(MAX_FILE_CARTELLA * sizeof(VoceCartella));
+    char* nomi = (char*)SDRAM.malloc(SPAZIO_NOMI_CARTELLA);
+    if (!voci) voci = (VoceCartella*)malloc(MAX_FILE_CARTELLA * sizeof(VoceCartella));
+    if (!nomi) nomi = (char*)malloc(SPAZIO_NOMI_CARTELLA);
+    _cartella.begin(voci, MAX_FILE_CARTELLA, nomi, SPAZIO_NOMI_CARTELLA);
+
+    // La chiavetta si monta nel thread del servizio USB, appena inserita
+    _usb.begin();
     Serial.println("Memoria (USB): Inizializzata. In attesa di connessione...");
-    // Non blocchiamo qui. La connessione avverrà al primo utilizzo o in ensureConnection().
     return true;
 }
 
 bool Memoria::initQSPI() {
     if (!_qspi) _qspi = new QSPIFBlockDevice();
+    // LittleFS passa dal contatore: i byte davvero programmati danno l'amplificazione di scrittura
+    if (!_profilo) _profilo = new mbed::ProfilingBlockDevice(_qspi);
     if (!_fsQSPI) _fsQSPI = new mbed::LittleFileSystem("fs");
     
-    if (_qspi->init() != 0) {
+    if (_profilo->init() != 0) {
         Serial.println("Memoria (QSPI): Errore Init Hardware");
         return false;
     }
     
-    int err = _fsQSPI->mount(_qspi);
+    int err = _fsQSPI->mount(_profilo);
     if (err) {
         Serial.println("Memoria (QSPI): Mount fallito, formattazione...");
-        err = _fsQSPI->reformat(_qspi);
+        err = _fsQSPI->reformat(_profilo);
     }
     
-    if (err == 0) Serial.println("Memoria (QSPI): Montata correttamente su /fs/");
-    return (err == 0);
-}
-
-bool Memoria::ensureConnection() {
-    // Se già connesso, ritorna true
-    if (_msd->connected()) {
-        return true;
-    }
-
-    // Prova a connettere (non bloccante se il dispositivo non c'è, ma necessario per rilevarlo)
-    // Nota: connect() tenta di enumerare il dispositivo
-    if (_msd->connect()) {
-        Serial.println("Memoria (USB): Dispositivo rilevato!");
-        
-        // Monta il filesystem
-        int err = _fsUSB->mount(_msd);
-        if (err) {
-            Serial.print("Memoria (USB): Errore mount: ");
-            Serial.println(err);
-            return false;
+    if (err) return false;
+    Serial.println("Memoria (QSPI): Montata correttamente su /fs/");
+
+    // Apre gli anelli: solo il manifesto e la testa, i segmenti non si scorrono.
+    // Un anello che non si apre rifiuta le scritture, gli altri canali restano attivi
+    for (int i = 0; i < NUMERO_CANALI; i++) {
+        char primo[PERCORSO_ANELLO_MASSIMO];
+        AnelloRegistro::percorsoSegmento(CANALI[i].anello.base, 0, primo, sizeof(primo));
+        FILE *f = fopen(primo, "r");
+        if (f) fclose(f);
+        else rename(CANALI[i].fileSingolo, primo);
+
+        if (!_anelli[i].begin(CANALI[i].anello)) {
+            Serial.print("Memoria (QSPI): Anello non disponibile ");
+            Serial.println(CANALI[i].anello.base);
+            continue;
         }
-        _mounted = true;
-        return true;
+        Serial.print("Memoria (QSPI): ");
+        Serial.print(CANALI[i].anello.base);
+        Serial.print(", segmento ");
+        Serial.print(_anelli[i].getTesta());
+        Serial.print(" di ");
+        Serial.print(CANALI[i].anello.segmenti);
+        Serial.print(", ritenzione ");
+        Serial.print(_anelli[i].getRitenzione());
+        Serial.println(" record");
     }
-    return false;
+    return true;
 }
 
-bool Memoria::logData(String date, String time, float temp, float hum, float press) {
-    if (!ensureConnection()) return false;
-
-    // Controllo consistenza file: Se esiste un file con vecchio formato (virgole), lo sovrascriviamo
-    // per evitare conflitti di lettura in Excel.
-    const char* mode = "a+"; // Default: Append (Aggiungi in coda)
-    
-    FILE *f_check = fopen("/usb/Archivio.csv", "r");
-    if (f_check) {
-        char buffer[128];
-        if (fgets(buffer, sizeof(buffer), f_check)) {
-            String header = String(buffer);
-            // Se troviamo virgole ma non punti e virgola, è il vecchio formato
-            if (header.indexOf(',') != -1 && header.indexOf(';') == -1) {
-                Serial.println("Memoria: Formato CSV obsoleto rilevato. Rigenerazione file...");
-                mode = "w"; // Modalità "Write": Sovrascrive e crea un file nuovo pulito
-            }
+void Memoria::update() {
+    unsigned long adesso = millis();
+
+    // Chiavetta inserita, tolta o con nuovo spazio libero: lo stato arriva dal servizio USB
+    _usb.update();
+    const StatoUsb& usb = _usb.getStato();
+    if (usb.versione != _versioneUsb) {
+        _versioneUsb = usb.versione;
+        // Chiavetta tolta: le righe esportate in attesa restano in RAM, l'esportazione riprende al ritorno.
+        // Il servizio USB smonta il filesystem solo dopo la conferma, a file già chiusi
+        if (_usbMontata && !usb.montata) _esportazione.abbandona();
+        if (!usb.montata) _usb.confermaSmontaggio(usb.versione);
+        _usbMontata = usb.montata;
+        invalidaCartella(1); // Può essere un'altra chiavetta
+        if (!_viewingFiles || _selectedDrive == 1) _ridisegnoUsb = true;
+#ifdef MEMORIA_BENCHMARK_LOG
+        if (_usbMontata && _canaleEsportato < 0) benchmarkLog();
+#endif
+    }
+    if (_canaleEsportato >= 0 && _usbMontata) passoEsportazione();
+
+    // Indice del file aperto, a pezzi: il loop non si ferma neanche su un file grande
+    if (_viewingFileContent && !_fileRegistro && !_indice.isCompleto() && _indice.costruisci(BYTE_PER_PASSO_INDICE)) {
+        _righeFile = _indice.getRighe();
+        if (_fineRichiesta) {
+            _fineRichiesta = false;
+            scrollFileContentToEnd();
         }
-        fclose(f_check);
+        _ridisegno = true;
+#ifdef MEMORIA_BENCHMARK_INDICE
+        benchmarkIndice();
+#endif
     }
 
-    // Apre il file (Append o Write a seconda del controllo)
-    FILE *f = fopen("/usb/Archivio.csv", mode);
-    if (!f) {
-        Serial.println("Memoria: Impossibile aprire il file su USB.");
+    if (_recordScritti != _recordReport && adesso - _ultimoReport >= PERIODO_REPORT_MEMORIA_MS) {
+        stampaStatistiche();
+    }
+}
+
+bool Memoria::logData(time_t epoch, float temp, float hum, float press) {
+    CampioneStorico campione = {(uint32_t)epoch, temp, hum, press};
+    return scriviRegistro(CANALE_ARCHIVIO, &campione, 1);
+}
+
+bool Memoria::scriviStorico(const CampioneStorico* campioni, int numero) {
+    return scriviRegistro(CANALE_STORICO, campioni, numero);
+}
+
+bool Memoria::scriviRegistro(int canale, const CampioneStorico* campioni, int numero) {
+    if (!_qspiMontata) return false;
+
+    // Un'apertura per blocco: su LittleFS ogni chiusura consolida il file
+    if (!_anelli[canale].aggiungi(campioni, numero)) {
+        Serial.print("Memoria (QSPI): Errore scrittura ");
+        Serial.println(CANALI[canale].anello.base);
         return false;
     }
 
-    // Controlla se il file è nuovo (dimensione 0) per scrivere l'intestazione
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    if (size == 0) {
-        // Usa punto e virgola come separatore per compatibilità con Excel (formato europeo)
-        fprintf(f, "Data;Ora;Temperatura;Umidita;Pressione\n");
+    // Le stesse righe nel CSV, solo per il confronto dei byte per record
+    for (int i = 0; i < numero; i++) {
+        char riga[RIGA_LOG_MASSIMA];
+        const float valori[3] = {campioni[i].temperatura, campioni[i].umidita, campioni[i].pressione};
+        _byteCsv += ScrittoreLog::formattaRiga(riga, sizeof(riga), campioni[i].epoch, valori, 3);
+    }
+    _recordScritti += numero;
+    invalidaCartella(0);
+    return true;
+}
+
+// Ora dell'ultimo record dello storico (0 se vuoto): legge solo la coda del segmento di testa
+uint32_t Memoria::ultimoStorico() {
+    CampioneStorico c;
+    if (!_qspiMontata || !_anelli[CANALE_STORICO].ultimo(c)) return 0;
+    return c.epoch;
+}
+
+bool Memoria::esporta() {
+    if (_canaleEsportato >= 0) {
+        Serial.println("Memoria (USB): Esportazione già in corso.");
+        return false;
+    }
+    if (!_qspiMontata || !_usbMontata) {
+        Serial.println("Memoria (USB): Esportazione impossibile, chiavetta o QSPI assente.");
+        return false;
     }
+    Serial.println("Memoria (USB): Esportazione in corso...");
+    _recordEsportati = 0;
+    _recordScartati = 0;
+    _inizioEsportazione = millis();
+    _canaleEsportato = 0;
+    iniziaCanaleEsportato();
+    return true;
+}
 
-    // Converte i float in stringhe e sostituisce il punto con la virgola
-    // Questo risolve i problemi di interpretazione (es. data) in Excel italiano
-    String sTemp = String(temp, 2);
-    sTemp.replace('.', ',');
-    
-    String sHum = String(hum, 2);
-    sHum.replace('.', ',');
-    
-    String sPress = String(press, 2);
-    sPress.replace('.', ',');
+bool Memoria::isEsportazioneInCorso() {
+    return _canaleEsportato >= 0;
+}
 
-    // Scrive la riga di dati
-    fprintf(f, "%s;%s;%s;%s;%s\n", date.c_str(), time.c_str(), sTemp.c_str(), sHum.c_str(), sPress.c_str());
-    
-    // Chiude il file per salvare le modifiche
+// Il CSV si riscrive da capo, dal segmento più vecchio alla testa
+void Memoria::iniziaCanaleEsportato() {
+    const char* destinazione = CANALI[_canaleEsportato].esportazione;
+    remove(destinazione);
+    invalidaCartella(1);
+    _esportazione.begin(destinazione, INTESTAZIONE_CSV);
+    const AnelloRegistro& anello = _anelli[_canaleEsportato];
+    _primoSegmento = (anello.getTesta() + 1) % anello.getSegmenti();
+    _segmentoEsportato = 0;
+    iniziaSegmentoEsportato();
+}
+
+// Si esportano i record presenti adesso. Un segmento mai scritto non esiste e si salta
+void Memoria::iniziaSegmentoEsportato() {
+    const ConfigurazioneAnello& configurazione = CANALI[_canaleEsportato].anello;
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    AnelloRegistro::percorsoSegmento(configurazione.base, (_primoSegmento + _segmentoEsportato) % configurazione.segmenti, percorso, sizeof(percorso));
+    _prossimoRecord = 0;
+    _recordDaEsportare = 0;
+
+    FILE *f = fopen(percorso, "r");
+    if (!f) return;
+
+    uint8_t intestazione[REGISTRO_INTESTAZIONE];
+    size_t letti = fread(intestazione, 1, sizeof(intestazione), f);
+    if (verificaIntestazioneRegistro(intestazione, (int)letti)) {
+        fseek(f, 0, SEEK_END);
+        _recordDaEsportare = registroRecordInteri(ftell(f));
+    } else {
+        Serial.print("Memoria (QSPI): Formato sconosciuto, saltato ");
+        Serial.println(percorso);
+    }
     fclose(f);
-    Serial.println("Memoria: Dati salvati su USB.");
-    return true;
+}
+
+// Un passo per loop: RECORD_PER_PASSO_ESPORTAZIONE record dalla QSPI al buffer dello ScrittoreLog
+void Memoria::passoEsportazione() {
+    unsigned long adesso = millis();
+    _esportazione.update(adesso);
+
+    if (_prossimoRecord >= _recordDaEsportare && _segmentoEsportato + 1 < CANALI[_canaleEsportato].anello.segmenti) {
+        _segmentoEsportato++;
+        iniziaSegmentoEsportato();
+        return;
+    }
+    if (_prossimoRecord >= _recordDaEsportare) {
+        // Canale finito: tutto sulla chiavetta prima di passare al prossimo (altrimenti si riprova)
+        if (!_esportazione.chiudi(adesso)) return;
+        invalidaCartella(1);
+        Serial.print("Memoria (USB): Scritto ");
+        Serial.println(CANALI[_canaleEsportato].esportazione);
+
+        if (++_canaleEsportato < NUMERO_CANALI) {
+            iniziaCanaleEsportato();
+            return;
+        }
+        _canaleEsportato = -1;
+        Serial.print("Memoria (USB): Esportazione completata, ");
+        Serial.print(_recordEsportati);
+        Serial.print(" record (");
+        Serial.print(_recordScartati);
+        Serial.print(" scartati) in ");
+        Serial.print(millis() - _inizioEsportazione);
+        Serial.println(" ms");
+        stampaStatistiche();
+        _usb.ricalcolaSpazio();
+        return;
+    }
+
+    // Il segmento si riapre a ogni passo: intanto logData() e lo storico possono accodare
+    const ConfigurazioneAnello& configurazione = CANALI[_canaleEsportato].anello;
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    AnelloRegistro::percorsoSegmento(configurazione.base, (_primoSegmento + _segmentoEsportato) % configurazione.segmenti, percorso, sizeof(percorso));
+    FILE *f = fopen(percorso, "r");
+    if (!f) {
+        _recordDaEsportare = _prossimoRecord;
+        return;
+    }
+    uint8_t buf[RECORD_PER_PASSO_ESPORTAZIONE * REGISTRO_RECORD];
+    long numero = _recordDaEsportare - _prossimoRecord;
+    if (numero > RECORD_PER_PASSO_ESPORTAZIONE) numero = RECORD_PER_PASSO_ESPORTAZIONE;
+    long letti = 0;
+    if (fseek(f, registroPosizione(_prossimoRecord), SEEK_SET) == 0) {
+        letti = (long)fread(buf, REGISTRO_RECORD, numero, f);
+    }
+    fclose(f);
+    // Segmento più corto del previsto: riciclato dalla rotazione durante l'esportazione
+    if (letti < numero) _recordDaEsportare = _prossimoRecord + letti;
+
+    for (long i = 0; i < letti; i++) {
+        CampioneStorico c;
+        if (!decodificaRecordRegistro(buf + i * REGISTRO_RECORD, c)) {
+            _recordScartati++;
+            _prossimoRecord++;
+            continue;
+        }
+        char riga[RIGA_LOG_MASSIMA];
+        const float valori[3] = {c.temperatura, c.umidita, c.pressione};
+        int lunghezza = ScrittoreLog::formattaRiga(riga, sizeof(riga), c.epoch, valori, 3);
+        // Buffer pieno e chiavetta che non accetta: il record si rilegge al prossimo passo
+        if (!_esportazione.aggiungi(riga, lunghezza, adesso)) break;
+        _recordEsportati++;
+        _prossimoRecord++;
+    }
+}
+
+void Memoria::stampaStatistiche() {
+    _recordReport = _recordScritti;
+    _ultimoReport = millis();
+    if (!_qspiMontata) return;
+
+    // Amplificazione: byte programmati dalla QSPI (metadati e copie di LittleFS compresi,
+    // per tutti i file) su byte chiesti dagli anelli. Contatori dall'avvio
+    uint32_t scritti = 0;
+    for (int i = 0; i < NUMERO_CANALI; i++) scritti += _anelli[i].getByteScritti();
+    unsigned long programmati = (unsigned long)_profilo->get_program_count();
+    unsigned long cancellati = (unsigned long)_profilo->get_erase_count();
+    Serial.print("Memoria (QSPI): ");
+    Serial.print(_recordScritti);
+    Serial.print(" record da ");
+    Serial.print(REGISTRO_RECORD);
+    Serial.print(" B");
+    if (_recordScritti > 0) {
+        Serial.print(" (CSV ");
+        Serial.print((float)_byteCsv / _recordScritti, 1);
+        Serial.print(" B)");
+    }
+    Serial.print(", scritti ");
+    Serial.print(scritti);
+    Serial.print(" B, programmati ");
+    Serial.print(programmati);
+    Serial.print(" B, cancellati ");
+    Serial.print(cancellati);
+    Serial.print(" B");
+    if (scritti > 0) {
+        Serial.print(", amplificazione ");
+        Serial.print((float)programmati / scritti, 1);
+    }
+    Serial.println();
 }
 
 void Memoria::selectDrive(int driveIndex) {
@@ -124,9 +331,12 @@ void Memoria::selectDrive(int driveIndex) {
 }
 
 void Memoria::enterSelectedDrive() {
+    // L'elenco e il visualizzatore devono vedere anche le righe esportate ancora in RAM
+    if (_selectedDrive == 1 && _canaleEsportato >= 0 && _usbMontata) _esportazione.sincronizza(millis());
     _viewingFiles = true;
     _fileListIndex = 0;
     _fileListScroll = 0;
+    _cartellaValida = false; // Fotografia nuova a ogni ingresso
 }
 
 void Memoria::exitFileList() {
@@ -134,33 +344,103 @@ void Memoria::exitFileList() {
 }
 
 void Memoria::moveFileSelection(int delta) {
+    int precedente = _fileListIndex;
+    int scroll = _fileListScroll;
+    int count = _cartella.getNumero();
+
     _fileListIndex += delta;
+    if (count > 0 && _fileListIndex >= count) _fileListIndex = count - 1;
     if (_fileListIndex < 0) _fileListIndex = 0;
-    if (_lastFileCount > 0 && _fileListIndex >= _lastFileCount) _fileListIndex = _lastFileCount - 1;
     
     // Auto-scroll della lista
     if (_fileListIndex < _fileListScroll) _fileListScroll = _fileListIndex;
-    if (_fileListIndex >= _fileListScroll + 7) _fileListScroll = _fileListIndex - 6;
+    if (_fileListIndex >= _fileListScroll + RIGHE_ELENCO_FILE) _fileListScroll = _fileListIndex - RIGHE_ELENCO_FILE + 1;
+
+    // Finestra ferma: al prossimo disegno bastano la riga lasciata e quella nuova
+    _rigaPrecedente = (scroll == _fileListScroll) ? precedente : -1;
 }
 
-void Memoria::openSelectedFile() {
-    // Trova il nome del file selezionato
-    mbed::FileSystem* fs = (_selectedDrive == 0) ? (mbed::FileSystem*)_fsQSPI : (mbed::FileSystem*)_fsUSB;
+void Memoria::cycleFileSort() {
+    // La selezione resta sullo stesso file (riordinando i nomi non si spostano)
+    const char* selezionato = _fileListIndex < _cartella.getNumero() ? _cartella.getNome(_fileListIndex) : nullptr;
+    _cartella.ordina((OrdineCartella)((_cartella.getOrdine() + 1) % NUMERO_ORDINI));
+    if (selezionato) _fileListIndex = _cartella.cerca(selezionato);
+    if (_fileListIndex < 0) _fileListIndex = 0;
+    if (_fileListIndex < _fileListScroll || _fileListIndex >= _fileListScroll + RIGHE_ELENCO_FILE) _fileListScroll = _fileListIndex;
+    _rigaPrecedente = -1;
+}
+
+const char* Memoria::getFileSortLabel() {
+    switch (_cartella.getOrdine()) {
+    case ORDINE_DATA: return "Per data";
+    case ORDINE_DIMENSIONE: return "Per dim.";
+    default: return "Per nome";
+    }
+}
+
+// Una readdir e una stat per file, solo all'ingresso o dopo un'invalidazione
+bool Memoria::fotografaCartella() {
+    _cartella.azzera();
+    _cartellaDrive = _selectedDrive;
+    _cartellaValida = false;
+
+    mbed::FileSystem* fs = (_selectedDrive == 0) ? (mbed::FileSystem*)_fsQSPI : _usb.getFileSystem();
     mbed::Dir dir;
-    if (dir.open(fs, "/") == 0) {
-        struct dirent d;
-        int count = 0;
-        while (dir.read(&d) > 0) {
-            if (d.d_name[0] == '.') continue;
-            if (count == _fileListIndex) {
-                _currentFileName = d.d_name;
-                _viewingFileContent = true;
-                _contentScrollLine = 0;
-                break;
-            }
-            count++;
+    if (dir.open(fs, "/") != 0) return false;
+
+    struct dirent d;
+    while (dir.read(&d) > 0) {
+        if (d.d_name[0] == '.') continue;
+        struct stat st;
+        // Usa il nome file relativo alla root del filesystem
+        if (fs->stat(d.d_name, &st) != 0) {
+            st.st_size = 0;
+            st.st_mtime = 0;
         }
-        dir.close();
+        _cartella.aggiungi(d.d_name, (uint32_t)st.st_size, (uint32_t)st.st_mtime);
+    }
+    dir.close();
+    _cartella.ordina(_cartella.getOrdine());
+    _cartellaValida = true;
+
+    // Intanto la cartella può essersi accorciata
+    int count = _cartella.getNumero();
+    if (_fileListIndex >= count) _fileListIndex = count > 0 ? count - 1 : 0;
+    if (_fileListScroll > _fileListIndex) _fileListScroll = _fileListIndex;
+    return true;
+}
+
+void Memoria::invalidaCartella(int drive) {
+    if (_cartellaDrive == drive) _cartellaValida = false;
+}
+
+void Memoria::openSelectedFile() {
+    // Il nome viene dalla fotografia mostrata, anche se nel frattempo è stata invalidata
+    if (_cartellaDrive != _selectedDrive || _fileListIndex >= _cartella.getNumero()) return;
+    _currentFileName = _cartella.getNome(_fileListIndex);
+    _viewingFileContent = true;
+    _contentScrollLine = 0;
+
+    _currentFilePath = "/" + String(_selectedDrive == 0 ? "fs" : "usb") + "/" + _currentFileName;
+    _fileRegistro = false;
+    _dimensioneFile = 0;
+    _fineRichiesta = false;
+    _ridisegno = false;
+    FILE *f = fopen(_currentFilePath.c_str(), "r");
+    if (f) {
+        uint8_t intestazione[REGISTRO_INTESTAZIONE];
+        size_t letti = fread(intestazione, 1, sizeof(intestazione), f);
+        _fileRegistro = verificaIntestazioneRegistro(intestazione, (int)letti);
+        fseek(f, 0, SEEK_END);
+        _dimensioneFile = ftell(f);
+        fclose(f);
+    }
+    if (_fileRegistro) {
+        // Registro binario: la posizione di ogni record si calcola, l'indice non serve
+        _righeFile = registroRecordInteri(_dimensioneFile);
+    } else {
+        _righeFile = -1;
+        _indice.begin(_currentFilePath.c_str()); // Costruito a pezzi in update()
     }
 }
 
@@ -171,10 +451,37 @@ void Memoria::closeFileView() {
 bool Memoria::isViewingFileContent() { return _viewingFileContent; }
 
 void Memoria::scrollFileContent(int delta) {
+    _fineRichiesta = false;
     _contentScrollLine += delta;
+    // Oltre l'ultima pagina solo finché il numero di righe non è noto
+    if (_righeFile >= 0 && _contentScrollLine > _righeFile - RIGHE_PAGINA_FILE) _contentScrollLine = _righeFile - RIGHE_PAGINA_FILE;
     if (_contentScrollLine < 0) _contentScrollLine = 0;
 }
 
+void Memoria::pageFileContent(int pages) {
+    scrollFileContent(pages * RIGHE_PAGINA_FILE);
+}
+
+void Memoria::scrollFileContentToStart() {
+    _fineRichiesta = false;
+    _contentScrollLine = 0;
+}
+
+void Memoria::scrollFileContentToEnd() {
+    if (_righeFile < 0) {
+        _fineRichiesta = true;
+        return;
+    }
+    _contentScrollLine = _righeFile > RIGHE_PAGINA_FILE ? _righeFile - RIGHE_PAGINA_FILE : 0;
+}
+
+bool Memoria::needsRedraw() {
+    bool ridisegno = (_ridisegno && _viewingFileContent) || _ridisegnoUsb;
+    _ridisegno = false;
+    _ridisegnoUsb = false;
+    return ridisegno;
+}
+
 bool Memoria::isViewingFiles() {
     return _viewingFiles;
 }
@@ -191,11 +498,13 @@ void Memoria::drawContent(GigaDisplay_GFX& display) {
     } else {
         drawDriveList(display);
     }
+    compositore.fineFrame("Memoria");
 }
 
 void Memoria::drawDriveList(GigaDisplay_GFX& display) {
     // Pulisci l'area dei contenuti (lasciando intatti i pulsanti in basso)
-    display.fillRect(0, 0, 800, 320, 0x0000); // NERO
+    compositore.invalida(0, 0, 800, 320);
+    compositore.flush(0x0000); // NERO
 
     display.setCursor(20, 60);
     display.setTextSize(3); // Aumentata grandezza testo
@@ -226,7 +535,8 @@ void Memoria::drawDriveList(GigaDisplay_GFX& display) {
     y += 60; // Spazio per la prossima voce
 
     // --- DRIVE 2: USB DRIVE ---
-    bool usbConn = ensureConnection();
+    const StatoUsb& usb = _usb.getStato();
+    bool usbConn = usb.montata;
     
     if (_selectedDrive == 1) display.setTextColor(0xFFE0, 0x0000); // GIALLO
     else if (usbConn) display.setTextColor(0x07E0, 0x0000); // VERDE
@@ -240,6 +550,14 @@ void Memoria::drawDriveList(GigaDisplay_GFX& display) {
     display.setCursor(400, y + 5);
     if (usbConn) {
         display.println(" Connesso");
+        // Calcolati al mount dal servizio USB, non a ogni disegno
+        display.setCursor(400, y + 30);
+        display.print((float)(usb.libero / 1048576) / 1024.0, 1);
+        display.print(" GB liberi di ");
+        display.print((float)(usb.capacita / 1048576) / 1024.0, 1);
+        display.print(" GB");
+    } else if (usb.presente) {
+        display.println(" Errore mount");
     } else {
         display.println(" Non rilevato");
     }
@@ -253,8 +571,22 @@ void Memoria::drawDriveList(GigaDisplay_GFX& display) {
 }
 
 void Memoria::drawFileList(GigaDisplay_GFX& display) {
+    bool connesso = _selectedDrive == 0 || _usbMontata;
+    bool rifatta = connesso && !(_cartellaValida && _cartellaDrive == _selectedDrive);
+    bool letta = connesso && (!rifatta || fotografaCartella());
+
+    if (letta && !rifatta && _rigaPrecedente >= 0) {
+        // Solo la selezione si è spostata: bastano la riga lasciata e quella nuova
+        drawFileRow(display, _rigaPrecedente, true);
+        drawFileRow(display, _fileListIndex, true);
+        _rigaPrecedente = -1;
+        return;
+    }
+    _rigaPrecedente = -1;
+
     // Pulisci l'area dei contenuti
-    display.fillRect(0, 0, 800, 320, 0x0000); // NERO
+    compositore.invalida(0, 0, 800, 320);
+    compositore.flush(0x0000); // NERO
 
     display.setCursor(20, 20);
     display.setTextSize(3);
@@ -267,118 +599,139 @@ void Memoria::drawFileList(GigaDisplay_GFX& display) {
     // Intestazione colonne
     display.setTextSize(2);
     display.setTextColor(0xAAAA, 0x0000); // Grigio chiaro
+    if (letta) {
+        display.setCursor(560, 26);
+        display.print(_cartella.getNumero() + _cartella.getOmesse());
+        display.print(" file");
+    }
     display.setCursor(20, 60); display.print("Nome");
     display.setCursor(350, 60); display.print("Dimensione");
     display.setCursor(550, 60); display.print("Data");
     display.drawLine(20, 80, 780, 80, 0xffff);
 
-    // Seleziona il filesystem corretto
-    mbed::FileSystem* fs = (_selectedDrive == 0) ? (mbed::FileSystem*)_fsQSPI : (mbed::FileSystem*)_fsUSB;
-    
-    if (_selectedDrive == 1 && !ensureConnection()) {
+    if (!connesso) {
         display.setTextColor(0xf800, 0x0000); // ROSSO
         display.println("Drive non connesso!");
         return;
     }
 
-    mbed::Dir dir;
-    if (dir.open(fs, "/") != 0) {
+    if (!letta) {
         display.setTextColor(0xf800, 0x0000);
         display.println("Errore apertura directory.");
         return;
     }
 
+    int count = _cartella.getNumero();
+    for (int i = _fileListScroll; i < count && i < _fileListScroll + RIGHE_ELENCO_FILE; i++) {
+        drawFileRow(display, i, false);
+    }
+    
     display.setTextColor(0x07E0, 0x0000); // VERDE
-    display.setTextSize(2);
+    if (count == 0) {
+        display.setCursor(20, 100);
+        display.println("(Cartella vuota)");
+    }
+    if (_cartella.getOmesse() > 0) {
+        // Fotografia piena (vedi MAX_FILE_CARTELLA)
+        display.setTextColor(0xAAAA, 0x0000);
+        display.setCursor(20, 100 + RIGHE_ELENCO_FILE * 30);
+        display.print("(altri ");
+        display.print(_cartella.getOmesse());
+        display.print(" file non mostrati)");
+    }
+}
 
-    struct dirent d;
-    int count = 0;
-    int lines = 0;
-    int y = 100;
+// Una riga dell'elenco dalla fotografia, senza toccare il filesystem
+void Memoria::drawFileRow(GigaDisplay_GFX& display, int index, bool clear) {
+    if (index < _fileListScroll || index >= _fileListScroll + RIGHE_ELENCO_FILE || index >= _cartella.getNumero()) return;
+    int y = 100 + (index - _fileListScroll) * 30;
+    if (clear) {
+        compositore.invalida(0, y, 800, 30);
+        compositore.flush(0x0000);
+    }
 
-    while (dir.read(&d) > 0) {
-        if (d.d_name[0] == '.') continue;
-        
-        // Gestione Scroll e Selezione
-        if (count < _fileListScroll) {
-            count++;
-            continue;
-        }
-        if (lines >= 7) { count++; continue; } // Conta comunque per _lastFileCount
+    display.setTextColor(0x07E0, 0x0000); // VERDE
+    display.setTextSize(2);
 
-        // Nome File (Troncato)
-        String fname = d.d_name;
-        if (fname.length() > 25) fname = fname.substring(0, 22) + "...";
+    // Nome File (Troncato)
+    String fname = _cartella.getNome(index);
+    if (fname.length() > 25) fname = fname.substring(0, 22) + "...";
 
-        display.setCursor(20, y);
-        if (count == _fileListIndex) display.print("> "); else display.print("  ");
-        display.print(fname);
-        
-        // Recupera dimensione
-        struct stat st;
-        // Usa il nome file relativo alla root del filesystem
-        if (fs->stat(d.d_name, &st) == 0) {
-            display.setCursor(350, y);
-            if (st.st_size < 1024) {
-                display.print(st.st_size); display.print(" B");
-            } else if (st.st_size < 1024 * 1024) {
-                display.print(st.st_size / 1024.0, 1); display.print(" KB");
-            } else {
-                display.print(st.st_size / 1024.0 / 1024.0, 1); display.print(" MB");
-            }
+    display.setCursor(20, y);
+    if (index == _fileListIndex) display.print("> "); else display.print("  ");
+    display.print(fname);
+    
+    // Dimensione
+    uint32_t size = _cartella.getDimensione(index);
+    display.setCursor(350, y);
+    if (size < 1024) {
+        display.print(size); display.print(" B");
+    } else if (size < 1024 * 1024) {
+        display.print(size / 1024.0, 1); display.print(" KB");
+    } else {
+        display.print(size / 1024.0 / 1024.0, 1); display.print(" MB");
+    }
 
-            // Data
-            if (st.st_mtime > 0) {
-                struct tm *t = localtime(&st.st_mtime);
-                if (t) {
-                    char dateBuf[24];
-                    int year = t->tm_year + 1900;
-
-                    // Controllo validità anno esteso (es. 1970-2099) per includere date di default
-                    if (year >= 1970 && year <= 2099) {
-                        sprintf(dateBuf, "%02d/%02d/%04d %02d:%02d", 
-                                t->tm_mday, 
-                                t->tm_mon + 1, 
-                                year, 
-                                t->tm_hour, 
-                                t->tm_min);
-                    } else {
-                        sprintf(dateBuf, "--/--/---- --:--");
-                    }
-                    
-                    display.setCursor(550, y);
-                    display.print(dateBuf);
-                }
+    // Data
+    time_t mtime = (time_t)_cartella.getData(index);
+    if (mtime > 0) {
+        struct tm *t = localtime(&mtime);
+        if (t) {
+            char dateBuf[24];
+            int year = t->tm_year + 1900;
+
+            // Controllo validità anno esteso (es. 1970-2099) per includere date di default
+            if (year >= 1970 && year <= 2099) {
+                sprintf(dateBuf, "%02d/%02d/%04d %02d:%02d", 
+                        t->tm_mday, 
+                        t->tm_mon + 1, 
+                        year, 
+                        t->tm_hour, 
+                        t->tm_min);
+            } else {
+                sprintf(dateBuf, "--/--/---- --:--");
             }
+            
+            display.setCursor(550, y);
+            display.print(dateBuf);
         }
-        
-        y += 30;
-        lines++;
-        count++;
     }
-    dir.close();
-    _lastFileCount = count;
-    
-    if (lines == 0) {
-        display.setCursor(20, 100);
-        display.println("(Cartella vuota)");
+}
+
+// Avanza di righe fine riga (come li conta IndiceRighe, anche per le righe più lunghe del buffer)
+static void saltaRighe(FILE *f, uint32_t righe) {
+    int c;
+    while (righe > 0 && (c = fgetc(f)) != EOF) {
+        if (c == '\n') righe--;
     }
 }
 
 void Memoria::drawFileContent(GigaDisplay_GFX& display) {
-    display.fillRect(0, 0, 800, 320, 0x0000);
+    compositore.invalida(0, 0, 800, 320);
+    compositore.flush(0x0000);
     display.setCursor(20, 20);
     display.setTextSize(3);
     display.setTextColor(0xffff, 0x0000);
     display.print("File: "); display.println(_currentFileName);
     display.drawLine(20, 50, 780, 50, 0xffff);
 
+    // Posizione nel file, o avanzamento dell'indice
     display.setTextSize(2);
+    display.setTextColor(0xAAAA, 0x0000);
+    display.setCursor(560, 26);
+    if (_righeFile >= 0) {
+        display.print(_righeFile == 0 ? 0 : _contentScrollLine + 1);
+        display.print("/");
+        display.print(_righeFile);
+    } else {
+        display.print("Indice ");
+        display.print(_dimensioneFile > 0 ? (int)(_indice.getByteLetti() * 100 / _dimensioneFile) : 0);
+        display.print("%");
+    }
+
     display.setTextColor(0x07E0, 0x0000);
 
-    mbed::FileSystem* fs = (_selectedDrive == 0) ? (mbed::FileSystem*)_fsQSPI : (mbed::FileSystem*)_fsUSB;
-    String path = "/" + String(_selectedDrive == 0 ? "fs" : "usb") + "/" + _currentFileName;
-    FILE *f = fopen(path.c_str(), "r");
+    FILE *f = fopen(_currentFilePath.c_str(), "r");
     if (!f) {
         display.setCursor(20, 70);
         display.println("Errore apertura file.");
@@ -386,15 +739,38 @@ void Memoria::drawFileContent(GigaDisplay_GFX& display) {
     }
 
     char buffer[128];
-    int currentLine = 0;
-    // Salta le righe scrollate
-    while (currentLine < _contentScrollLine && fgets(buffer, sizeof(buffer), f)) {
-        currentLine++;
+    int y = 70;
+
+    if (_fileRegistro) {
+        // Registro binario: un record per riga, nello stesso formato dell'esportazione
+        uint8_t record[REGISTRO_RECORD];
+        fseek(f, registroPosizione(_contentScrollLine), SEEK_SET);
+        for (int i = 0; i < RIGHE_PAGINA_FILE && fread(record, 1, REGISTRO_RECORD, f) == REGISTRO_RECORD; i++) {
+            CampioneStorico c;
+            display.setCursor(20, y);
+            if (decodificaRecordRegistro(record, c)) {
+                const float valori[3] = {c.temperatura, c.umidita, c.pressione};
+                ScrittoreLog::formattaRiga(buffer, sizeof(buffer), c.epoch, valori, 3);
+                String line = buffer;
+                line.trim();
+                line.replace(';', ' ');
+                display.println(line);
+            } else {
+                display.println("(record danneggiato)");
+            }
+            y += 25;
+        }
+        fclose(f);
+        return;
     }
 
-    int y = 70;
+    // Un solo fseek() alla voce dell'indice più vicina, poi meno di un passo di righe da saltare
+    uint32_t rigaVoce;
+    fseek(f, _indice.cerca(_contentScrollLine, rigaVoce), SEEK_SET);
+    saltaRighe(f, _contentScrollLine - rigaVoce);
+
     int linesDrawn = 0;
-    while (linesDrawn < 10 && fgets(buffer, sizeof(buffer), f)) {
+    while (linesDrawn < RIGHE_PAGINA_FILE && fgets(buffer, sizeof(buffer), f)) {
         String line = buffer;
         line.trim();
         line.replace(';', ' '); // Sostituisci separatori per leggibilità
@@ -404,4 +780,98 @@ void Memoria::drawFileContent(GigaDisplay_GFX& display) {
         linesDrawn++;
     }
     fclose(f);
-}
\ No newline at end of file
+}
+
+#ifdef MEMORIA_BENCHMARK_LOG
+// Righe al secondo verso la chiavetta: una riapertura per riga (il vecchio logData) contro ScrittoreLog
+void Memoria::benchmarkLog() {
+    const char* percorso = "/usb/Benchmark.csv";
+    const int righe = 500;
+    const float valori[3] = {21.37f, 45.5f, 101.32f};
+    char riga[RIGA_LOG_MASSIMA];
+    uint32_t epoch = (uint32_t)time(NULL);
+
+    remove(percorso);
+    unsigned long inizio = millis();
+    for (int i = 0; i < righe; i++) {
+        FILE *f = fopen(percorso, "a+");
+        if (!f) break;
+        fseek(f, 0, SEEK_END);
+        int lunghezza = ScrittoreLog::formattaRiga(riga, sizeof(riga), epoch + i, valori, 3);
+        fwrite(riga, 1, lunghezza, f);
+        fclose(f);
+    }
+    unsigned long riaperture = millis() - inizio;
+
+    remove(percorso);
+    static ScrittoreLog log; // 4 KB di buffer: non sullo stack del loop
+    log.begin(percorso, INTESTAZIONE_CSV);
+    inizio = millis();
+    for (int i = 0; i < righe; i++) {
+        int lunghezza = ScrittoreLog::formattaRiga(riga, sizeof(riga), epoch + i, valori, 3);
+        log.aggiungi(riga, lunghezza, millis());
+        log.update(millis());
+    }
+    log.sincronizza(millis());
+    unsigned long bufferizzato = millis() - inizio;
+    log.abbandona();
+    remove(percorso);
+
+    Serial.print("Memoria (USB): benchmark ");
+    Serial.print(righe);
+    Serial.print(" righe, riapertura per riga ");
+    Serial.print(righe * 1000.0f / (riaperture ? riaperture : 1), 0);
+    Serial.print(" righe/s, ScrittoreLog ");
+    Serial.print(righe * 1000.0f / (bufferizzato ? bufferizzato : 1), 0);
+    Serial.println(" righe/s");
+}
+#endif
+
+#ifdef MEMORIA_BENCHMARK_INDICE
+// Una pagina all'inizio, a metà e in fondo al file aperto: salto con fgets() dall'inizio
+// (il vecchio drawFileContent) contro indice. Da ripetere su file di dimensioni diverse
+void Memoria::benchmarkIndice() {
+    const char* percorso = _currentFilePath.c_str();
+    long bersagli[3] = {0, _righeFile / 2, _righeFile > RIGHE_PAGINA_FILE ? _righeFile - RIGHE_PAGINA_FILE : 0};
+    char buffer[128];
+
+    Serial.print("Memoria: benchmark scorrimento ");
+    Serial.print(percorso);
+    Serial.print(", ");
+    Serial.print(_indice.getByteLetti());
+    Serial.print(" B, ");
+    Serial.print(_righeFile);
+    Serial.print(" righe, passo indice ");
+    Serial.println(_indice.getPasso());
+
+    for (int i = 0; i < 3; i++) {
+        unsigned long inizio = micros();
+        FILE *f = fopen(percorso, "r");
+        if (!f) return;
+        for (long r = 0; r < bersagli[i] && fgets(buffer, sizeof(buffer), f); r++) {}
+        for (int r = 0; r < RIGHE_PAGINA_FILE && fgets(buffer, sizeof(buffer), f); r++) {}
+        fclose(f);
+        unsigned long sequenziale = micros() - inizio;
+
+        inizio = micros();
+        f = fopen(percorso, "r");
+        if (!f) return;
+        uint32_t rigaVoce;
+        fseek(f, _indice.cerca(bersagli[i], rigaVoce), SEEK_SET);
+        saltaRighe(f, bersagli[i] - rigaVoce);
+        for (int r = 0; r < RIGHE_PAGINA_FILE && fgets(buffer, sizeof(buffer), f); r++) {}
+        fclose(f);
+        unsigned long indicizzato = micros() - inizio;
+
+        Serial.print("  riga ");
+        Serial.print(bersagli[i]);
+        Serial.print(": fgets ");
+        Serial.print(sequenziale);
+        Serial.print(" us, indice ");
+        Serial.print(indicizzato);
+        Serial.println(" us");
+    }
+}
+#endif
+
+#endif // CORE_CM4
@@ -3,18 +3,70 @@
 
 #include <Arduino.h>
 #include <mbed.h>
-#include <Arduino_USBHostMbed5.h>
-#include <FATFileSystem.h>
 #include <QSPIFBlockDevice.h>
 #include <LittleFileSystem.h>
+#include <ProfilingBlockDevice.h>
 #include <Arduino_GigaDisplay_GFX.h>
+#include "UnioneStorico.h"
+#include "ScrittoreLog.h"
+#include "AnelloRegistro.h"
+#include "IndiceRighe.h"
+#include "FotoCartella.h"
+#include "ServizioUsb.h"
 
-class Memoria {
+// Archivio principale su QSPI: un anello di segmenti per canale (vedi AnelloRegistro.h),
+// record binari di dimensione fissa (vedi FormatoRegistro.h).
+// Ritenzione di un canale = segmenti × (dimensione del segmento - 8) / 12 record
+#define CANALE_ARCHIVIO 0
+#define CANALE_STORICO 1
+#define NUMERO_CANALI 2
+// Campioni orari del Master (logData): 2730 record per segmento, circa due anni e mezzo
+#define BASE_ARCHIVIO "/fs/Archivio"
+#define SEGMENTO_ARCHIVIO 32768
+#define SEGMENTI_ARCHIVIO 8
+// Campioni del Sense ogni 30 s, anche quelli registrati fuori portata (vedi UnioneStorico.h):
+// 21844 record (7 giorni e mezzo) per segmento, circa 4 mesi in 4 MB
+#define BASE_STORICO "/fs/Storico"
+#define SEGMENTO_STORICO 262144
+#define SEGMENTI_STORICO 16
+// CSV su chiavetta, generati su richiesta (esporta()). Nomi nuovi: il vecchio
+// /usb/Archivio.csv, scritto direttamente da logData(), resta intatto
+#define ESPORTAZIONE_ARCHIVIO "/usb/Esporta_Archivio.csv"
+#define ESPORTAZIONE_STORICO "/usb/Esporta_Storico.csv"
+#define INTESTAZIONE_CSV "Data;Ora;Temperatura;Umidita;Pressione\n"
+
+#define RECORD_PER_PASSO_ESPORTAZIONE 64      // Record letti dalla QSPI per loop durante l'esportazione
+#define PERIODO_REPORT_MEMORIA_MS 600000      // Byte per record e amplificazione su Serial, se è cambiato qualcosa
+
+#define RIGHE_PAGINA_FILE 10                  // Righe visibili nel visualizzatore
+#define RIGHE_ELENCO_FILE 7                   // File visibili nell'elenco
+#define MAX_FILE_CARTELLA 4096                // Fotografia della cartella (in SDRAM): 48 KB di voci
+#define SPAZIO_NOMI_CARTELLA 131072           // e 128 KB di nomi (32 byte a file)
+#define BYTE_PER_PASSO_INDICE 8192            // Byte letti per loop costruendo l'indice del file aperto
+
+// Decommentare per misurare all'avvio le righe al secondo verso la chiavetta,
+// riapertura per riga contro ScrittoreLog (file /usb/Benchmark.csv, poi cancellato)
+// #define MEMORIA_BENCHMARK_LOG
+// Decommentare per misurare, a indice completo, il tempo di una pagina all'inizio, a metà
+// e in fondo al file aperto: salto con fgets() dall'inizio contro indice (vedi IndiceRighe.h)
+// #define MEMORIA_BENCHMARK_INDICE
+
+class Memoria : public ScrittoreStorico {
 public:
     Memoria();
     bool begin();
-    // Salva una riga nel CSV: Data, Ora, Temp, Hum, Press
-    bool logData(String date, String time, float temp, float hum, float press);
+    void update(); // Esportazione a passi, stato della chiavetta dal servizio USB, report periodico
+    // Un record nell'archivio su QSPI: Temp, Hum, Press (epoch in ora locale, come time(NULL)).
+    // false se la QSPI non è disponibile
+    bool logData(time_t epoch, float temp, float hum, float press);
+    // ScrittoreStorico: record binari su QSPI, un'apertura per blocco
+    bool scriviStorico(const CampioneStorico* campioni, int numero);
+    uint32_t ultimoStorico();
+    // Avvia la copia di tutti i canali in CSV (punto e virgola, virgola decimale) sulla chiavetta.
+    // Prosegue in update() senza bloccare il loop. false se già in corso o senza chiavetta
+    bool esporta();
+    bool isEsportazioneInCorso();
+    void stampaStatistiche(); // Byte per record e amplificazione di scrittura su Serial
     void drawContent(GigaDisplay_GFX& display); // Visualizza il contenuto sul display
     void selectDrive(int driveIndex); // 0 = Flash, 1 = USB
     void enterSelectedDrive(); // Entra nella visualizzazione file
@@ -23,20 +75,48 @@ public:
     int getSelectedDrive(); // Restituisce l'indice del drive selezionato
     
     void moveFileSelection(int delta);
+    void cycleFileSort(); // Ordine dell'elenco: nome, data, dimensione
+    const char* getFileSortLabel(); // Etichetta del pulsante per l'ordine attuale
     void openSelectedFile();
     void closeFileView();
     bool isViewingFileContent();
     void scrollFileContent(int delta);
+    void pageFileContent(int pages); // Pagine di RIGHE_PAGINA_FILE righe, negative verso l'inizio
+    void scrollFileContentToStart();
+    void scrollFileContentToEnd(); // Con l'indice ancora in costruzione ci arriva appena completo
+    bool needsRedraw(); // Indice del file aperto completato (numero di righe, salto alla fine) o chiavetta cambiata
 
 private:
-    // USB
-    USBHostMSD* _msd;
-    mbed::FATFileSystem* _fsUSB;
+    // USB: rilevamento, mount e spazio nel thread del servizio, qui solo lo stato pubblicato
+    ServizioUsb _usb;
     // QSPI (Flash Interna)
     QSPIFBlockDevice* _qspi;
+    mbed::ProfilingBlockDevice* _profilo; // Conta i byte programmati e cancellati sotto LittleFS
     mbed::LittleFileSystem* _fsQSPI;
     
-    bool _mounted;
+    bool _usbMontata;           // Ultimo stato visto dal loop
+    uint32_t _versioneUsb;
+    bool _ridisegnoUsb;
+    bool _qspiMontata;
+
+    AnelloRegistro _anelli[NUMERO_CANALI];
+
+    // Esportazione verso la chiavetta
+    ScrittoreLog _esportazione;
+    int _canaleEsportato;       // -1 = nessuna esportazione
+    int _primoSegmento;         // Il più vecchio all'avvio dell'esportazione del canale
+    int _segmentoEsportato;     // Segmenti già esportati del canale
+    long _prossimoRecord;       // Prossimo record da leggere nel segmento in esportazione
+    long _recordDaEsportare;    // Record del segmento all'avvio: quelli aggiunti dopo restano alla prossima
+    uint32_t _recordEsportati;
+    uint32_t _recordScartati;   // CRC errato
+    unsigned long _inizioEsportazione;
+
+    // Statistiche di scrittura su QSPI dall'avvio
+    uint32_t _recordScritti;
+    uint32_t _byteCsv;          // Gli stessi record come righe del CSV
+    uint32_t _recordReport;     // _recordScritti all'ultimo report
+    unsigned long _ultimoReport;
     int _selectedDrive; // 0 = Flash Interna, 1 = USB Drive
     bool _viewingFiles; // Flag per sapere se siamo nella lista file
     
@@ -45,12 +125,38 @@ private:
     int _fileListIndex;
     int _fileListScroll;
     int _contentScrollLine;
-    int _lastFileCount;
 
-    bool ensureConnection(); // Controlla e connette l'USB se necessario
+    // Elenco file: fotografia della cartella, rifatta solo se invalidata (vedi FotoCartella.h)
+    FotoCartella _cartella;
+    int _cartellaDrive;         // Drive fotografato, -1 = nessuno
+    bool _cartellaValida;
+    int _rigaPrecedente;        // Selezione prima dello spostamento, -1 = elenco da ridisegnare tutto
+
+    // Visualizzatore: indice delle righe dei file di testo, i registri binari si leggono per record
+    String _currentFilePath;
+    IndiceRighe _indice;
+    bool _fileRegistro;
+    long _righeFile;            // Righe o record (testo: dall'indice, -1 finché non è completo)
+    long _dimensioneFile;
+    bool _fineRichiesta;        // Salto alla fine in attesa dell'indice
+    bool _ridisegno;
+
+    bool scriviRegistro(int canale, const CampioneStorico* campioni, int numero);
+    void iniziaCanaleEsportato();
+    void iniziaSegmentoEsportato();
+    void passoEsportazione();
+#ifdef MEMORIA_BENCHMARK_LOG
+    void benchmarkLog();
+#endif
+#ifdef MEMORIA_BENCHMARK_INDICE
+    void benchmarkIndice();
+#endif
     bool initQSPI(); // Inizializza la memoria interna
     void drawDriveList(GigaDisplay_GFX& display);
     void drawFileList(GigaDisplay_GFX& display);
+    void drawFileRow(GigaDisplay_GFX& display, int index, bool clear);
+    bool fotografaCartella();
+    void invalidaCartella(int drive); // Dopo una nostra scrittura o un cambio di chiavetta
     void drawFileContent(GigaDisplay_GFX& display);
 };
 
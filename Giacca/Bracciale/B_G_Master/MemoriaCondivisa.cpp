@@ -0,0 +1,55 @@
+// Kicco972.net
+
+
+#include "MemoriaCondivisa.h"
+#include <new>
+
+#if defined(CORE_CM7) || defined(CORE_CM4)
+#include <mbed.h>
+
+AreaCondivisa* areaCondivisa()
+{
+  return reinterpret_cast<AreaCondivisa*>(INDIRIZZO_AREA_CONDIVISA);
+}
+#else
+// Fuori dalla Giga (verifiche su PC): area in RAM normale
+static AreaCondivisa areaLocale;
+
+AreaCondivisa* areaCondivisa()
+{
+  return &areaLocale;
+}
+#endif
+
+void preparaAreaCondivisa()
+{
+#if defined(CORE_CM7)
+  // L'M7 ha la D-cache, l'M4 no: senza questa regione l'M7 leggerebbe copie vecchie
+  // dell'area e le sue scritture resterebbero in cache.
+  MPU_Region_InitTypeDef regione = {};
+  HAL_MPU_Disable();
+  regione.Enable = MPU_REGION_ENABLE;
+  regione.Number = MPU_REGION_NUMBER15;
+  regione.BaseAddress = INDIRIZZO_AREA_CONDIVISA;
+  regione.Size = MPU_REGION_SIZE_1KB;
+  regione.SubRegionDisable = 0x00;
+  regione.TypeExtField = MPU_TEX_LEVEL1;
+  regione.AccessPermission = MPU_REGION_FULL_ACCESS;
+  regione.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  regione.IsShareable = MPU_ACCESS_SHAREABLE;
+  regione.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  regione.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  HAL_MPU_ConfigRegion(&regione);
+  HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+
+  // Serve per il semaforo hardware di Wire1
+  __HAL_RCC_HSEM_CLK_ENABLE();
+#endif
+
+  // La SRAM4 non viene inizializzata al boot: si costruiscono le caselle sul posto
+  AreaCondivisa* area = areaCondivisa();
+  area->firma.store(0, std::memory_order_relaxed);
+  new (&area->statoImu) CasellaCondivisa<StatoImuCondiviso>();
+  new (&area->comandoImu) CasellaCondivisa<ComandoImuCondiviso>();
+  area->firma.store(FIRMA_AREA_CONDIVISA, std::memory_order_release);
+}
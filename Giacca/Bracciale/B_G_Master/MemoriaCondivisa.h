@@ -0,0 +1,60 @@
+/*
+  MemoriaCondivisa.h
+  Protocollo tra M7 (UI e I/O) e M4 (campionamento e fusione IMU) in modalità doppio core.
+  Le due caselle vivono in fondo alla SRAM4 (dominio D3, visibile da entrambi i core):
+  - statoImu:   M4 -> M7, orientamento e statistiche, pubblicato ad ogni risveglio dell'M4
+  - comandoImu: M7 -> M4, tara e magnetometro remoto, pubblicato ad ogni loop dell'M7
+  Lo stesso sketch va caricato due volte: target_core=cm7 e target_core=cm4
+  (con uno split della flash diverso da 100_0, es. 75_25).
+  Fuori dalla Giga l'area è una normale variabile statica: i due core si simulano con due thread.
+*/
+#ifndef MEMORIA_CONDIVISA_H
+#define MEMORIA_CONDIVISA_H
+
+#include <stdint.h>
+#include "CasellaCondivisa.h"
+#include "AssettoImu.h"
+
+// 1 = IMU sull'M4 (serve lo sketch caricato anche sull'M4), 0 = tutto sull'M7
+#define USA_CORE_M4 0
+
+// Ultimo KB della SRAM4: l'inizio è usato da OpenAMP (RPC)
+#define INDIRIZZO_AREA_CONDIVISA 0x3800FC00
+#define DIMENSIONE_AREA_CONDIVISA 1024
+#define FIRMA_AREA_CONDIVISA 0x4B494D34 // "KIM4"
+
+// Hardware semaphore (HSEM) che protegge Wire1 tra i due core
+#define HSEM_WIRE1 10
+
+struct StatoImuCondiviso {
+    StatoAssetto assetto;
+    bool sensoreOk;           // false se il BMI270 non ha risposto all'M4
+    bool fifoAttiva;
+    uint32_t campioniPersi;   // Coda piena sull'M4
+    uint32_t frameSaltati;    // FIFO del sensore piena
+    uint32_t burstFifo;       // Totale burst I2C
+};
+
+struct ComandoImuCondiviso {
+    uint32_t numeroTara;      // Incrementato dall'M7 ad ogni richiesta di tara
+    float magX, magY, magZ;
+    bool magValido;
+    bool usaMagnetometro;
+    bool fermaM4;             // L'M7 ha ripreso il campionamento in locale
+};
+
+struct AreaCondivisa {
+    std::atomic<uint32_t> firma; // Scritta dall'M7 quando l'area è pronta
+    CasellaCondivisa<StatoImuCondiviso> statoImu;
+    CasellaCondivisa<ComandoImuCondiviso> comandoImu;
+};
+
+static_assert(sizeof(AreaCondivisa) <= DIMENSIONE_AREA_CONDIVISA, "L'area condivisa non entra nel KB riservato");
+
+// Puntatore all'area (indirizzo fisso sulla Giga, variabile statica altrove)
+AreaCondivisa* areaCondivisa();
+
+// Solo M7, prima di avviare l'M4: area non in cache, firma e caselle azzerate
+void preparaAreaCondivisa();
+
+#endif
@@ -0,0 +1,72 @@
+/*
+  MeshSfera.h
+  Geometria costante della sfera IMU: vista isometrica fissa e mesh a raggio
+  unitario (3 cerchi ortogonali e punti cardinali), scalate e ruotate da una
+  sola matrice per frame (vedi Imu3DVisualizer::proiettaSfera).
+  Solo C++ standard, compilabile anche su PC (benchmark in TestPc).
+*/
+#ifndef MESH_SFERA_H
+#define MESH_SFERA_H
+
+#include "Matematica3D.h"
+
+#define PUNTI_CERCHIO_SFERA 25 // 0..360 gradi a passi di 15
+
+// Rotazione fissa della vista isometrica (gradi)
+#define VISTA_PITCH -30
+#define VISTA_ROLL -70
+#define VISTA_YAW -60
+
+// --- MESH COSTANTI (raggio unitario, scalate dalla matrice del frame) ---
+
+// Sfera wireframe: 3 cerchi ortogonali a passi di 15 gradi
+static const Point3D MESH_SFERA[3][PUNTI_CERCHIO_SFERA] = {
+    // Piano YZ
+    {
+        {0.0000000f, 1.0000000f, 0.0000000f}, {0.0000000f, 0.9659258f, 0.2588190f}, {0.0000000f, 0.8660254f, 0.5000000f},
+        {0.0000000f, 0.7071068f, 0.7071068f}, {0.0000000f, 0.5000000f, 0.8660254f}, {0.0000000f, 0.2588190f, 0.9659258f},
+        {0.0000000f, 0.0000000f, 1.0000000f}, {0.0000000f, -0.2588190f, 0.9659258f}, {0.0000000f, -0.5000000f, 0.8660254f},
+        {0.0000000f, -0.7071068f, 0.7071068f}, {0.0000000f, -0.8660254f, 0.5000000f}, {0.0000000f, -0.9659258f, 0.2588190f},
+        {0.0000000f, -1.0000000f, 0.0000000f}, {0.0000000f, -0.9659258f, -0.2588190f}, {0.0000000f, -0.8660254f, -0.5000000f},
+        {0.0000000f, -0.7071068f, -0.7071068f}, {0.0000000f, -0.5000000f, -0.8660254f}, {0.0000000f, -0.2588190f, -0.9659258f},
+        {0.0000000f, 0.0000000f, -1.0000000f}, {0.0000000f, 0.2588190f, -0.9659258f}, {0.0000000f, 0.5000000f, -0.8660254f},
+        {0.0000000f, 0.7071068f, -0.7071068f}, {0.0000000f, 0.8660254f, -0.5000000f}, {0.0000000f, 0.9659258f, -0.2588190f},
+        {0.0000000f, 1.0000000f, 0.0000000f}
+    },
+    // Piano XZ
+    {
+        {1.0000000f, 0.0000000f, 0.0000000f}, {0.9659258f, 0.0000000f, 0.2588190f}, {0.8660254f, 0.0000000f, 0.5000000f},
+        {0.7071068f, 0.0000000f, 0.7071068f}, {0.5000000f, 0.0000000f, 0.8660254f}, {0.2588190f, 0.0000000f, 0.9659258f},
+        {0.0000000f, 0.0000000f, 1.0000000f}, {-0.2588190f, 0.0000000f, 0.9659258f}, {-0.5000000f, 0.0000000f, 0.8660254f},
+        {-0.7071068f, 0.0000000f, 0.7071068f}, {-0.8660254f, 0.0000000f, 0.5000000f}, {-0.9659258f, 0.0000000f, 0.2588190f},
+        {-1.0000000f, 0.0000000f, 0.0000000f}, {-0.9659258f, 0.0000000f, -0.2588190f}, {-0.8660254f, 0.0000000f, -0.5000000f},
+        {-0.7071068f, 0.0000000f, -0.7071068f}, {-0.5000000f, 0.0000000f, -0.8660254f}, {-0.2588190f, 0.0000000f, -0.9659258f},
+        {0.0000000f, 0.0000000f, -1.0000000f}, {0.2588190f, 0.0000000f, -0.9659258f}, {0.5000000f, 0.0000000f, -0.8660254f},
+        {0.7071068f, 0.0000000f, -0.7071068f}, {0.8660254f, 0.0000000f, -0.5000000f}, {0.9659258f, 0.0000000f, -0.2588190f},
+        {1.0000000f, 0.0000000f, 0.0000000f}
+    },
+    // Piano XY
+    {
+        {1.0000000f, 0.0000000f, 0.0000000f}, {0.9659258f, 0.2588190f, 0.0000000f}, {0.8660254f, 0.5000000f, 0.0000000f},
+        {0.7071068f, 0.7071068f, 0.0000000f}, {0.5000000f, 0.8660254f, 0.0000000f}, {0.2588190f, 0.9659258f, 0.0000000f},
+        {0.0000000f, 1.0000000f, 0.0000000f}, {-0.2588190f, 0.9659258f, 0.0000000f}, {-0.5000000f, 0.8660254f, 0.0000000f},
+        {-0.7071068f, 0.7071068f, 0.0000000f}, {-0.8660254f, 0.5000000f, 0.0000000f}, {-0.9659258f, 0.2588190f, 0.0000000f},
+        {-1.0000000f, 0.0000000f, 0.0000000f}, {-0.9659258f, -0.2588190f, 0.0000000f}, {-0.8660254f, -0.5000000f, 0.0000000f},
+        {-0.7071068f, -0.7071068f, 0.0000000f}, {-0.5000000f, -0.8660254f, 0.0000000f}, {-0.2588190f, -0.9659258f, 0.0000000f},
+        {0.0000000f, -1.0000000f, 0.0000000f}, {0.2588190f, -0.9659258f, 0.0000000f}, {0.5000000f, -0.8660254f, 0.0000000f},
+        {0.7071068f, -0.7071068f, 0.0000000f}, {0.8660254f, -0.5000000f, 0.0000000f}, {0.9659258f, -0.2588190f, 0.0000000f},
+        {1.0000000f, 0.0000000f, 0.0000000f}
+    }
+};
+
+// Punti cardinali N = +X (sono anche gli estremi degli assi X, Y, Z)
+static const Point3D MESH_CARDINALI[6] = {
+    {1, 0, 0},  // N (+X)
+    {-1, 0, 0}, // S (-X)
+    {0, 1, 0},  // W (+Y)
+    {0, -1, 0}, // E (-Y)
+    {0, 0, 1},  // Alto (+Z)
+    {0, 0, -1}  // Basso (-Z)
+};
+
+#endif
@@ -0,0 +1,72 @@
+// Kicco972.net
+
+
+#include "PoliticaBle.h"
+
+// Bit dei canali del Sense (ordine di GrandezzaSense in RegistroBle.h)
+#define CANALI_AMBIENTE 0x07
+#define CANALI_TUTTI 0x0F
+
+static const ProfiloBle PROFILI[NUM_CONTESTI_BLE] = {
+    // nome       canali           mag   amb    intervallo    timeout
+    {"base",     CANALI_AMBIENTE, 0,    2000,  160, 320,     400},  // 200-400 ms
+    {"bussola",  CANALI_TUTTI,    50,   2000,  6,   12,      200},  // 7.5-15 ms
+    {"imu",      CANALI_TUTTI,    100,  2000,  24,  40,      200},  // 30-50 ms
+    {"memoria",  CANALI_AMBIENTE, 0,    10000, 320, 400,     400},  // 400-500 ms
+};
+
+PoliticaBle::PoliticaBle() : _attivo(CONTESTO_BASE), _richiesto(CONTESTO_BASE), _richiestoDa(0)
+{
+}
+
+void PoliticaBle::setContesto(ContestoBle contesto, unsigned long adessoMs)
+{
+    if (contesto != _richiesto)
+    {
+        _richiesto = contesto;
+        _richiestoDa = adessoMs;
+    }
+}
+
+bool PoliticaBle::update(unsigned long adessoMs)
+{
+    if (_richiesto == _attivo)
+        return false;
+
+    // Chiedere di più non aspetta, chiedere di meno sì
+    if (isRiduzione(PROFILI[_attivo], PROFILI[_richiesto]) && adessoMs - _richiestoDa < RITARDO_RIDUZIONE_MS)
+        return false;
+
+    _attivo = _richiesto;
+    return true;
+}
+
+ContestoBle PoliticaBle::getContesto() const
+{
+    return _attivo;
+}
+
+const ProfiloBle& PoliticaBle::getProfilo() const
+{
+    return PROFILI[_attivo];
+}
+
+const ProfiloBle& PoliticaBle::profiloPer(ContestoBle contesto)
+{
+    return PROFILI[contesto];
+}
+
+// Periodo confrontabile: 0 (spento) è il più lento di tutti
+static uint32_t periodo(uint16_t ms)
+{
+    return ms == 0 ? 0x10000u : ms;
+}
+
+bool PoliticaBle::isRiduzione(const ProfiloBle& da, const ProfiloBle& a)
+{
+    bool nessunCanaleNuovo = (a.canali & ~da.canali) == 0;
+    return nessunCanaleNuovo &&
+           periodo(a.periodoMagMs) >= periodo(da.periodoMagMs) &&
+           a.periodoAmbienteMs >= da.periodoAmbienteMs &&
+           a.intervalloMax >= da.intervalloMax;
+}
@@ -0,0 +1,64 @@
+/*
+  PoliticaBle.h
+  Sceglie il traffico BLE in base alla schermata attiva: quali canali del Sense
+  servono, a che ritmo il Sense li manda e con che intervallo di connessione.
+  Un profilo più ricco si applica subito; uno più povero solo dopo che il
+  contesto è rimasto stabile per RITARDO_RIDUZIONE_MS, così passare avanti e
+  indietro tra le schermate non riscrive di continuo i parametri.
+  Solo C++ standard, compilabile anche su PC.
+*/
+#ifndef POLITICA_BLE_H
+#define POLITICA_BLE_H
+
+#include <stdint.h>
+
+#define RITARDO_RIDUZIONE_MS 3000
+
+// Intervallo delle periferiche senza dati (attuatori): fisso, basta una risposta rapida al tocco
+#define INTERVALLO_COMANDI_MIN 60   // 75 ms (unità da 1.25 ms)
+#define INTERVALLO_COMANDI_MAX 80   // 100 ms
+#define TIMEOUT_COMANDI 200         // 2 s (unità da 10 ms)
+
+// Intervallo durante il recupero dell'arretrato del Sense (vedi ProtocolloStorico.h), poi torna il profilo
+#define INTERVALLO_STORICO_MIN 6    // 7.5 ms
+#define INTERVALLO_STORICO_MAX 12   // 15 ms
+#define TIMEOUT_STORICO 200         // 2 s
+
+enum ContestoBle {
+    CONTESTO_BASE,      // Dati ambientali (display, allarme, archivio)
+    CONTESTO_BUSSOLA,   // Magnetometro veloce
+    CONTESTO_IMU,       // Magnetometro nella fusione (solo con "Mag ON")
+    CONTESTO_MEMORIA,   // Traffico minimo
+    NUM_CONTESTI_BLE
+};
+
+struct ProfiloBle {
+    const char* nome;
+    uint8_t canali;             // Canali del Sense richiesti (bit = GrandezzaSense)
+    uint16_t periodoMagMs;      // 0 = magnetometro spento sul Sense
+    uint16_t periodoAmbienteMs;
+    uint16_t intervalloMin;     // Intervallo di connessione [1.25 ms]
+    uint16_t intervalloMax;
+    uint16_t timeout;           // Supervision timeout [10 ms]
+};
+
+class PoliticaBle {
+public:
+    PoliticaBle();
+
+    void setContesto(ContestoBle contesto, unsigned long adessoMs);
+    bool update(unsigned long adessoMs);      // true quando il profilo attivo cambia
+
+    ContestoBle getContesto() const;          // Attivo (può seguire quello richiesto)
+    const ProfiloBle& getProfilo() const;
+
+    static const ProfiloBle& profiloPer(ContestoBle contesto);
+    static bool isRiduzione(const ProfiloBle& da, const ProfiloBle& a); // a chiede meno di da
+
+private:
+    ContestoBle _attivo;
+    ContestoBle _richiesto;
+    unsigned long _richiestoDa;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+  ProtocolloAttuatore.h
+  Comandi del Master al Nano IoT e conferme del Nano IoT.
+  Copia identica in Giacca/Nano33_IoT e Giacca/Bracciale/B_G_Master
+  (Arduino compila solo la cartella dello sketch): modificare sempre entrambe.
+  Solo C++ standard, header-only, compilabile anche su PC.
+
+  Comando (caratteristica interruttore, scritto senza risposta, 2 byte):
+    0     uint8   identificativo del comando (1-255, 0 = nessuno)
+    1     uint8   valore (0 = spento, 1 = acceso)
+  Un comando di 1 byte (solo valore) è il formato dei firmware precedenti,
+  scritto con risposta: vale come comando senza identificativo.
+
+  Stato (caratteristica in lettura e notifica, 2 byte, stesso formato):
+    0     uint8   identificativo dell'ultimo comando applicato (0 = nessuno)
+    1     uint8   valore attuale dell'uscita
+  Il Nano IoT lo notifica dopo ogni comando (anche ripetuto: la conferma
+  può essersi persa) e alla sottoscrizione, così il Master conosce lo stato reale.
+*/
+#ifndef PROTOCOLLO_ATTUATORE_H
+#define PROTOCOLLO_ATTUATORE_H
+
+#include <stdint.h>
+
+#define UUID_SERVIZIO_ATTUATORE "19B10000-E8F2-537E-4F6C-D104768A1214"
+#define UUID_COMANDO_ATTUATORE "19B10001-E8F2-537E-4F6C-D104768A1214"
+#define UUID_STATO_ATTUATORE "19B10002-E8F2-537E-4F6C-D104768A1214"
+
+#define MESSAGGIO_ATTUATORE_DIMENSIONE 2
+
+struct MessaggioAttuatore {
+    uint8_t id;
+    uint8_t valore;
+};
+
+inline int codificaMessaggioAttuatore(const MessaggioAttuatore& m, uint8_t* buf, int dimensione)
+{
+    if (dimensione < MESSAGGIO_ATTUATORE_DIMENSIONE)
+        return 0;
+    buf[0] = m.id;
+    buf[1] = m.valore;
+    return MESSAGGIO_ATTUATORE_DIMENSIONE;
+}
+
+// Accetta anche il formato a 1 byte (id = 0)
+inline bool decodificaMessaggioAttuatore(const uint8_t* buf, int lunghezza, MessaggioAttuatore& m)
+{
+    if (lunghezza == 1)
+    {
+        m.id = 0;
+        m.valore = buf[0];
+        return true;
+    }
+    if (lunghezza < MESSAGGIO_ATTUATORE_DIMENSIONE)
+        return false;
+    m.id = buf[0];
+    m.valore = buf[1];
+    return true;
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+  ProtocolloStorico.h
+  Recupero dei campioni ambientali registrati dal Nano Sense mentre il Master
+  era fuori portata (store-and-forward).
+  Copia identica in Giacca/Nano33_sense e Giacca/Bracciale/B_G_Master
+  (Arduino compila solo la cartella dello sketch): modificare sempre entrambe.
+  Solo C++ standard, header-only, compilabile anche su PC.
+
+  Trasferimento a finestra (go-back-N):
+  - il Master scrive RICHIESTA_INIZIA con la finestra e la dimensione dei pacchetti
+    (payload ATT: MTU negoziato - 3);
+  - il Sense notifica fino a "finestra" pacchetti oltre l'ultimo confermato,
+    l'ultimo del trasferimento è STORICO_FINE (senza campioni);
+  - il Master accetta solo il pacchetto atteso con CRC valido e conferma
+    cumulativamente (RICHIESTA_CONFERMA = numero del prossimo pacchetto atteso);
+  - senza conferme per TIMEOUT_STORICO_MS il Sense riparte dal primo non confermato;
+  - alla conferma di STORICO_FINE il Sense scarta i campioni trasferiti.
+
+  Pacchetto (little endian):
+    0     uint8   tipo (STORICO_DATI o STORICO_FINE)
+    1     uint8   numero di campioni
+    2-3   uint16  sequenza del pacchetto (da 0)
+    4-7   uint32  tempo attuale del Sense [ms]: il Master ne ricava l'ora dei campioni
+    8-9   uint16  CRC-16/CCITT dei byte 0-7 e dei campioni
+    10-   campioni, 10 byte ciascuno:
+          uint32 tempo del Sense [ms], int16 temperatura [0.01 °C],
+          uint16 umidità [0.01 %], uint16 pressione [2 Pa] (come TramaSensori,
+          anche per i codici nulli dei valori NaN)
+
+  Richiesta (scritta senza risposta, 6 byte):
+    0     uint8   comando (RICHIESTA_INIZIA o RICHIESTA_CONFERMA)
+    1     uint8   finestra [pacchetti]
+    2-3   uint16  dimensione massima di un pacchetto [byte]
+    4-5   uint16  prossimo pacchetto atteso
+*/
+#ifndef PROTOCOLLO_STORICO_H
+#define PROTOCOLLO_STORICO_H
+
+#include <stdint.h>
+#include "TramaSensori.h"
+
+#define UUID_STORICO_SENSE "19B10012-E8F2-537E-4F6C-D104768A1214"
+#define UUID_RICHIESTA_STORICO "19B10013-E8F2-537E-4F6C-D104768A1214"
+
+#define STORICO_DATI 1
+#define STORICO_FINE 2
+#define RICHIESTA_INIZIA 1
+#define RICHIESTA_CONFERMA 2
+
+#define STORICO_INTESTAZIONE 10
+#define STORICO_CAMPIONE_DIMENSIONE 10
+#define STORICO_PACCHETTO_MINIMO 20      // MTU di default (23 - 3)
+#define STORICO_PACCHETTO_MASSIMO 244    // MTU 247, un pacchetto per evento con DLE
+#define STORICO_MAX_CAMPIONI_PACCHETTO ((STORICO_PACCHETTO_MASSIMO - STORICO_INTESTAZIONE) / STORICO_CAMPIONE_DIMENSIONE)
+#define RICHIESTA_STORICO_DIMENSIONE 6
+
+#define PERIODO_STORICO_MS 30000         // Un campione (media) ogni 30 s fuori portata
+#define TIMEOUT_STORICO_MS 250           // Senza conferme: si riparte dal primo non confermato
+#define FINESTRA_STORICO_DEFAULT 8
+
+struct CampioneSense {
+    uint32_t tempoMs;     // millis() del Sense all'acquisizione
+    float temperatura;    // °C
+    float umidita;        // %
+    float pressione;      // kPa
+};
+
+struct PacchettoStorico {
+    uint8_t tipo;
+    uint8_t numero;
+    uint16_t sequenza;
+    uint32_t tempoSenseMs;
+    CampioneSense campioni[STORICO_MAX_CAMPIONI_PACCHETTO];
+};
+
+struct RichiestaStorico {
+    uint8_t comando;
+    uint8_t finestra;
+    uint16_t dimensionePacchetto;
+    uint16_t atteso;
+};
+
+// CRC-16/CCITT-FALSE (polinomio 0x1021, valore iniziale 0xFFFF)
+inline uint16_t storicoCrc16(uint16_t crc, const uint8_t* dati, int lunghezza)
+{
+    for (int i = 0; i < lunghezza; i++)
+    {
+        crc ^= (uint16_t)dati[i] << 8;
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+// Campioni che entrano in un pacchetto della dimensione data
+inline int storicoCampioniPerPacchetto(int dimensione)
+{
+    if (dimensione > STORICO_PACCHETTO_MASSIMO)
+        dimensione = STORICO_PACCHETTO_MASSIMO;
+    int n = (dimensione - STORICO_INTESTAZIONE) / STORICO_CAMPIONE_DIMENSIONE;
+    return n < 1 ? 1 : n;
+}
+
+inline void codificaCampioneSense(const CampioneSense& c, uint8_t* buf)
+{
+    tramaScrivi32(buf, c.tempoMs);
+    tramaScrivi16(buf + 4, tramaMisura16(c.temperatura, 100.0f, true));
+    tramaScrivi16(buf + 6, tramaMisura16(c.umidita, 100.0f, false));
+    tramaScrivi16(buf + 8, tramaMisura16(c.pressione, 500.0f, false));
+}
+
+inline void decodificaCampioneSense(const uint8_t* buf, CampioneSense& c)
+{
+    c.tempoMs = tramaLeggi32(buf);
+    c.temperatura = tramaLeggiMisura16(buf + 4, 100.0f, true);
+    c.umidita = tramaLeggiMisura16(buf + 6, 100.0f, false);
+    c.pressione = tramaLeggiMisura16(buf + 8, 500.0f, false);
+}
+
+// Intestazione e CRC attorno a campioni già codificati in buf + STORICO_INTESTAZIONE
+inline int chiudiPacchettoStorico(uint8_t tipo, uint8_t numero, uint16_t sequenza, uint32_t tempoSenseMs, uint8_t* buf)
+{
+    buf[0] = tipo;
+    buf[1] = numero;
+    tramaScrivi16(buf + 2, sequenza);
+    tramaScrivi32(buf + 4, tempoSenseMs);
+    int lunghezza = STORICO_INTESTAZIONE + numero * STORICO_CAMPIONE_DIMENSIONE;
+    uint16_t crc = storicoCrc16(0xFFFF, buf, 8);
+    crc = storicoCrc16(crc, buf + STORICO_INTESTAZIONE, lunghezza - STORICO_INTESTAZIONE);
+    tramaScrivi16(buf + 8, crc);
+    return lunghezza;
+}
+
+// false se il pacchetto è troncato, di tipo sconosciuto o con CRC errato
+inline bool decodificaPacchettoStorico(const uint8_t* buf, int lunghezza, PacchettoStorico& p)
+{
+    if (lunghezza < STORICO_INTESTAZIONE || (buf[0] != STORICO_DATI && buf[0] != STORICO_FINE))
+        return false;
+    p.tipo = buf[0];
+    p.numero = buf[1];
+    if (p.numero > STORICO_MAX_CAMPIONI_PACCHETTO || lunghezza != STORICO_INTESTAZIONE + p.numero * STORICO_CAMPIONE_DIMENSIONE)
+        return false;
+    uint16_t crc = storicoCrc16(0xFFFF, buf, 8);
+    crc = storicoCrc16(crc, buf + STORICO_INTESTAZIONE, lunghezza - STORICO_INTESTAZIONE);
+    if (crc != tramaLeggi16(buf + 8))
+        return false;
+    p.sequenza = tramaLeggi16(buf + 2);
+    p.tempoSenseMs = tramaLeggi32(buf + 4);
+    for (int i = 0; i < p.numero; i++)
+        decodificaCampioneSense(buf + STORICO_INTESTAZIONE + i * STORICO_CAMPIONE_DIMENSIONE, p.campioni[i]);
+    return true;
+}
+
+inline int codificaRichiestaStorico(const RichiestaStorico& r, uint8_t* buf, int dimensione)
+{
+    if (dimensione < RICHIESTA_STORICO_DIMENSIONE)
+        return 0;
+    buf[0] = r.comando;
+    buf[1] = r.finestra;
+    tramaScrivi16(buf + 2, r.dimensionePacchetto);
+    tramaScrivi16(buf + 4, r.atteso);
+    return RICHIESTA_STORICO_DIMENSIONE;
+}
+
+inline bool decodificaRichiestaStorico(const uint8_t* buf, int lunghezza, RichiestaStorico& r)
+{
+    if (lunghezza < RICHIESTA_STORICO_DIMENSIONE)
+        return false;
+    r.comando = buf[0];
+    r.finestra = buf[1] == 0 ? 1 : buf[1];
+    r.dimensionePacchetto = tramaLeggi16(buf + 2);
+    if (r.dimensionePacchetto < STORICO_PACCHETTO_MINIMO)
+        r.dimensionePacchetto = STORICO_PACCHETTO_MINIMO;
+    r.atteso = tramaLeggi16(buf + 4);
+    return r.comando == RICHIESTA_INIZIA || r.comando == RICHIESTA_CONFERMA;
+}
+
+#endif
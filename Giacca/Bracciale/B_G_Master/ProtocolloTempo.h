@@ -0,0 +1,106 @@
+/*
+  ProtocolloTempo.h
+  Sincronizzazione dell'orologio delle periferiche con quello del Master
+  (disciplinato dall'NTP in WiFiGiga), a scambi come l'NTP.
+  Copia identica in Giacca/Nano33_sense e Giacca/Bracciale/B_G_Master
+  (Arduino compila solo la cartella dello sketch): modificare sempre entrambe.
+  Solo C++ standard, header-only, compilabile anche su PC.
+
+  Il Master scrive la sua ora (T1), la periferica risponde con una notifica
+  con T1, l'istante di ricezione (T2) e quello di invio (T3) nel suo millis();
+  all'arrivo (T4) il Master ricava:
+    ritardo = (T4 - T1) - (T3 - T2)
+    scarto  = ((T1 - T2) + (T4 - T3)) / 2     (ora del Master - millis() della periferica)
+  Le periferiche marcano i campioni all'acquisizione con il proprio millis()
+  (es. TramaSensori::tempoMs): il Master li porta nella sua ora con lo scarto.
+
+  Richiesta (scritta senza risposta, 10 byte, little endian):
+    0     uint8   TEMPO_RICHIESTA
+    1     uint8   sequenza
+    2-9   uint64  T1: ora del Master [ms dal 1970, ora locale come time(NULL)]
+  Risposta (notifica, 18 byte):
+    0     uint8   TEMPO_RISPOSTA
+    1     uint8   sequenza della richiesta
+    2-9   uint64  T1 della richiesta
+    10-13 uint32  T2: millis() della periferica alla ricezione
+    14-17 uint32  T3: millis() della periferica all'invio
+*/
+#ifndef PROTOCOLLO_TEMPO_H
+#define PROTOCOLLO_TEMPO_H
+
+#include <stdint.h>
+#include "TramaSensori.h"
+
+#define UUID_TEMPO "19B10014-E8F2-537E-4F6C-D104768A1214"
+
+#define TEMPO_RICHIESTA 1
+#define TEMPO_RISPOSTA 2
+#define RICHIESTA_TEMPO_DIMENSIONE 10
+#define RISPOSTA_TEMPO_DIMENSIONE 18
+
+struct RichiestaTempo {
+    uint8_t sequenza;
+    uint64_t t1;
+};
+
+struct RispostaTempo {
+    uint8_t sequenza;
+    uint64_t t1;
+    uint32_t t2;
+    uint32_t t3;
+};
+
+inline void tempoScrivi64(uint8_t* p, uint64_t v)
+{
+    tramaScrivi32(p, (uint32_t)v);
+    tramaScrivi32(p + 4, (uint32_t)(v >> 32));
+}
+
+inline uint64_t tempoLeggi64(const uint8_t* p)
+{
+    return (uint64_t)tramaLeggi32(p) | ((uint64_t)tramaLeggi32(p + 4) << 32);
+}
+
+inline int codificaRichiestaTempo(const RichiestaTempo& r, uint8_t* buf, int dimensione)
+{
+    if (dimensione < RICHIESTA_TEMPO_DIMENSIONE)
+        return 0;
+    buf[0] = TEMPO_RICHIESTA;
+    buf[1] = r.sequenza;
+    tempoScrivi64(buf + 2, r.t1);
+    return RICHIESTA_TEMPO_DIMENSIONE;
+}
+
+inline bool decodificaRichiestaTempo(const uint8_t* buf, int lunghezza, RichiestaTempo& r)
+{
+    if (lunghezza < RICHIESTA_TEMPO_DIMENSIONE || buf[0] != TEMPO_RICHIESTA)
+        return false;
+    r.sequenza = buf[1];
+    r.t1 = tempoLeggi64(buf + 2);
+    return true;
+}
+
+inline int codificaRispostaTempo(const RispostaTempo& r, uint8_t* buf, int dimensione)
+{
+    if (dimensione < RISPOSTA_TEMPO_DIMENSIONE)
+        return 0;
+    buf[0] = TEMPO_RISPOSTA;
+    buf[1] = r.sequenza;
+    tempoScrivi64(buf + 2, r.t1);
+    tramaScrivi32(buf + 10, r.t2);
+    tramaScrivi32(buf + 14, r.t3);
+    return RISPOSTA_TEMPO_DIMENSIONE;
+}
+
+inline bool decodificaRispostaTempo(const uint8_t* buf, int lunghezza, RispostaTempo& r)
+{
+    if (lunghezza < RISPOSTA_TEMPO_DIMENSIONE || buf[0] != TEMPO_RISPOSTA)
+        return false;
+    r.sequenza = buf[1];
+    r.t1 = tempoLeggi64(buf + 2);
+    r.t2 = tramaLeggi32(buf + 10);
+    r.t3 = tramaLeggi32(buf + 14);
+    return true;
+}
+
+#endif
@@ -0,0 +1,143 @@
+// Kicco972.net
+
+
+#include "RegistroBle.h"
+#include "TramaSensori.h"
+#include "ProtocolloAttuatore.h"
+#include "ProtocolloStorico.h"
+#include "ProtocolloTempo.h"
+#include <string.h>
+
+// --- Nano Sense ---
+// La trama unica se il firmware la offre, altrimenti le quattro caratteristiche separate.
+// Il controllo manca nei firmware precedenti: allora cambiano solo le sottoscrizioni.
+// Lo storico (campioni registrati fuori portata) e la sincronizzazione dell'orologio
+// non hanno decoder: li riceve BleNetwork.
+
+static const CaratteristicaTipo CARATTERISTICHE_SENSE[] = {
+    {UUID_TRAMA_SENSORI, CARATT_NOTIFICA | CARATT_PREFERITA, 0, 0x0F, decodificaTramaSense, nullptr, nullptr, "Trama"},
+    {"2A6E", CARATT_NOTIFICA, SENSE_TEMPERATURA, 1 << SENSE_TEMPERATURA, decodificaFloat, "Temperatura", "°C", "Temp"},
+    {"2A6F", CARATT_NOTIFICA, SENSE_UMIDITA, 1 << SENSE_UMIDITA, decodificaFloat, "Umidità", "%", "Umid"},
+    {"2A6D", CARATT_NOTIFICA, SENSE_PRESSIONE, 1 << SENSE_PRESSIONE, decodificaFloat, "Pressione", "kPa", "Press"},
+    {"2AA1", CARATT_NOTIFICA, SENSE_MAGNETOMETRO, 1 << SENSE_MAGNETOMETRO, decodificaVettore, nullptr, nullptr, "Mag"},
+    {UUID_CONTROLLO_SENSE, CARATT_CONTROLLO, 0, 0, nullptr, nullptr, nullptr, "Ctrl"},
+    {UUID_STORICO_SENSE, CARATT_NOTIFICA | CARATT_STORICO, SENSE_TEMPERATURA, 0x07, nullptr, nullptr, nullptr, "Storico"},
+    {UUID_RICHIESTA_STORICO, CARATT_RICHIESTA_STORICO, 0, 0, nullptr, nullptr, nullptr, "Rich"},
+    {UUID_TEMPO, CARATT_NOTIFICA | CARATT_TEMPO, 0, 0x0F, nullptr, nullptr, nullptr, "Tempo"},
+};
+
+const TipoPeriferica TIPO_SENSE = {
+    "Sense",
+    "181A",
+    CARATTERISTICHE_SENSE,
+    sizeof(CARATTERISTICHE_SENSE) / sizeof(CARATTERISTICHE_SENSE[0]),
+};
+
+// --- Nano IoT (attuatore) ---
+// Lo stato manca nei firmware precedenti: allora il comando si scrive con risposta.
+
+static const CaratteristicaTipo CARATTERISTICHE_IOT[] = {
+    {UUID_COMANDO_ATTUATORE, CARATT_COMANDO, 0, 0, nullptr, nullptr, nullptr, "Switch"},
+    {UUID_STATO_ATTUATORE, CARATT_NOTIFICA | CARATT_CONFERMA, IOT_STATO, 1 << IOT_STATO, decodificaStatoAttuatore, nullptr, nullptr, "Stato"},
+};
+
+const TipoPeriferica TIPO_IOT = {
+    "IoT",
+    UUID_SERVIZIO_ATTUATORE,
+    CARATTERISTICHE_IOT,
+    sizeof(CARATTERISTICHE_IOT) / sizeof(CARATTERISTICHE_IOT[0]),
+};
+
+// --- Decoder ---
+
+static void copiaFloat(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                       unsigned long adessoMs, MisuraBle* canali, int numValori)
+{
+    // Il valore della notifica è già in memoria: nessuna lettura ATT
+    MisuraBle& m = canali[c.canale];
+    if (lunghezza > (int)(numValori * sizeof(float)))
+        lunghezza = numValori * sizeof(float);
+    memcpy(m.valori, dati, lunghezza);
+    m.tempoMs = adessoMs;
+    m.aggiornamenti++;
+}
+
+void decodificaFloat(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                     unsigned long adessoMs, MisuraBle* canali, ContatoriTrama&)
+{
+    copiaFloat(c, dati, lunghezza, adessoMs, canali, 1);
+}
+
+void decodificaVettore(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                       unsigned long adessoMs, MisuraBle* canali, ContatoriTrama&)
+{
+    copiaFloat(c, dati, lunghezza, adessoMs, canali, 3);
+}
+
+void decodificaStatoAttuatore(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                               unsigned long adessoMs, MisuraBle* canali, ContatoriTrama&)
+{
+    MessaggioAttuatore stato;
+    if (!decodificaMessaggioAttuatore(dati, lunghezza, stato))
+        return;
+    MisuraBle& m = canali[c.canale];
+    m.valori[0] = stato.valore;
+    m.valori[1] = stato.id;
+    m.tempoMs = adessoMs;
+    m.aggiornamenti++;
+}
+
+void decodificaTramaSense(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                          unsigned long adessoMs, MisuraBle* canali, ContatoriTrama& contatori)
+{
+    TramaSensori t;
+    if (!decodificaTramaSensori(dati, lunghezza, t))
+        return;
+
+    // Un tempo del Sense che torna indietro vuol dire che il Sense è ripartito: la sequenza riparte da 0
+    if (!contatori.prima && t.tempoMs >= contatori.ultimoTempo)
+        contatori.perse += tramePerse(contatori.ultimaSequenza, t.sequenza);
+    contatori.prima = false;
+    contatori.ultimaSequenza = t.sequenza;
+    contatori.ultimoTempo = t.tempoMs;
+    contatori.ricevute++;
+
+    // Il tempo della trama è l'acquisizione dell'ultimo gruppo cambiato: un valore
+    // ripetuto tiene la marca della trama che l'ha portato per primo
+    MisuraBle& m = canali[c.canale + SENSE_MAGNETOMETRO];
+    if (m.tempoPeriferica == 0 || m.valori[0] != t.magX || m.valori[1] != t.magY || m.valori[2] != t.magZ)
+        m.tempoPeriferica = t.tempoMs;
+    m.valori[0] = t.magX;
+    m.valori[1] = t.magY;
+    m.valori[2] = t.magZ;
+    m.tempoMs = adessoMs;
+    m.aggiornamenti++;
+
+    // I dati ambientali cambiano ogni 2 s ma viaggiano in ogni trama
+    if (t.ambienteValido)
+    {
+        const float ambiente[3] = {t.temperatura, t.umidita, t.pressione};
+        const GrandezzaSense grandezze[3] = {SENSE_TEMPERATURA, SENSE_UMIDITA, SENSE_PRESSIONE};
+        for (int i = 0; i < 3; i++)
+        {
+            MisuraBle& a = canali[c.canale + grandezze[i]];
+            if (a.tempoPeriferica == 0 || a.valori[0] != ambiente[i])
+                a.tempoPeriferica = t.tempoMs;
+            a.valori[0] = ambiente[i];
+            a.tempoMs = adessoMs;
+            a.aggiornamenti++;
+        }
+    }
+}
+
+bool stessoUuid(const char* a, const char* b)
+{
+    for (; *a && *b; a++, b++)
+    {
+        char x = (*a >= 'A' && *a <= 'Z') ? (char)(*a - 'A' + 'a') : *a;
+        char y = (*b >= 'A' && *b <= 'Z') ? (char)(*b - 'A' + 'a') : *b;
+        if (x != y)
+            return false;
+    }
+    return *a == *b;
+}
@@ -0,0 +1,105 @@
+/*
+  RegistroBle.h
+  Tipi di periferica BLE conosciuti dal Master, descritti da tabelle:
+  servizio pubblicizzato (per riconoscerle in scansione), caratteristiche
+  e decoder che scrivono nei canali della periferica.
+  Per aggiungere un tipo basta una nuova TipoPeriferica; per aggiungere
+  una periferica basta una voce in più nella configurazione di BleNetwork.
+  Solo C++ standard, compilabile anche su PC.
+*/
+#ifndef REGISTRO_BLE_H
+#define REGISTRO_BLE_H
+
+#include <stdint.h>
+
+#define MAX_PERIFERICHE_BLE 8          // Periferiche collegate contemporaneamente
+#define MAX_CANALI_PERIFERICA 4        // Canali riservati a ogni periferica
+#define MAX_CARATTERISTICHE_TIPO 10    // Caratteristiche descritte per tipo
+
+// Ultimo campione di un canale, con l'istante di arrivo della notifica
+struct MisuraBle {
+    float valori[3];          // Grandezze scalari in valori[0], vettori in X/Y/Z
+    unsigned long tempoMs;    // millis() all'arrivo (0 = mai ricevuto)
+    uint32_t aggiornamenti;   // Notifiche ricevute dalla connessione
+    uint32_t tempoPeriferica; // millis() della periferica all'acquisizione (0 = non marcato),
+                              // nell'ora del Master con BleNetwork::getEpochMs()
+};
+
+// Contatori di una caratteristica con sequenza (trama unica del Sense)
+struct ContatoriTrama {
+    bool prima;
+    uint16_t ultimaSequenza;
+    uint32_t ultimoTempo;
+    uint32_t ricevute;
+    uint32_t perse;               // Buchi nella sequenza dalla connessione
+};
+
+struct CaratteristicaTipo;
+
+// Decodifica una notifica nei canali della periferica (canali[0..MAX_CANALI_PERIFERICA-1])
+typedef void (*DecoderCanali)(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                              unsigned long adessoMs, MisuraBle* canali, ContatoriTrama& contatori);
+
+// Proprietà delle caratteristiche nella tabella
+#define CARATT_NOTIFICA  0x01 // Da sottoscrivere
+#define CARATT_PREFERITA 0x02 // Se presente sostituisce le altre CARATT_NOTIFICA
+#define CARATT_COMANDO   0x04 // Destinazione di scriviComando()
+#define CARATT_CONTROLLO 0x08 // Riceve i periodi del profilo attivo (vedi PoliticaBle.h)
+#define CARATT_CONFERMA  0x10 // Notifica le conferme dei comandi (vedi CodaComandi.h)
+#define CARATT_STORICO   0x20 // Pacchetti dell'arretrato, sottoscritta anche con la preferita (vedi ProtocolloStorico.h)
+#define CARATT_RICHIESTA_STORICO 0x40 // Riceve richiesta e conferme del trasferimento dell'arretrato
+#define CARATT_TEMPO     0x80 // Sincronizzazione dell'orologio, sottoscritta anche con la preferita (vedi ProtocolloTempo.h)
+
+struct CaratteristicaTipo {
+    const char* uuid;
+    uint8_t flag;
+    uint8_t canale;           // Canale scritto dal decoder (i decoder a più canali partono da qui)
+    uint8_t canali;           // Maschera dei canali trasportati: la sottoscrizione segue il profilo
+    DecoderCanali decoder;
+    const char* etichetta;    // Per il log su Serial, nullptr = silenziosa
+    const char* unita;
+    const char* sigla;        // Nome breve per la tabella delle statistiche
+};
+
+struct TipoPeriferica {
+    const char* nome;         // Per il log
+    const char* uuidServizio; // Servizio pubblicizzato e che contiene le caratteristiche
+    const CaratteristicaTipo* caratteristiche;
+    int numCaratteristiche;
+};
+
+// --- Tipi conosciuti ---
+
+// Canali del Nano IoT: valori[0] = uscita, valori[1] = id dell'ultimo comando applicato
+enum GrandezzaIoT {
+    IOT_STATO,
+    NUM_GRANDEZZE_IOT
+};
+
+// Canali del Nano Sense
+enum GrandezzaSense {
+    SENSE_TEMPERATURA,
+    SENSE_UMIDITA,
+    SENSE_PRESSIONE,
+    SENSE_MAGNETOMETRO,
+    NUM_GRANDEZZE_SENSE
+};
+
+extern const TipoPeriferica TIPO_SENSE;
+extern const TipoPeriferica TIPO_IOT;
+
+// --- Decoder comuni ---
+
+void decodificaFloat(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                     unsigned long adessoMs, MisuraBle* canali, ContatoriTrama& contatori);
+void decodificaVettore(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                       unsigned long adessoMs, MisuraBle* canali, ContatoriTrama& contatori);
+void decodificaStatoAttuatore(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                               unsigned long adessoMs, MisuraBle* canali, ContatoriTrama& contatori);
+void decodificaTramaSense(const CaratteristicaTipo& c, const uint8_t* dati, int lunghezza,
+                          unsigned long adessoMs, MisuraBle* canali, ContatoriTrama& contatori);
+
+// Confronto di UUID senza distinzione tra maiuscole e minuscole
+bool stessoUuid(const char* a, const char* b);
+
+#endif
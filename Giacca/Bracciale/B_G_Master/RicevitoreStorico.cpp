@@ -0,0 +1,187 @@
+// Kicco972.net
+
+
+#include "RicevitoreStorico.h"
+#include <string.h>
+
+RicevitoreStorico::RicevitoreStorico()
+    : _testa(0), _numero(0), _attivo(false), _periferica(-1), _finestra(1), _atteso(0),
+      _daConfermare(0), _confermaPronta(false), _bucoSegnalato(false),
+      _ultimoFuoriOrdine(0), _riferimentoEpoch(0), _riferimentoSenseMs(0)
+{
+    memset(&_statistiche, 0, sizeof(_statistiche));
+}
+
+void RicevitoreStorico::inizia(int periferica, uint16_t dimensionePacchetto, uint8_t finestra,
+                               unsigned long adessoMs, RichiestaStorico& richiesta)
+{
+    if (dimensionePacchetto > STORICO_PACCHETTO_MASSIMO)
+        dimensionePacchetto = STORICO_PACCHETTO_MASSIMO;
+    if (dimensionePacchetto < STORICO_PACCHETTO_MINIMO)
+        dimensionePacchetto = STORICO_PACCHETTO_MINIMO;
+
+    // Tutta la finestra deve entrare nella coda, altrimenti i pacchetti in volo si perdono
+    int perPacchetto = storicoCampioniPerPacchetto(dimensionePacchetto);
+    int massima = (CODA_STORICO - _numero) / perPacchetto;
+    if (finestra > massima)
+        finestra = (uint8_t)(massima < 1 ? 1 : massima);
+    if (finestra < 1)
+        finestra = 1;
+
+    _attivo = true;
+    _periferica = periferica;
+    _finestra = finestra;
+    _atteso = 0;
+    _daConfermare = 0;
+    _confermaPronta = false;
+    _bucoSegnalato = false;
+    memset(&_statistiche, 0, sizeof(_statistiche));
+    _statistiche.inizioMs = adessoMs;
+    _statistiche.fineMs = adessoMs;
+
+    richiesta.comando = RICHIESTA_INIZIA;
+    richiesta.finestra = finestra;
+    richiesta.dimensionePacchetto = dimensionePacchetto;
+    richiesta.atteso = 0;
+}
+
+void RicevitoreStorico::annulla(unsigned long adessoMs)
+{
+    _confermaPronta = false;
+    _periferica = -1;
+    if (!_attivo)
+        return;
+    _attivo = false;
+    _statistiche.fineMs = adessoMs;
+}
+
+void RicevitoreStorico::ricevi(const uint8_t* dati, int lunghezza, uint32_t adessoEpoch, unsigned long adessoMs)
+{
+    // A trasferimento completato si risponde ancora ai ripetuti: la conferma della fine può essersi persa
+    if (!_attivo && !_statistiche.completato)
+        return;
+
+    PacchettoStorico p;
+    if (!decodificaPacchettoStorico(dati, lunghezza, p))
+    {
+        _statistiche.scartati++;
+        return;
+    }
+
+    if (!_attivo || p.sequenza != _atteso)
+    {
+        _statistiche.fuoriOrdine++;
+        // Ripetuto: la conferma si è persa e va rimandata
+        if (!_attivo || (uint16_t)(_atteso - p.sequenza) <= 0x8000)
+        {
+            _confermaPronta = true;
+            return;
+        }
+        // Dopo un buco il Sense riparte subito: una conferma per giro (la sequenza che torna
+        // indietro vuol dire che il Sense è già ripartito e il buco si è ripresentato)
+        if (!_bucoSegnalato || (uint16_t)(_ultimoFuoriOrdine - p.sequenza) <= 0x8000)
+            _confermaPronta = true;
+        _bucoSegnalato = true;
+        _ultimoFuoriOrdine = p.sequenza;
+        return;
+    }
+
+    if (CODA_STORICO - _numero < p.numero)
+    {
+        _statistiche.senzaPosto++;
+        return;
+    }
+
+    accoda(p, adessoEpoch);
+    _atteso++;
+    _bucoSegnalato = false;
+    _statistiche.pacchetti++;
+    _statistiche.campioni += p.numero;
+    _statistiche.byte += lunghezza;
+    _statistiche.fineMs = adessoMs;
+
+    // Conferma ogni mezza finestra (per difetto): anche se una conferma si perde,
+    // la successiva parte prima che il Sense abbia esaurito la finestra
+    _daConfermare++;
+    if (_daConfermare >= (_finestra > 1 ? _finestra / 2 : 1) || p.tipo == STORICO_FINE)
+        _confermaPronta = true;
+
+    if (p.tipo == STORICO_FINE)
+    {
+        _statistiche.completato = true;
+        _attivo = false;
+    }
+}
+
+bool RicevitoreStorico::confermaDaInviare(RichiestaStorico& conferma)
+{
+    if (!_confermaPronta)
+        return false;
+    _confermaPronta = false;
+    _daConfermare = 0;
+    _statistiche.conferme++;
+
+    conferma.comando = RICHIESTA_CONFERMA;
+    conferma.finestra = _finestra;
+    conferma.dimensionePacchetto = 0;
+    conferma.atteso = _atteso;
+    return true;
+}
+
+bool RicevitoreStorico::estrai(CampioneStorico& c)
+{
+    if (_numero == 0)
+        return false;
+    c = _coda[_testa];
+    _testa = (_testa + 1) % CODA_STORICO;
+    _numero--;
+    return true;
+}
+
+int RicevitoreStorico::getNumeroInCoda() const
+{
+    return _numero;
+}
+
+bool RicevitoreStorico::isAttivo() const
+{
+    return _attivo;
+}
+
+int RicevitoreStorico::getPeriferica() const
+{
+    return _periferica;
+}
+
+const StatisticheStorico& RicevitoreStorico::getStatistiche() const
+{
+    return _statistiche;
+}
+
+uint32_t RicevitoreStorico::getVelocitaByteS() const
+{
+    unsigned long durata = _statistiche.fineMs - _statistiche.inizioMs;
+    if (durata == 0)
+        return 0;
+    return (uint32_t)((uint64_t)_statistiche.byte * 1000 / durata);
+}
+
+void RicevitoreStorico::accoda(const PacchettoStorico& p, uint32_t adessoEpoch)
+{
+    // Un solo riferimento per trasferimento: i campioni restano a distanza esatta tra loro
+    if (_statistiche.pacchetti == 0)
+    {
+        _riferimentoEpoch = adessoEpoch;
+        _riferimentoSenseMs = p.tempoSenseMs;
+    }
+    for (int i = 0; i < p.numero; i++)
+    {
+        const CampioneSense& s = p.campioni[i];
+        CampioneStorico& c = _coda[(_testa + _numero) % CODA_STORICO];
+        c.epoch = _riferimentoEpoch - (_riferimentoSenseMs - s.tempoMs) / 1000;
+        c.temperatura = s.temperatura;
+        c.umidita = s.umidita;
+        c.pressione = s.pressione;
+        _numero++;
+    }
+}
@@ -0,0 +1,76 @@
+/*
+  RicevitoreStorico.h
+  Lato Master del recupero dell'arretrato del Sense (vedi ProtocolloStorico.h).
+  ricevi() gira nel gestore di evento delle notifiche e non scrive mai su BLE:
+  prepara solo la conferma cumulativa, che BleNetwork scrive nel loop.
+  Un pacchetto si accetta solo se è il prossimo atteso, con CRC valido e con
+  posto nella coda dei campioni; altrimenti il Sense lo ripete (go-back-N).
+  I tempi del Sense diventano ora del Master con il tempo del Sense scritto
+  nel primo pacchetto: epoch = adesso - (tempo del Sense - tempo del campione).
+  Solo C++ standard, compilabile anche su PC.
+*/
+#ifndef RICEVITORE_STORICO_H
+#define RICEVITORE_STORICO_H
+
+#include <stdint.h>
+#include "ProtocolloStorico.h"
+#include "UnioneStorico.h"
+
+#define CODA_STORICO 256               // Campioni ricevuti in attesa della flash (una finestra intera)
+
+// Esito del trasferimento in corso (o dell'ultimo)
+struct StatisticheStorico {
+    uint32_t pacchetti;         // Accettati
+    uint32_t campioni;
+    uint32_t byte;              // Byte dei pacchetti accettati
+    uint32_t scartati;          // CRC o formato errato
+    uint32_t fuoriOrdine;       // Ripetuti o dopo un buco
+    uint32_t senzaPosto;        // Coda dei campioni piena
+    uint32_t conferme;
+    unsigned long inizioMs;
+    unsigned long fineMs;
+    bool completato;            // Arrivato STORICO_FINE
+};
+
+class RicevitoreStorico {
+public:
+    RicevitoreStorico();
+
+    // Nuovo trasferimento: la finestra si riduce finché la coda può contenerla tutta
+    void inizia(int periferica, uint16_t dimensionePacchetto, uint8_t finestra, unsigned long adessoMs,
+                RichiestaStorico& richiesta);
+    void annulla(unsigned long adessoMs);   // Periferica scollegata: i campioni già in coda restano validi
+
+    void ricevi(const uint8_t* dati, int lunghezza, uint32_t adessoEpoch, unsigned long adessoMs);
+
+    // Conferma cumulativa da scrivere al Sense. false se non serve
+    bool confermaDaInviare(RichiestaStorico& conferma);
+
+    bool estrai(CampioneStorico& c);
+    int getNumeroInCoda() const;
+
+    bool isAttivo() const;
+    int getPeriferica() const;
+    const StatisticheStorico& getStatistiche() const;
+    uint32_t getVelocitaByteS() const;      // Byte utili al secondo del trasferimento
+
+private:
+    CampioneStorico _coda[CODA_STORICO];
+    int _testa;
+    int _numero;
+    bool _attivo;
+    int _periferica;
+    uint8_t _finestra;
+    uint16_t _atteso;                      // Prossimo pacchetto atteso
+    uint8_t _daConfermare;                 // Pacchetti accettati dall'ultima conferma
+    bool _confermaPronta;
+    bool _bucoSegnalato;                   // Una sola conferma ripetuta per buco e per giro
+    uint16_t _ultimoFuoriOrdine;
+    uint32_t _riferimentoEpoch;            // Ora del Master e del Sense al primo pacchetto
+    uint32_t _riferimentoSenseMs;
+    StatisticheStorico _statistiche;
+
+    void accoda(const PacchettoStorico& p, uint32_t adessoEpoch);
+};
+
+#endif
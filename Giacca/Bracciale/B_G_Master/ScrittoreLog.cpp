@@ -0,0 +1,256 @@
+// Kicco972.net
+
+
+#include "ScrittoreLog.h"
+#include <string.h>
+#include <unistd.h>
+
+ScrittoreLog::ScrittoreLog()
+    : _percorso(nullptr), _intestazione(""), _file(nullptr), _usati(0), _daSincronizzare(false),
+      _primaRigaMs(0), _ultimaSyncMs(0), _ultimoErroreMs(0), _inErrore(false)
+{
+    memset(&_statistiche, 0, sizeof(_statistiche));
+}
+
+void ScrittoreLog::begin(const char* percorso, const char* intestazione)
+{
+    _percorso = percorso;
+    _intestazione = intestazione;
+}
+
+bool ScrittoreLog::aggiungi(const char* riga, int lunghezza, unsigned long adessoMs)
+{
+    if (lunghezza <= 0 || lunghezza > DIMENSIONE_BUFFER_LOG)
+        return false;
+    if (_usati + lunghezza > DIMENSIONE_BUFFER_LOG)
+        svuota(adessoMs);
+    if (_usati + lunghezza > DIMENSIONE_BUFFER_LOG)
+    {
+        _statistiche.perse++;
+        return false;
+    }
+    if (_usati == 0)
+        _primaRigaMs = adessoMs;
+    memcpy(_buffer + _usati, riga, lunghezza);
+    _usati += lunghezza;
+    _statistiche.righe++;
+    return true;
+}
+
+void ScrittoreLog::update(unsigned long adessoMs)
+{
+    // Buffer quasi pieno (la prossima riga potrebbe non starci) o riga più vecchia scaduta
+    if (_usati > 0 && (_usati > DIMENSIONE_BUFFER_LOG - RIGA_LOG_MASSIMA || adessoMs - _primaRigaMs >= ATTESA_MASSIMA_LOG_MS))
+        svuota(adessoMs);
+
+    if (_daSincronizzare && adessoMs - _ultimaSyncMs >= PERIODO_SYNC_LOG_MS)
+        sincronizza(adessoMs);
+}
+
+bool ScrittoreLog::sincronizza(unsigned long adessoMs)
+{
+    if (!svuota(adessoMs))
+        return false;
+    _ultimaSyncMs = adessoMs;
+    if (!_daSincronizzare)
+        return true;
+    if (fflush(_file) != 0 || fsync(fileno(_file)) != 0)
+    {
+        errore(adessoMs);
+        return false;
+    }
+    _daSincronizzare = false;
+    _statistiche.sincronizzazioni++;
+    return true;
+}
+
+void ScrittoreLog::abbandona()
+{
+    // Il supporto non c'è più: fclose() non può scrivere niente, libera solo le risorse
+    if (_file)
+        fclose(_file);
+    _file = nullptr;
+    _daSincronizzare = false;
+}
+
+bool ScrittoreLog::chiudi(unsigned long adessoMs)
+{
+    if (!sincronizza(adessoMs))
+        return false;
+    abbandona();
+    return true;
+}
+
+bool ScrittoreLog::isAperto() const
+{
+    return _file != nullptr;
+}
+
+int ScrittoreLog::getInAttesa() const
+{
+    return _usati;
+}
+
+const StatisticheLog& ScrittoreLog::getStatistiche() const
+{
+    return _statistiche;
+}
+
+// Scrive il buffer nel file (aprendolo se serve). true se il buffer è vuoto
+bool ScrittoreLog::svuota(unsigned long adessoMs)
+{
+    if (!_file && !apri(adessoMs))
+        return false;
+    if (_usati == 0)
+        return true;
+
+    size_t scritti = fwrite(_buffer, 1, _usati, _file);
+    if (scritti != (size_t)_usati)
+    {
+        // Quanto è arrivato davvero sul supporto non si sa: si riscrive tutto alla riapertura
+        errore(adessoMs);
+        return false;
+    }
+    _usati = 0;
+    _daSincronizzare = true;
+    _statistiche.scritture++;
+    return true;
+}
+
+bool ScrittoreLog::apri(unsigned long adessoMs)
+{
+    if (!_percorso || (_inErrore && adessoMs - _ultimoErroreMs < RIPROVA_LOG_MS))
+        return false;
+
+    // Vecchio formato (virgole senza punto e virgola): il file si rigenera, come faceva logData()
+    const char* modo = "a+";
+    FILE* f = fopen(_percorso, "r");
+    if (f)
+    {
+        char prima[128];
+        if (fgets(prima, sizeof(prima), f) && strchr(prima, ',') && !strchr(prima, ';'))
+            modo = "w+";
+        fclose(f);
+    }
+
+    _file = fopen(_percorso, modo);
+    if (!_file)
+    {
+        errore(adessoMs);
+        return false;
+    }
+    // Niente buffer di stdio: il buffer è già questo, e arriva al file a blocchi interi
+    setvbuf(_file, nullptr, _IONBF, 0);
+
+    bool ok = fseek(_file, 0, SEEK_END) == 0;
+    long dimensione = ftell(_file);
+    bool scritto = false;
+    if (ok && dimensione == 0)
+    {
+        ok = fputs(_intestazione, _file) >= 0;
+        scritto = true;
+    }
+    else if (ok && dimensione > 0)
+    {
+        // Riga troncata da una rimozione a metà scrittura: la si chiude.
+        // Tra una lettura e una scrittura sullo stesso stream serve un
+        // posizionamento (C11 7.21.5.3); con "a+" si scrive comunque in fondo
+        char ultimo = '\n';
+        ok = fseek(_file, dimensione - 1, SEEK_SET) == 0 && fread(&ultimo, 1, 1, _file) == 1;
+        if (ok && ultimo != '\n')
+        {
+            ok = fseek(_file, 0, SEEK_END) == 0 && fputc('\n', _file) != EOF;
+            scritto = true;
+        }
+    }
+    if (!ok)
+    {
+        errore(adessoMs);
+        return false;
+    }
+    _inErrore = false;
+    if (scritto)
+        _daSincronizzare = true;
+    return true;
+}
+
+void ScrittoreLog::errore(unsigned long adessoMs)
+{
+    abbandona();
+    _inErrore = true;
+    _ultimoErroreMs = adessoMs;
+    _statistiche.errori++;
+}
+
+// Cifre di un intero non negativo, da destra. Restituisce la lunghezza
+static int scriviIntero(char* buf, uint32_t valore, int cifreMinime)
+{
+    char cifre[10];
+    int n = 0;
+    do
+    {
+        cifre[n++] = (char)('0' + valore % 10);
+        valore /= 10;
+    } while (valore > 0);
+    while (n < cifreMinime)
+        cifre[n++] = '0';
+    for (int i = 0; i < n; i++)
+        buf[i] = cifre[n - 1 - i];
+    return n;
+}
+
+int ScrittoreLog::formattaRiga(char* buf, int dimensione, uint32_t epoch, const float* valori, int numero)
+{
+    // Data civile dai giorni dal 1970 (algoritmo di H. Hinnant), senza localtime()
+    uint32_t giorni = epoch / 86400;
+    uint32_t secondi = epoch % 86400;
+    uint32_t z = giorni + 719468;
+    uint32_t era = z / 146097;
+    uint32_t giornoEra = z - era * 146097;
+    uint32_t annoEra = (giornoEra - giornoEra / 1460 + giornoEra / 36524 - giornoEra / 146096) / 365;
+    uint32_t giornoAnno = giornoEra - (365 * annoEra + annoEra / 4 - annoEra / 100);
+    uint32_t mp = (5 * giornoAnno + 2) / 153;
+    uint32_t giorno = giornoAnno - (153 * mp + 2) / 5 + 1;
+    uint32_t mese = mp < 10 ? mp + 3 : mp - 9;
+    uint32_t anno = annoEra + era * 400 + (mese <= 2 ? 1 : 0);
+
+    // Data e ora: 20 caratteri, ogni valore al più 14 ("-21474836,48;") più '\n'
+    if (dimensione < 20 + numero * 14 + 1)
+        return 0;
+    char* p = buf;
+    p += scriviIntero(p, giorno, 2);
+    *p++ = '/';
+    p += scriviIntero(p, mese, 2);
+    *p++ = '/';
+    p += scriviIntero(p, anno, 4);
+    *p++ = ';';
+    p += scriviIntero(p, secondi / 3600, 2);
+    *p++ = ':';
+    p += scriviIntero(p, secondi / 60 % 60, 2);
+    *p++ = ':';
+    p += scriviIntero(p, secondi % 60, 2);
+
+    for (int i = 0; i < numero; i++)
+    {
+        *p++ = ';';
+        float v = valori[i];
+        if (!(v == v) || v > 2.0e7f || v < -2.0e7f)
+        {
+            // NaN (sensore guasto) o fuori scala: la cella resta leggibile
+            memcpy(p, "nan", 3);
+            p += 3;
+            continue;
+        }
+        if (v < 0)
+        {
+            *p++ = '-';
+            v = -v;
+        }
+        uint32_t centesimi = (uint32_t)(v * 100.0f + 0.5f);
+        p += scriviIntero(p, centesimi / 100, 1);
+        *p++ = ',';
+        p += scriviIntero(p, centesimi % 100, 2);
+    }
+    *p++ = '\n';
+    return (int)(p - buf);
+}
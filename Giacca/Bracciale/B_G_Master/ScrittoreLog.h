@@ -0,0 +1,81 @@
+/*
+  ScrittoreLog.h
+  Registro CSV con il file sempre aperto. Le righe si accodano in un buffer
+  preallocato e arrivano al file a blocchi: con il buffer quasi pieno o
+  dopo ATTESA_MASSIMA_LOG_MS dalla prima riga in attesa. Ogni
+  PERIODO_SYNC_LOG_MS, o quando lo chiede chi usa il file (sincronizza()),
+  segue fsync(): solo allora i dati sono sicuri sul supporto.
+  Un errore di scrittura o la rimozione del supporto (abbandona()) chiudono
+  il file senza perdere le righe in attesa: si riapre ogni RIPROVA_LOG_MS,
+  e una riga rimasta a metà viene chiusa prima di scrivere le nuove.
+  C standard (stdio) più fsync() POSIX, che c'è anche nell'mbed: compilabile anche su PC.
+*/
+#ifndef SCRITTORE_LOG_H
+#define SCRITTORE_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define DIMENSIONE_BUFFER_LOG 4096     // Un blocco intero per scrittura (cluster FAT tipico)
+#define RIGA_LOG_MASSIMA 96
+#define ATTESA_MASSIMA_LOG_MS 2000     // Età massima di una riga in RAM
+#define PERIODO_SYNC_LOG_MS 10000      // Dati scritti ma non ancora sincronizzati, al più
+#define RIPROVA_LOG_MS 3000            // Riapertura dopo un errore
+
+struct StatisticheLog {
+    uint32_t righe;            // Righe accodate
+    uint32_t perse;            // Buffer pieno con il file chiuso
+    uint32_t scritture;        // Blocchi scritti
+    uint32_t sincronizzazioni;
+    uint32_t errori;           // Aperture o scritture fallite
+};
+
+class ScrittoreLog {
+public:
+    ScrittoreLog();
+
+    // intestazione: prima riga di un file nuovo (con '\n')
+    void begin(const char* percorso, const char* intestazione);
+
+    // Copia la riga nel buffer (svuotandolo prima se serve). false se la riga è persa
+    bool aggiungi(const char* riga, int lunghezza, unsigned long adessoMs);
+
+    // Politica di scrittura e sincronizzazione, riapertura dopo un errore (una volta per loop)
+    void update(unsigned long adessoMs);
+
+    // Punto di sincronizzazione: tutto sul supporto (es. prima di leggere il file)
+    bool sincronizza(unsigned long adessoMs);
+
+    // Supporto rimosso: chiude senza scrivere, le righe restano in attesa
+    void abbandona();
+
+    // Fine del file (es. esportazione completata): sincronizza e chiude. false se restano righe in attesa
+    bool chiudi(unsigned long adessoMs);
+
+    bool isAperto() const;
+    int getInAttesa() const;   // Byte nel buffer
+    const StatisticheLog& getStatistiche() const;
+
+    // "gg/mm/aaaa;hh:mm:ss;v1;v2;...\n" con la virgola decimale (Excel italiano), senza heap.
+    // epoch è già in ora locale (vedi WiFiGiga). Restituisce la lunghezza, 0 se non ci sta
+    static int formattaRiga(char* buf, int dimensione, uint32_t epoch, const float* valori, int numero);
+
+private:
+    const char* _percorso;
+    const char* _intestazione;
+    FILE* _file;
+    char _buffer[DIMENSIONE_BUFFER_LOG];
+    int _usati;
+    bool _daSincronizzare;             // Scritture dopo l'ultimo fsync()
+    unsigned long _primaRigaMs;        // Età della riga più vecchia in attesa
+    unsigned long _ultimaSyncMs;
+    unsigned long _ultimoErroreMs;
+    bool _inErrore;
+    StatisticheLog _statistiche;
+
+    bool apri(unsigned long adessoMs);
+    bool svuota(unsigned long adessoMs);
+    void errore(unsigned long adessoMs);
+};
+
+#endif
@@ -0,0 +1,230 @@
+// Kicco972.net
+
+
+#include "SensoreImu.h"
+
+// Instantiate the IMU on Wire1 (Correct for GIGA Display Shield)
+BoschSensorClass imu(Wire1);
+
+#define ODR_BMI270 0x0A              // Codice ODR per 400 Hz (ACC_CONF / GYR_CONF)
+#define FREQUENZA_FIFO 400.0f
+#define FREQUENZA_SENZA_FIFO 100.0f  // ODR di default della libreria, usato se la FIFO non si configura
+#define PERIODO_CAMPIONAMENTO_MS 10  // Risveglio: ~4 frame per burst a 400 Hz
+#define INDIRIZZO_BMI270 0x68
+
+SensoreImu::SensoreImu() : _campionatore(nullptr), _fifoAttiva(false), _burstFifo(0) {}
+
+bool SensoreImu::begin()
+{
+  mutexWire1.lock();
+  bool ok = imu.begin();
+  mutexWire1.unlock();
+  if (!ok)
+    return false;
+
+  // FIFO hardware ad alto ODR; in caso di errore restano le letture registro per registro
+  _fifoAttiva = configuraFifo();
+  return true;
+}
+
+bool SensoreImu::avviaThread()
+{
+  // La frequenza di campionamento non dipende più da chi consuma i campioni
+  _campionatore = new rtos::Thread(osPriorityAboveNormal, 2048, nullptr, "imu");
+  if (_campionatore->start(mbed::callback(this, &SensoreImu::cicloCampionatore)) != osOK)
+  {
+    delete _campionatore;
+    _campionatore = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool SensoreImu::leggiCampione(CampioneImu &c)
+{
+  // --- FORCE READ (Bypass available() check for debugging) ---
+  // If these return false, the variables remain untouched.
+  // We initialize them to 0 to ensure we aren't using garbage memory.
+  // (Un accelerometro nullo fa saltare la correzione di gravità nella fusione)
+  c.ax = 0;
+  c.ay = 0;
+  c.az = 0;
+
+  mutexWire1.lock();
+  // The library returns 1 (true) on success, 0 (false) on failure
+  c.accValido = imu.readAcceleration(c.ax, c.ay, c.az);
+  bool gyroOk = imu.readGyroscope(c.gx, c.gy, c.gz);
+  mutexWire1.unlock();
+
+  c.tempoUs = micros();
+  return gyroOk;
+}
+
+bool SensoreImu::scriviRegistro(uint8_t reg, uint8_t valore)
+{
+  Wire1.beginTransmission(INDIRIZZO_BMI270);
+  Wire1.write(reg);
+  Wire1.write(valore);
+  return Wire1.endTransmission() == 0;
+}
+
+bool SensoreImu::leggiRegistri(uint8_t reg, uint8_t *dati, int n)
+{
+  Wire1.beginTransmission(INDIRIZZO_BMI270);
+  Wire1.write(reg);
+  if (Wire1.endTransmission(false) != 0)
+    return false;
+  if (Wire1.requestFrom((uint8_t)INDIRIZZO_BMI270, (size_t)n) != (uint8_t)n)
+    return false;
+  for (int i = 0; i < n; i++)
+    dati[i] = Wire1.read();
+  return true;
+}
+
+bool SensoreImu::configuraFifo()
+{
+  // Chiamata dopo imu.begin(): la libreria ha già caricato la configurazione e acceso i sensori.
+  // Stessi range della libreria (±4 g, ±2000 °/s) così le scale restano quelle di readAcceleration().
+  const uint8_t confSensore = 0xA0 | ODR_BMI270; // filter_perf + banda normale
+  const uint8_t confFifo1 = 0xD0;                // gyr_en + acc_en + header_en
+
+  mutexWire1.lock();
+  bool ok = scriviRegistro(0x7C, 0x00); // PWR_CONF: disattiva l'advanced power save
+  delay(1);
+  ok = ok && scriviRegistro(BMI270_REG_ACC_CONF, confSensore);
+  delayMicroseconds(500);
+  ok = ok && scriviRegistro(BMI270_REG_ACC_RANGE, 0x01);
+  delayMicroseconds(500);
+  ok = ok && scriviRegistro(BMI270_REG_GYR_CONF, confSensore);
+  delayMicroseconds(500);
+  ok = ok && scriviRegistro(BMI270_REG_GYR_RANGE, 0x00);
+  delayMicroseconds(500);
+  ok = ok && scriviRegistro(BMI270_REG_FIFO_CONFIG_0, 0x02); // Stream + frame di sensortime
+  delayMicroseconds(500);
+  ok = ok && scriviRegistro(BMI270_REG_FIFO_CONFIG_1, confFifo1);
+  delayMicroseconds(500);
+
+  // Verifica rileggendo i registri scritti
+  uint8_t letti[2];
+  ok = ok && leggiRegistri(BMI270_REG_ACC_CONF, letti, 1) && letti[0] == confSensore;
+  ok = ok && leggiRegistri(BMI270_REG_FIFO_CONFIG_1, letti, 1) && letti[0] == confFifo1;
+
+  ok = ok && scriviRegistro(BMI270_REG_CMD, BMI270_CMD_FIFO_FLUSH);
+  mutexWire1.unlock();
+  return ok;
+}
+
+void SensoreImu::svuotaFifo()
+{
+  // Legge la FIFO in burst da DIMENSIONE_BURST byte e decodifica i frame.
+  // Un frame troncato in fondo al burst viene ripresentato dal sensore al burst successivo.
+  int numFrame = 0;
+  bool vuota = false;
+
+  mutexWire1.lock();
+  for (int b = 0; b < MAX_BURST && !vuota && numFrame < MAX_FRAME_FIFO; b++)
+  {
+    uint8_t lunghezza[2];
+    if (!leggiRegistri(BMI270_REG_FIFO_LENGTH_0, lunghezza, 2))
+      break;
+    int disponibili = lunghezza[0] | ((lunghezza[1] & 0x3F) << 8);
+    if (disponibili == 0)
+      break;
+
+    // +4 per il frame di sensortime che segue l'ultimo frame dati
+    int daLeggere = disponibili + 4;
+    if (daLeggere > DIMENSIONE_BURST)
+      daLeggere = DIMENSIONE_BURST;
+    if (!leggiRegistri(BMI270_REG_FIFO_DATA, _bufferFifo, daLeggere))
+      break;
+    _burstFifo++;
+
+    numFrame += _decoderFifo.decodifica(_bufferFifo, daLeggere, _frameFifo + numFrame, MAX_FRAME_FIFO - numFrame);
+    vuota = _decoderFifo.isFifoVuota() || daLeggere < DIMENSIONE_BURST;
+  }
+  mutexWire1.unlock();
+
+  if (numFrame == 0)
+    return;
+
+  // Marca temporale: l'ultimo frame è il più recente, gli altri sono distanziati di un periodo ODR.
+  // I frame persi dal sensore compaiono come un buco rispetto al burst precedente.
+  uint32_t adesso = micros();
+  uint32_t periodoUs = (uint32_t)(1000000.0f / FREQUENZA_FIFO);
+  for (int i = 0; i < numFrame; i++)
+  {
+    const FrameFifoBmi270 &f = _frameFifo[i];
+    CampioneImu c;
+    c.tempoUs = adesso - (uint32_t)(numFrame - 1 - i) * periodoUs;
+    c.ax = f.ax / BMI270_LSB_PER_G;
+    c.ay = f.ay / BMI270_LSB_PER_G;
+    c.az = f.az / BMI270_LSB_PER_G;
+    c.gx = f.gx / BMI270_LSB_PER_DPS;
+    c.gy = f.gy / BMI270_LSB_PER_DPS;
+    c.gz = f.gz / BMI270_LSB_PER_DPS;
+    c.accValido = f.acc;
+    _codaCampioni.inserisci(c); // Se nessuno svuota la coda, il campione viene contato come perso
+  }
+}
+
+void SensoreImu::campiona()
+{
+  if (_fifoAttiva)
+  {
+    svuotaFifo();
+  }
+  else
+  {
+    CampioneImu c;
+    if (leggiCampione(c))
+      _codaCampioni.inserisci(c);
+  }
+}
+
+void SensoreImu::cicloCampionatore()
+{
+  // Produttore: svuota la FIFO (o legge l'IMU) a periodo fisso.
+  // sleep_until sul tempo assoluto evita che il ritardo della lettura si accumuli.
+  auto prossimo = rtos::Kernel::Clock::now();
+  while (true)
+  {
+    prossimo += std::chrono::milliseconds(PERIODO_CAMPIONAMENTO_MS);
+    campiona();
+    rtos::ThisThread::sleep_until(prossimo);
+  }
+}
+
+bool SensoreImu::estrai(CampioneImu &c)
+{
+  return _codaCampioni.estrai(c);
+}
+
+float SensoreImu::getFrequenza()
+{
+  return _fifoAttiva ? FREQUENZA_FIFO : FREQUENZA_SENZA_FIFO;
+}
+
+bool SensoreImu::isFifoAttiva()
+{
+  return _fifoAttiva;
+}
+
+bool SensoreImu::isThreadAttivo()
+{
+  return _campionatore != nullptr;
+}
+
+uint32_t SensoreImu::getPersi()
+{
+  return _codaCampioni.getPersi();
+}
+
+uint32_t SensoreImu::getFrameSaltati()
+{
+  return _decoderFifo.getFrameSaltati();
+}
+
+uint32_t SensoreImu::getBurst()
+{
+  return _burstFifo;
+}
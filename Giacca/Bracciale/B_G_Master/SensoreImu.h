@@ -0,0 +1,57 @@
+#ifndef SENSORE_IMU_H
+#define SENSORE_IMU_H
+
+#include <Arduino.h>
+#include <mbed.h>
+#include <Arduino_BMI270_BMM150.h>
+#include <Wire.h>
+#include "BusCondiviso.h"
+#include "CampioneImu.h"
+#include "CodaSpsc.h"
+#include "FifoBmi270.h"
+
+// Wire1 è condiviso tra IMU e touch: accesso serializzato (anche tra i core)
+extern BloccoBus mutexWire1;
+
+// Campionamento del BMI270 a frequenza fissa, indipendente da chi consuma i campioni.
+// Legge la FIFO hardware in burst (o i registri uno per uno se la FIFO non si configura)
+// e accoda i campioni con la loro marca temporale.
+class SensoreImu {
+public:
+    SensoreImu();
+    bool begin();                 // Avvia il BMI270 e configura la FIFO
+    bool avviaThread();           // Campionamento in un thread dedicato (altrimenti chiamare campiona())
+    void campiona();              // Un giro di lettura (dal thread o dal loop)
+    bool estrai(CampioneImu& c);  // Lato consumatore
+
+    float getFrequenza();         // ODR effettivo dei campioni [Hz]
+    bool isFifoAttiva();
+    bool isThreadAttivo();
+    uint32_t getPersi();          // Campioni scartati per coda piena
+    uint32_t getFrameSaltati();   // Frame persi dal sensore per FIFO piena
+    uint32_t getBurst();          // Burst I2C eseguiti
+
+private:
+    // Campionamento a frequenza fissa in un thread dedicato
+    rtos::Thread* _campionatore;
+    CodaSpsc<CampioneImu, 128> _codaCampioni;
+
+    // FIFO hardware del BMI270: un burst I2C per svuotare più campioni
+    static const int DIMENSIONE_BURST = 240; // Entro il buffer di ricezione di Wire (256 byte)
+    static const int MAX_BURST = 4;          // Burst massimi per risveglio
+    static const int MAX_FRAME_FIFO = (DIMENSIONE_BURST / 13 + 1) * MAX_BURST;
+    DecoderFifoBmi270 _decoderFifo;
+    uint8_t _bufferFifo[DIMENSIONE_BURST];
+    FrameFifoBmi270 _frameFifo[MAX_FRAME_FIFO];
+    bool _fifoAttiva;
+    uint32_t _burstFifo;
+
+    bool leggiCampione(CampioneImu& c);
+    bool configuraFifo();
+    void svuotaFifo();
+    bool scriviRegistro(uint8_t reg, uint8_t valore);
+    bool leggiRegistri(uint8_t reg, uint8_t* dati, int n);
+    void cicloCampionatore();
+};
+
+#endif
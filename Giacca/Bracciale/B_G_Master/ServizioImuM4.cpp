@@ -0,0 +1,107 @@
+// Kicco972.net
+
+
+#include "ServizioImuM4.h"
+
+#define PERIODO_M4_MS 10 // Stesso risveglio del thread di campionamento sull'M7
+
+ServizioImuM4::ServizioImuM4()
+    : _area(nullptr), _sensoreOk(false), _sequenzaComando(0), _ultimaTara(0), _prossimoRisveglio(0)
+{
+  memset(&_comando, 0, sizeof(_comando));
+}
+
+bool ServizioImuM4::begin()
+{
+  // L'M7 prepara l'area prima di avviare l'M4: si aspetta comunque la firma
+  _area = areaCondivisa();
+  unsigned long inizio = millis();
+  while (_area->firma.load(std::memory_order_acquire) != FIRMA_AREA_CONDIVISA)
+  {
+    if (millis() - inizio > 2000)
+      return false;
+    delay(1);
+  }
+
+#if defined(CORE_CM4)
+  __HAL_RCC_HSEM_CLK_ENABLE();
+#endif
+
+  _sensoreOk = _sensore.begin();
+  if (_sensoreOk)
+    _assetto.setFrequenza(_sensore.getFrequenza());
+
+  // Pubblica subito: l'M7 usa il primo messaggio come segnale di vita (anche se il sensore è guasto)
+  StatoImuCondiviso stato;
+  memset(&stato, 0, sizeof(stato));
+  stato.assetto = _assetto.getStato();
+  stato.sensoreOk = _sensoreOk;
+  stato.fifoAttiva = _sensore.isFifoAttiva();
+  _area->statoImu.pubblica(stato);
+
+  _prossimoRisveglio = millis();
+  return _sensoreOk;
+}
+
+void ServizioImuM4::applicaComandi()
+{
+  if (!_area->comandoImu.leggi(_comando, _sequenzaComando))
+    return;
+
+  if (_comando.numeroTara != _ultimaTara)
+  {
+    _ultimaTara = _comando.numeroTara;
+    _assetto.tara();
+  }
+  _assetto.setMagnetometro(_comando.magX, _comando.magY, _comando.magZ, _comando.magValido);
+  _assetto.setUsaMagnetometro(_comando.usaMagnetometro);
+}
+
+void ServizioImuM4::update()
+{
+  if (!_sensoreOk)
+  {
+    delay(100);
+    return;
+  }
+
+  applicaComandi();
+
+  // L'M7 ha ripreso l'IMU in locale: l'M4 non tocca più Wire1
+  if (_comando.fermaM4)
+  {
+    delay(100);
+    return;
+  }
+
+  // Tutto il lavoro avviene qui, niente thread: l'M4 non ha altro da fare
+  _sensore.campiona();
+
+  CampioneImu c;
+  bool nuovi = false;
+  while (_sensore.estrai(c))
+  {
+    _assetto.fondi(c);
+    nuovi = true;
+  }
+
+  if (nuovi)
+  {
+    StatoImuCondiviso stato;
+    stato.assetto = _assetto.getStato();
+    stato.sensoreOk = true;
+    stato.fifoAttiva = _sensore.isFifoAttiva();
+    stato.campioniPersi = _sensore.getPersi();
+    stato.frameSaltati = _sensore.getFrameSaltati();
+    stato.burstFifo = _sensore.getBurst();
+    _area->statoImu.pubblica(stato);
+  }
+
+  // Periodo fisso sul tempo assoluto
+  _prossimoRisveglio += PERIODO_M4_MS;
+  long attesa = (long)(_prossimoRisveglio - millis());
+  if (attesa > 0)
+    delay(attesa);
+  else
+    _prossimoRisveglio = millis();
+}
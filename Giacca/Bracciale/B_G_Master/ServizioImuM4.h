@@ -0,0 +1,32 @@
+#ifndef SERVIZIO_IMU_M4_H
+#define SERVIZIO_IMU_M4_H
+
+#include <Arduino.h>
+#include "SensoreImu.h"
+#include "AssettoImu.h"
+#include "MemoriaCondivisa.h"
+
+// Lato M4 della modalità doppio core: campiona il BMI270, fonde i campioni
+// e pubblica il risultato all'M7 nella casella statoImu.
+// I comandi dell'M7 (tara, magnetometro) arrivano dalla casella comandoImu.
+class ServizioImuM4 {
+public:
+    ServizioImuM4();
+    bool begin();   // Attende l'area condivisa preparata dall'M7 e avvia il sensore
+    void update();  // Un periodo: comandi, campionamento, fusione, pubblicazione
+
+private:
+    SensoreImu _sensore;
+    AssettoImu _assetto;
+    AreaCondivisa* _area;
+    bool _sensoreOk;
+
+    ComandoImuCondiviso _comando;
+    uint32_t _sequenzaComando;
+    uint32_t _ultimaTara;
+    unsigned long _prossimoRisveglio;
+
+    void applicaComandi();
+};
+
+#endif
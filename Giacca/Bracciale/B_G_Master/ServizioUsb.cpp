@@ -0,0 +1,218 @@
+// Kicco972.net
+
+
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
+#include "ServizioUsb.h"
+
+#define PERIODO_CONTROLLO_USB_MS 200 // Rimozione rilevata entro questo tempo
+#define RIPROVA_USB_MS 1000          // connect() o mount senza chiavetta montata
+#define STACK_THREAD_USB 4096
+
+ServizioUsb::ServizioUsb() {
+    _msd = nullptr;
+    _fs = nullptr;
+    _thread = nullptr;
+    memset(&_stato, 0, sizeof(_stato));
+    _sequenzaStato = 0;
+    _confermaInSospeso = false;
+    _versioneConfermata = 0;
+    memset(&_pubblicato, 0, sizeof(_pubblicato));
+    _ultimoTentativo = 0;
+    _daSmontare = false;
+    _versioneRimozione = 0;
+}
+
+void ServizioUsb::begin() {
+    // Istanzia il driver per USB Mass Storage e il FileSystem FAT
+    if (!_msd) _msd = new USBHostMSD();
+    if (!_fs) _fs = new mbed::FATFileSystem("usb");
+
+    // Stessa priorità del loop, come il thread di rete: connect() e la FAT aspettano il bus senza occupare la CPU
+    _thread = new rtos::Thread(osPriorityNormal, STACK_THREAD_USB, nullptr, "usb");
+    if (_thread->start(mbed::callback(this, &ServizioUsb::cicloUsb)) != osOK) {
+        Serial.println("Memoria (USB): Errore - Thread USB non avviato!");
+        delete _thread;
+        _thread = nullptr;
+    }
+}
+
+void ServizioUsb::update() {
+    aggiornaStato();
+    if (_confermaInSospeso) inviaConferma();
+
+    // Messaggi del thread USB: Serial si usa solo dal loop
+    EventoUsb e;
+    while (_eventi.estrai(e)) {
+        switch (e.tipo) {
+        case EVENTO_USB_RILEVATA:
+            Serial.println("Memoria (USB): Dispositivo rilevato!");
+            break;
+        case EVENTO_USB_MONTATA:
+            Serial.print("Memoria (USB): Montata su /usb/, ");
+            Serial.print((float)(_stato.libero / 1048576), 0);
+            Serial.print(" MB liberi di ");
+            Serial.print((float)(_stato.capacita / 1048576), 0);
+            Serial.println(" MB");
+            break;
+        case EVENTO_USB_ERRORE_MOUNT:
+            Serial.print("Memoria (USB): Errore mount: ");
+            Serial.println(e.valore);
+            break;
+        case EVENTO_USB_RIMOSSA:
+            Serial.println("Memoria (USB): Dispositivo rimosso.");
+            break;
+        }
+    }
+}
+
+const StatoUsb& ServizioUsb::getStato() {
+    aggiornaStato();
+    return _stato;
+}
+
+bool ServizioUsb::isMontata() {
+    aggiornaStato();
+    return _stato.montata;
+}
+
+mbed::FileSystem* ServizioUsb::getFileSystem() {
+    return _fs;
+}
+
+void ServizioUsb::ricalcolaSpazio() {
+    ComandoUsb c;
+    c.tipo = USB_RICALCOLA_SPAZIO;
+    c.versione = 0;
+    _comandi.inserisci(c);
+}
+
+void ServizioUsb::confermaSmontaggio(uint32_t versione) {
+    _versioneConfermata = versione;
+    _confermaInSospeso = true;
+    inviaConferma();
+}
+
+void ServizioUsb::inviaConferma() {
+    ComandoUsb c;
+    c.tipo = USB_SMONTA;
+    c.versione = _versioneConfermata;
+    if (_comandi.inserisci(c)) _confermaInSospeso = false;
+}
+
+void ServizioUsb::aggiornaStato() {
+    // Niente di nuovo (o scrittura in corso): resta la copia precedente
+    _casella.leggi(_stato, _sequenzaStato);
+}
+
+// --- THREAD USB ---
+
+void ServizioUsb::cicloUsb() {
+    while (true) {
+        bool ricalcola = false;
+        bool confermato = false;
+        ComandoUsb comando;
+        while (_comandi.estrai(comando)) {
+            if (comando.tipo == USB_RICALCOLA_SPAZIO) ricalcola = true;
+            // Una conferma di uno stato precedente non vale: il loop può non aver ancora visto la rimozione
+            if (comando.tipo == USB_SMONTA && _daSmontare && comando.versione == _versioneRimozione) confermato = true;
+        }
+
+        unsigned long adesso = millis();
+        if (_daSmontare) {
+            // Niente nuovi mount finché il vecchio filesystem non è smontato
+            if (confermato) smonta();
+        } else if (_pubblicato.montata) {
+            if (!_msd->connected()) {
+                rimossa();
+            } else if (ricalcola) {
+                calcolaSpazio();
+                pubblica();
+            }
+        } else if (adesso - _ultimoTentativo >= RIPROVA_USB_MS) {
+            _ultimoTentativo = adesso;
+            bool presente = _msd->connected();
+            if (!presente) {
+                // Enumerazione: rapida se il dispositivo non c'è, altrimenti può bloccare per secondi
+                presente = _msd->connect();
+                if (presente) segnala(EVENTO_USB_RILEVATA);
+            }
+            if (presente) {
+                monta();
+            } else if (_pubblicato.presente) {
+                // Tolta prima che il mount riuscisse
+                _pubblicato.presente = false;
+                _pubblicato.erroreMount = 0;
+                pubblica();
+            }
+        }
+
+        rtos::ThisThread::sleep_for(std::chrono::milliseconds(PERIODO_CONTROLLO_USB_MS));
+    }
+}
+
+void ServizioUsb::monta() {
+    int err = _fs->mount(_msd);
+    _pubblicato.presente = true;
+    if (err) {
+        // Si riprova dopo RIPROVA_USB_MS: il messaggio solo se l'errore cambia
+        if (err != _pubblicato.erroreMount) {
+            _pubblicato.erroreMount = err;
+            segnala(EVENTO_USB_ERRORE_MOUNT, err);
+            pubblica();
+        }
+        return;
+    }
+    _pubblicato.montata = true;
+    _pubblicato.erroreMount = 0;
+    calcolaSpazio();
+    pubblica();
+    segnala(EVENTO_USB_MONTATA);
+}
+
+void ServizioUsb::rimossa() {
+    // La chiavetta non c'è più: niente da salvare. Prima lo si dice al loop, che smette di
+    // usare /usb/ e chiude i suoi file; intanto le chiamate alla FAT falliscono (il filesystem ha il suo lock)
+    _pubblicato.presente = false;
+    _pubblicato.montata = false;
+    _pubblicato.capacita = 0;
+    _pubblicato.libero = 0;
+    pubblica();
+    _daSmontare = true;
+    _versioneRimozione = _pubblicato.versione;
+    segnala(EVENTO_USB_RIMOSSA);
+}
+
+// Solo dopo USB_SMONTA: nessun FILE* del loop è ancora aperto su /usb/
+void ServizioUsb::smonta() {
+    _fs->unmount();
+    _daSmontare = false;
+    _ultimoTentativo = millis();
+}
+
+// statvfs() conta i cluster liberi scorrendo la FAT: una volta per montaggio, non a ogni disegno
+void ServizioUsb::calcolaSpazio() {
+    struct statvfs st;
+    if (_fs->statvfs("/", &st) == 0) {
+        _pubblicato.capacita = (uint64_t)st.f_blocks * st.f_frsize;
+        _pubblicato.libero = (uint64_t)st.f_bfree * st.f_frsize;
+    } else {
+        _pubblicato.capacita = 0;
+        _pubblicato.libero = 0;
+    }
+}
+
+void ServizioUsb::pubblica() {
+    _pubblicato.versione++;
+    _casella.pubblica(_pubblicato);
+}
+
+void ServizioUsb::segnala(TipoEventoUsb tipo, int32_t valore) {
+    EventoUsb e;
+    e.tipo = (uint8_t)tipo;
+    e.valore = valore;
+    _eventi.inserisci(e);
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SERVIZIO_USB_H
+#define SERVIZIO_USB_H
+
+#include <Arduino.h>
+#include <mbed.h>
+#include <Arduino_USBHostMbed5.h>
+#include <FATFileSystem.h>
+#include "CasellaCondivisa.h"
+#include "CodaSpsc.h"
+
+// Chiavetta USB in un thread dedicato: connect() enumera il bus e può bloccare,
+// mount e statvfs scorrono la FAT. Il thread rileva inserimento e rimozione,
+// monta e smonta il filesystem su /usb/ e pubblica lo stato; il loop legge solo
+// l'ultimo stato pubblicato, senza lock (come WiFiGiga).
+// Alla rimozione il thread pubblica prima lo stato "non montata" e smonta solo
+// quando il loop conferma di aver chiuso i suoi file (USB_SMONTA): unmount()
+// non avviene mai sotto un FILE* aperto dal loop.
+
+// Stato pubblicato dal thread USB
+struct StatoUsb {
+    bool presente;             // Dispositivo enumerato
+    bool montata;              // FAT montato su /usb/
+    int32_t erroreMount;       // Ultimo errore di mount (0 = nessuno)
+    uint64_t capacita;         // Byte, calcolati una volta per montaggio (e su richiesta)
+    uint64_t libero;
+    uint32_t versione;         // Cambia a ogni montaggio, rimozione o nuovo calcolo dello spazio
+};
+
+// Loop -> thread USB
+enum TipoComandoUsb {
+    USB_RICALCOLA_SPAZIO,      // Dopo le nostre scritture (es. fine esportazione)
+    USB_SMONTA                 // Il loop ha visto lo stato "non montata" e chiuso i suoi file
+};
+
+struct ComandoUsb {
+    uint8_t tipo;              // TipoComandoUsb
+    uint32_t versione;         // USB_SMONTA: versione dello stato visto dal loop
+};
+
+// Thread USB -> loop: messaggi per Serial (stampati dal loop, non dal thread)
+enum TipoEventoUsb {
+    EVENTO_USB_RILEVATA,
+    EVENTO_USB_MONTATA,
+    EVENTO_USB_ERRORE_MOUNT,
+    EVENTO_USB_RIMOSSA
+};
+
+struct EventoUsb {
+    uint8_t tipo;              // TipoEventoUsb
+    int32_t valore;            // Es. codice di errore del mount
+};
+
+class ServizioUsb {
+public:
+    ServizioUsb();
+    void begin();              // Avvia il thread USB (non attende la chiavetta)
+    void update();             // Stampa su Serial i messaggi del thread USB
+    const StatoUsb& getStato(); // Ultimo stato pubblicato dal thread USB
+    bool isMontata();
+    mbed::FileSystem* getFileSystem(); // Da usare solo con isMontata()
+    void ricalcolaSpazio();    // Comando al thread USB (senza attesa)
+    // Il loop non usa più /usb/ (stato con montata = false, versione data): il thread può smontare.
+    // Se la coda è piena si riprova in update()
+    void confermaSmontaggio(uint32_t versione);
+
+private:
+    USBHostMSD* _msd;
+    mbed::FATFileSystem* _fs;
+
+    // Thread USB e code verso il loop
+    rtos::Thread* _thread;
+    CasellaCondivisa<StatoUsb> _casella;
+    CodaSpsc<ComandoUsb, 4> _comandi;
+    CodaSpsc<EventoUsb, 8> _eventi;
+
+    // Copia del loop dell'ultimo stato letto dalla casella
+    StatoUsb _stato;
+    uint32_t _sequenzaStato;
+    bool _confermaInSospeso;   // USB_SMONTA non ancora entrato nella coda
+    uint32_t _versioneConfermata;
+
+    // Solo thread USB
+    StatoUsb _pubblicato;
+    unsigned long _ultimoTentativo;
+    bool _daSmontare;          // Rimozione pubblicata, si aspetta la conferma del loop
+    uint32_t _versioneRimozione; // Versione dello stato che l'ha pubblicata
+
+    void cicloUsb();           // Corpo del thread USB
+    void monta();
+    void rimossa();            // Pubblica la rimozione, senza smontare
+    void smonta();
+    void calcolaSpazio();
+    void pubblica();
+    void segnala(TipoEventoUsb tipo, int32_t valore = 0);
+    void aggiornaStato();      // Lato loop: legge la casella
+    void inviaConferma();      // Lato loop: USB_SMONTA in coda
+};
+
+#endif
@@ -0,0 +1,169 @@
+// Kicco972.net
+
+
+#include "SincronizzazioneTempo.h"
+
+SincronizzazioneTempo::SincronizzazioneTempo()
+    : _derivaPpm(0), _derivaValida(false), _erroreUs(0), _ritardoMs(0), _sincronizzazioni(0), _scambiPersi(0), _sequenza(0)
+{
+    azzera();
+}
+
+void SincronizzazioneTempo::azzera()
+{
+    _sincronizzata = false;
+    _epochUs = 0;
+    _riferimento = 0;
+    _ancoraEpochUs = 0;
+    _ancoraRiferimento = 0;
+    _scambi = 0;
+    _inAttesa = false;
+    _t1 = 0;
+    _inviataMs = 0;
+    _prossimaMs = 0;
+    _subito = true;
+    _migliore = false;
+    _migliorEpochUs = 0;
+    _migliorRiferimento = 0;
+    _migliorRitardoMs = 0;
+}
+
+bool SincronizzazioneTempo::richiesta(unsigned long adessoMs, uint64_t epochMs, uint8_t* buf, int& lunghezza)
+{
+    if (_inAttesa)
+    {
+        if (adessoMs - _inviataMs < TIMEOUT_SCAMBIO_MS)
+            return false;
+        _inAttesa = false;
+        _scambiPersi++;
+        if (_scambi >= CAMPIONI_SINCRONIZZAZIONE)
+            concludi(adessoMs);
+    }
+
+    // _prossimaMs nel passato o adesso (confronto valido anche al giro di millis())
+    if (!_subito && (long)(adessoMs - _prossimaMs) < 0)
+        return false;
+    _subito = false;
+
+    RichiestaTempo r = {++_sequenza, epochMs};
+    lunghezza = codificaRichiestaTempo(r, buf, RICHIESTA_TEMPO_DIMENSIONE);
+    _t1 = epochMs;
+    _inviataMs = adessoMs;
+    _inAttesa = true;
+    _scambi++;
+    return true;
+}
+
+bool SincronizzazioneTempo::risposta(const uint8_t* dati, int lunghezza, uint64_t epochMs, unsigned long adessoMs)
+{
+    RispostaTempo r;
+    if (!_inAttesa || !decodificaRispostaTempo(dati, lunghezza, r) || r.sequenza != _sequenza || r.t1 != _t1)
+        return false;
+    _inAttesa = false;
+
+    // T3 - T2: tempo speso nella periferica, da togliere al giro completo
+    int64_t giro = (int64_t)(epochMs - r.t1);
+    int64_t periferica = (int64_t)(uint32_t)(r.t3 - r.t2);
+    int64_t ritardo = giro - periferica;
+    if (ritardo < 0)
+        ritardo = 0;
+
+    if (!_migliore || (uint32_t)ritardo < _migliorRitardoMs)
+    {
+        // A metà tra T2 e T3 il Master segnava (T1 + T4) / 2 (scarto ((T1 - T2) + (T4 - T3)) / 2),
+        // in microsecondi per non perdere il mezzo millisecondo. Solo differenze di millis():
+        // T2 e T3 possono stare ai due lati del giro dei 32 bit
+        uint32_t nellaPeriferica = r.t3 - r.t2;
+        _migliorRiferimento = r.t2 + nellaPeriferica / 2;
+        _migliorEpochUs = ((int64_t)r.t1 + (int64_t)epochMs) * 500 - (int64_t)(nellaPeriferica % 2) * 500;
+        _migliorRitardoMs = (uint32_t)ritardo;
+        _migliore = true;
+    }
+
+    if (_scambi < CAMPIONI_SINCRONIZZAZIONE)
+    {
+        _prossimaMs = adessoMs + PAUSA_SCAMBI_MS;
+        return false;
+    }
+    concludi(adessoMs);
+    return true;
+}
+
+void SincronizzazioneTempo::concludi(unsigned long adessoMs)
+{
+    _scambi = 0;
+    _prossimaMs = adessoMs + PERIODO_SINCRONIZZAZIONE_MS;
+    if (!_migliore)
+        return;
+    _migliore = false;
+
+    if (_sincronizzata)
+    {
+        _erroreUs = (int32_t)(_migliorEpochUs - previstoUs(_migliorRiferimento));
+
+        // Deriva = variazione dello scarto nel tempo (1 ms ogni 1000 s = 1 ppm)
+        int32_t base = (int32_t)(_migliorRiferimento - _ancoraRiferimento);
+        if (base >= BASE_DERIVA_MS)
+        {
+            int64_t variazioneUs = _migliorEpochUs - _ancoraEpochUs - (int64_t)base * 1000;
+            float misurata = (float)variazioneUs * 1000.0f / base;
+            _derivaPpm = _derivaValida ? _derivaPpm + (misurata - _derivaPpm) / 4 : misurata;
+            _derivaValida = true;
+            _ancoraEpochUs = _migliorEpochUs;
+            _ancoraRiferimento = _migliorRiferimento;
+        }
+    }
+    else
+    {
+        _ancoraEpochUs = _migliorEpochUs;
+        _ancoraRiferimento = _migliorRiferimento;
+    }
+
+    _epochUs = _migliorEpochUs;
+    _riferimento = _migliorRiferimento;
+    _ritardoMs = _migliorRitardoMs;
+    _sincronizzata = true;
+    _sincronizzazioni++;
+}
+
+bool SincronizzazioneTempo::isSincronizzata() const
+{
+    return _sincronizzata;
+}
+
+uint64_t SincronizzazioneTempo::epochDa(uint32_t tempoPeriferica) const
+{
+    return (uint64_t)((previstoUs(tempoPeriferica) + 500) / 1000);
+}
+
+// Distanza con segno dal riferimento: vale per istanti entro ±24 giorni, anche oltre il giro di millis()
+int64_t SincronizzazioneTempo::previstoUs(uint32_t tempoPeriferica) const
+{
+    int32_t distanza = (int32_t)(tempoPeriferica - _riferimento);
+    return _epochUs + (int64_t)distanza * 1000 + (int64_t)(_derivaPpm * distanza / 1000.0f);
+}
+
+float SincronizzazioneTempo::getDerivaPpm() const
+{
+    return -_derivaPpm;
+}
+
+int32_t SincronizzazioneTempo::getErroreUs() const
+{
+    return _erroreUs;
+}
+
+uint32_t SincronizzazioneTempo::getRitardoMs() const
+{
+    return _ritardoMs;
+}
+
+uint32_t SincronizzazioneTempo::getSincronizzazioni() const
+{
+    return _sincronizzazioni;
+}
+
+uint32_t SincronizzazioneTempo::getScambiPersi() const
+{
+    return _scambiPersi;
+}
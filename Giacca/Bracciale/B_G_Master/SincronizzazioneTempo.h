@@ -0,0 +1,91 @@
+/*
+  SincronizzazioneTempo.h
+  Stima dello scarto e della deriva dell'orologio di una periferica rispetto
+  al Master (protocollo in ProtocolloTempo.h).
+  Ogni PERIODO_SINCRONIZZAZIONE_MS una raffica di CAMPIONI_SINCRONIZZAZIONE
+  scambi, uno alla volta: vale quello con il ritardo minore (meno attesa nel
+  loop e negli eventi di connessione, quindi meno asimmetria). La deriva viene
+  dalla variazione dello scarto su almeno BASE_DERIVA_MS (su basi più corte
+  l'asimmetria residua, qualche ms, pesa più della deriva del quarzo);
+  l'errore di previsione dice di quanto l'orologio della periferica si era
+  allontanato dalla stima precedente.
+  Solo C++ standard, compilabile anche su PC.
+*/
+#ifndef SINCRONIZZAZIONE_TEMPO_H
+#define SINCRONIZZAZIONE_TEMPO_H
+
+#include <stdint.h>
+#include "ProtocolloTempo.h"
+
+#define PERIODO_SINCRONIZZAZIONE_MS 30000
+#define CAMPIONI_SINCRONIZZAZIONE 4      // Scambi per raffica
+#define PAUSA_SCAMBI_MS 100              // Tra due scambi della stessa raffica
+#define TIMEOUT_SCAMBIO_MS 1000          // Risposta persa: si passa al prossimo
+#define BASE_DERIVA_MS 600000            // Una misura di deriva ogni 10 minuti
+
+// Ora del Master in millisecondi (WiFiGiga, dall'NTP)
+class OrologioMaster {
+public:
+    virtual ~OrologioMaster() {}
+    virtual bool getEpochMs(uint64_t& epochMs) = 0;  // false finché l'NTP non ha risposto
+};
+
+class SincronizzazioneTempo {
+public:
+    SincronizzazioneTempo();
+
+    // Nuova connessione (la periferica può essere ripartita): la prima raffica parte subito,
+    // della stima precedente resta solo la deriva, che è del quarzo
+    void azzera();
+
+    // Richiesta da scrivere adesso. false se non è il momento
+    bool richiesta(unsigned long adessoMs, uint64_t epochMs, uint8_t* buf, int& lunghezza);
+
+    // Risposta della periferica; epochMs = ora del Master all'arrivo. true se chiude una raffica
+    bool risposta(const uint8_t* dati, int lunghezza, uint64_t epochMs, unsigned long adessoMs);
+
+    bool isSincronizzata() const;
+
+    // Istante della periferica (suo millis()) nell'ora del Master
+    uint64_t epochDa(uint32_t tempoPeriferica) const;
+
+    float getDerivaPpm() const;         // Positiva se il quarzo della periferica va avanti
+    int32_t getErroreUs() const;        // Scarto misurato - scarto previsto all'ultima raffica
+    uint32_t getRitardoMs() const;      // Ritardo dello scambio scelto
+    uint32_t getSincronizzazioni() const;
+    uint32_t getScambiPersi() const;
+
+private:
+    // Stima corrente: all'istante _riferimento della periferica il Master segnava _epochUs.
+    // Gli altri istanti contano dal riferimento con una distanza con segno (più la deriva):
+    // il giro dei 32 bit del millis() della periferica non sposta la stima
+    bool _sincronizzata;
+    int64_t _epochUs;
+    uint32_t _riferimento;              // millis() della periferica a cui vale _epochUs
+    float _derivaPpm;                   // Variazione dello scarto (Master - periferica) [µs/s]
+    bool _derivaValida;
+    int64_t _ancoraEpochUs;             // Inizio della base su cui si misura la deriva
+    uint32_t _ancoraRiferimento;
+    int32_t _erroreUs;
+    uint32_t _ritardoMs;
+    uint32_t _sincronizzazioni;
+    uint32_t _scambiPersi;
+
+    // Raffica in corso
+    int _scambi;                        // Richieste inviate nella raffica
+    bool _inAttesa;
+    uint8_t _sequenza;
+    uint64_t _t1;
+    unsigned long _inviataMs;
+    unsigned long _prossimaMs;          // Prossima richiesta (scambio o raffica)
+    bool _subito;                       // Prima raffica della connessione
+    bool _migliore;                     // C'è almeno una risposta nella raffica
+    int64_t _migliorEpochUs;
+    uint32_t _migliorRiferimento;
+    uint32_t _migliorRitardoMs;
+
+    void concludi(unsigned long adessoMs);
+    int64_t previstoUs(uint32_t tempoPeriferica) const; // Ora del Master secondo la stima corrente
+};
+
+#endif
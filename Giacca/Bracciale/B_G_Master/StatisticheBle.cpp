@@ -0,0 +1,185 @@
+// Kicco972.net
+
+
+#include "StatisticheBle.h"
+#include <string.h>
+
+// Pesi delle medie mobili: 1/8 per l'intervallo, 1/16 per il jitter (RFC 3550)
+#define PESO_INTERVALLO (1.0f / 8.0f)
+#define PESO_JITTER (1.0f / 16.0f)
+
+// Restituita per posizioni inesistenti
+static const StatisticaPeriferica STATISTICA_VUOTA = {};
+
+StatisticheBle::StatisticheBle() : _inizioFinestra(0)
+{
+    memset(_periferiche, 0, sizeof(_periferiche));
+}
+
+bool StatisticheBle::valida(int periferica)
+{
+    return periferica >= 0 && periferica < MAX_PERIFERICHE_BLE;
+}
+
+void StatisticheBle::connessa(int periferica, unsigned long adessoMs)
+{
+    if (!valida(periferica))
+        return;
+    StatisticaPeriferica& p = _periferiche[periferica];
+    p.connessioni++;
+    p.connessa = true;
+    p.connessaDa = adessoMs;
+
+    // L'intervallo tra l'ultima notifica della connessione precedente e la prima di questa non conta
+    for (int k = 0; k < MAX_CARATTERISTICHE_TIPO; k++)
+        p.caratteristiche[k].arrivoValido = false;
+}
+
+void StatisticheBle::disconnessa(int periferica, unsigned long adessoMs)
+{
+    if (!valida(periferica) || !_periferiche[periferica].connessa)
+        return;
+    StatisticaPeriferica& p = _periferiche[periferica];
+    p.tempoConnessoMs += adessoMs - p.connessaDa;
+    p.connessa = false;
+}
+
+void StatisticheBle::notifica(int periferica, int caratteristica, unsigned long adessoMs)
+{
+    if (!valida(periferica) || caratteristica < 0 || caratteristica >= MAX_CARATTERISTICHE_TIPO)
+        return;
+    StatisticaCaratteristica& c = _periferiche[periferica].caratteristiche[caratteristica];
+    c.notifiche++;
+    c.notificheFinestra++;
+
+    if (c.arrivoValido)
+    {
+        float intervallo = (float)(adessoMs - c.ultimoArrivo);
+        if (c.intervalloMs <= 0)
+        {
+            // Primo intervallo: la media parte da qui
+            c.intervalloMs = intervallo;
+        }
+        else
+        {
+            float scarto = intervallo - c.intervalloMs;
+            c.intervalloMs += scarto * PESO_INTERVALLO;
+            c.jitterMs += ((scarto < 0 ? -scarto : scarto) - c.jitterMs) * PESO_JITTER;
+        }
+    }
+    c.ultimoArrivo = adessoMs;
+    c.arrivoValido = true;
+}
+
+void StatisticheBle::perse(int periferica, uint32_t trame)
+{
+    if (!valida(periferica) || trame == 0)
+        return;
+    _periferiche[periferica].perse += trame;
+    _periferiche[periferica].buchi++;
+}
+
+void StatisticheBle::campioneRssi(int periferica, int rssi)
+{
+    // HCI.readRssi() restituisce RSSI_NON_VALIDO se la lettura fallisce
+    if (!valida(periferica) || rssi >= 0 || rssi < -128)
+        return;
+    StatisticaPeriferica& p = _periferiche[periferica];
+
+    // Anello pieno: il campione più vecchio esce dalla somma
+    if (p.numRssi == CAMPIONI_RSSI)
+        p.sommaRssi -= p.rssi[p.testaRssi];
+    else
+        p.numRssi++;
+    p.rssi[p.testaRssi] = (int8_t)rssi;
+    p.sommaRssi += rssi;
+    p.testaRssi = (p.testaRssi + 1) % CAMPIONI_RSSI;
+}
+
+void StatisticheBle::update(unsigned long adessoMs)
+{
+    unsigned long durata = adessoMs - _inizioFinestra;
+    if (durata < FINESTRA_FREQUENZA_MS)
+        return;
+
+    for (int i = 0; i < MAX_PERIFERICHE_BLE; i++)
+    {
+        for (int k = 0; k < MAX_CARATTERISTICHE_TIPO; k++)
+        {
+            StatisticaCaratteristica& c = _periferiche[i].caratteristiche[k];
+            c.frequenzaHz = c.notificheFinestra * 1000.0f / durata;
+            c.notificheFinestra = 0;
+        }
+    }
+    _inizioFinestra = adessoMs;
+}
+
+void StatisticheBle::azzera(unsigned long adessoMs)
+{
+    for (int i = 0; i < MAX_PERIFERICHE_BLE; i++)
+    {
+        StatisticaPeriferica& p = _periferiche[i];
+        bool connessa = p.connessa;
+        memset(&p, 0, sizeof(p));
+        if (connessa)
+        {
+            // La connessione in corso riparte da adesso e conta come prima
+            p.connessa = true;
+            p.connessaDa = adessoMs;
+            p.connessioni = 1;
+        }
+    }
+    _inizioFinestra = adessoMs;
+}
+
+const StatisticaPeriferica& StatisticheBle::getPeriferica(int periferica) const
+{
+    if (!valida(periferica))
+        return STATISTICA_VUOTA;
+    return _periferiche[periferica];
+}
+
+uint32_t StatisticheBle::getTempoConnessoMs(int periferica, unsigned long adessoMs) const
+{
+    if (!valida(periferica))
+        return 0;
+    const StatisticaPeriferica& p = _periferiche[periferica];
+    return p.tempoConnessoMs + (p.connessa ? adessoMs - p.connessaDa : 0);
+}
+
+bool StatisticheBle::haRssi(int periferica) const
+{
+    return valida(periferica) && _periferiche[periferica].numRssi > 0;
+}
+
+int StatisticheBle::getRssiUltimo(int periferica) const
+{
+    if (!haRssi(periferica))
+        return RSSI_NON_VALIDO;
+    const StatisticaPeriferica& p = _periferiche[periferica];
+    return p.rssi[(p.testaRssi + CAMPIONI_RSSI - 1) % CAMPIONI_RSSI];
+}
+
+int StatisticheBle::getRssiMedio(int periferica) const
+{
+    if (!haRssi(periferica))
+        return RSSI_NON_VALIDO;
+    const StatisticaPeriferica& p = _periferiche[periferica];
+    // Arrotondamento verso il valore più vicino (la somma è negativa)
+    return (p.sommaRssi - p.numRssi / 2) / p.numRssi;
+}
+
+int StatisticheBle::getRssiMinimo(int periferica) const
+{
+    if (!haRssi(periferica))
+        return RSSI_NON_VALIDO;
+    // Lettura per il display: scorre l'anello, non tocca il costo per evento
+    const StatisticaPeriferica& p = _periferiche[periferica];
+    int minimo = 0;
+    for (int i = 0; i < p.numRssi; i++)
+    {
+        if (p.rssi[i] < minimo)
+            minimo = p.rssi[i];
+    }
+    return minimo;
+}
@@ -0,0 +1,76 @@
+/*
+  StatisticheBle.h
+  Statistiche dei collegamenti BLE, per periferica e per caratteristica:
+  frequenza delle notifiche, intervallo medio e jitter tra gli arrivi,
+  trame perse, storia dell'RSSI e tempo di connessione.
+  Memoria fissa e costo costante per evento: medie mobili esponenziali
+  (jitter come in RFC 3550) e un anello di campioni RSSI con somma corrente.
+  Solo C++ standard, compilabile anche su PC.
+*/
+#ifndef STATISTICHE_BLE_H
+#define STATISTICHE_BLE_H
+
+#include <stdint.h>
+#include "RegistroBle.h"
+
+#define CAMPIONI_RSSI 16               // Storia RSSI per periferica
+#define FINESTRA_FREQUENZA_MS 1000     // Finestra di conteggio per la frequenza
+#define RSSI_NON_VALIDO 127            // Valore di errore di HCI.readRssi()
+
+struct StatisticaCaratteristica {
+    uint32_t notifiche;           // Totale dall'avvio (o dall'ultimo azzeramento)
+    uint32_t notificheFinestra;   // Nella finestra in corso
+    float frequenzaHz;            // Ultima finestra chiusa
+    float intervalloMs;           // Media mobile dell'intervallo tra due notifiche
+    float jitterMs;               // Media mobile dello scarto dall'intervallo medio
+    unsigned long ultimoArrivo;
+    bool arrivoValido;            // ultimoArrivo appartiene alla connessione in corso
+};
+
+struct StatisticaPeriferica {
+    StatisticaCaratteristica caratteristiche[MAX_CARATTERISTICHE_TIPO]; // Indici della tabella del tipo
+    uint32_t connessioni;
+    uint32_t tempoConnessoMs;     // Connessioni concluse
+    unsigned long connessaDa;
+    bool connessa;
+    uint32_t perse;               // Trame perse in totale (tutte le connessioni)
+    uint32_t buchi;               // Salti di sequenza (uno per più trame perse di fila)
+
+    int8_t rssi[CAMPIONI_RSSI];   // Anello dei campioni, il più recente in rssi[testaRssi - 1]
+    uint8_t testaRssi;
+    uint8_t numRssi;
+    int16_t sommaRssi;
+};
+
+class StatisticheBle {
+  public:
+    StatisticheBle();
+
+    // Eventi (costo costante)
+    void connessa(int periferica, unsigned long adessoMs);
+    void disconnessa(int periferica, unsigned long adessoMs);
+    void notifica(int periferica, int caratteristica, unsigned long adessoMs);
+    void perse(int periferica, uint32_t trame);
+    void campioneRssi(int periferica, int rssi);
+
+    // Chiude la finestra della frequenza ogni FINESTRA_FREQUENZA_MS
+    void update(unsigned long adessoMs);
+
+    // Riparte da zero, senza perdere lo stato delle connessioni in corso
+    void azzera(unsigned long adessoMs);
+
+    const StatisticaPeriferica& getPeriferica(int periferica) const;
+    uint32_t getTempoConnessoMs(int periferica, unsigned long adessoMs) const;
+    bool haRssi(int periferica) const;
+    int getRssiUltimo(int periferica) const;
+    int getRssiMedio(int periferica) const;
+    int getRssiMinimo(int periferica) const;
+
+  private:
+    StatisticaPeriferica _periferiche[MAX_PERIFERICHE_BLE];
+    unsigned long _inizioFinestra;
+
+    static bool valida(int periferica);
+};
+
+#endif
@@ -1,6 +1,9 @@
 // Kicco972.net
 
 
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
 #include "Stato.h"
 
 Stato::Stato() : _livelloCorrente(PERICOLO), _rgb(NULL), _lastBlinkTime(0), _ledOn(false) {}
@@ -80,4 +83,6 @@ void Stato::accendiLed()
     _rgb->on(255, 0, 0);
     break;
   }
-}
\ No newline at end of file
+}
+
+#endif // CORE_CM4
@@ -0,0 +1,173 @@
+// Kicco972.net
+
+
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
+#include "TabellaStatistiche.h"
+#include "Compositore.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BIANCO 0xffff
+#define NERO 0x0000
+#define GRIGIO_CHIARO 0x6666
+
+#define PERIODO_TABELLA_MS 500 // Le frequenze cambiano una volta al secondo
+#define RIGA_Y 60              // Prima riga sotto le intestazioni
+#define ALTEZZA_RIGA 20
+#define LARGHEZZA_CARATTERE 12 // Testo size 2
+#define ALTEZZA_CARATTERE 16
+
+// Colonne: posizione e caratteri disponibili. Tra due celle resta sempre un margine,
+// così il compositore non unisce celle vicine (cancellerebbe anche quella non cambiata)
+static const int COLONNA_X[TabellaStatistiche::NUM_COLONNE] = {10, 130, 250, 400, 490, 610};
+static const int COLONNA_CARATTERI[TabellaStatistiche::NUM_COLONNE] = {9, 9, 12, 7, 9, 15};
+
+// Intestazioni: riga della periferica e riga delle sue caratteristiche
+static const char *const INTESTAZIONE_PERIFERICA[TabellaStatistiche::NUM_COLONNE] = {
+    "Periferica", "Stato", "RSSI u/m/min", "Ricon.", "Connessa", "Perse/buchi"};
+static const char *const INTESTAZIONE_CARATTERISTICA[TabellaStatistiche::NUM_COLONNE] = {
+    "  Caratt.", "Frequenza", "Intervallo", "Jitter", "Notifiche", ""};
+
+// Decimi senza printf dei float (non sempre abilitato nella libc del core)
+static void formattaDecimi(char *buffer, float valore, const char *unita)
+{
+    long decimi = (long)(valore * 10.0f + 0.5f);
+    snprintf(buffer, TabellaStatistiche::MAX_TESTO, "%ld.%ld%s", decimi / 10, decimi % 10, unita);
+}
+
+TabellaStatistiche::TabellaStatistiche() : _ultimoAggiornamento(0)
+{
+    memset(_mostrato, 0, sizeof(_mostrato));
+    memset(_nuovo, 0, sizeof(_nuovo));
+}
+
+void TabellaStatistiche::begin() {}
+
+void TabellaStatistiche::drawBackground()
+{
+    gigaDisplay.setTextSize(2);
+    for (int c = 0; c < NUM_COLONNE; c++)
+    {
+        gigaDisplay.setTextColor(BIANCO);
+        gigaDisplay.setCursor(COLONNA_X[c], 10);
+        gigaDisplay.print(INTESTAZIONE_PERIFERICA[c]);
+        gigaDisplay.setTextColor(GRIGIO_CHIARO);
+        gigaDisplay.setCursor(COLONNA_X[c], 30);
+        gigaDisplay.print(INTESTAZIONE_CARATTERISTICA[c]);
+    }
+    gigaDisplay.drawFastHLine(10, 50, 780, GRIGIO_CHIARO);
+
+    // Lo schermo è stato appena pulito: tutte le celle vanno ridisegnate
+    compositore.reset();
+    memset(_mostrato, 0, sizeof(_mostrato));
+    _ultimoAggiornamento = millis() - PERIODO_TABELLA_MS;
+}
+
+void TabellaStatistiche::updateAndDraw(BleNetwork &rete)
+{
+    unsigned long adesso = millis();
+    if (adesso - _ultimoAggiornamento < PERIODO_TABELLA_MS)
+        return;
+    _ultimoAggiornamento = adesso;
+
+    // 1. Testo di ogni cella per questo frame (le righe avanzate restano vuote)
+    memset(_nuovo, 0, sizeof(_nuovo));
+    int riga = 0;
+    for (int i = 0; i < rete.getNumeroPeriferiche() && riga < MAX_RIGHE; i++)
+    {
+        riga = riempiPeriferica(rete, riga, i);
+        riga = riempiCaratteristiche(rete, riga, i);
+    }
+
+    // 2. Una riga alla volta: pulisce le celle il cui testo è cambiato e le riscrive.
+    // Con al massimo NUM_COLONNE regioni la lista del compositore non si riempie mai
+    gigaDisplay.setTextSize(2);
+    gigaDisplay.setTextColor(BIANCO);
+    for (int r = 0; r < MAX_RIGHE; r++)
+    {
+        bool cambiata = false;
+        for (int c = 0; c < NUM_COLONNE; c++)
+        {
+            _nuovo[r][c][COLONNA_CARATTERI[c]] = '\0';
+            if (strcmp(_mostrato[r][c], _nuovo[r][c]) == 0)
+                continue;
+            cambiata = true;
+            int vecchi = strlen(_mostrato[r][c]);
+            if (vecchi > 0)
+                compositore.invalida(COLONNA_X[c], RIGA_Y + r * ALTEZZA_RIGA, vecchi * LARGHEZZA_CARATTERE, ALTEZZA_CARATTERE);
+        }
+        if (!cambiata)
+            continue;
+        compositore.flush(NERO);
+
+        for (int c = 0; c < NUM_COLONNE; c++)
+        {
+            if (strcmp(_mostrato[r][c], _nuovo[r][c]) == 0)
+                continue;
+            gigaDisplay.setCursor(COLONNA_X[c], RIGA_Y + r * ALTEZZA_RIGA);
+            gigaDisplay.print(_nuovo[r][c]);
+            compositore.aggiungiTesto(strlen(_nuovo[r][c]), 2);
+            strcpy(_mostrato[r][c], _nuovo[r][c]);
+        }
+    }
+
+    compositore.fineFrame("Statistiche");
+}
+
+// Riga della periferica: stato, RSSI, riconnessioni, tempo connesso, trame perse
+int TabellaStatistiche::riempiPeriferica(BleNetwork &rete, int riga, int periferica)
+{
+    const StatisticheBle &s = rete.getStatistiche();
+    const StatisticaPeriferica &p = s.getPeriferica(periferica);
+    const ConnessionePeriferica &conn = rete.getConnessione(periferica);
+    char (*cella)[MAX_TESTO] = _nuovo[riga];
+
+    rete.getNome(periferica, cella[0], MAX_TESTO);
+    snprintf(cella[1], MAX_TESTO, "%s", ConnessionePeriferica::nomeStato(conn.getStato()));
+    if (s.haRssi(periferica))
+        snprintf(cella[2], MAX_TESTO, "%d/%d/%d", s.getRssiUltimo(periferica), s.getRssiMedio(periferica), s.getRssiMinimo(periferica));
+    else
+        snprintf(cella[2], MAX_TESTO, "-");
+    snprintf(cella[3], MAX_TESTO, "%lu", (unsigned long)conn.getRiconnessioni());
+    formattaDurata(cella[4], s.getTempoConnessoMs(periferica, millis()));
+    snprintf(cella[5], MAX_TESTO, "%lu/%lu", (unsigned long)p.perse, (unsigned long)p.buchi);
+    return riga + 1;
+}
+
+// Una riga per caratteristica con notifiche: frequenza, intervallo medio, jitter, totale
+int TabellaStatistiche::riempiCaratteristiche(BleNetwork &rete, int riga, int periferica)
+{
+    const TipoPeriferica *tipo = rete.getTipo(periferica);
+    const StatisticaPeriferica &p = rete.getStatistiche().getPeriferica(periferica);
+
+    for (int k = 0; k < tipo->numCaratteristiche && riga < MAX_RIGHE; k++)
+    {
+        const StatisticaCaratteristica &c = p.caratteristiche[k];
+        if (!(tipo->caratteristiche[k].flag & CARATT_NOTIFICA) || c.notifiche == 0)
+            continue;
+
+        char (*cella)[MAX_TESTO] = _nuovo[riga++];
+        snprintf(cella[0], MAX_TESTO, "  %s", tipo->caratteristiche[k].sigla);
+        formattaDecimi(cella[1], c.frequenzaHz, " Hz");
+        formattaDecimi(cella[2], c.intervalloMs, " ms");
+        formattaDecimi(cella[3], c.jitterMs, "");
+        snprintf(cella[4], MAX_TESTO, "%lu", (unsigned long)c.notifiche);
+    }
+    return riga;
+}
+
+// "45s", "12m05s", "3h07m": al massimo 6 caratteri
+void TabellaStatistiche::formattaDurata(char *buffer, uint32_t ms)
+{
+    uint32_t secondi = ms / 1000;
+    if (secondi < 60)
+        snprintf(buffer, MAX_TESTO, "%lus", (unsigned long)secondi);
+    else if (secondi < 3600)
+        snprintf(buffer, MAX_TESTO, "%lum%02lus", (unsigned long)(secondi / 60), (unsigned long)(secondi % 60));
+    else
+        snprintf(buffer, MAX_TESTO, "%luh%02lum", (unsigned long)(secondi / 3600), (unsigned long)(secondi / 60 % 60));
+}
+
+#endif // CORE_CM4
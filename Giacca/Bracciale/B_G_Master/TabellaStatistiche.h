@@ -0,0 +1,34 @@
+#ifndef TABELLA_STATISTICHE_H
+#define TABELLA_STATISTICHE_H
+
+#include <Arduino.h>
+#include <Arduino_GigaDisplay_GFX.h>
+#include "BleNetwork.h"
+
+extern GigaDisplay_GFX gigaDisplay;
+
+// Schermata F2: statistiche dei collegamenti BLE in forma di tabella.
+// Una riga per periferica e una per ogni caratteristica che ha ricevuto notifiche.
+// Ogni cella ricorda il testo mostrato: si ridisegnano solo le celle cambiate.
+class TabellaStatistiche {
+public:
+    static const int MAX_RIGHE = 13;      // Fino al bordo dei pulsanti (Y=330)
+    static const int NUM_COLONNE = 6;
+    static const int MAX_TESTO = 16;      // Caratteri per cella, terminatore incluso
+
+    TabellaStatistiche();
+    void begin();
+    void drawBackground();
+    void updateAndDraw(BleNetwork& rete);
+
+private:
+    char _mostrato[MAX_RIGHE][NUM_COLONNE][MAX_TESTO]; // Testo sullo schermo
+    char _nuovo[MAX_RIGHE][NUM_COLONNE][MAX_TESTO];    // Testo del frame in corso
+    unsigned long _ultimoAggiornamento;
+
+    int riempiPeriferica(BleNetwork& rete, int riga, int periferica);
+    int riempiCaratteristiche(BleNetwork& rete, int riga, int periferica);
+    static void formattaDurata(char* buffer, uint32_t ms);
+};
+
+#endif
@@ -0,0 +1,118 @@
+// Kicco972.net
+
+
+#include "UnioneStorico.h"
+
+UnioneStorico::UnioneStorico()
+    : _scrittore(nullptr), _numInAttesa(0), _numBlocco(0), _ultimoEpoch(0), _arretrato(false),
+      _scritti(0), _doppioni(0), _direttiPersi(0)
+{
+}
+
+void UnioneStorico::begin(ScrittoreStorico& scrittore)
+{
+    _scrittore = &scrittore;
+    _ultimoEpoch = scrittore.ultimoStorico();
+}
+
+void UnioneStorico::iniziaArretrato()
+{
+    _arretrato = true;
+}
+
+void UnioneStorico::arretrato(const CampioneStorico& c)
+{
+    // I diretti più vecchi del campione (recupero lento) vanno prima
+    scriviInAttesa(c.epoch);
+    aggiungi(c);
+}
+
+void UnioneStorico::fineArretrato(bool completo)
+{
+    // Interrotto: il Sense ha ancora il resto dell'arretrato, i diretti aspettano il prossimo recupero
+    if (!completo)
+        return;
+    _arretrato = false;
+    scriviInAttesa(0xFFFFFFFFUL);
+}
+
+void UnioneStorico::diretto(const CampioneStorico& c)
+{
+    if (!_arretrato)
+    {
+        aggiungi(c);
+        return;
+    }
+
+    // Coda piena: si perde il diretto più vecchio, l'arretrato resta completo
+    if (_numInAttesa >= MAX_DIRETTI_IN_ATTESA)
+    {
+        for (int i = 0; i < _numInAttesa - 1; i++)
+            _inAttesa[i] = _inAttesa[i + 1];
+        _numInAttesa--;
+        _direttiPersi++;
+    }
+    _inAttesa[_numInAttesa++] = c;
+}
+
+bool UnioneStorico::update()
+{
+    return svuotaBlocco();
+}
+
+bool UnioneStorico::isArretratoInCorso() const
+{
+    return _arretrato;
+}
+
+uint32_t UnioneStorico::getScritti() const
+{
+    return _scritti;
+}
+
+uint32_t UnioneStorico::getDoppioni() const
+{
+    return _doppioni;
+}
+
+uint32_t UnioneStorico::getDirettiPersi() const
+{
+    return _direttiPersi;
+}
+
+void UnioneStorico::aggiungi(const CampioneStorico& c)
+{
+    if (_ultimoEpoch != 0 && c.epoch <= _ultimoEpoch + TOLLERANZA_DOPPIONI_S)
+    {
+        _doppioni++;
+        return;
+    }
+    if (_numBlocco >= BLOCCO_SCRITTURA_STORICO)
+        svuotaBlocco();
+    _blocco[_numBlocco++] = c;
+    _ultimoEpoch = c.epoch;
+}
+
+// Diretti in attesa con epoch precedente a primaDi, in ordine
+void UnioneStorico::scriviInAttesa(uint32_t primaDi)
+{
+    int n = 0;
+    while (n < _numInAttesa && _inAttesa[n].epoch < primaDi)
+        aggiungi(_inAttesa[n++]);
+    if (n == 0)
+        return;
+    for (int i = n; i < _numInAttesa; i++)
+        _inAttesa[i - n] = _inAttesa[i];
+    _numInAttesa -= n;
+}
+
+bool UnioneStorico::svuotaBlocco()
+{
+    if (_numBlocco == 0)
+        return true;
+    bool esito = _scrittore && _scrittore->scriviStorico(_blocco, _numBlocco);
+    if (esito)
+        _scritti += _numBlocco;
+    _numBlocco = 0;
+    return esito;
+}
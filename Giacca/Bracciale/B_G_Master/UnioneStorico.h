@@ -0,0 +1,77 @@
+/*
+  UnioneStorico.h
+  Archivio su flash dei campioni ambientali del Sense, in ordine di tempo.
+  Arrivano da due strade: i campioni in diretta (uno ogni PERIODO_STORICO_MS
+  a Sense collegato) e l'arretrato registrato dal Sense fuori portata
+  (vedi ProtocolloStorico.h), più vecchio dei diretti.
+  Durante il recupero i diretti aspettano in RAM e vengono scritti solo
+  quando l'arretrato li ha raggiunti; un campione non successivo all'ultimo
+  scritto è un doppione (trasferimento interrotto e ripetuto) e si scarta.
+  Un recupero interrotto lascia i diretti in attesa fino al prossimo: scritti
+  subito farebbero scartare come doppioni i campioni arretrati non ancora arrivati.
+  La scrittura passa da ScrittoreStorico a blocchi, un file aperto per blocco:
+  solo C++ standard, su PC si può pilotare con uno scrittore simulato.
+*/
+#ifndef UNIONE_STORICO_H
+#define UNIONE_STORICO_H
+
+#include <stdint.h>
+
+#define MAX_DIRETTI_IN_ATTESA 16       // 8 minuti di diretta durante un recupero
+#define BLOCCO_SCRITTURA_STORICO 32    // Campioni per scrittura su flash
+#define TOLLERANZA_DOPPIONI_S 2        // Arrotondamento della conversione all'ora del Master
+#define EPOCH_VALIDO_MINIMO 1577836800UL // 1/1/2020: prima l'orologio non è ancora stato impostato dall'NTP
+
+struct CampioneStorico {
+    uint32_t epoch;       // Ora locale del Master (time(NULL), vedi WiFiGiga)
+    float temperatura;    // °C
+    float umidita;        // %
+    float pressione;      // kPa
+};
+
+// Archivio su flash (Memoria)
+class ScrittoreStorico {
+public:
+    virtual ~ScrittoreStorico() {}
+    virtual bool scriviStorico(const CampioneStorico* campioni, int numero) = 0;
+    virtual uint32_t ultimoStorico() = 0;  // epoch dell'ultimo campione archiviato (0 = archivio vuoto)
+};
+
+class UnioneStorico {
+public:
+    UnioneStorico();
+
+    // L'ultimo campione archiviato evita i doppioni anche dopo un riavvio del Master
+    void begin(ScrittoreStorico& scrittore);
+
+    void iniziaArretrato();
+    void arretrato(const CampioneStorico& c);
+    void fineArretrato(bool completo);        // Completo: scrive i diretti in attesa
+    void diretto(const CampioneStorico& c);
+
+    // Scrive il blocco accumulato (una volta per loop). false se la scrittura è fallita
+    bool update();
+
+    bool isArretratoInCorso() const;
+    uint32_t getScritti() const;
+    uint32_t getDoppioni() const;
+    uint32_t getDirettiPersi() const;         // Coda dei diretti piena durante un recupero lungo
+
+private:
+    ScrittoreStorico* _scrittore;
+    CampioneStorico _inAttesa[MAX_DIRETTI_IN_ATTESA];  // Diretti, in ordine di arrivo
+    int _numInAttesa;
+    CampioneStorico _blocco[BLOCCO_SCRITTURA_STORICO];
+    int _numBlocco;
+    uint32_t _ultimoEpoch;
+    bool _arretrato;
+    uint32_t _scritti;
+    uint32_t _doppioni;
+    uint32_t _direttiPersi;
+
+    void aggiungi(const CampioneStorico& c);
+    void scriviInAttesa(uint32_t primaDi);
+    bool svuotaBlocco();
+};
+
+#endif
@@ -1,180 +1,292 @@
 // Kicco972.net
 
 
+// Solo M7: lo stesso sketch compilato per l'M4 usa solo ServizioImuM4 (vedi MemoriaCondivisa.h)
+#ifndef CORE_CM4
+
 #include "WiFiGiga.h"
-#include <mbed.h> // Per set_time()
+#include <mbed.h> // Per set_time() e rtos::Thread
 
 // --- CONFIGURAZIONE RETE ---
 // INSERISCI QUI I DATI DELLA TUA RETE DI CASA
 const char* WIFI_SSID = "TP-Paradiso";
 const char* WIFI_PASS = "Dario2001";
 
+#define PORTA_LOCALE_NTP 2390
+#define SERVER_NTP "pool.ntp.org"
+#define FUSO_ORARIO_S 3600          // Per ora fisso a UTC+1 (CET)
+#define PERIODO_NTP_MS 3600000      // Una sincronizzazione all'ora
+#define RIPROVA_NTP_MS 10000        // Dopo un timeout o un DNS fallito
+#define RIPROVA_WIFI_MS 10000
+#define PERIODO_RSSI_WIFI_MS 1000
+#define STACK_THREAD_RETE 6144      // DNS e socket dell'mbed
+
 WiFiGiga::WiFiGiga() {
     _ssid = WIFI_SSID;
     _pass = WIFI_PASS;
+    _thread = nullptr;
+    memset(&_stato, 0, sizeof(_stato));
+    _sequenzaStato = 0;
+    memset(&_pubblicato, 0, sizeof(_pubblicato));
     _lastAttemptTime = 0;
-    _hardwareOk = false;
+    _lastRssiTime = 0;
     _lastNtpSyncTime = 0;
-    _ntpRequestSent = false;
-    _ntpRequestTime = 0;
+    _lastNtpAttemptTime = 0;
+    _ntpForzato = true; // Prima sincronizzazione appena connessi
+    _tentativi = 0;
 }
 
 void WiFiGiga::begin() {
     Serial.println("WiFi: Inizializzazione...");
 
-    // Verifica presenza hardware
-    if (WiFi.status() == WL_NO_MODULE) {
-        Serial.println("WiFi: Errore - Modulo non rilevato!");
-        _hardwareOk = false;
-        return;
-    }
-    _hardwareOk = true;
-
-    // Verifica versione firmware
-    String fv = WiFi.firmwareVersion();
-    if (fv < WIFI_FIRMWARE_LATEST_VERSION) {
-        Serial.println("WiFi: Avviso - Consigliato aggiornamento firmware.");
-    }
-
-    Serial.print("WiFi: Tentativo di connessione a ");
-    Serial.println(_ssid);
-
-    // Avvia connessione
-    WiFi.begin(_ssid, _pass);
-
-    // Attesa connessione (Timeout 10 secondi)
-    unsigned long start = millis();
-    while (WiFi.status() != WL_CONNECTED) {
-        if (millis() - start > 10000) {
-            Serial.println("\nWiFi: Timeout connessione.");
-            break;
-        }
-        delay(500);
-        Serial.print(".");
-    }
-    Serial.println();
-
-    if (isConnected()) {
-        Serial.println("WiFi: Connesso con successo!");
-        printStatus();
+    // Stessa priorità del loop: con una priorità più bassa il loop, che non dorme mai,
+    // lo lascerebbe senza CPU. Le chiamate WiFi aspettano il modulo senza occupare la CPU
+    _thread = new rtos::Thread(osPriorityNormal, STACK_THREAD_RETE, nullptr, "rete");
+    if (_thread->start(mbed::callback(this, &WiFiGiga::cicloRete)) != osOK) {
+        Serial.println("WiFi: Errore - Thread di rete non avviato!");
+        delete _thread;
+        _thread = nullptr;
     }
-    
-    // Avvia UDP per NTP sulla porta 2390
-    _udp.begin(2390);
-    
-    _lastAttemptTime = millis();
 }
 
 void WiFiGiga::update() {
-    // Se l'hardware non c'è, inutile provare
-    if (!_hardwareOk) return;
+    aggiornaStato();
 
-    // Se NON siamo connessi, proviamo a riconnetterci ogni 10 secondi
-    if (WiFi.status() != WL_CONNECTED) {
-        unsigned long currentMillis = millis();
-        if (currentMillis - _lastAttemptTime >= 10000) {
-            Serial.println("WiFi: Connessione persa o assente. Tentativo di riconnessione...");
-            
-            // Disconnetti per pulire lo stato precedente e riprova
-            WiFi.disconnect();
-            WiFi.begin(_ssid, _pass);
-            
-            _lastAttemptTime = currentMillis;
+    // Messaggi del thread di rete: Serial si usa solo dal loop
+    EventoRete e;
+    while (_eventi.estrai(e)) {
+        switch (e.tipo) {
+        case EVENTO_MODULO_ASSENTE:
+            Serial.println("WiFi: Errore - Modulo non rilevato!");
+            break;
+        case EVENTO_FIRMWARE_VECCHIO:
+            Serial.println("WiFi: Avviso - Consigliato aggiornamento firmware.");
+            break;
+        case EVENTO_TENTATIVO:
+            if (e.valore == 0) {
+                Serial.print("WiFi: Tentativo di connessione a ");
+                Serial.println(_ssid);
+            } else {
+                Serial.println("WiFi: Connessione persa o assente. Tentativo di riconnessione...");
+            }
+            break;
+        case EVENTO_CONNESSO:
+            Serial.println("WiFi: Connesso con successo!");
+            printStatus();
+            break;
+        case EVENTO_TIMEOUT:
+            Serial.println("WiFi: Timeout connessione.");
+            break;
+        case EVENTO_PERSO:
+            Serial.println("WiFi: Connessione persa.");
+            break;
+        case EVENTO_NTP_INVIATA:
+            Serial.println("NTP: Richiesta inviata...");
+            break;
+        case EVENTO_NTP_DNS_FALLITO:
+            Serial.println("NTP: Server non raggiungibile (DNS o invio).");
+            break;
+        case EVENTO_NTP_SINCRONIZZATO:
+            Serial.print("NTP: Orario sincronizzato! (ritardo ");
+            Serial.print(e.valore);
+            Serial.println(" ms)");
+            break;
+        case EVENTO_NTP_TIMEOUT:
+            Serial.println("NTP: Timeout.");
+            break;
         }
     }
-    
-    // Gestione sincronizzazione orario NTP
-    handleNtp();
 }
 
 bool WiFiGiga::isConnected() {
-    return (WiFi.status() == WL_CONNECTED);
+    aggiornaStato();
+    return _stato.connesso;
 }
 
 void WiFiGiga::printStatus() {
-    Serial.print("  SSID: "); Serial.println(WiFi.SSID());
-    Serial.print("  IP:   "); Serial.println(WiFi.localIP());
-    Serial.print("  RSSI: "); Serial.print(WiFi.RSSI()); Serial.println(" dBm");
+    Serial.print("  SSID: "); Serial.println(_ssid);
+    Serial.print("  IP:   "); Serial.println(getIP());
+    Serial.print("  RSSI: "); Serial.print(getRSSI()); Serial.println(" dBm");
 }
 
 String WiFiGiga::getIP() {
     if (isConnected()) {
-        IPAddress ip = WiFi.localIP();
-        return String(ip[0]) + "." + String(ip[1]) + "." + String(ip[2]) + "." + String(ip[3]);
+        return String(_stato.ip[0]) + "." + String(_stato.ip[1]) + "." + String(_stato.ip[2]) + "." + String(_stato.ip[3]);
     }
     return "---";
 }
 
 int WiFiGiga::getRSSI() {
-    if (isConnected()) return (int)WiFi.RSSI();
+    if (isConnected()) return (int)_stato.rssi;
     return 0;
 }
 
-// --- GESTIONE NTP E ORARIO ---
+void WiFiGiga::riconnetti() {
+    _comandi.inserisci(RETE_RICONNETTI);
+}
 
-const int NTP_PACKET_SIZE = 48;
-byte packetBuffer[NTP_PACKET_SIZE];
+void WiFiGiga::sincronizzaOra() {
+    _comandi.inserisci(RETE_SINCRONIZZA_ORA);
+}
+
+const StatoRete& WiFiGiga::getStato() {
+    aggiornaStato();
+    return _stato;
+}
 
-void WiFiGiga::handleNtp() {
-    if (!isConnected()) return;
+void WiFiGiga::aggiornaStato() {
+    // Niente di nuovo (o scrittura in corso): resta la copia precedente
+    _casella.leggi(_stato, _sequenzaStato);
+}
 
-    unsigned long currentMillis = millis();
+// --- THREAD DI RETE ---
 
-    // Sincronizza ogni ora (3600000 ms) o se non è mai stato sincronizzato (_lastNtpSyncTime == 0)
-    if (currentMillis - _lastNtpSyncTime > 3600000 || _lastNtpSyncTime == 0) {
-        if (!_ntpRequestSent) {
-            // Invia richiesta
-            IPAddress timeServerIP;
-            WiFi.hostByName("pool.ntp.org", timeServerIP);
-            sendNTPPacket(timeServerIP);
-            _ntpRequestSent = true;
-            _ntpRequestTime = currentMillis;
-            Serial.println("NTP: Richiesta inviata...");
+void WiFiGiga::cicloRete() {
+    avviaModulo();
+    if (!_pubblicato.hardwareOk) return; // Se l'hardware non c'è, inutile provare
+
+    while (true) {
+        ComandoRete comando;
+        while (_comandi.estrai(comando)) {
+            if (comando == RETE_RICONNETTI) _lastAttemptTime = millis() - RIPROVA_WIFI_MS;
+            if (comando == RETE_SINCRONIZZA_ORA) _ntpForzato = true;
+        }
+
+        unsigned long currentMillis = millis();
+        gestisciConnessione(currentMillis);
+        handleNtp(millis());
+        _casella.pubblica(_pubblicato);
+
+        // In attesa della risposta NTP si controlla spesso: il ritardo misurato resta piccolo
+        rtos::ThisThread::sleep_for(std::chrono::milliseconds(_ntp.isInAttesa() ? 5 : 100));
+    }
+}
+
+void WiFiGiga::avviaModulo() {
+    // Verifica presenza hardware
+    if (WiFi.status() == WL_NO_MODULE) {
+        _pubblicato.hardwareOk = false;
+        segnala(EVENTO_MODULO_ASSENTE);
+        return;
+    }
+    _pubblicato.hardwareOk = true;
+
+    // Verifica versione firmware
+    String fv = WiFi.firmwareVersion();
+    if (fv < WIFI_FIRMWARE_LATEST_VERSION) {
+        segnala(EVENTO_FIRMWARE_VECCHIO);
+    }
+
+    _ntp.begin(_trasporto, SERVER_NTP);
+
+    // Primo tentativo subito
+    _lastAttemptTime = millis() - RIPROVA_WIFI_MS;
+}
+
+void WiFiGiga::gestisciConnessione(unsigned long currentMillis) {
+    bool connesso = (WiFi.status() == WL_CONNECTED);
+    if (_pubblicato.connesso && !connesso) {
+        _pubblicato.connesso = false;
+        segnala(EVENTO_PERSO);
+    }
+
+    // Se NON siamo connessi, proviamo a riconnetterci ogni 10 secondi
+    if (!connesso && currentMillis - _lastAttemptTime >= RIPROVA_WIFI_MS) {
+        segnala(EVENTO_TENTATIVO, (int32_t)_tentativi++);
+
+        // Disconnetti per pulire lo stato precedente e riprova (bloccante: qui non ferma il loop)
+        WiFi.disconnect();
+        WiFi.begin(_ssid, _pass);
+        _lastAttemptTime = millis();
+
+        connesso = (WiFi.status() == WL_CONNECTED);
+        if (connesso) {
+            IPAddress ip = WiFi.localIP();
+            for (int i = 0; i < 4; i++) _pubblicato.ip[i] = ip[i];
+            _pubblicato.rssi = WiFi.RSSI();
+            _pubblicato.connesso = true;
+            _lastRssiTime = millis();
+
+            // Avvia UDP per NTP sulla porta 2390 (socket nuovo a ogni connessione)
+            _trasporto.begin(PORTA_LOCALE_NTP);
+            segnala(EVENTO_CONNESSO);
         } else {
-            // Attendi risposta (Timeout 1 secondo)
-            if (currentMillis - _ntpRequestTime > 1000) {
-                _ntpRequestSent = false; // Timeout, riproverà al prossimo ciclo
-                Serial.println("NTP: Timeout.");
-            } else {
-                int cb = _udp.parsePacket();
-                if (cb) {
-                    // Risposta ricevuta!
-                    _udp.read(packetBuffer, NTP_PACKET_SIZE);
-                    
-                    unsigned long highWord = word(packetBuffer[40], packetBuffer[41]);
-                    unsigned long lowWord = word(packetBuffer[42], packetBuffer[43]);
-                    unsigned long secsSince1900 = highWord << 16 | lowWord;
-                    const unsigned long seventyYears = 2208988800UL;
-                    unsigned long epoch = secsSince1900 - seventyYears;
-
-                    // Imposta RTC interno (Mbed OS)
-                    // Aggiungi Offset Fuso Orario (Es. +1 ora = 3600 sec). 
-                    // Per ora fisso a UTC+1 (CET).
-                    set_time(epoch + 3600); 
-                    
-                    _lastNtpSyncTime = currentMillis;
-                    _ntpRequestSent = false;
-                    Serial.println("NTP: Orario sincronizzato!");
-                }
-            }
+            segnala(EVENTO_TIMEOUT);
         }
     }
+
+    if (_pubblicato.connesso && currentMillis - _lastRssiTime >= PERIODO_RSSI_WIFI_MS) {
+        _pubblicato.rssi = WiFi.RSSI();
+        _lastRssiTime = currentMillis;
+    }
 }
 
-void WiFiGiga::sendNTPPacket(IPAddress& address) {
-    memset(packetBuffer, 0, NTP_PACKET_SIZE);
-    packetBuffer[0] = 0b11100011;   // LI, Version, Mode
-    packetBuffer[1] = 0;     // Stratum
-    packetBuffer[2] = 6;     // Polling Interval
-    packetBuffer[3] = 0xEC;  // Precision
-    // 8 bytes zero per Root Delay & Dispersion
-    packetBuffer[12]  = 49;
-    packetBuffer[13]  = 0x4E;
-    packetBuffer[14]  = 49;
-    packetBuffer[15]  = 52;
-    _udp.beginPacket(address, 123);
-    _udp.write(packetBuffer, NTP_PACKET_SIZE);
-    _udp.endPacket();
+void WiFiGiga::segnala(TipoEventoRete tipo, int32_t valore) {
+    // Prima lo stato: quando il loop stampa il messaggio, lo stato lo riflette già
+    _casella.pubblica(_pubblicato);
+    EventoRete e = {(uint8_t)tipo, valore};
+    _eventi.inserisci(e);
+}
+
+// --- GESTIONE NTP E ORARIO ---
+
+void WiFiGiga::handleNtp(unsigned long currentMillis) {
+    if (!_pubblicato.connesso) return;
+
+    // Risposta alla richiesta in corso (timeout 1 secondo)
+    if (_ntp.isInAttesa()) {
+        RisultatoNtp r;
+        EsitoNtp esito = _ntp.controlla(currentMillis, r);
+        if (esito == NTP_SINCRONIZZATO) {
+            // Imposta RTC interno (Mbed OS) con l'offset del fuso orario
+            set_time((time_t)(r.epochMs / 1000) + FUSO_ORARIO_S);
+
+            // Millisecondi per le periferiche BLE, poi si prosegue con millis()
+            _pubblicato.epochSyncMs = r.epochMs + (uint64_t)FUSO_ORARIO_S * 1000;
+            _pubblicato.millisSync = r.millisRicezione;
+            _pubblicato.ritardoNtpMs = r.ritardoMs;
+            _lastNtpSyncTime = currentMillis;
+            segnala(EVENTO_NTP_SINCRONIZZATO, (int32_t)r.ritardoMs);
+        } else if (esito == NTP_SCADUTO) {
+            segnala(EVENTO_NTP_TIMEOUT);
+        }
+        return;
+    }
+
+    // Sincronizza ogni ora, subito se richiesto o mai sincronizzato; dopo un errore si aspetta
+    bool dovuto = _ntpForzato || _pubblicato.epochSyncMs == 0 || currentMillis - _lastNtpSyncTime >= PERIODO_NTP_MS;
+    bool inPausa = _lastNtpAttemptTime != 0 && currentMillis - _lastNtpAttemptTime < RIPROVA_NTP_MS;
+    if (!dovuto || (inPausa && !_ntpForzato)) return;
+    _lastNtpAttemptTime = currentMillis;
+    _ntpForzato = false;
+
+    // DNS e invio: bloccanti, ma solo per questo thread
+    if (_ntp.richiedi(millis())) {
+        segnala(EVENTO_NTP_INVIATA);
+    } else {
+        segnala(EVENTO_NTP_DNS_FALLITO);
+    }
+}
+
+// --- TRASPORTO UDP ---
+
+void TrasportoWiFi::begin(uint16_t portaLocale) {
+    _udp.stop();
+    _udp.begin(portaLocale);
+}
+
+bool TrasportoWiFi::invia(const char* server, uint16_t porta, const uint8_t* dati, int lunghezza) {
+    IPAddress indirizzo;
+    if (WiFi.hostByName(server, indirizzo) != 1) return false;
+    if (!_udp.beginPacket(indirizzo, porta)) return false;
+    _udp.write(dati, lunghezza);
+    return _udp.endPacket() == 1;
+}
+
+int TrasportoWiFi::ricevi(uint8_t* dati, int dimensione) {
+    int lunghezza = _udp.parsePacket();
+    if (lunghezza <= 0) return 0;
+    return _udp.read(dati, lunghezza < dimensione ? lunghezza : dimensione);
 }
 
 String WiFiGiga::getTimeString() {
@@ -191,4 +303,13 @@ String WiFiGiga::getDateString() {
     char buffer[12];
     strftime(buffer, 12, "%d/%m/%Y", timeinfo);
     return String(buffer);
-}
\ No newline at end of file
+}
+
+bool WiFiGiga::getEpochMs(uint64_t& epochMs) {
+    aggiornaStato();
+    if (_stato.epochSyncMs == 0) return false;
+    epochMs = _stato.epochSyncMs + (uint32_t)(millis() - _stato.millisSync);
+    return true;
+}
+
+#endif // CORE_CM4
@@ -2,37 +2,114 @@
 #define WIFI_GIGA_H
 
 #include <Arduino.h>
+#include <mbed.h>
 #include <WiFi.h>
 #include <WiFiUdp.h>
+#include "SincronizzazioneTempo.h"
+#include "ClientNtp.h"
+#include "CasellaCondivisa.h"
+#include "CodaSpsc.h"
 
-class WiFiGiga {
+// Connessione, DNS e NTP girano in un thread dedicato (le chiamate WiFi bloccano
+// anche per secondi): il loop legge solo l'ultimo stato pubblicato, senza lock,
+// e scambia messaggi con il thread attraverso due code.
+
+// Stato pubblicato dal thread di rete
+struct StatoRete {
+    bool hardwareOk;
+    bool connesso;
+    uint8_t ip[4];
+    int32_t rssi;
+    uint64_t epochSyncMs;      // Ora locale in ms all'ultima risposta NTP (0 = mai)
+    uint32_t millisSync;       // millis() alla stessa risposta
+    uint32_t ritardoNtpMs;     // Ritardo dell'ultima risposta NTP
+};
+
+// Loop -> thread di rete
+enum ComandoRete {
+    RETE_RICONNETTI,           // Nuovo tentativo subito, senza aspettare i 10 s
+    RETE_SINCRONIZZA_ORA       // Richiesta NTP subito, senza aspettare l'ora
+};
+
+// Thread di rete -> loop: messaggi per Serial (stampati dal loop, non dal thread)
+enum TipoEventoRete {
+    EVENTO_MODULO_ASSENTE,
+    EVENTO_FIRMWARE_VECCHIO,
+    EVENTO_TENTATIVO,
+    EVENTO_CONNESSO,
+    EVENTO_TIMEOUT,
+    EVENTO_PERSO,
+    EVENTO_NTP_INVIATA,
+    EVENTO_NTP_DNS_FALLITO,
+    EVENTO_NTP_SINCRONIZZATO,
+    EVENTO_NTP_TIMEOUT
+};
+
+struct EventoRete {
+    uint8_t tipo;              // TipoEventoRete
+    int32_t valore;            // Es. ritardo NTP [ms]
+};
+
+// Trasporto dei pacchetti NTP su WiFiUDP (DNS compreso), usato solo dal thread di rete
+class TrasportoWiFi : public TrasportoUdp {
+public:
+    void begin(uint16_t portaLocale);
+    bool invia(const char* server, uint16_t porta, const uint8_t* dati, int lunghezza) override;
+    int ricevi(uint8_t* dati, int dimensione) override;
+
+private:
+    WiFiUDP _udp;
+};
+
+class WiFiGiga : public OrologioMaster {
 public:
     WiFiGiga();
-    void begin();           // Avvia la connessione
-    void update();          // Gestisce la riconnessione automatica
+    void begin();           // Avvia il thread di rete (non attende la connessione)
+    void update();          // Stampa su Serial i messaggi del thread di rete
     bool isConnected();     // Restituisce true se connesso
     void printStatus();     // Stampa IP e potenza segnale su Serial
     String getIP();         // Restituisce IP come stringa
     int getRSSI();          // Restituisce RSSI
+    void riconnetti();      // Comandi al thread di rete (senza attesa)
+    void sincronizzaOra();
     
     // Metodi per l'orario
     String getTimeString(); // Restituisce "HH:MM"
     String getDateString(); // Restituisce "DD/MM/YYYY"
+    bool getEpochMs(uint64_t& epochMs) override; // Ora locale in ms (per le periferiche BLE)
+    const StatoRete& getStato(); // Ultimo stato pubblicato dal thread di rete
 
 private:
     const char* _ssid;
     const char* _pass;
+
+    // Thread di rete e code verso il loop
+    rtos::Thread* _thread;
+    CasellaCondivisa<StatoRete> _casella;
+    CodaSpsc<ComandoRete, 8> _comandi;
+    CodaSpsc<EventoRete, 16> _eventi;
+
+    // Copia del loop dell'ultimo stato letto dalla casella
+    StatoRete _stato;
+    uint32_t _sequenzaStato;
+
+    // Solo thread di rete
+    StatoRete _pubblicato;
     unsigned long _lastAttemptTime;
-    bool _hardwareOk;
-    
-    // Variabili per NTP
-    WiFiUDP _udp;
+    unsigned long _lastRssiTime;
     unsigned long _lastNtpSyncTime;
-    bool _ntpRequestSent;
-    unsigned long _ntpRequestTime;
-    
-    void handleNtp(); // Gestisce la macchina a stati NTP
-    void sendNTPPacket(IPAddress& address);
+    unsigned long _lastNtpAttemptTime;
+    bool _ntpForzato;
+    uint32_t _tentativi;    // Tentativi di connessione dall'avvio
+    TrasportoWiFi _trasporto;
+    ClientNtp _ntp;
+
+    void cicloRete();       // Corpo del thread di rete
+    void avviaModulo();
+    void gestisciConnessione(unsigned long currentMillis);
+    void handleNtp(unsigned long currentMillis); // Gestisce la macchina a stati NTP
+    void segnala(TipoEventoRete tipo, int32_t valore = 0);
+    void aggiornaStato();   // Lato loop: legge la casella
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -5,16 +5,26 @@
 */
 
 #include <ArduinoBLE.h>
+#include "ProtocolloAttuatore.h" // Comandi con identificativo e conferme (copia identica nel Master)
 
-// UUID definiti nel Master (Custom Service)
-const char* uuidService = "19B10000-E8F2-537E-4F6C-D104768A1214";
-const char* uuidCharSwitch = "19B10001-E8F2-537E-4F6C-D104768A1214";
+BLEService iotService(UUID_SERVIZIO_ATTUATORE);
 
-BLEService iotService(uuidService);
-BLEByteCharacteristic switchCharacteristic(uuidCharSwitch, BLERead | BLEWrite);
+// Comando: 2 byte [id, valore] scritti senza risposta dal Master, oppure 1 byte dai Master precedenti
+BLECharacteristic switchCharacteristic(UUID_COMANDO_ATTUATORE, BLERead | BLEWrite | BLEWriteWithoutResponse,
+                                       MESSAGGIO_ATTUATORE_DIMENSIONE, false);
+// Stato: [id dell'ultimo comando applicato, valore], notificato come conferma
+BLECharacteristic statoCharacteristic(UUID_STATO_ATTUATORE, BLERead | BLENotify, MESSAGGIO_ATTUATORE_DIMENSIONE, true);
 
 const int ledPin = LED_BUILTIN;
 
+MessaggioAttuatore stato = {0, 0}; // Stato attuale dell'uscita
+
+void pubblicaStato() {
+  uint8_t buffer[MESSAGGIO_ATTUATORE_DIMENSIONE];
+  int lunghezza = codificaMessaggioAttuatore(stato, buffer, sizeof(buffer));
+  statoCharacteristic.writeValue(buffer, lunghezza); // Notifica se il Master è sottoscritto
+}
+
 void setup() {
   Serial.begin(115200);
   
@@ -32,14 +42,17 @@ void setup() {
   // Imposta il servizio pubblicizzato
   BLE.setAdvertisedService(iotService);
 
-  // Aggiungi la caratteristica
+  // Aggiungi le caratteristiche
   iotService.addCharacteristic(switchCharacteristic);
+  iotService.addCharacteristic(statoCharacteristic);
 
   // Aggiungi il servizio
   BLE.addService(iotService);
 
   // Imposta valore iniziale (Spento)
-  switchCharacteristic.writeValue(0);
+  uint8_t spento = 0;
+  switchCharacteristic.writeValue(&spento, 1);
+  pubblicaStato();
 
   // Avvia la pubblicità
   BLE.advertise();
@@ -55,18 +68,33 @@ void loop() {
     Serial.print("Connesso al centrale: ");
     Serial.println(central.address());
 
+    bool sottoscritto = false;
     while (central.connected()) {
+      // Alla sottoscrizione il Master riceve lo stato reale dell'uscita
+      if (statoCharacteristic.subscribed() != sottoscritto) {
+        sottoscritto = statoCharacteristic.subscribed();
+        if (sottoscritto)
+          pubblicaStato();
+      }
+
       // Controlla se il valore è stato scritto dal Master
       if (switchCharacteristic.written()) {
-        byte val = switchCharacteristic.value();
-        
-        if (val) {
+        MessaggioAttuatore comando;
+        if (!decodificaMessaggioAttuatore(switchCharacteristic.value(), switchCharacteristic.valueLength(), comando))
+          continue;
+
+        if (comando.valore) {
           Serial.println("Comando ricevuto: ON");
           digitalWrite(ledPin, HIGH);
         } else {
           Serial.println("Comando ricevuto: OFF");
           digitalWrite(ledPin, LOW);
         }
+
+        // Conferma anche i comandi ripetuti: la conferma precedente può essere andata persa
+        stato.id = comando.id;
+        stato.valore = comando.valore ? 1 : 0;
+        pubblicaStato();
       }
     }
 
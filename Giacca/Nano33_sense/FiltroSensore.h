@@ -0,0 +1,127 @@
+/*
+  FiltroSensore.h
+  Sovracampionamento e invio su variazione per le grandezze del Nano Sense.
+  MediaCampioni accumula i campioni di un periodo e ne restituisce la media;
+  BandaMorta decide se la media va inviata: scostamento dall'ultimo valore
+  inviato di almeno la banda su un asse qualsiasi, oppure intervallo massimo
+  scaduto (il Master sa così che il Sense è vivo anche a valori fermi).
+  Solo C++ standard, header-only, compilabile anche su PC.
+*/
+#ifndef FILTRO_SENSORE_H
+#define FILTRO_SENSORE_H
+
+#include <stdint.h>
+
+#define MAX_ASSI_FILTRO 3
+
+class MediaCampioni {
+public:
+    MediaCampioni() { begin(1); }
+
+    void begin(int assi)
+    {
+        _assi = (assi < 1) ? 1 : (assi > MAX_ASSI_FILTRO ? MAX_ASSI_FILTRO : assi);
+        azzera();
+    }
+
+    void aggiungi(const float* valori)
+    {
+        for (int i = 0; i < _assi; i++)
+            _somma[i] += valori[i];
+        _numero++;
+    }
+
+    void aggiungi(float valore) { aggiungi(&valore); }
+
+    int getNumero() const { return _numero; }
+
+    // Media del periodo in media[0.._assi-1] e nuovo periodo. false se non ci sono campioni
+    bool chiudi(float* media)
+    {
+        if (_numero == 0)
+            return false;
+        for (int i = 0; i < _assi; i++)
+            media[i] = _somma[i] / _numero;
+        azzera();
+        return true;
+    }
+
+    void azzera()
+    {
+        for (int i = 0; i < MAX_ASSI_FILTRO; i++)
+            _somma[i] = 0;
+        _numero = 0;
+    }
+
+private:
+    float _somma[MAX_ASSI_FILTRO];
+    int _numero;
+    int _assi;
+};
+
+class BandaMorta {
+public:
+    BandaMorta() : _assi(1), _intervalloMassimoMs(0), _ultimoInvioMs(0), _inviato(false)
+    {
+        for (int i = 0; i < MAX_ASSI_FILTRO; i++)
+        {
+            _banda[i] = 0;
+            _ultimo[i] = 0;
+        }
+    }
+
+    void begin(int assi)
+    {
+        _assi = (assi < 1) ? 1 : (assi > MAX_ASSI_FILTRO ? MAX_ASSI_FILTRO : assi);
+        dimentica();
+    }
+
+    // Una banda per asse (grandezze diverse nello stesso gruppo), 0 = invia sempre
+    void setBanda(int asse, float banda)
+    {
+        if (asse >= 0 && asse < MAX_ASSI_FILTRO)
+            _banda[asse] = banda < 0 ? -banda : banda;
+    }
+
+    void setIntervalloMassimo(uint32_t ms) { _intervalloMassimoMs = ms; }
+
+    bool daInviare(const float* valori, unsigned long adessoMs) const
+    {
+        // millis() è a 32 bit: la differenza a 32 bit regge il giro anche dove unsigned long è più largo (PC)
+        if (!_inviato || (uint32_t)(adessoMs - _ultimoInvioMs) >= _intervalloMassimoMs)
+            return true;
+        for (int i = 0; i < _assi; i++)
+        {
+            float scarto = valori[i] - _ultimo[i];
+            if (scarto < 0)
+                scarto = -scarto;
+            // Anche NaN fa partire l'invio: il Master vede il guasto del sensore
+            if (!(scarto < _banda[i]))
+                return true;
+        }
+        return false;
+    }
+
+    void inviato(const float* valori, unsigned long adessoMs)
+    {
+        for (int i = 0; i < _assi; i++)
+            _ultimo[i] = valori[i];
+        _ultimoInvioMs = adessoMs;
+        _inviato = true;
+    }
+
+    // Il prossimo valore parte comunque (es. nuova connessione)
+    void dimentica() { _inviato = false; }
+
+    unsigned long getUltimoInvioMs() const { return _ultimoInvioMs; }
+
+private:
+    int _assi;
+    float _banda[MAX_ASSI_FILTRO];
+    float _ultimo[MAX_ASSI_FILTRO];
+    uint32_t _intervalloMassimoMs;
+    unsigned long _ultimoInvioMs;
+    bool _inviato;
+};
+
+#endif
@@ -9,6 +9,16 @@
 #include <Arduino_HS300x.h>        // Libreria per sensore temperatura (Rev1). Usa Arduino_HS300x per Rev2.
 #include <Arduino_LPS22HB.h>       // Libreria per sensore pressione
 #include <Arduino_BMI270_BMM150.h> // Libreria per IMU/Magnetometro (Rev2)
+#include "TramaSensori.h"          // Trama binaria con tutte le grandezze (copia identica nel Master)
+#include "FiltroSensore.h"         // Medie dei campioni e banda morta (invio solo su variazione)
+#include "ProtocolloStorico.h"     // Recupero dei campioni registrati fuori portata (copia identica nel Master)
+#include "TrasmettitoreStorico.h"  // Anello dei campioni e invio a finestra
+#include "ProtocolloTempo.h"       // Sincronizzazione dell'orologio con il Master (copia identica nel Master)
+#include <utility/ATT.h>           // ATT.setMaxMtu(): pacchetti dello storico fino a 244 byte
+
+// Sovracampionamento: letture per periodo, il periodo invia (al più) la loro media
+#define CAMPIONI_AMBIENTE 4
+#define CAMPIONI_MAG 4             // Controlli del magnetometro: si legge solo un dato nuovo
 
 // UUID del servizio Environmental Sensing (Standard 0x181A)
 BLEService envService("181A");
@@ -23,9 +33,39 @@ BLEFloatCharacteristic pressCharacteristic("2A6D", BLERead | BLENotify);
 // UUID per Magnetometro (Custom o Standard 2AA1 Magnetic Flux Density 3D)
 // Usiamo una caratteristica generica di 12 byte (3 float x 4 byte)
 BLECharacteristic magCharacteristic("2AA1", BLERead | BLENotify, 12);
+// Trama compatta: sequenza, tempo e tutte le grandezze in una sola notifica.
+// Le caratteristiche sopra restano per i Master che non la conoscono
+// (una notifica parte solo verso chi si è sottoscritto).
+BLECharacteristic tramaCharacteristic(UUID_TRAMA_SENSORI, BLERead | BLENotify, TRAMA_SENSORI_DIMENSIONE);
+// Periodi richiesti dal Master in base alla schermata (vedi TramaSensori.h)
+BLECharacteristic controlloCharacteristic(UUID_CONTROLLO_SENSE, BLEWrite | BLEWriteWithoutResponse, CONTROLLO_SENSE_DIMENSIONE);
+// Arretrato registrato fuori portata: pacchetti a lunghezza variabile (fino al payload dell'MTU)
+// e richiesta/conferme del Master (vedi ProtocolloStorico.h)
+BLECharacteristic storicoCharacteristic(UUID_STORICO_SENSE, BLENotify, STORICO_PACCHETTO_MASSIMO);
+BLECharacteristic richiestaStoricoCharacteristic(UUID_RICHIESTA_STORICO, BLEWrite | BLEWriteWithoutResponse, RICHIESTA_STORICO_DIMENSIONE);
+// Orologio: il Master scrive la sua ora, la risposta torna come notifica (vedi ProtocolloTempo.h)
+BLECharacteristic tempoCharacteristic(UUID_TEMPO, BLEWrite | BLEWriteWithoutResponse | BLENotify, RISPOSTA_TEMPO_DIMENSIONE);
+
+TramaSensori trama;         // Ultimi valori inviati
+ControlloSense controllo;   // Periodi e bande in uso (di default finché il Master non scrive)
+
+MediaCampioni mediaAmbiente; // Temperatura, umidità, pressione
+MediaCampioni mediaMag;
+BandaMorta bandaAmbiente;
+BandaMorta bandaMag;
+
+AnelloStorico anello;               // Campioni registrati senza Master
+TrasmettitoreStorico trasmettitore;
+MediaCampioni mediaStorico;         // Un campione dell'anello = media di CAMPIONI_AMBIENTE letture
+
+unsigned long previousEnvMillis = 0; // Timer per dati ambientali (lenti)
+unsigned long previousMagMillis = 0; // Timer per magnetometro (veloce)
+unsigned long ultimoCampioneAmbiente = 0;
+unsigned long ultimoCampioneMag = 0;
+unsigned long inizioPeriodoStorico = 0;
+unsigned long ultimoCampioneStorico = 0;
 
-long previousEnvMillis = 0; // Timer per dati ambientali (lenti)
-long previousMagMillis = 0; // Timer per magnetometro (veloce)
+void rispondiTempo(BLEDevice central, BLECharacteristic characteristic);
 
 void setup()
 {
@@ -55,6 +95,13 @@ void setup()
       ;
   }
 
+  mediaAmbiente.begin(3);
+  mediaMag.begin(3);
+  bandaAmbiente.begin(3);
+  bandaMag.begin(3);
+  mediaStorico.begin(3);
+  trasmettitore.begin(anello);
+
   // Inizializzazione BLE
   if (!BLE.begin())
   {
@@ -63,6 +110,9 @@ void setup()
       ;
   }
 
+  // MTU più grande se il Master lo chiede (lo scambio lo avvia il Master)
+  ATT.setMaxMtu(STORICO_PACCHETTO_MASSIMO + 3);
+
   // Imposta il nome locale che il Master cerca ("NanoSense")
   BLE.setLocalName("NanoSense");
 
@@ -74,6 +124,14 @@ void setup()
   envService.addCharacteristic(humCharacteristic);
   envService.addCharacteristic(pressCharacteristic);
   envService.addCharacteristic(magCharacteristic);
+  envService.addCharacteristic(tramaCharacteristic);
+  envService.addCharacteristic(controlloCharacteristic);
+  envService.addCharacteristic(storicoCharacteristic);
+  envService.addCharacteristic(richiestaStoricoCharacteristic);
+  envService.addCharacteristic(tempoCharacteristic);
+
+  // Risposta dentro il gestore di evento: T2 e T3 non aspettano il giro del loop
+  tempoCharacteristic.setEventHandler(BLEWritten, rispondiTempo);
 
   // Aggiungi il servizio
   BLE.addService(envService);
@@ -84,6 +142,152 @@ void setup()
   Serial.println("NanoSense pronto e in ascolto...");
 }
 
+// Bande e intervallo massimo del controllo ai filtri
+void applicaControllo()
+{
+  bandaAmbiente.setBanda(0, controllo.bandaTemperatura);
+  bandaAmbiente.setBanda(1, controllo.bandaUmidita);
+  bandaAmbiente.setBanda(2, controllo.bandaPressione);
+  for (int i = 0; i < 3; i++)
+    bandaMag.setBanda(i, controllo.bandaMag);
+  bandaAmbiente.setIntervalloMassimo(controllo.intervalloMassimoMs);
+  bandaMag.setIntervalloMassimo(controllo.intervalloMassimoMs);
+}
+
+// Valori di default a ogni connessione: un Master che non scrive il controllo riceve
+// gli stessi periodi di prima, con invio su variazione. I primi valori partono comunque
+void controlloDefault()
+{
+  controlloSenseDefault(controllo);
+  applicaControllo();
+  mediaAmbiente.azzera();
+  mediaMag.azzera();
+  bandaAmbiente.dimentica();
+  bandaMag.dimentica();
+}
+
+// Tempo rimasto prima di una scadenza (0 se già passata)
+unsigned long rimanente(unsigned long inizio, unsigned long periodo, unsigned long adesso)
+{
+  unsigned long trascorso = adesso - inizio;
+  return trascorso >= periodo ? 0 : periodo - trascorso;
+}
+
+// Attesa fino al prossimo campione o alla fine di un periodo
+unsigned long attesaProssimoCampione(unsigned long adesso)
+{
+  unsigned long attesa = rimanente(ultimoCampioneAmbiente, controllo.periodoAmbienteMs / CAMPIONI_AMBIENTE, adesso);
+  unsigned long fine = rimanente(previousEnvMillis, controllo.periodoAmbienteMs, adesso);
+  if (fine < attesa)
+    attesa = fine;
+  if (controllo.magnetometro)
+  {
+    unsigned long campione = rimanente(ultimoCampioneMag, controllo.periodoMagMs / CAMPIONI_MAG, adesso);
+    fine = rimanente(previousMagMillis, controllo.periodoMagMs, adesso);
+    if (campione < attesa)
+      attesa = campione;
+    if (fine < attesa)
+      attesa = fine;
+  }
+  return attesa;
+}
+
+// Scambio dell'orologio: T2 all'ingresso, T3 subito prima della notifica
+void rispondiTempo(BLEDevice central, BLECharacteristic characteristic)
+{
+  uint32_t t2 = millis();
+  RichiestaTempo richiesta;
+  if (!decodificaRichiestaTempo(characteristic.value(), characteristic.valueLength(), richiesta))
+    return;
+
+  RispostaTempo risposta = {richiesta.sequenza, richiesta.t1, t2, 0};
+  uint8_t buffer[RISPOSTA_TEMPO_DIMENSIONE];
+  risposta.t3 = millis();
+  int lunghezza = codificaRispostaTempo(risposta, buffer, sizeof(buffer));
+  characteristic.writeValue(buffer, lunghezza);
+}
+
+// Invia la trama unica: una notifica con tutto, la sequenza rivela le trame perse.
+// currentMillis è la chiusura del periodo dei gruppi inviati: il Master la porta
+// nella sua ora con lo scarto dell'orologio (acquisizione, non arrivo)
+void inviaTrama(unsigned long currentMillis)
+{
+  trama.tempoMs = currentMillis;
+  uint8_t buffer[TRAMA_SENSORI_DIMENSIONE];
+  int lunghezza = codificaTramaSensori(trama, buffer, sizeof(buffer));
+  tramaCharacteristic.writeValue(buffer, lunghezza);
+  trama.sequenza++;
+}
+
+// Fuori portata: CAMPIONI_AMBIENTE letture per PERIODO_STORICO_MS, la media va nell'anello
+void registraStorico(unsigned long adesso)
+{
+  if (adesso - ultimoCampioneStorico >= PERIODO_STORICO_MS / CAMPIONI_AMBIENTE)
+  {
+    ultimoCampioneStorico = adesso;
+    float campione[3];
+    campione[0] = HS300x.readTemperature();
+    campione[1] = HS300x.readHumidity();
+    campione[2] = BARO.readPressure();
+    mediaStorico.aggiungi(campione);
+  }
+
+  float media[3];
+  if (adesso - inizioPeriodoStorico >= PERIODO_STORICO_MS)
+  {
+    inizioPeriodoStorico = adesso;
+    if (mediaStorico.chiudi(media))
+    {
+      CampioneSense c = {(uint32_t)adesso, media[0], media[1], media[2]};
+      anello.aggiungi(c);
+    }
+  }
+}
+
+unsigned long attesaStorico(unsigned long adesso)
+{
+  unsigned long attesa = rimanente(ultimoCampioneStorico, PERIODO_STORICO_MS / CAMPIONI_AMBIENTE, adesso);
+  unsigned long fine = rimanente(inizioPeriodoStorico, PERIODO_STORICO_MS, adesso);
+  return fine < attesa ? fine : attesa;
+}
+
+// Richiesta di inizio o conferma cumulativa del Master
+void gestisciRichiestaStorico(unsigned long adesso)
+{
+  RichiestaStorico r;
+  if (!decodificaRichiestaStorico(richiestaStoricoCharacteristic.value(), richiestaStoricoCharacteristic.valueLength(), r))
+    return;
+
+  if (r.comando == RICHIESTA_INIZIA)
+  {
+    trasmettitore.inizia(r, adesso);
+    Serial.print("Storico: invio di ");
+    Serial.print(trasmettitore.getCampioni());
+    Serial.print(" campioni, pacchetti da ");
+    Serial.print(r.dimensionePacchetto);
+    Serial.println(" byte");
+    return;
+  }
+
+  trasmettitore.conferma(r, adesso);
+  if (!trasmettitore.isAttivo())
+  {
+    Serial.print("Storico: trasferimento concluso, ripetizioni ");
+    Serial.println(trasmettitore.getRipetizioni());
+  }
+}
+
+// Pacchetti dell'arretrato fin dove la finestra lo permette
+void inviaStorico()
+{
+  if (!storicoCharacteristic.subscribed())
+    return;
+  uint8_t buffer[STORICO_PACCHETTO_MASSIMO];
+  int lunghezza;
+  while (trasmettitore.prossimoPacchetto(buffer, lunghezza, millis(), millis()))
+    storicoCharacteristic.writeValue(buffer, lunghezza);
+}
+
 void loop()
 {
   // Attendi connessione da un centrale
@@ -93,54 +297,144 @@ void loop()
   {
     Serial.print("Connesso al centrale: ");
     Serial.println(central.address());
+    controlloDefault();
+    if (anello.getNumero() > 0)
+    {
+      Serial.print("Storico: ");
+      Serial.print(anello.getNumero());
+      Serial.println(" campioni in attesa del Master");
+    }
 
     while (central.connected())
     {
-      long currentMillis = millis();
+      unsigned long currentMillis = millis();
+
+      // 0. Controllo dal Master: cambia periodi e bande (es. magnetometro spento fuori dalla bussola)
+      if (controlloCharacteristic.written())
+      {
+        ControlloSense nuovo;
+        if (decodificaControlloSense(controlloCharacteristic.value(), controlloCharacteristic.valueLength(), nuovo))
+        {
+          controllo = nuovo;
+          applicaControllo();
+          Serial.print("Controllo: magnetometro ");
+          Serial.print(controllo.magnetometro ? controllo.periodoMagMs : 0);
+          Serial.print(" ms, ambiente ");
+          Serial.print(controllo.periodoAmbienteMs);
+          Serial.print(" ms, intervallo massimo ");
+          Serial.print(controllo.intervalloMassimoMs);
+          Serial.println(" ms");
+        }
+      }
+
+      // 0b. Arretrato: richieste e conferme del Master, poi i pacchetti che la finestra permette
+      if (richiestaStoricoCharacteristic.written())
+        gestisciRichiestaStorico(currentMillis);
+      inviaStorico();
+
+      bool inviaTramaOra = false;
+
+      // 1. Dati Ambientali: CAMPIONI_AMBIENTE letture per periodo (ogni 2 secondi di default)
+      if (currentMillis - ultimoCampioneAmbiente >= controllo.periodoAmbienteMs / CAMPIONI_AMBIENTE)
+      {
+        ultimoCampioneAmbiente = currentMillis;
+        float campione[3];
+        campione[0] = HS300x.readTemperature(); // °C
+        campione[1] = HS300x.readHumidity();    // %
+        campione[2] = BARO.readPressure();      // kPa
+        mediaAmbiente.aggiungi(campione);
+      }
 
-      // 1. Dati Ambientali: Aggiornamento lento (ogni 2 secondi)
-      if (currentMillis - previousEnvMillis >= 2000)
+      // 2. Fine del periodo ambientale: la media parte solo se cambiata oltre la banda
+      float ambiente[3];
+      if (currentMillis - previousEnvMillis >= controllo.periodoAmbienteMs)
       {
         previousEnvMillis = currentMillis;
+        if (mediaAmbiente.chiudi(ambiente) && bandaAmbiente.daInviare(ambiente, currentMillis))
+        {
+          bandaAmbiente.inviato(ambiente, currentMillis);
 
-        float temperature = HS300x.readTemperature(); // °C
-        float humidity = HS300x.readHumidity();       // %
-        float pressure = BARO.readPressure();
+          Serial.print("Temperatura inviata: ");
+          Serial.print(ambiente[0]);
+          Serial.println(" °C");
 
-        Serial.print("Temperatura inviata: ");
-        Serial.print(temperature);
-        Serial.println(" °C");
+          Serial.print("Umidità inviata: ");
+          Serial.print(ambiente[1]);
+          Serial.println(" %");
 
-        Serial.print("Umidità inviata: ");
-        Serial.print(humidity);
-        Serial.println(" %");
+          Serial.print("Pressione inviata: ");
+          Serial.print(ambiente[2]);
+          Serial.println(" kPa");
 
-        Serial.print("Pressione inviata: ");
-        Serial.print(pressure);
-        Serial.println(" kPa");
+          tempCharacteristic.writeValue(ambiente[0]);
+          humCharacteristic.writeValue(ambiente[1]);
+          pressCharacteristic.writeValue(ambiente[2]);
 
-        tempCharacteristic.writeValue(temperature);
-        humCharacteristic.writeValue(humidity);
-        pressCharacteristic.writeValue(pressure);
+          trama.temperatura = ambiente[0];
+          trama.umidita = ambiente[1];
+          trama.pressione = ambiente[2];
+          trama.ambienteValido = true;
+          inviaTramaOra = true;
+        }
       }
 
-      // 2. Magnetometro: Aggiornamento veloce (ogni 100ms = 10Hz)
-      if (currentMillis - previousMagMillis >= 100)
+      // 3. Magnetometro: campioni nuovi CAMPIONI_MAG volte per periodo (ogni 50ms = 20Hz di default)
+      if (controllo.magnetometro)
       {
-        previousMagMillis = currentMillis;
-
-        float x, y, z;
-        IMU.readMagneticField(x, y, z);
+        if (currentMillis - ultimoCampioneMag >= controllo.periodoMagMs / CAMPIONI_MAG)
+        {
+          ultimoCampioneMag = currentMillis;
+          if (IMU.magneticFieldAvailable())
+          {
+            float campione[3];
+            IMU.readMagneticField(campione[0], campione[1], campione[2]);
+            mediaMag.aggiungi(campione);
+          }
+        }
 
-        // Invia array di 3 float
         float magData[3];
-        magData[0] = x;
-        magData[1] = y;
-        magData[2] = z;
-        magCharacteristic.writeValue((byte *)magData, 12);
+        if (currentMillis - previousMagMillis >= controllo.periodoMagMs)
+        {
+          previousMagMillis = currentMillis;
+          if (mediaMag.chiudi(magData) && bandaMag.daInviare(magData, currentMillis))
+          {
+            bandaMag.inviato(magData, currentMillis);
+
+            // Invia array di 3 float
+            magCharacteristic.writeValue((byte *)magData, 12);
+
+            trama.magX = magData[0];
+            trama.magY = magData[1];
+            trama.magZ = magData[2];
+            inviaTramaOra = true;
+          }
+        }
       }
+
+      // 4. Trama unica quando almeno un gruppo è cambiato: entrambi i gruppi, ultimi valori
+      if (inviaTramaOra)
+        inviaTrama(currentMillis);
+
+      // 5. Niente attesa attiva: BLE.poll() dorme fino al prossimo campione, a un evento radio
+      //    o al timeout delle conferme dello storico
+      unsigned long adesso = millis();
+      unsigned long attesa = attesaProssimoCampione(adesso);
+      unsigned long attesaInvio = trasmettitore.getAttesaMs(adesso);
+      BLE.poll(attesaInvio < attesa ? attesaInvio : attesa);
     }
 
+    // L'arretrato non confermato resta nell'anello per la prossima connessione
+    trasmettitore.annulla();
+    mediaStorico.azzera();
+    inizioPeriodoStorico = millis();
+    ultimoCampioneStorico = millis();
     Serial.println("Disconnesso dal centrale.");
   }
-}
\ No newline at end of file
+  else
+  {
+    // Fuori portata: si registra per il Master e si dorme fino al prossimo campione
+    // (un evento radio, come una connessione, sveglia prima)
+    registraStorico(millis());
+    BLE.poll(attesaStorico(millis()));
+  }
+}
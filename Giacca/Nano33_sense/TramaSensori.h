@@ -0,0 +1,242 @@
+/*
+  TramaSensori.h
+  Trama binaria compatta del Nano Sense: tutte le grandezze in una sola notifica BLE.
+  Copia identica in Giacca/Nano33_sense e Giacca/Bracciale/B_G_Master
+  (Arduino compila solo la cartella dello sketch): modificare sempre entrambe.
+  Solo C++ standard, header-only, compilabile anche su PC.
+
+  Formato versione 1 (little endian, 20 byte = payload di una notifica con MTU di default):
+    0     uint8   versione
+    1     uint8   flag (bit 0: dati ambientali validi)
+    2-3   uint16  sequenza (+1 per trama, riparte da 0 dopo 65535)
+    4-7   uint32  tempo del Sense [ms dall'avvio]
+    8-9   int16   temperatura [0.01 °C]
+    10-11 uint16  umidità [0.01 %]
+    12-13 uint16  pressione [2 Pa]
+    14-19 int16   magnetometro X, Y, Z [0.1 uT]
+  Un valore assente (NaN, sensore guasto) ha un codice riservato, come in FormatoRegistro.h:
+  -32768 per i campi int16, 65535 per i campi uint16. I valori fuori scala si fermano
+  un passo prima (-327.67 °C, 655.34 %): un Master precedente li legge come fondo scala.
+
+  Controllo dal Master (scritto senza risposta, 16 byte), versione 1:
+    0     uint8   versione
+    1     uint8   flag (bit 0: magnetometro acceso)
+    2-3   uint16  periodo del magnetometro [ms]
+    4-5   uint16  periodo dei dati ambientali [ms]
+    6-7   uint16  banda morta temperatura [0.01 °C]
+    8-9   uint16  banda morta umidità [0.01 %]
+    10-11 uint16  banda morta pressione [Pa]
+    12-13 uint16  banda morta magnetometro [0.1 uT]
+    14-15 uint16  intervallo massimo tra due invii [ms]
+  I byte 6-15 sono stati aggiunti in coda: un controllo di 6 byte vale con le
+  bande di default, un Sense precedente legge solo i primi 6.
+  Il Sense invia un gruppo (ambiente o magnetometro) quando la media del periodo
+  si scosta dall'ultimo valore inviato di almeno la banda, o allo scadere
+  dell'intervallo massimo. Banda 0 = invia ogni periodo.
+  Senza controllo il Sense usa i valori di default qui sotto.
+*/
+#ifndef TRAMA_SENSORI_H
+#define TRAMA_SENSORI_H
+
+#include <stdint.h>
+#include <math.h>
+
+#define TRAMA_SENSORI_VERSIONE 1
+#define TRAMA_SENSORI_DIMENSIONE 20
+#define UUID_TRAMA_SENSORI "19B10010-E8F2-537E-4F6C-D104768A1214"
+
+#define TRAMA_FLAG_AMBIENTE 0x01
+#define TRAMA_INT16_NULLO 0x8000  // NaN nei campi int16
+#define TRAMA_UINT16_NULLO 0xFFFF // NaN nei campi uint16
+
+#define CONTROLLO_SENSE_VERSIONE 1
+#define CONTROLLO_SENSE_DIMENSIONE 16
+#define CONTROLLO_SENSE_DIMENSIONE_MINIMA 6 // Solo i periodi (Master precedenti)
+#define UUID_CONTROLLO_SENSE "19B10011-E8F2-537E-4F6C-D104768A1214"
+
+#define CONTROLLO_FLAG_MAGNETOMETRO 0x01
+#define PERIODO_MAG_DEFAULT_MS 50         // 20 Hz
+#define PERIODO_AMBIENTE_DEFAULT_MS 2000
+#define PERIODO_MINIMO_MS 20              // Limite ai periodi ricevuti
+#define BANDA_TEMPERATURA_DEFAULT 0.05f   // °C
+#define BANDA_UMIDITA_DEFAULT 0.3f        // %
+#define BANDA_PRESSIONE_DEFAULT 0.01f     // kPa (10 Pa, circa 1 m di quota)
+#define BANDA_MAG_DEFAULT 0.5f            // uT
+#define INTERVALLO_MASSIMO_DEFAULT_MS 10000
+
+struct TramaSensori {
+    uint16_t sequenza;
+    uint32_t tempoMs;
+    bool ambienteValido;
+    float temperatura; // °C
+    float umidita;     // %
+    float pressione;   // kPa (come BARO.readPressure())
+    float magX, magY, magZ; // uT
+};
+
+struct ControlloSense {
+    bool magnetometro;
+    uint16_t periodoMagMs;
+    uint16_t periodoAmbienteMs;
+    float bandaTemperatura;   // °C
+    float bandaUmidita;       // %
+    float bandaPressione;     // kPa
+    float bandaMag;           // uT
+    uint16_t intervalloMassimoMs;
+};
+
+// --- Dettagli interni ---
+
+inline int32_t tramaArrotonda(float v, float scala, int32_t minimo, int32_t massimo)
+{
+    float s = v * scala;
+    if (!(s < (float)massimo)) // Anche NaN satura al massimo: per le misure vedi tramaMisura16()
+        return massimo;
+    if (s <= (float)minimo)
+        return minimo;
+    return (int32_t)(s >= 0 ? s + 0.5f : s - 0.5f);
+}
+
+inline void tramaScrivi16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+inline void tramaScrivi32(uint8_t* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+inline uint16_t tramaLeggi16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t tramaLeggi32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Misure: NaN ha il suo codice, gli altri valori saturano senza raggiungerlo
+inline uint16_t tramaMisura16(float v, float scala, bool conSegno)
+{
+    if (isnan(v))
+        return conSegno ? TRAMA_INT16_NULLO : TRAMA_UINT16_NULLO;
+    if (conSegno)
+        return (uint16_t)(int16_t)tramaArrotonda(v, scala, -32767, 32767);
+    return (uint16_t)tramaArrotonda(v, scala, 0, 65534);
+}
+
+inline float tramaLeggiMisura16(const uint8_t* p, float scala, bool conSegno)
+{
+    uint16_t v = tramaLeggi16(p);
+    if (conSegno)
+        return v == TRAMA_INT16_NULLO ? NAN : (int16_t)v / scala;
+    return v == TRAMA_UINT16_NULLO ? NAN : v / scala;
+}
+
+// --- Interfaccia ---
+
+// Scrive la trama in buf. Restituisce i byte scritti, 0 se buf è troppo piccolo.
+// I valori fuori scala vengono saturati, NaN viaggia con il codice nullo.
+inline int codificaTramaSensori(const TramaSensori& t, uint8_t* buf, int dimensione)
+{
+    if (dimensione < TRAMA_SENSORI_DIMENSIONE)
+        return 0;
+    buf[0] = TRAMA_SENSORI_VERSIONE;
+    buf[1] = t.ambienteValido ? TRAMA_FLAG_AMBIENTE : 0;
+    tramaScrivi16(buf + 2, t.sequenza);
+    tramaScrivi32(buf + 4, t.tempoMs);
+    tramaScrivi16(buf + 8, tramaMisura16(t.temperatura, 100.0f, true));
+    tramaScrivi16(buf + 10, tramaMisura16(t.umidita, 100.0f, false));
+    tramaScrivi16(buf + 12, tramaMisura16(t.pressione, 500.0f, false)); // kPa -> 2 Pa
+    tramaScrivi16(buf + 14, tramaMisura16(t.magX, 10.0f, true));
+    tramaScrivi16(buf + 16, tramaMisura16(t.magY, 10.0f, true));
+    tramaScrivi16(buf + 18, tramaMisura16(t.magZ, 10.0f, true));
+    return TRAMA_SENSORI_DIMENSIONE;
+}
+
+// Legge una trama. Restituisce false se la versione non è gestita o la trama è troppo corta.
+// Versioni future della stessa famiglia possono solo aggiungere campi in coda.
+inline bool decodificaTramaSensori(const uint8_t* buf, int lunghezza, TramaSensori& t)
+{
+    if (lunghezza < TRAMA_SENSORI_DIMENSIONE || buf[0] != TRAMA_SENSORI_VERSIONE)
+        return false;
+    t.ambienteValido = (buf[1] & TRAMA_FLAG_AMBIENTE) != 0;
+    t.sequenza = tramaLeggi16(buf + 2);
+    t.tempoMs = tramaLeggi32(buf + 4);
+    t.temperatura = tramaLeggiMisura16(buf + 8, 100.0f, true);
+    t.umidita = tramaLeggiMisura16(buf + 10, 100.0f, false);
+    t.pressione = tramaLeggiMisura16(buf + 12, 500.0f, false);
+    t.magX = tramaLeggiMisura16(buf + 14, 10.0f, true);
+    t.magY = tramaLeggiMisura16(buf + 16, 10.0f, true);
+    t.magZ = tramaLeggiMisura16(buf + 18, 10.0f, true);
+    return true;
+}
+
+// Periodi, bande e intervallo massimo di default
+inline void controlloSenseDefault(ControlloSense& c)
+{
+    c.magnetometro = true;
+    c.periodoMagMs = PERIODO_MAG_DEFAULT_MS;
+    c.periodoAmbienteMs = PERIODO_AMBIENTE_DEFAULT_MS;
+    c.bandaTemperatura = BANDA_TEMPERATURA_DEFAULT;
+    c.bandaUmidita = BANDA_UMIDITA_DEFAULT;
+    c.bandaPressione = BANDA_PRESSIONE_DEFAULT;
+    c.bandaMag = BANDA_MAG_DEFAULT;
+    c.intervalloMassimoMs = INTERVALLO_MASSIMO_DEFAULT_MS;
+}
+
+inline int codificaControlloSense(const ControlloSense& c, uint8_t* buf, int dimensione)
+{
+    if (dimensione < CONTROLLO_SENSE_DIMENSIONE)
+        return 0;
+    buf[0] = CONTROLLO_SENSE_VERSIONE;
+    buf[1] = c.magnetometro ? CONTROLLO_FLAG_MAGNETOMETRO : 0;
+    tramaScrivi16(buf + 2, c.periodoMagMs);
+    tramaScrivi16(buf + 4, c.periodoAmbienteMs);
+    tramaScrivi16(buf + 6, (uint16_t)tramaArrotonda(c.bandaTemperatura, 100.0f, 0, 65535));
+    tramaScrivi16(buf + 8, (uint16_t)tramaArrotonda(c.bandaUmidita, 100.0f, 0, 65535));
+    tramaScrivi16(buf + 10, (uint16_t)tramaArrotonda(c.bandaPressione, 1000.0f, 0, 65535)); // kPa -> Pa
+    tramaScrivi16(buf + 12, (uint16_t)tramaArrotonda(c.bandaMag, 10.0f, 0, 65535));
+    tramaScrivi16(buf + 14, c.intervalloMassimoMs);
+    return CONTROLLO_SENSE_DIMENSIONE;
+}
+
+// I periodi sotto PERIODO_MINIMO_MS vengono alzati al minimo, l'intervallo massimo
+// non scende sotto il periodo del gruppo più lento (altrimenti ogni periodo sarebbe un invio)
+inline bool decodificaControlloSense(const uint8_t* buf, int lunghezza, ControlloSense& c)
+{
+    if (lunghezza < CONTROLLO_SENSE_DIMENSIONE_MINIMA || buf[0] != CONTROLLO_SENSE_VERSIONE)
+        return false;
+    controlloSenseDefault(c);
+    c.magnetometro = (buf[1] & CONTROLLO_FLAG_MAGNETOMETRO) != 0;
+    c.periodoMagMs = tramaLeggi16(buf + 2);
+    c.periodoAmbienteMs = tramaLeggi16(buf + 4);
+    if (c.periodoMagMs < PERIODO_MINIMO_MS)
+        c.periodoMagMs = PERIODO_MINIMO_MS;
+    if (c.periodoAmbienteMs < PERIODO_MINIMO_MS)
+        c.periodoAmbienteMs = PERIODO_MINIMO_MS;
+
+    if (lunghezza >= CONTROLLO_SENSE_DIMENSIONE)
+    {
+        c.bandaTemperatura = tramaLeggi16(buf + 6) / 100.0f;
+        c.bandaUmidita = tramaLeggi16(buf + 8) / 100.0f;
+        c.bandaPressione = tramaLeggi16(buf + 10) / 1000.0f;
+        c.bandaMag = tramaLeggi16(buf + 12) / 10.0f;
+        c.intervalloMassimoMs = tramaLeggi16(buf + 14);
+    }
+    if (c.intervalloMassimoMs < c.periodoAmbienteMs)
+        c.intervalloMassimoMs = c.periodoAmbienteMs;
+    return true;
+}
+
+// Trame mancanti tra due sequenze consecutive ricevute (gestisce il giro a 65535)
+inline uint16_t tramePerse(uint16_t precedente, uint16_t attuale)
+{
+    return (uint16_t)(attuale - precedente - 1);
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+  TrasmettitoreStorico.h
+  Campioni ambientali registrati fuori portata e loro invio al Master
+  alla riconnessione (protocollo in ProtocolloStorico.h).
+  AnelloStorico conserva gli ultimi MAX_CAMPIONI_STORICO campioni già codificati
+  (pieno: si perde il più vecchio). TrasmettitoreStorico li invia a finestra
+  e li scarta solo quando il Master ha confermato la fine del trasferimento:
+  una connessione persa a metà lascia l'arretrato intatto per la prossima.
+  Solo C++ standard, header-only, compilabile anche su PC.
+*/
+#ifndef TRASMETTITORE_STORICO_H
+#define TRASMETTITORE_STORICO_H
+
+#include <stdint.h>
+#include <string.h>
+#include "ProtocolloStorico.h"
+
+#define MAX_CAMPIONI_STORICO 2048      // 17 ore a un campione ogni 30 s, 20 KB di RAM
+
+class AnelloStorico {
+public:
+    AnelloStorico() : _testa(0), _numero(0), _persi(0) {}
+
+    void aggiungi(const CampioneSense& c)
+    {
+        if (_numero == MAX_CAMPIONI_STORICO)
+        {
+            _testa = (_testa + 1) % MAX_CAMPIONI_STORICO;
+            _numero--;
+            _persi++;
+        }
+        codificaCampioneSense(c, _dati[(_testa + _numero) % MAX_CAMPIONI_STORICO]);
+        _numero++;
+    }
+
+    // Campione i-esimo dal più vecchio, già codificato
+    void leggi(int indice, uint8_t* buf) const
+    {
+        memcpy(buf, _dati[(_testa + indice) % MAX_CAMPIONI_STORICO], STORICO_CAMPIONE_DIMENSIONE);
+    }
+
+    // Toglie i campioni più vecchi (trasferiti)
+    void scarta(int numero)
+    {
+        if (numero > _numero)
+            numero = _numero;
+        _testa = (_testa + numero) % MAX_CAMPIONI_STORICO;
+        _numero -= numero;
+    }
+
+    int getNumero() const { return _numero; }
+    uint32_t getPersi() const { return _persi; }
+
+private:
+    uint8_t _dati[MAX_CAMPIONI_STORICO][STORICO_CAMPIONE_DIMENSIONE];
+    int _testa;
+    int _numero;
+    uint32_t _persi;
+};
+
+class TrasmettitoreStorico {
+public:
+    TrasmettitoreStorico()
+        : _anello(nullptr), _attivo(false), _campioni(0), _perPacchetto(1), _finestra(1),
+          _totale(0), _base(0), _prossimo(0), _ultimoProgressoMs(0), _ripetizioni(0) {}
+
+    void begin(AnelloStorico& anello) { _anello = &anello; }
+
+    // Fotografia dell'anello: fuori portata non si registra, quindi non cambia durante il trasferimento
+    void inizia(const RichiestaStorico& r, unsigned long adessoMs)
+    {
+        if (!_anello)
+            return;
+        _attivo = true;
+        _campioni = _anello->getNumero();
+        _perPacchetto = storicoCampioniPerPacchetto(r.dimensionePacchetto);
+        _finestra = r.finestra;
+        _totale = (uint16_t)((_campioni + _perPacchetto - 1) / _perPacchetto + 1); // + STORICO_FINE
+        _base = 0;
+        _prossimo = 0;
+        _ultimoProgressoMs = adessoMs;
+    }
+
+    // Conferma cumulativa: r.atteso è il primo pacchetto non ancora ricevuto
+    void conferma(const RichiestaStorico& r, unsigned long adessoMs)
+    {
+        if (!_attivo || r.atteso > _prossimo)
+            return;
+        if (r.atteso > _base)
+        {
+            _base = r.atteso;
+            _ultimoProgressoMs = adessoMs;
+            if (_base == _totale)
+            {
+                _anello->scarta(_campioni);
+                _attivo = false;
+            }
+        }
+        else if (r.atteso == _base && _prossimo > _base)
+        {
+            // Conferma ripetuta: il Master ha visto un buco, si riparte senza aspettare il timeout
+            ripeti(adessoMs);
+        }
+    }
+
+    void annulla() { _attivo = false; }
+
+    // Prossimo pacchetto da notificare, se la finestra lo permette. tempoSenseMs = millis() attuale
+    bool prossimoPacchetto(uint8_t* buf, int& lunghezza, uint32_t tempoSenseMs, unsigned long adessoMs)
+    {
+        if (!_attivo)
+            return false;
+        if (_prossimo > _base && adessoMs - _ultimoProgressoMs >= TIMEOUT_STORICO_MS)
+            ripeti(adessoMs);
+        if (_prossimo >= _totale || _prossimo - _base >= _finestra)
+            return false;
+
+        uint16_t sequenza = _prossimo++;
+        if (sequenza == _totale - 1)
+        {
+            lunghezza = chiudiPacchettoStorico(STORICO_FINE, 0, sequenza, tempoSenseMs, buf);
+            return true;
+        }
+
+        int primo = sequenza * _perPacchetto;
+        int numero = _campioni - primo < _perPacchetto ? _campioni - primo : _perPacchetto;
+        for (int i = 0; i < numero; i++)
+            _anello->leggi(primo + i, buf + STORICO_INTESTAZIONE + i * STORICO_CAMPIONE_DIMENSIONE);
+        lunghezza = chiudiPacchettoStorico(STORICO_DATI, (uint8_t)numero, sequenza, tempoSenseMs, buf);
+        return true;
+    }
+
+    // Attesa massima prima che serva richiamare prossimoPacchetto() (per BLE.poll())
+    unsigned long getAttesaMs(unsigned long adessoMs) const
+    {
+        if (!_attivo)
+            return 0xFFFFFFFFUL;
+        if (_prossimo < _totale && _prossimo - _base < _finestra)
+            return 0;
+        unsigned long trascorso = adessoMs - _ultimoProgressoMs;
+        return trascorso >= TIMEOUT_STORICO_MS ? 0 : TIMEOUT_STORICO_MS - trascorso;
+    }
+
+    bool isAttivo() const { return _attivo; }
+    int getCampioni() const { return _campioni; }
+    uint32_t getRipetizioni() const { return _ripetizioni; }
+
+private:
+    AnelloStorico* _anello;
+    bool _attivo;
+    int _campioni;                 // Campioni del trasferimento in corso
+    int _perPacchetto;
+    uint8_t _finestra;
+    uint16_t _totale;              // Pacchetti, STORICO_FINE compreso
+    uint16_t _base;                // Primo non confermato
+    uint16_t _prossimo;            // Prossimo da inviare
+    unsigned long _ultimoProgressoMs;
+    uint32_t _ripetizioni;         // Ripartenze dal primo non confermato
+
+    void ripeti(unsigned long adessoMs)
+    {
+        _prossimo = _base;
+        _ultimoProgressoMs = adessoMs;
+        _ripetizioni++;
+    }
+};
+
+#endif
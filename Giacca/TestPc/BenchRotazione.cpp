@@ -0,0 +1,115 @@
+// Kicco972.net
+
+
+// Proiezione di un frame della sfera IMU (81 punti): il vecchio percorso con due
+// rotatePoint per punto (6 funzioni trigonometriche ciascuno) contro una sola
+// matrice per frame. Verifica che diano lo stesso risultato e stampa i tempi.
+
+#include "MeshSfera.h"
+#include "Verifica.h"
+
+#define RAGGIO 100.0f
+#define FRAME 20000
+
+// Percorso originale di Imu3DVisualizer, tenuto qui come riferimento
+static Point3D rotatePoint(Point3D p, float pitchDeg, float rollDeg, float yawDeg)
+{
+    float pRad = pitchDeg * M3D_DEG_TO_RAD;
+    float rRad = rollDeg * M3D_DEG_TO_RAD;
+    float yRad = yawDeg * M3D_DEG_TO_RAD;
+
+    // X Rotation
+    float y1 = p.y * cosf(pRad) - p.z * sinf(pRad);
+    float z1 = p.y * sinf(pRad) + p.z * cosf(pRad);
+    float x1 = p.x;
+
+    // Y Rotation
+    float x2 = x1 * cosf(rRad) + z1 * sinf(rRad);
+    float z2 = -x1 * sinf(rRad) + z1 * cosf(rRad);
+    float y2 = y1;
+
+    // Z Rotation
+    float x3 = x2 * cosf(yRad) - y2 * sinf(yRad);
+    float y3 = x2 * sinf(yRad) + y2 * cosf(yRad);
+    float z3 = z2;
+
+    return {x3, y3, z3};
+}
+
+static Point3D vecchio(const Point3D& punto, float p, float r, float y)
+{
+    Point3D pt = {punto.x * RAGGIO, punto.y * RAGGIO, punto.z * RAGGIO};
+    return rotatePoint(rotatePoint(pt, p, r, y), VISTA_PITCH, VISTA_ROLL, VISTA_YAW);
+}
+
+int main()
+{
+    const Matrice3 vista = Matrice3::daEulero(VISTA_PITCH, VISTA_ROLL, VISTA_YAW);
+    volatile float pozzo = 0; // Impedisce al compilatore di eliminare i calcoli
+
+    // Stesso risultato, punto per punto, su orientamenti sparsi
+    float errMax = 0;
+    for (int k = 0; k < 360; k++)
+    {
+        float p = k * 0.7f, r = k * 0.3f - 50, y = k * 1.1f;
+        Matrice3 totale = (vista * Matrice3::daEulero(p, r, y)) * RAGGIO;
+        for (int axis = 0; axis < 3; axis++)
+            for (int i = 0; i < PUNTI_CERCHIO_SFERA; i++)
+            {
+                Point3D a = vecchio(MESH_SFERA[axis][i], p, r, y);
+                Point3D b = totale * MESH_SFERA[axis][i];
+                errMax = fmaxf(errMax, fabsf(a.x - b.x) + fabsf(a.y - b.y) + fabsf(a.z - b.z));
+            }
+        for (int i = 0; i < 6; i++)
+        {
+            Point3D a = vecchio(MESH_CARDINALI[i], p, r, y);
+            Point3D b = totale * MESH_CARDINALI[i];
+            errMax = fmaxf(errMax, fabsf(a.x - b.x) + fabsf(a.y - b.y) + fabsf(a.z - b.z));
+        }
+    }
+    // Sotto il millesimo di pixel: le due proiezioni cadono sugli stessi pixel
+    VERIFICA(errMax < 1e-3f);
+
+    double t0 = adessoUs();
+    for (int k = 0; k < FRAME; k++)
+    {
+        float p = k * 0.7f, r = k * 0.3f, y = k * 1.1f;
+        for (int axis = 0; axis < 3; axis++)
+            for (int i = 0; i < PUNTI_CERCHIO_SFERA; i++)
+            {
+                Point3D rot = vecchio(MESH_SFERA[axis][i], p, r, y);
+                pozzo = pozzo + rot.x + rot.y;
+            }
+        for (int i = 0; i < 6; i++)
+        {
+            Point3D rot = vecchio(MESH_CARDINALI[i], p, r, y);
+            pozzo = pozzo + rot.x + rot.y;
+        }
+    }
+    double tVecchio = adessoUs() - t0;
+
+    t0 = adessoUs();
+    for (int k = 0; k < FRAME; k++)
+    {
+        float p = k * 0.7f, r = k * 0.3f, y = k * 1.1f;
+        Matrice3 totale = (vista * Matrice3::daEulero(p, r, y)) * RAGGIO;
+        for (int axis = 0; axis < 3; axis++)
+            for (int i = 0; i < PUNTI_CERCHIO_SFERA; i++)
+            {
+                Point3D rot = totale * MESH_SFERA[axis][i];
+                pozzo = pozzo + rot.x + rot.y;
+            }
+        for (int i = 0; i < 6; i++)
+        {
+            Point3D rot = totale * MESH_CARDINALI[i];
+            pozzo = pozzo + rot.x + rot.y;
+        }
+    }
+    double tNuovo = adessoUs() - t0;
+
+    printf("Rotazione, %d frame da %d punti:\n", FRAME, 3 * PUNTI_CERCHIO_SFERA + 6);
+    printf("  rotatePoint x2: %.2f us/frame\n", tVecchio / FRAME);
+    printf("  matrice/frame:  %.2f us/frame (%.1fx)\n", tNuovo / FRAME, tVecchio / tNuovo);
+    printf("  errore max: %g\n", errMax);
+    return fineVerifiche();
+}
@@ -0,0 +1,289 @@
+// Kicco972.net
+
+
+// AnelloRegistro su PC, su file veri in bin/: giro dell'anello su più segmenti
+// (restano solo gli ultimi, in ordine), ricostruzione senza manifesto o con il
+// manifesto rovinato (anche a cavallo del giro delle generazioni a 16 bit),
+// record e intestazione lasciati a metà da un reset, rotazione interrotta tra
+// il troncamento del segmento più vecchio e la scrittura del manifesto.
+
+#include "AnelloRegistro.h"
+#include "Verifica.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define BASE_PROVA "bin/Anello"
+#define RECORD_PER_SEGMENTO 5
+#define SEGMENTI_PROVA 3
+
+static ConfigurazioneAnello configurazione()
+{
+    return ConfigurazioneAnello{BASE_PROVA, REGISTRO_INTESTAZIONE + RECORD_PER_SEGMENTO * REGISTRO_RECORD, SEGMENTI_PROVA};
+}
+
+static void pulisci()
+{
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    for (int i = 0; i < MAX_SEGMENTI_ANELLO; i++)
+    {
+        AnelloRegistro::percorsoSegmento(BASE_PROVA, i, percorso, sizeof(percorso));
+        remove(percorso);
+    }
+    remove(BASE_PROVA ".man");
+    remove(BASE_PROVA ".tmp");
+    rmdir(BASE_PROVA ".tmp");
+}
+
+static bool aggiungi(AnelloRegistro& a, uint32_t primo, int numero)
+{
+    std::vector<CampioneStorico> c(numero);
+    for (int i = 0; i < numero; i++)
+        c[i] = CampioneStorico{primo + i, 20.0f + i * 0.01f, 50.0f, 101.3f};
+    return a.aggiungi(c.data(), numero);
+}
+
+// Epoch dei record validi, dal segmento più vecchio alla testa
+static std::vector<uint32_t> leggiTutto(const AnelloRegistro& a)
+{
+    std::vector<uint32_t> epoch;
+    for (int o = 0; o < a.getSegmenti(); o++)
+    {
+        char percorso[PERCORSO_ANELLO_MASSIMO];
+        a.percorsoInOrdine(o, percorso, sizeof(percorso));
+        FILE* f = fopen(percorso, "rb");
+        if (!f)
+            continue;
+        uint8_t buf[REGISTRO_RECORD];
+        if (fread(buf, 1, REGISTRO_INTESTAZIONE, f) == REGISTRO_INTESTAZIONE && verificaIntestazioneRegistro(buf, REGISTRO_INTESTAZIONE))
+        {
+            CampioneStorico c;
+            while (fread(buf, 1, REGISTRO_RECORD, f) == REGISTRO_RECORD)
+                if (decodificaRecordRegistro(buf, c))
+                    epoch.push_back(c.epoch);
+        }
+        fclose(f);
+    }
+    return epoch;
+}
+
+static bool consecutivi(const std::vector<uint32_t>& epoch, uint32_t primo, uint32_t ultimo)
+{
+    if (epoch.size() != ultimo - primo + 1)
+        return false;
+    for (size_t i = 0; i < epoch.size(); i++)
+        if (epoch[i] != primo + i)
+            return false;
+    return true;
+}
+
+static long dimensioneFile(const char* percorso)
+{
+    struct stat s;
+    return stat(percorso, &s) == 0 ? (long)s.st_size : -1;
+}
+
+static void giroDellAnello()
+{
+    pulisci();
+    AnelloRegistro a;
+    VERIFICA(a.begin(configurazione()));
+    VERIFICA(a.getRecordPerSegmento() == RECORD_PER_SEGMENTO && a.getRitenzione() == RECORD_PER_SEGMENTO * SEGMENTI_PROVA);
+    CampioneStorico c;
+    VERIFICA(!a.ultimo(c)); // Vuoto
+
+    // Testa esattamente piena: la rotazione aspetta il record successivo
+    VERIFICA(aggiungi(a, 0, RECORD_PER_SEGMENTO));
+    VERIFICA(a.getTesta() == 0 && a.getGenerazione() == 0);
+
+    // 23 record: 0-4, 5-9, 10-14, poi 15-19 e 20-22 riciclano i segmenti 0 e 1
+    VERIFICA(aggiungi(a, RECORD_PER_SEGMENTO, 23 - RECORD_PER_SEGMENTO));
+    VERIFICA(a.getTesta() == 1 && a.getGenerazione() == 4);
+    VERIFICA(consecutivi(leggiTutto(a), 10, 22));
+    VERIFICA(a.ultimo(c) && c.epoch == 22);
+
+    // Un segmento non supera mai la dimensione configurata
+    char percorso[PERCORSO_ANELLO_MASSIMO];
+    bool entro = true;
+    for (int i = 0; i < SEGMENTI_PROVA; i++)
+    {
+        AnelloRegistro::percorsoSegmento(BASE_PROVA, i, percorso, sizeof(percorso));
+        entro = entro && dimensioneFile(percorso) <= (long)configurazione().dimensioneSegmento;
+    }
+    VERIFICA(entro);
+
+    // Un blocco più lungo di tutto l'anello: restano gli ultimi record
+    VERIFICA(aggiungi(a, 100, 40));
+    std::vector<uint32_t> e = leggiTutto(a);
+    VERIFICA(!e.empty() && e.back() == 139 && e.size() > 2 * RECORD_PER_SEGMENTO);
+    VERIFICA(consecutivi(e, 140 - (uint32_t)e.size(), 139));
+
+    // Riaperto con il manifesto: stessa testa, si continua dove si era rimasti
+    AnelloRegistro b;
+    VERIFICA(b.begin(configurazione()));
+    VERIFICA(b.getTesta() == a.getTesta() && b.getGenerazione() == a.getGenerazione());
+    VERIFICA(b.ultimo(c) && c.epoch == 139);
+}
+
+static void senzaManifesto()
+{
+    pulisci();
+    AnelloRegistro a;
+    VERIFICA(a.begin(configurazione()));
+    VERIFICA(aggiungi(a, 0, 23));
+
+    remove(BASE_PROVA ".man");
+    AnelloRegistro b;
+    VERIFICA(b.begin(configurazione()));
+    VERIFICA(b.getTesta() == a.getTesta() && b.getGenerazione() == a.getGenerazione());
+    VERIFICA(dimensioneFile(BASE_PROVA ".man") == MANIFESTO_ANELLO_DIMENSIONE); // Riscritto
+    VERIFICA(aggiungi(b, 23, 3));
+    VERIFICA(consecutivi(leggiTutto(b), 15, 25));
+
+    // Manifesto con un byte rovinato: come se mancasse
+    FILE* f = fopen(BASE_PROVA ".man", "r+b");
+    fseek(f, 6, SEEK_SET);
+    fputc(2, f);
+    fclose(f);
+    AnelloRegistro r;
+    VERIFICA(r.begin(configurazione()));
+    VERIFICA(r.getTesta() == b.getTesta());
+    VERIFICA(consecutivi(leggiTutto(r), 15, 25));
+
+    // Generazioni a cavallo di 0xFFFF: la testa è quella con 0x0000
+    pulisci();
+    const uint16_t generazioni[SEGMENTI_PROVA] = {0xFFFE, 0xFFFF, 0x0000};
+    for (int i = 0; i < SEGMENTI_PROVA; i++)
+    {
+        char percorso[PERCORSO_ANELLO_MASSIMO];
+        AnelloRegistro::percorsoSegmento(BASE_PROVA, i, percorso, sizeof(percorso));
+        uint8_t intestazione[REGISTRO_INTESTAZIONE];
+        codificaIntestazioneRegistro(intestazione, generazioni[i]);
+        f = fopen(percorso, "wb");
+        fwrite(intestazione, 1, sizeof(intestazione), f);
+        fclose(f);
+    }
+    AnelloRegistro g;
+    VERIFICA(g.begin(configurazione()));
+    VERIFICA(g.getTesta() == 2);
+
+    // Nessun segmento e nessun manifesto: anello nuovo
+    pulisci();
+    AnelloRegistro n;
+    VERIFICA(n.begin(configurazione()) && n.getTesta() == 0 && n.getGenerazione() == 0);
+}
+
+static void codaStrappata()
+{
+    pulisci();
+    AnelloRegistro a;
+    VERIFICA(a.begin(configurazione()));
+    VERIFICA(aggiungi(a, 0, 3));
+
+    // Reset a metà di un record: 5 byte dei 12 del record 3
+    char testa[PERCORSO_ANELLO_MASSIMO];
+    AnelloRegistro::percorsoSegmento(BASE_PROVA, a.getTesta(), testa, sizeof(testa));
+    uint8_t mezzo[REGISTRO_RECORD];
+    CampioneStorico c = {3, 20.0f, 50.0f, 101.3f};
+    codificaRecordRegistro(c, mezzo);
+    FILE* f = fopen(testa, "ab");
+    fwrite(mezzo, 1, 5, f);
+    fclose(f);
+
+    AnelloRegistro b;
+    VERIFICA(b.begin(configurazione()));
+    VERIFICA(b.ultimo(c) && c.epoch == 2);
+
+    // Il record a metà si chiude (e si salta), i nuovi ripartono allineati
+    VERIFICA(aggiungi(b, 10, 1));
+    VERIFICA(dimensioneFile(testa) == registroPosizione(5));
+    std::vector<uint32_t> e = leggiTutto(b);
+    VERIFICA(e.size() == 4 && e[2] == 2 && e[3] == 10);
+    VERIFICA(b.ultimo(c) && c.epoch == 10);
+
+    // Record interi ma rovinati in coda: ultimo() li salta
+    f = fopen(testa, "ab");
+    memset(mezzo, 0x00, sizeof(mezzo));
+    fwrite(mezzo, 1, sizeof(mezzo), f);
+    fclose(f);
+    VERIFICA(b.ultimo(c) && c.epoch == 10);
+
+    // Intestazione a metà (reset subito dopo la creazione): si completa
+    pulisci();
+    AnelloRegistro::percorsoSegmento(BASE_PROVA, 0, testa, sizeof(testa));
+    uint8_t intestazione[REGISTRO_INTESTAZIONE];
+    codificaIntestazioneRegistro(intestazione, 0);
+    f = fopen(testa, "wb");
+    fwrite(intestazione, 1, 3, f);
+    fclose(f);
+    AnelloRegistro h;
+    VERIFICA(h.begin(configurazione()));
+    VERIFICA(aggiungi(h, 0, 2));
+    VERIFICA(consecutivi(leggiTutto(h), 0, 1));
+}
+
+// Il manifesto non si può scrivere (al posto del file temporaneo c'è una cartella):
+// il segmento più vecchio è già troncato, ma il manifesto indica ancora la testa piena
+static void rotazioneInterrotta()
+{
+    pulisci();
+    AnelloRegistro a;
+    VERIFICA(a.begin(configurazione()));
+    VERIFICA(aggiungi(a, 0, 3 * RECORD_PER_SEGMENTO)); // Tutti i segmenti pieni, testa 2
+    VERIFICA(a.getTesta() == 2);
+
+    VERIFICA(mkdir(BASE_PROVA ".tmp", 0755) == 0);
+    VERIFICA(!aggiungi(a, 15, 1));
+    VERIFICA(rmdir(BASE_PROVA ".tmp") == 0);
+
+    char vecchio[PERCORSO_ANELLO_MASSIMO];
+    AnelloRegistro::percorsoSegmento(BASE_PROVA, 0, vecchio, sizeof(vecchio));
+    VERIFICA(dimensioneFile(vecchio) == REGISTRO_INTESTAZIONE); // Troncato prima del manifesto
+
+    // Al riavvio il manifesto è quello vecchio: la rotazione si ripete, nessun record perso oltre il segmento riciclato
+    AnelloRegistro b;
+    VERIFICA(b.begin(configurazione()));
+    VERIFICA(b.getTesta() == 2);
+    CampioneStorico c;
+    VERIFICA(b.ultimo(c) && c.epoch == 14);
+    VERIFICA(consecutivi(leggiTutto(b), 5, 14));
+    VERIFICA(aggiungi(b, 15, 2));
+    VERIFICA(b.getTesta() == 0);
+    VERIFICA(consecutivi(leggiTutto(b), 5, 16));
+
+    // Stessa interruzione, poi anche il manifesto perso: la testa è il segmento troncato
+    VERIFICA(aggiungi(b, 17, RECORD_PER_SEGMENTO - 2));
+    VERIFICA(mkdir(BASE_PROVA ".tmp", 0755) == 0);
+    VERIFICA(!aggiungi(b, 20, 1));
+    VERIFICA(rmdir(BASE_PROVA ".tmp") == 0);
+    remove(BASE_PROVA ".man");
+    AnelloRegistro r;
+    VERIFICA(r.begin(configurazione()));
+    VERIFICA(r.getTesta() == 1);
+    VERIFICA(r.ultimo(c) && c.epoch == 19); // Dal segmento prima della testa appena ruotata
+    VERIFICA(aggiungi(r, 20, 1));
+    VERIFICA(consecutivi(leggiTutto(r), 10, 20));
+
+    // Reset tra l'apertura in troncamento e l'intestazione: segmento vuoto, testa invariata
+    VERIFICA(aggiungi(r, 21, RECORD_PER_SEGMENTO - 1));
+    char prossimo[PERCORSO_ANELLO_MASSIMO];
+    AnelloRegistro::percorsoSegmento(BASE_PROVA, 2, prossimo, sizeof(prossimo));
+    fclose(fopen(prossimo, "w"));
+    remove(BASE_PROVA ".man");
+    AnelloRegistro v;
+    VERIFICA(v.begin(configurazione()));
+    VERIFICA(v.getTesta() == 1);
+    VERIFICA(aggiungi(v, 25, 1));
+    VERIFICA(v.getTesta() == 2);
+    VERIFICA(consecutivi(leggiTutto(v), 15, 25));
+    pulisci();
+}
+
+int main()
+{
+    giroDellAnello();
+    senzaManifesto();
+    codaStrappata();
+    rotazioneInterrotta();
+    return fineVerifiche();
+}
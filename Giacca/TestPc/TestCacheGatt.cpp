@@ -0,0 +1,136 @@
+// Kicco972.net
+
+
+// CacheGatt su PC: una voce per ogni periferica collegabile senza sostituzioni,
+// sostituzione della meno usata oltre il massimo, salvataggio e ricarica, file
+// con meno voci (come quelli scritti quando il massimo era 4) e file corrotti.
+
+#include "CacheGatt.h"
+#include "Verifica.h"
+#include <string.h>
+
+#define PERCORSO_PROVA "bin/gatt.bin"
+
+static void indirizzo(char* buf, int i)
+{
+    snprintf(buf, 18, "aa:bb:cc:dd:ee:%02x", i);
+}
+
+static void riempi(CacheGatt& cache, int voci)
+{
+    char a[18];
+    for (int i = 0; i < voci; i++)
+    {
+        indirizzo(a, i);
+        cache.memorizza(a, "19b10000-e8f2-537e-4f6c-d104768a1214", 1000u + i);
+    }
+}
+
+static void unaVocePerPeriferica()
+{
+    VERIFICA(MAX_VOCI_CACHE_GATT >= MAX_PERIFERICHE_BLE);
+
+    CacheGatt cache;
+    riempi(cache, MAX_PERIFERICHE_BLE);
+    VERIFICA(cache.getNumeroVoci() == MAX_PERIFERICHE_BLE);
+    char a[18];
+    bool tutte = true;
+    for (int i = 0; i < MAX_PERIFERICHE_BLE; i++)
+    {
+        indirizzo(a, i);
+        const VoceCacheGatt* v = cache.cerca(a);
+        tutte = tutte && v && v->firma == 1000u + i;
+    }
+    VERIFICA(tutte);
+
+    // Oltre il massimo sparisce la voce usata meno di recente (la 0, dopo le ricerche in ordine)
+    indirizzo(a, 1);
+    cache.cerca(a);
+    indirizzo(a, MAX_PERIFERICHE_BLE);
+    cache.memorizza(a, "servizio", 7);
+    VERIFICA(cache.getNumeroVoci() == MAX_PERIFERICHE_BLE);
+    indirizzo(a, 0);
+    VERIFICA(cache.cerca(a) == nullptr);
+    indirizzo(a, 1);
+    VERIFICA(cache.cerca(a) != nullptr);
+
+    // Una voce uguale non segna la cache come modificata
+    VERIFICA(cache.salva(PERCORSO_PROVA) && !cache.isModificata());
+    indirizzo(a, 2);
+    cache.memorizza(a, "19b10000-e8f2-537e-4f6c-d104768a1214", 1002u);
+    VERIFICA(!cache.isModificata());
+    cache.dimentica(a);
+    VERIFICA(cache.isModificata() && cache.cerca(a) == nullptr);
+}
+
+static void salvaERicarica()
+{
+    CacheGatt cache;
+    riempi(cache, MAX_PERIFERICHE_BLE);
+    VERIFICA(cache.salva(PERCORSO_PROVA));
+
+    CacheGatt letta;
+    VERIFICA(letta.carica(PERCORSO_PROVA));
+    VERIFICA(letta.getNumeroVoci() == MAX_PERIFERICHE_BLE && !letta.isModificata());
+    char a[18];
+    indirizzo(a, MAX_PERIFERICHE_BLE - 1);
+    const VoceCacheGatt* v = letta.cerca(a);
+    VERIFICA(v && v->firma == 1000u + MAX_PERIFERICHE_BLE - 1);
+    VERIFICA(v && strcmp(v->servizio, "19b10000-e8f2-537e-4f6c-d104768a1214") == 0);
+
+    // Un file con 4 voci si legge ancora
+    CacheGatt piccola;
+    riempi(piccola, 4);
+    VERIFICA(piccola.salva(PERCORSO_PROVA));
+    VERIFICA(letta.carica(PERCORSO_PROVA) && letta.getNumeroVoci() == 4);
+}
+
+static void fileRovinati()
+{
+    CacheGatt cache;
+    riempi(cache, 3);
+    VERIFICA(cache.salva(PERCORSO_PROVA));
+
+    FILE* f = fopen(PERCORSO_PROVA, "rb");
+    uint8_t buf[1024];
+    size_t n = f ? fread(buf, 1, sizeof(buf), f) : 0;
+    if (f)
+        fclose(f);
+    VERIFICA(n > 20);
+
+    // Un bit cambiato in una voce
+    buf[20] ^= 0x01;
+    f = fopen(PERCORSO_PROVA, "wb");
+    fwrite(buf, 1, n, f);
+    fclose(f);
+    CacheGatt letta;
+    VERIFICA(!letta.carica(PERCORSO_PROVA) && letta.getNumeroVoci() == 0);
+
+    // File troncato
+    buf[20] ^= 0x01;
+    f = fopen(PERCORSO_PROVA, "wb");
+    fwrite(buf, 1, n - 1, f);
+    fclose(f);
+    VERIFICA(!letta.carica(PERCORSO_PROVA) && letta.getNumeroVoci() == 0);
+
+    remove(PERCORSO_PROVA);
+    VERIFICA(!letta.carica(PERCORSO_PROVA));
+}
+
+static void firma()
+{
+    uint32_t a = CacheGatt::aggiungiFirma(CacheGatt::FIRMA_INIZIALE, "19B10010-E8F2", true, 0x10);
+    uint32_t b = CacheGatt::aggiungiFirma(CacheGatt::FIRMA_INIZIALE, "19b10010-e8f2", true, 0x10);
+    VERIFICA(a == b);
+    VERIFICA(a != CacheGatt::aggiungiFirma(CacheGatt::FIRMA_INIZIALE, "19b10010-e8f2", true, 0x12));
+    VERIFICA(a != CacheGatt::aggiungiFirma(CacheGatt::FIRMA_INIZIALE, "19b10010-e8f2", false, 0x10));
+}
+
+int main()
+{
+    unaVocePerPeriferica();
+    salvaERicarica();
+    fileRovinati();
+    firma();
+    return fineVerifiche();
+}
@@ -0,0 +1,113 @@
+// Kicco972.net
+
+
+// CasellaCondivisa su PC con due thread al posto dei due core: lo scrittore
+// pubblica di continuo, il lettore legge quando può.
+// - Nessuna lettura a metà: ogni messaggio letto è intero e porta il numero
+//   che corrisponde alla sequenza restituita (messaggio i -> sequenza 2(i+1)).
+// - Persi contati dalla sequenza: letti + persi (salti di sequenza / 2) = pubblicati.
+
+#include "CasellaCondivisa.h"
+#include "Verifica.h"
+#include <atomic>
+#include <thread>
+
+#define MESSAGGI 2000000
+#define PAROLE 30 // Messaggio di 128 byte: la copia dura abbastanza da essere interrotta
+
+struct Messaggio {
+    uint32_t numero;
+    uint32_t parole[PAROLE];
+    uint32_t firma;
+};
+
+static uint32_t parola(uint32_t numero, int i)
+{
+    return numero * 2654435761u + (uint32_t)i * 40503u;
+}
+
+static Messaggio crea(uint32_t numero)
+{
+    Messaggio m;
+    m.numero = numero;
+    for (int i = 0; i < PAROLE; i++)
+        m.parole[i] = parola(numero, i);
+    m.firma = ~numero;
+    return m;
+}
+
+static bool integro(const Messaggio& m)
+{
+    if (m.firma != ~m.numero)
+        return false;
+    for (int i = 0; i < PAROLE; i++)
+    {
+        if (m.parole[i] != parola(m.numero, i))
+            return false;
+    }
+    return true;
+}
+
+// Con pause, lo scrittore cede la CPU ogni 64 messaggi: con una sola CPU il lettore
+// legge spesso. Senza pause, il lettore legge solo quando lo scrittore viene
+// interrotto dal sistema, anche a metà copia: è il caso che deve riprovare.
+static void prova(bool pause)
+{
+    CasellaCondivisa<Messaggio> casella;
+    std::atomic<bool> fatto(false);
+
+    // Niente di pubblicato: niente da leggere
+    Messaggio m;
+    uint32_t sequenza = 0;
+    VERIFICA(!casella.leggi(m, sequenza));
+    VERIFICA(casella.getPubblicati() == 0);
+
+    double t0 = adessoUs();
+    std::thread scrittore([&] {
+        for (uint32_t i = 0; i < MESSAGGI; i++)
+        {
+            casella.pubblica(crea(i));
+            if (pause && i % 64 == 0)
+                std::this_thread::yield();
+        }
+        fatto.store(true);
+    });
+
+    uint32_t letti = 0, persi = 0, rotti = 0, sequenzaSbagliata = 0;
+    while (true)
+    {
+        bool eraFatto = fatto.load();
+        uint32_t precedente = sequenza;
+        if (!casella.leggi(m, sequenza))
+        {
+            if (eraFatto)
+                break; // Letto tutto ciò che è stato pubblicato
+            std::this_thread::yield();
+            continue;
+        }
+        letti++;
+        persi += (sequenza - precedente) / 2 - 1;
+        if (!integro(m))
+            rotti++;
+        if (m.numero != sequenza / 2 - 1)
+            sequenzaSbagliata++;
+    }
+    scrittore.join();
+    double t = adessoUs() - t0;
+
+    VERIFICA(rotti == 0);
+    VERIFICA(sequenzaSbagliata == 0);
+    VERIFICA(letti + persi == MESSAGGI);
+    VERIFICA(casella.getPubblicati() == MESSAGGI);
+    VERIFICA(m.numero == MESSAGGI - 1); // L'ultimo letto è l'ultimo pubblicato
+    VERIFICA(!casella.leggi(m, sequenza));
+    printf("%s: %d messaggi in %.0f ms, letti %u, persi %u, rotti %u, sequenza sbagliata %u\n",
+           pause ? "Con pause" : "Senza pause", MESSAGGI, t / 1000, letti, persi, rotti, sequenzaSbagliata);
+}
+
+int main()
+{
+    prova(true);
+    prova(false);
+    return fineVerifiche();
+}
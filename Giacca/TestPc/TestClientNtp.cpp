@@ -0,0 +1,260 @@
+// Kicco972.net
+
+
+// ClientNtp su PC con un TrasportoUdp finto: un server NTP simulato risponde con
+// l'ora vera dopo ritardi scelti dal test (andata, tempo nel server, ritorno).
+// Si controllano la correzione dell'ora su percorso simmetrico e asimmetrico
+// (errore = metà della differenza tra andata e ritorno, come da RFC 5905), la
+// risposta persa, le risposte con origine sbagliata, il "kiss of death", il
+// server non sincronizzato, il nome non risolvibile e le date dopo il 2036.
+
+#include "ClientNtp.h"
+#include "Verifica.h"
+#include <string.h>
+#include <map>
+#include <vector>
+
+#define SERVER "pool.ntp.org"
+#define EPOCH_2025_MS 1735689600000ULL
+
+static void scriviMarca(uint8_t* p, uint64_t epochMs)
+{
+    uint32_t secondi = (uint32_t)(epochMs / 1000 + SECONDI_1900_1970); // Modulo 2^32: dopo il 2036 si riparte da 0
+    uint32_t frazione = (uint32_t)(((epochMs % 1000) << 32) / 1000);
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (uint8_t)(secondi >> (24 - 8 * i));
+        p[4 + i] = (uint8_t)(frazione >> (24 - 8 * i));
+    }
+}
+
+// Rete e server finti. L'ora vera è oraZeroMs + millis() del client
+class ServerFinto : public TrasportoUdp {
+public:
+    uint64_t oraZeroMs = EPOCH_2025_MS;
+    uint32_t adessoMs = 0;            // millis() del client, mosso dal test
+    uint32_t andataMs = 20;
+    uint32_t nelServerMs = 3;
+    uint32_t ritornoMs = 20;
+    bool rispondi = true;             // false = risposta persa
+    uint8_t strato = 2;
+    uint8_t salto = 0;                // 3 = server non sincronizzato
+    bool origineSbagliata = false;    // Una risposta estranea arriva prima di quella giusta
+    int richieste = 0;
+    std::multimap<uint32_t, std::vector<uint8_t>> inArrivo;
+
+    bool invia(const char* server, uint16_t porta, const uint8_t* dati, int lunghezza) override
+    {
+        // DNS: solo il nome del server è risolvibile
+        if (strcmp(server, SERVER) != 0 || porta != PORTA_NTP || lunghezza != PACCHETTO_NTP)
+            return false;
+        richieste++;
+        uint8_t mode = dati[0] & 0x07;
+        VERIFICA(mode == 3);
+        if (!rispondi)
+            return true;
+
+        uint8_t r[PACCHETTO_NTP];
+        memset(r, 0, sizeof(r));
+        r[0] = (uint8_t)(salto << 6 | 4 << 3 | 4); // Versione 4, modo server
+        r[1] = strato;
+        memcpy(r + 24, dati + 40, 8);              // Origine = nostra trasmissione
+        uint32_t arrivoServer = adessoMs + andataMs;
+        scriviMarca(r + 32, oraZeroMs + arrivoServer);               // T2
+        scriviMarca(r + 40, oraZeroMs + arrivoServer + nelServerMs); // T3
+        uint32_t arrivo = arrivoServer + nelServerMs + ritornoMs;
+        if (origineSbagliata)
+        {
+            std::vector<uint8_t> estranea(r, r + sizeof(r));
+            estranea[31] ^= 0x01;
+            inArrivo.insert(std::make_pair(arrivo - 1, estranea));
+        }
+        inArrivo.insert(std::make_pair(arrivo, std::vector<uint8_t>(r, r + sizeof(r))));
+        return true;
+    }
+
+    int ricevi(uint8_t* dati, int dimensione) override
+    {
+        if (inArrivo.empty() || (int32_t)(inArrivo.begin()->first - adessoMs) > 0)
+            return 0;
+        std::vector<uint8_t> p = inArrivo.begin()->second;
+        inArrivo.erase(inArrivo.begin());
+        int n = (int)p.size() < dimensione ? (int)p.size() : dimensione;
+        memcpy(dati, p.data(), n);
+        return n;
+    }
+};
+
+// Richiesta all'istante inizio, poi controlla() ogni ms fino a un esito
+static EsitoNtp scambio(ClientNtp& client, ServerFinto& server, uint32_t inizio, RisultatoNtp& r)
+{
+    server.adessoMs = inizio;
+    if (!client.richiedi(inizio))
+        return NTP_NESSUNA_RICHIESTA;
+    EsitoNtp esito = NTP_IN_ATTESA;
+    for (int i = 0; i <= 2 * TIMEOUT_NTP_MS && esito == NTP_IN_ATTESA; i++)
+    {
+        server.adessoMs = inizio + i;
+        esito = client.controlla(server.adessoMs, r);
+    }
+    return esito;
+}
+
+// Errore dell'ora ricevuta rispetto a quella vera all'istante di ricezione
+static int64_t errore(const ServerFinto& s, const RisultatoNtp& r)
+{
+    return (int64_t)(r.epochMs - (s.oraZeroMs + r.millisRicezione));
+}
+
+static void percorsoSimmetrico()
+{
+    ServerFinto server;
+    ClientNtp client;
+    client.begin(server, SERVER);
+    RisultatoNtp r;
+    VERIFICA(scambio(client, server, 5000, r) == NTP_SINCRONIZZATO);
+    VERIFICA(r.ritardoMs == server.andataMs + server.ritornoMs);
+    VERIFICA(r.millisRicezione == 5000 + 43);
+    VERIFICA(r.strato == 2);
+    int64_t e = errore(server, r);
+    VERIFICA(e >= -1 && e <= 1);
+    VERIFICA(!client.isInAttesa() && client.getScartati() == 0);
+    printf("Simmetrico 20/20 ms: ritardo %u ms, errore %lld ms\n", r.ritardoMs, (long long)e);
+}
+
+static void percorsoAsimmetrico()
+{
+    ServerFinto server;
+    server.andataMs = 10;
+    server.ritornoMs = 90;
+    server.nelServerMs = 200; // Tolto dal giro: non deve pesare sulla correzione
+    ClientNtp client;
+    client.begin(server, SERVER);
+    RisultatoNtp r;
+    VERIFICA(scambio(client, server, 100, r) == NTP_SINCRONIZZATO);
+    VERIFICA(r.ritardoMs == 100);
+    // Con metà giro di correzione si sbaglia di (andata - ritorno) / 2, mai più di metà ritardo
+    int64_t e = errore(server, r);
+    VERIFICA(e >= -41 && e <= -39);
+    VERIFICA(e >= -(int64_t)r.ritardoMs / 2 - 1);
+    printf("Asimmetrico 10/90 ms: ritardo %u ms, errore %lld ms (atteso -40)\n", r.ritardoMs, (long long)e);
+}
+
+static void rispostaPersa()
+{
+    ServerFinto server;
+    server.rispondi = false;
+    ClientNtp client;
+    client.begin(server, SERVER);
+    RisultatoNtp r;
+    server.adessoMs = 0xFFFFFE00u; // Anche a cavallo del giro di millis()
+    VERIFICA(client.richiedi(server.adessoMs));
+    VERIFICA(client.controlla(server.adessoMs + TIMEOUT_NTP_MS - 1, r) == NTP_IN_ATTESA);
+    VERIFICA(client.controlla(server.adessoMs + TIMEOUT_NTP_MS, r) == NTP_SCADUTO);
+    VERIFICA(!client.isInAttesa());
+    VERIFICA(client.controlla(server.adessoMs + TIMEOUT_NTP_MS + 1, r) == NTP_NESSUNA_RICHIESTA);
+
+    // La risposta arriva dopo il timeout: alla richiesta successiva è vecchia e si scarta
+    server.rispondi = true;
+    server.ritornoMs = 2000;
+    VERIFICA(scambio(client, server, 10000, r) == NTP_SCADUTO);
+    server.ritornoMs = 20;
+    server.adessoMs = 13000;
+    uint32_t scartatiPrima = client.getScartati();
+    VERIFICA(scambio(client, server, 13000, r) == NTP_SINCRONIZZATO);
+    VERIFICA(client.getScartati() == scartatiPrima + 1);
+    int64_t e = errore(server, r);
+    VERIFICA(e >= -1 && e <= 1);
+}
+
+static void origineSbagliata()
+{
+    ServerFinto server;
+    server.origineSbagliata = true;
+    ClientNtp client;
+    client.begin(server, SERVER);
+    RisultatoNtp r;
+    VERIFICA(scambio(client, server, 0, r) == NTP_SINCRONIZZATO);
+    VERIFICA(client.getScartati() == 1);
+    int64_t e = errore(server, r);
+    VERIFICA(e >= -1 && e <= 1);
+
+    // Solo la risposta estranea: nessuna sincronizzazione, si aspetta il timeout
+    uint8_t p[PACCHETTO_NTP];
+    memset(p, 0, sizeof(p));
+    p[0] = 0x24;
+    p[1] = 2;
+    scriviMarca(p + 32, EPOCH_2025_MS);
+    scriviMarca(p + 40, EPOCH_2025_MS);
+    uint8_t origine[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    VERIFICA(!ClientNtp::decodifica(p, sizeof(p), origine, 0, 10, r));
+    memcpy(p + 24, origine, 8);
+    VERIFICA(ClientNtp::decodifica(p, sizeof(p), origine, 0, 10, r));
+    VERIFICA(!ClientNtp::decodifica(p, PACCHETTO_NTP - 1, origine, 0, 10, r)); // Troncato
+    scriviMarca(p + 40, EPOCH_2025_MS - 1000);
+    VERIFICA(!ClientNtp::decodifica(p, sizeof(p), origine, 0, 10, r)); // T3 prima di T2
+}
+
+static void kissOfDeath()
+{
+    // Strato 0: il server chiede di smettere (es. "RATE"); non è un'ora
+    ServerFinto server;
+    server.strato = 0;
+    ClientNtp client;
+    client.begin(server, SERVER);
+    RisultatoNtp r;
+    VERIFICA(scambio(client, server, 0, r) == NTP_SCADUTO);
+    VERIFICA(client.getScartati() == 1);
+
+    // Server non sincronizzato (LI = 3)
+    server.strato = 2;
+    server.salto = 3;
+    VERIFICA(scambio(client, server, 5000, r) == NTP_SCADUTO);
+    VERIFICA(client.getScartati() == 2);
+
+    // Strato oltre 15: non valido
+    server.salto = 0;
+    server.strato = 16;
+    VERIFICA(scambio(client, server, 10000, r) == NTP_SCADUTO);
+    VERIFICA(client.getScartati() == 3);
+}
+
+static void nomeNonRisolvibile()
+{
+    ServerFinto server;
+    ClientNtp client;
+    client.begin(server, "server.inesistente.invalid");
+    RisultatoNtp r;
+    VERIFICA(!client.richiedi(0));
+    VERIFICA(!client.isInAttesa());
+    VERIFICA(client.controlla(TIMEOUT_NTP_MS * 2, r) == NTP_NESSUNA_RICHIESTA);
+    VERIFICA(server.richieste == 0);
+
+    ClientNtp senzaTrasporto;
+    VERIFICA(!senzaTrasporto.richiedi(0));
+}
+
+static void dopoIl2036()
+{
+    // 1/1/2040: i secondi NTP hanno già fatto il giro (era 1)
+    ServerFinto server;
+    server.oraZeroMs = 2208988800000ULL;
+    ClientNtp client;
+    client.begin(server, SERVER);
+    RisultatoNtp r;
+    VERIFICA(scambio(client, server, 0, r) == NTP_SINCRONIZZATO);
+    int64_t e = errore(server, r);
+    VERIFICA(e >= -1 && e <= 1);
+}
+
+int main()
+{
+    percorsoSimmetrico();
+    percorsoAsimmetrico();
+    rispostaPersa();
+    origineSbagliata();
+    kissOfDeath();
+    nomeNonRisolvibile();
+    dopoIl2036();
+    return fineVerifiche();
+}
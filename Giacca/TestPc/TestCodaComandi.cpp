@@ -0,0 +1,294 @@
+// Kicco972.net
+
+
+// CodaComandi su PC con un MittenteComandi simulato e un Nano IoT simulato che
+// decodifica i comandi (ProtocolloAttuatore.h) e ne notifica lo stato: più
+// comandi in volo, sostituzione dell'ultimo valore, conferme vecchie o estranee,
+// ripetizioni fino a MAX_TENTATIVI_COMANDO, scritture rifiutate, periferica
+// scollegata fino a SCADENZA_COMANDO_MS e firmware a 1 byte senza conferme.
+
+#include "CodaComandi.h"
+#include "ProtocolloAttuatore.h"
+#include "Verifica.h"
+#include <vector>
+
+#define PERIFERICHE_PROVA 6
+
+struct Scrittura {
+    int periferica;
+    uint8_t buf[MESSAGGIO_ATTUATORE_DIMENSIONE];
+    int lunghezza;
+    unsigned long adessoMs;
+};
+
+class MittenteFinto : public MittenteComandi {
+public:
+    bool collegata[PERIFERICHE_PROVA] = {true, true, true, true, true, true};
+    bool conConferme = true;       // false = firmware a 1 byte, scrittura con risposta
+    int rifiutate = 0;             // Prossime scritture che falliscono
+    unsigned long adessoMs = 0;
+    std::vector<Scrittura> scritte;
+
+    bool puoInviare(int periferica) override
+    {
+        return collegata[periferica];
+    }
+
+    EsitoInvio invia(const ComandoAttuatore& comando) override
+    {
+        if (rifiutate > 0)
+        {
+            rifiutate--;
+            return INVIO_FALLITO;
+        }
+        Scrittura s;
+        s.periferica = comando.periferica;
+        s.adessoMs = adessoMs;
+        if (!conConferme)
+        {
+            s.buf[0] = comando.valore;
+            s.lunghezza = 1;
+            scritte.push_back(s);
+            return INVIO_CONFERMATO;
+        }
+        MessaggioAttuatore m = {comando.id, comando.valore};
+        s.lunghezza = codificaMessaggioAttuatore(m, s.buf, sizeof(s.buf));
+        scritte.push_back(s);
+        return INVIO_IN_ATTESA;
+    }
+};
+
+// Nano IoT: applica le scritture arrivate e notifica lo stato (come Nano33_IoT.ino)
+struct IoTFinto {
+    MessaggioAttuatore stato[PERIFERICHE_PROVA] = {};
+    size_t lette = 0;
+
+    // Scritture arrivate dall'ultima chiamata; perdi = notifiche che non arrivano
+    int rispondi(MittenteFinto& m, CodaComandi& coda, unsigned long adessoMs, bool perdi = false)
+    {
+        int chiusi = 0;
+        for (; lette < m.scritte.size(); lette++)
+        {
+            const Scrittura& s = m.scritte[lette];
+            MessaggioAttuatore comando;
+            if (!decodificaMessaggioAttuatore(s.buf, s.lunghezza, comando))
+                continue;
+            stato[s.periferica].id = comando.id;
+            stato[s.periferica].valore = comando.valore ? 1 : 0;
+            if (!perdi && coda.conferma(s.periferica, stato[s.periferica].id, adessoMs))
+                chiusi++;
+        }
+        return chiusi;
+    }
+};
+
+static void inVolo()
+{
+    CodaComandi coda;
+    MittenteFinto m;
+    IoTFinto iot;
+    for (int p = 0; p < 3; p++)
+        VERIFICA(coda.accoda(p, 1, 0));
+    coda.update(0, m);
+    // Tre comandi scritti senza aspettare le conferme
+    VERIFICA(m.scritte.size() == 3 && coda.getNumeroComandi() == 3);
+    coda.update(100, m);
+    VERIFICA(m.scritte.size() == 3); // Nessuna ripetizione prima del timeout
+
+    VERIFICA(iot.rispondi(m, coda, 30) == 3);
+    VERIFICA(coda.getNumeroComandi() == 0);
+    const StatisticheComandi& s = coda.getStatistiche();
+    VERIFICA(s.confermati == 3 && s.ripetuti == 0 && s.falliti == 0);
+    VERIFICA(coda.getLatenzaMediaMs() == 30 && s.latenzaMinimaMs == 30 && s.latenzaMassimaMs == 30);
+    VERIFICA(iot.stato[2].valore == 1);
+
+    // Coda limitata: una periferica in più non entra, la stessa sì (sostituisce)
+    for (int p = 0; p < MAX_COMANDI_IN_CODA; p++)
+        VERIFICA(coda.accoda(p, 0, 200));
+    VERIFICA(!coda.accoda(MAX_COMANDI_IN_CODA, 0, 200));
+    VERIFICA(coda.accoda(0, 1, 200));
+    VERIFICA(coda.getNumeroComandi() == MAX_COMANDI_IN_CODA);
+}
+
+static void sostituzione()
+{
+    CodaComandi coda;
+    MittenteFinto m;
+    IoTFinto iot;
+
+    // Due pressioni prima dell'invio: parte solo l'ultimo valore
+    coda.accoda(0, 1, 0);
+    coda.accoda(0, 0, 5);
+    coda.update(10, m);
+    VERIFICA(m.scritte.size() == 1 && m.scritte[0].buf[1] == 0);
+    VERIFICA(iot.rispondi(m, coda, 20) == 1);
+    VERIFICA(coda.getStatistiche().ultimaLatenzaMs == 15); // Dall'ultima pressione
+
+    // Una pressione con il vecchio comando in volo: la sua conferma non chiude il nuovo
+    coda.accoda(0, 1, 100);
+    coda.update(100, m);
+    uint8_t vecchio = m.scritte.back().buf[0];
+    coda.accoda(0, 0, 110);
+    VERIFICA(!coda.conferma(0, vecchio, 120));
+    VERIFICA(coda.isInCoda(0));
+    coda.update(120, m); // Il nuovo parte subito, senza aspettare il timeout del vecchio
+    VERIFICA(m.scritte.size() == 3 && m.scritte.back().buf[1] == 0 && m.scritte.back().buf[0] != vecchio);
+    VERIFICA(iot.rispondi(m, coda, 140) == 1);
+    VERIFICA(!coda.isInCoda(0) && iot.stato[0].valore == 0);
+    VERIFICA(coda.getStatistiche().sostituiti == 2 && coda.getStatistiche().confermati == 2);
+}
+
+static void confermeEstranee()
+{
+    CodaComandi coda;
+    MittenteFinto m;
+    coda.accoda(1, 1, 0);
+    VERIFICA(!coda.conferma(1, 1, 0)); // Non ancora inviato
+    coda.update(0, m);
+    uint8_t id = m.scritte[0].buf[0];
+    VERIFICA(!coda.conferma(1, 0, 10));                 // 0 = nessun comando (stato alla sottoscrizione)
+    VERIFICA(!coda.conferma(1, (uint8_t)(id + 1), 10)); // Id diverso
+    VERIFICA(!coda.conferma(2, id, 10));                // Altra periferica
+    VERIFICA(!coda.conferma(-1, id, 10) && !coda.conferma(PERIFERICHE_PROVA, id, 10));
+    VERIFICA(coda.conferma(1, id, 10));
+    VERIFICA(!coda.conferma(1, id, 20)); // Conferma ripetuta dal Nano IoT
+    VERIFICA(coda.getStatistiche().confermati == 1);
+
+    // Gli id non valgono mai 0, anche dopo il giro dei 255
+    bool maiZero = true;
+    for (int i = 0; i < 600; i++)
+    {
+        coda.accoda(0, (uint8_t)(i & 1), 1000 + i);
+        coda.update(1000 + i, m);
+        maiZero = maiZero && m.scritte.back().buf[0] != 0;
+        coda.conferma(0, m.scritte.back().buf[0], 1000 + i);
+    }
+    VERIFICA(maiZero && coda.getNumeroComandi() == 0);
+}
+
+static void ripetizioni()
+{
+    CodaComandi coda;
+    MittenteFinto m;
+    IoTFinto iot;
+
+    // Nessuna conferma: MAX_TENTATIVI_COMANDO invii distanziati di TIMEOUT_CONFERMA_MS, poi si rinuncia
+    coda.accoda(0, 1, 0);
+    unsigned long rinuncia = 0;
+    for (unsigned long t = 0; t <= 2000 && rinuncia == 0; t += 10)
+    {
+        m.adessoMs = t;
+        coda.update(t, m);
+        iot.rispondi(m, coda, t, true);
+        if (!coda.isInCoda(0))
+            rinuncia = t;
+    }
+    VERIFICA(m.scritte.size() == MAX_TENTATIVI_COMANDO);
+    bool distanziati = true;
+    for (size_t i = 1; i < m.scritte.size(); i++)
+        distanziati = distanziati && m.scritte[i].adessoMs - m.scritte[i - 1].adessoMs == TIMEOUT_CONFERMA_MS;
+    VERIFICA(distanziati);
+    VERIFICA(rinuncia == MAX_TENTATIVI_COMANDO * TIMEOUT_CONFERMA_MS);
+    VERIFICA(coda.getStatistiche().ripetuti == MAX_TENTATIVI_COMANDO - 1 && coda.getStatistiche().falliti == 1);
+
+    // La conferma del terzo invio chiude il comando: stesso id a ogni invio
+    CodaComandi c2;
+    MittenteFinto m2;
+    IoTFinto iot2;
+    c2.accoda(3, 1, 0);
+    for (unsigned long t = 0; t < 3 * TIMEOUT_CONFERMA_MS; t += 10)
+    {
+        c2.update(t, m2);
+        iot2.rispondi(m2, c2, t, true);
+    }
+    VERIFICA(m2.scritte.size() == 3 && m2.scritte[0].buf[0] == m2.scritte[2].buf[0]);
+    iot2.lette = 2; // Arriva solo la conferma dell'ultimo invio
+    VERIFICA(iot2.rispondi(m2, c2, 3 * TIMEOUT_CONFERMA_MS) == 1);
+    VERIFICA(c2.getStatistiche().ultimaLatenzaMs == 3 * TIMEOUT_CONFERMA_MS);
+
+    // Scritture rifiutate: contano come tentativi e si ripetono al timeout
+    CodaComandi c3;
+    MittenteFinto m3;
+    IoTFinto iot3;
+    m3.rifiutate = 2;
+    c3.accoda(0, 1, 0);
+    for (unsigned long t = 0; t <= 2 * TIMEOUT_CONFERMA_MS; t += 10)
+    {
+        c3.update(t, m3);
+        iot3.rispondi(m3, c3, t);
+    }
+    VERIFICA(!c3.isInCoda(0) && c3.getStatistiche().confermati == 1 && c3.getStatistiche().ripetuti == 2);
+    VERIFICA(c3.getStatistiche().ultimaLatenzaMs == 2 * TIMEOUT_CONFERMA_MS);
+}
+
+static void scollegata()
+{
+    CodaComandi coda;
+    MittenteFinto m;
+    IoTFinto iot;
+    m.collegata[0] = false;
+    m.collegata[1] = false;
+    coda.accoda(0, 1, 0);
+    coda.accoda(1, 1, 0);
+
+    // Scollegata: nessun tentativo consumato, la 1 si ricollega a 3 s e il comando parte subito
+    for (unsigned long t = 0; t < SCADENZA_COMANDO_MS; t += 10)
+    {
+        if (t == 3000)
+            m.collegata[1] = true;
+        coda.update(t, m);
+        iot.rispondi(m, coda, t);
+    }
+    VERIFICA(m.scritte.size() == 1 && m.scritte[0].periferica == 1);
+    VERIFICA(!coda.isInCoda(1) && coda.getStatistiche().ultimaLatenzaMs == 3000);
+    VERIFICA(coda.isInCoda(0));
+    coda.update(SCADENZA_COMANDO_MS, m);
+    VERIFICA(!coda.isInCoda(0) && coda.getStatistiche().falliti == 1);
+
+    // Scadenza anche con tentativi rimasti: collegata ma senza conferme, poi scollegata
+    CodaComandi c2;
+    MittenteFinto m2;
+    c2.accoda(0, 1, 0);
+    c2.update(0, m2);
+    m2.collegata[0] = false;
+    c2.update(SCADENZA_COMANDO_MS - 1, m2);
+    VERIFICA(c2.isInCoda(0));
+    c2.update(SCADENZA_COMANDO_MS, m2);
+    VERIFICA(!c2.isInCoda(0) && m2.scritte.size() == 1);
+}
+
+static void firmwareAUnByte()
+{
+    CodaComandi coda;
+    MittenteFinto m;
+    IoTFinto iot;
+    m.conConferme = false;
+    coda.accoda(0, 1, 0);
+    coda.accoda(1, 0, 0);
+    coda.update(40, m); // La risposta alla scrittura vale come conferma
+    VERIFICA(coda.getNumeroComandi() == 0 && coda.getStatistiche().confermati == 2);
+    VERIFICA(coda.getStatistiche().ultimaLatenzaMs == 40);
+
+    // Il Nano IoT legge il byte come comando senza identificativo
+    VERIFICA(iot.rispondi(m, coda, 50) == 0);
+    VERIFICA(iot.stato[0].id == 0 && iot.stato[0].valore == 1 && iot.stato[1].valore == 0);
+
+    // Formato del messaggio
+    MessaggioAttuatore a = {7, 1}, b;
+    uint8_t buf[MESSAGGIO_ATTUATORE_DIMENSIONE];
+    VERIFICA(codificaMessaggioAttuatore(a, buf, 1) == 0);
+    VERIFICA(codificaMessaggioAttuatore(a, buf, sizeof(buf)) == MESSAGGIO_ATTUATORE_DIMENSIONE);
+    VERIFICA(decodificaMessaggioAttuatore(buf, sizeof(buf), b) && b.id == 7 && b.valore == 1);
+    VERIFICA(!decodificaMessaggioAttuatore(buf, 0, b));
+}
+
+int main()
+{
+    inVolo();
+    sostituzione();
+    confermeEstranee();
+    ripetizioni();
+    scollegata();
+    firmwareAUnByte();
+    return fineVerifiche();
+}
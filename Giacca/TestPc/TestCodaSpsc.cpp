@@ -0,0 +1,141 @@
+// Kicco972.net
+
+
+// CodaSpsc su PC con due thread al posto del campionatore e del loop.
+// 1) Il produttore riprova quando la coda è piena: il consumatore deve ricevere
+//    tutti gli elementi, in ordine, una volta sola e interi.
+// 2) Il produttore non riprova (come il thread dell'IMU): ogni elemento è
+//    ricevuto oppure contato in getPersi(), mai entrambe le cose o nessuna.
+
+#include "CodaSpsc.h"
+#include "Verifica.h"
+#include <atomic>
+#include <thread>
+
+#define ELEMENTI 4000000
+
+// Più parole per elemento: un elemento letto a metà scrittura non torna con la firma
+struct Elemento {
+    uint32_t numero;
+    uint32_t firma;
+    float valori[4];
+};
+
+static uint32_t firma(uint32_t numero)
+{
+    return numero * 2654435761u ^ 0x5A5A5A5Au;
+}
+
+static Elemento crea(uint32_t numero)
+{
+    Elemento e;
+    e.numero = numero;
+    e.firma = firma(numero);
+    for (int i = 0; i < 4; i++)
+        e.valori[i] = (float)(numero + i);
+    return e;
+}
+
+static bool integro(const Elemento& e)
+{
+    if (e.firma != firma(e.numero))
+        return false;
+    for (int i = 0; i < 4; i++)
+    {
+        if (e.valori[i] != (float)(e.numero + i))
+            return false;
+    }
+    return true;
+}
+
+static void senzaPerdite()
+{
+    static CodaSpsc<Elemento, 64> coda;
+    double t0 = adessoUs();
+    std::thread produttore([] {
+        for (uint32_t i = 0; i < ELEMENTI;)
+        {
+            if (coda.inserisci(crea(i)))
+                i++;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    uint32_t atteso = 0, fuoriOrdine = 0, rotti = 0;
+    while (atteso < ELEMENTI)
+    {
+        Elemento e;
+        if (!coda.estrai(e))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!integro(e))
+            rotti++;
+        if (e.numero != atteso)
+            fuoriOrdine++;
+        atteso = e.numero + 1;
+    }
+    produttore.join();
+    double t = adessoUs() - t0;
+
+    Elemento e;
+    VERIFICA(!coda.estrai(e)); // Niente duplicati in coda alla fine
+    VERIFICA(fuoriOrdine == 0);
+    VERIFICA(rotti == 0);
+    VERIFICA(coda.dimensione() == 0);
+    printf("Senza perdite: %d elementi in %.0f ms (%.1f M/s), fuori ordine %u, rotti %u\n",
+           ELEMENTI, t / 1000, ELEMENTI / t, fuoriOrdine, rotti);
+}
+
+static void conPerdite()
+{
+    static CodaSpsc<Elemento, 16> coda;
+    static std::atomic<bool> fatto(false);
+    std::thread produttore([] {
+        for (uint32_t i = 0; i < ELEMENTI; i++)
+        {
+            coda.inserisci(crea(i));
+            // Un po' più lento del consumatore, a tratti: la coda passa da vuota a piena
+            if (i % 32 == 0)
+                std::this_thread::yield();
+        }
+        fatto.store(true);
+    });
+
+    uint32_t ricevuti = 0, fuoriOrdine = 0, rotti = 0;
+    int64_t ultimo = -1;
+    while (true)
+    {
+        bool eraFatto = fatto.load();
+        Elemento e;
+        if (!coda.estrai(e))
+        {
+            if (eraFatto)
+                break; // Vuota dopo l'ultimo inserimento
+            std::this_thread::yield();
+            continue;
+        }
+        if (!integro(e))
+            rotti++;
+        if ((int64_t)e.numero <= ultimo)
+            fuoriOrdine++; // Duplicato o indietro
+        ultimo = e.numero;
+        ricevuti++;
+    }
+    produttore.join();
+
+    VERIFICA(fuoriOrdine == 0);
+    VERIFICA(rotti == 0);
+    VERIFICA(ricevuti + coda.getPersi() == ELEMENTI);
+    printf("Con perdite: ricevuti %u, persi %u, somma %u su %d\n",
+           ricevuti, coda.getPersi(), ricevuti + coda.getPersi(), ELEMENTI);
+}
+
+int main()
+{
+    senzaPerdite();
+    conPerdite();
+    return fineVerifiche();
+}
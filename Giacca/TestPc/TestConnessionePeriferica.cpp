@@ -0,0 +1,229 @@
+// Kicco972.net
+
+
+// ConnessionePeriferica su PC con un DriverBle a copione: ogni operazione sul
+// modulo BLE restituisce l'esito previsto dal test e viene annotata, insieme ai
+// cambi di stato. Si controllano la sequenza completa fino al collegamento (una
+// sola operazione per update), l'attesa esponenziale, la perdita del collegamento
+// e la disabilitazione.
+
+#include "ConnessionePeriferica.h"
+#include "Verifica.h"
+#include <deque>
+#include <string>
+
+#define ID_PERIFERICA 3
+
+class DriverCopione : public DriverBle {
+public:
+    std::deque<bool> esitiConnessione; // Vuoto = riesce
+    std::deque<bool> esitiScoperta;
+    int sottoscrizioni = 3;
+    bool connessa = false;
+    std::string diario;                // Operazioni e cambi di stato, in ordine
+    int operazioni = 0;                // Chiamate che parlano col modulo BLE
+
+    bool connetti(int id) override
+    {
+        annota(id, "connetti");
+        connessa = prossimo(esitiConnessione);
+        return connessa;
+    }
+
+    bool scopriAttributi(int id) override
+    {
+        annota(id, "scopri");
+        return prossimo(esitiScoperta);
+    }
+
+    int numeroSottoscrizioni(int) override { return sottoscrizioni; }
+
+    bool sottoscrivi(int id, int indice) override
+    {
+        annota(id, ("sottoscrivi" + std::to_string(indice)).c_str());
+        return indice != 1; // Una caratteristica senza notifiche
+    }
+
+    bool isConnessa(int) override { return connessa; }
+
+    void disconnetti(int id) override
+    {
+        annota(id, "disconnetti");
+        connessa = false;
+    }
+
+    void cambioStato(int id, StatoConnessione vecchio, StatoConnessione nuovo) override
+    {
+        VERIFICA(id == ID_PERIFERICA);
+        VERIFICA(vecchio != nuovo);
+        diario += std::string(ConnessionePeriferica::nomeStato(nuovo)) + " ";
+    }
+
+    // Restituisce il diario e lo azzera
+    std::string leggi()
+    {
+        std::string d = diario;
+        diario.clear();
+        return d;
+    }
+
+private:
+    void annota(int id, const char* operazione)
+    {
+        VERIFICA(id == ID_PERIFERICA);
+        diario += std::string(operazione) + " ";
+        operazioni++;
+    }
+
+    static bool prossimo(std::deque<bool>& esiti)
+    {
+        if (esiti.empty())
+            return true;
+        bool e = esiti.front();
+        esiti.pop_front();
+        return e;
+    }
+};
+
+static void sequenzaCompleta()
+{
+    DriverCopione driver;
+    ConnessionePeriferica c;
+    c.begin(ID_PERIFERICA, driver);
+
+    c.update(0);
+    VERIFICA(c.getStato() == CONN_INATTIVA && driver.operazioni == 0);
+    c.trovata(); // Ignorata se non si sta cercando
+    VERIFICA(c.getStato() == CONN_INATTIVA);
+
+    c.abilita();
+    c.update(10);
+    VERIFICA(c.isInRicerca() && driver.operazioni == 0);
+    c.trovata();
+    VERIFICA(c.isOccupata());
+
+    // Al massimo un'operazione per update
+    int update = 0;
+    for (unsigned long t = 20; !c.isAttiva() && update < 20; t += 10, update++)
+    {
+        int prima = driver.operazioni;
+        c.update(t);
+        VERIFICA(driver.operazioni - prima <= 1);
+    }
+    VERIFICA(c.isAttiva());
+    VERIFICA(update == 6); // connetti, scopri, 3 sottoscrizioni, passaggio ad attiva
+    VERIFICA(driver.leggi() == "ricerca connessione connetti scoperta scopri sottoscrizione "
+                               "sottoscrivi0 sottoscrivi1 sottoscrivi2 attiva ");
+    VERIFICA(c.getTentativi() == 0 && c.getRiconnessioni() == 0);
+
+    // Collegamento attivo: nessuna operazione
+    c.update(200);
+    VERIFICA(driver.leggi().empty());
+
+    // Disabilitare non chiude un collegamento attivo
+    c.disabilita();
+    c.update(210);
+    VERIFICA(c.isAttiva());
+}
+
+static void attesaEsponenziale()
+{
+    DriverCopione driver;
+    ConnessionePeriferica c;
+    c.begin(ID_PERIFERICA, driver);
+    c.abilita();
+    for (int i = 0; i < 9; i++)
+        driver.esitiConnessione.push_back(false);
+
+    const unsigned long attese[] = {500, 1000, 2000, 4000, 8000, 16000, 30000, 30000, 30000};
+    unsigned long t = 1000;
+    bool ok = true;
+    for (int i = 0; i < 9; i++)
+    {
+        c.trovata();
+        c.update(t);
+        ok = ok && c.getStato() == CONN_ATTESA && c.getTentativi() == (uint32_t)(i + 1) &&
+             c.getAttesaMs() == attese[i];
+        // Un attimo prima della fine resta in attesa, allo scadere torna a cercare
+        c.update(t + attese[i] - 1);
+        ok = ok && c.getStato() == CONN_ATTESA;
+        c.trovata(); // Ignorata durante l'attesa
+        ok = ok && c.getStato() == CONN_ATTESA;
+        t += attese[i];
+        c.update(t);
+        ok = ok && c.isInRicerca();
+    }
+    VERIFICA(ok);
+
+    // Il primo collegamento riuscito azzera i tentativi
+    c.trovata();
+    for (int i = 0; i < 6; i++)
+        c.update(t += 10);
+    VERIFICA(c.isAttiva() && c.getTentativi() == 0);
+    driver.leggi();
+
+    // Collegamento perso: una riconnessione e l'attesa riparte da 0.5 s
+    driver.connessa = false;
+    c.update(t += 10);
+    VERIFICA(c.getStato() == CONN_ATTESA && c.getRiconnessioni() == 1 && c.getAttesaMs() == 500);
+
+    // Scoperta fallita: si disconnette prima di attendere
+    c.update(t += 500);
+    c.trovata();
+    driver.esitiScoperta.push_back(false);
+    c.update(t += 10);
+    c.update(t += 10);
+    VERIFICA(driver.leggi() == "attesa ricerca connessione connetti scoperta scopri disconnetti attesa ");
+    VERIFICA(c.getAttesaMs() == 1000 && !driver.connessa);
+}
+
+static void perditaDuranteSottoscrizione()
+{
+    DriverCopione driver;
+    ConnessionePeriferica c;
+    c.begin(ID_PERIFERICA, driver);
+    c.abilita();
+    c.trovata();
+    c.update(0); // connetti
+    c.update(1); // scopri
+    c.update(2); // sottoscrivi0
+    driver.connessa = false;
+    c.update(3);
+    VERIFICA(c.getStato() == CONN_ATTESA);
+    VERIFICA(c.getRiconnessioni() == 0); // Non era ancora attiva
+    VERIFICA(driver.leggi() == "ricerca connessione connetti scoperta scopri sottoscrizione sottoscrivi0 attesa ");
+}
+
+static void disabilitazione()
+{
+    DriverCopione driver;
+    ConnessionePeriferica c;
+    c.begin(ID_PERIFERICA, driver);
+    c.abilita();
+
+    // Un fallimento dopo disabilita() non rimette in attesa
+    c.trovata();
+    c.disabilita();
+    driver.esitiConnessione.push_back(false);
+    c.update(0);
+    VERIFICA(c.getStato() == CONN_INATTIVA && c.getTentativi() == 0);
+
+    // Disabilitare durante l'attesa ferma i tentativi
+    c.abilita();
+    c.trovata();
+    driver.esitiConnessione.push_back(false);
+    c.update(10);
+    VERIFICA(c.getStato() == CONN_ATTESA);
+    c.disabilita();
+    c.update(100000);
+    VERIFICA(c.getStato() == CONN_INATTIVA);
+}
+
+int main()
+{
+    sequenzaCompleta();
+    attesaEsponenziale();
+    perditaDuranteSottoscrizione();
+    disabilitazione();
+    return fineVerifiche();
+}
@@ -0,0 +1,199 @@
+// Kicco972.net
+
+
+// DecoderFifoBmi270 su PC: rigioca un dump di letture di FIFO_DATA (una riga
+// esadecimale per burst, come le fa SensoreImu::svuotaFifo) e controlla frame,
+// salti, sensortime, frame troncati a fine burst, FIFO vuota e header sconosciuti.
+// Poi rilegge gli stessi byte con burst di ogni lunghezza da 13 a 40: i frame
+// spezzati tra due letture devono uscire identici.
+//   TestFifoBmi270 [dump.txt]
+// Senza argomenti usa dati/FifoBmi270.txt (vedi il commento in testa al file).
+
+#include "FifoBmi270.h"
+#include "Verifica.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define MAX_FRAME 64
+#define BYTE_FRAME_COMPLETO 13 // Header + giroscopio + accelerometro
+
+typedef std::vector<uint8_t> Burst;
+
+static bool leggiDump(const char* percorso, std::vector<Burst>& burst)
+{
+    FILE* f = fopen(percorso, "r");
+    if (!f)
+        return false;
+    char riga[2048];
+    while (fgets(riga, sizeof(riga), f))
+    {
+        if (riga[0] == '#')
+            continue;
+        Burst b;
+        char* p = riga;
+        char* fine;
+        for (long v = strtol(p, &fine, 16); fine != p; v = strtol(p, &fine, 16))
+        {
+            b.push_back((uint8_t)v);
+            p = fine;
+        }
+        if (!b.empty())
+            burst.push_back(b);
+    }
+    fclose(f);
+    return true;
+}
+
+// Il frame dati k del dump: giroscopio (k, -k, 2k), accelerometro (8192, -100, 10k)
+static bool giroscopioDi(const FrameFifoBmi270& f, int k)
+{
+    return f.gx == k && f.gy == -k && f.gz == 2 * k;
+}
+
+static bool accelerometroDi(const FrameFifoBmi270& f, int k)
+{
+    return f.ax == 8192 && f.ay == -100 && f.az == 10 * k;
+}
+
+static bool uguali(const FrameFifoBmi270& a, const FrameFifoBmi270& b)
+{
+    return a.ax == b.ax && a.ay == b.ay && a.az == b.az && a.gx == b.gx && a.gy == b.gy &&
+           a.gz == b.gz && a.acc == b.acc && a.gyr == b.gyr;
+}
+
+// Burst per burst, come nel dump
+static void rigiocaDump(const std::vector<Burst>& burst, std::vector<FrameFifoBmi270>& frame)
+{
+    DecoderFifoBmi270 decoder;
+    FrameFifoBmi270 letti[MAX_FRAME];
+
+    // 1: 18 frame interi, il 19 troncato resta nella FIFO
+    int n = decoder.decodifica(burst[0].data(), (int)burst[0].size(), letti, MAX_FRAME);
+    VERIFICA(burst[0].size() == 240);
+    VERIFICA(n == 18);
+    VERIFICA(decoder.getByteConsumati() == 18 * BYTE_FRAME_COMPLETO);
+    VERIFICA(!decoder.isFifoVuota());
+    VERIFICA(!decoder.haSensorTime());
+    frame.insert(frame.end(), letti, letti + n);
+
+    // Con meno posto del necessario si ferma dopo maxFrame, senza consumare il resto
+    DecoderFifoBmi270 limitato;
+    VERIFICA(limitato.decodifica(burst[0].data(), (int)burst[0].size(), letti, 5) == 5);
+    VERIFICA(limitato.getByteConsumati() == 5 * BYTE_FRAME_COMPLETO);
+
+    // 2: il 19 ripresentato intero, salto, configurazione, frame con un solo sensore, scarto
+    n = decoder.decodifica(burst[1].data(), (int)burst[1].size(), letti, MAX_FRAME);
+    VERIFICA(n == 10);
+    VERIFICA(decoder.getByteConsumati() == (int)burst[1].size());
+    VERIFICA(decoder.isFifoVuota());
+    VERIFICA(decoder.getFrameSaltati() == 5);
+    VERIFICA(decoder.haSensorTime());
+    VERIFICA(decoder.getSensorTime() == 0x002710);
+    frame.insert(frame.end(), letti, letti + n);
+
+    // 3: sensortime con i bit di interrupt nell'header
+    n = decoder.decodifica(burst[2].data(), (int)burst[2].size(), letti, MAX_FRAME);
+    VERIFICA(n == 2);
+    VERIFICA(decoder.isFifoVuota());
+    VERIFICA(decoder.getSensorTime() == 0x004E20);
+    frame.insert(frame.end(), letti, letti + n);
+
+    // 4: header sconosciuto, il resto del burst è perso ma il frame prima no
+    n = decoder.decodifica(burst[3].data(), (int)burst[3].size(), letti, MAX_FRAME);
+    VERIFICA(n == 1);
+    VERIFICA(decoder.getFrameScartati() == 1);
+    VERIFICA(decoder.getByteConsumati() == (int)burst[3].size());
+    VERIFICA(decoder.getFrameSaltati() == 5);
+    frame.insert(frame.end(), letti, letti + n);
+}
+
+static void controllaFrame(const std::vector<FrameFifoBmi270>& frame)
+{
+    VERIFICA(frame.size() == 31);
+    if (frame.size() != 31)
+        return;
+
+    // 1..24 interi e in ordine, nessun doppione del 19 tra i primi due burst
+    bool ok = true;
+    for (int k = 1; k <= 24; k++)
+    {
+        const FrameFifoBmi270& f = frame[k - 1];
+        ok = ok && f.acc && f.gyr && giroscopioDi(f, k) && accelerometroDi(f, k);
+    }
+    VERIFICA(ok);
+
+    // Dopo il salto: 30 solo accelerometro (giroscopio del 24), 31 solo giroscopio (accelerometro del 30)
+    VERIFICA(frame[24].acc && !frame[24].gyr);
+    VERIFICA(accelerometroDi(frame[24], 30) && giroscopioDi(frame[24], 24));
+    VERIFICA(!frame[25].acc && frame[25].gyr);
+    VERIFICA(giroscopioDi(frame[25], 31) && accelerometroDi(frame[25], 30));
+
+    int attesi[] = {32, 33, 34, 35, 36};
+    for (int i = 0; i < 5; i++)
+        VERIFICA(giroscopioDi(frame[26 + i], attesi[i]) && accelerometroDi(frame[26 + i], attesi[i]));
+
+    // Scale della libreria: 1 g e 1 °/s per LSB_PER_G e LSB_PER_DPS
+    VERIFICA(frame[0].ax / BMI270_LSB_PER_G == 1.0f);
+    VERIFICA(frame[15].gx / BMI270_LSB_PER_DPS > 0.97f && frame[15].gx / BMI270_LSB_PER_DPS < 0.98f);
+}
+
+// Stessi byte (senza riempitivo e senza il burst rovinato) letti come da una FIFO
+// con burst di lunghezza fissa: ciò che non viene consumato resta in testa
+static void burstDiOgniLunghezza(const std::vector<Burst>& burst, const std::vector<FrameFifoBmi270>& riferimento)
+{
+    Burst fifo(burst[0].begin(), burst[0].begin() + 18 * BYTE_FRAME_COMPLETO);
+    for (int i = 1; i <= 2; i++)
+    {
+        size_t fine = burst[i].size();
+        while (fine > 0 && burst[i][fine - 1] == 0x80)
+            fine--;
+        fifo.insert(fifo.end(), burst[i].begin(), burst[i].begin() + fine);
+    }
+
+    int lunghezzeSbagliate = 0;
+    for (int lunghezza = BYTE_FRAME_COMPLETO; lunghezza <= 40; lunghezza++)
+    {
+        DecoderFifoBmi270 decoder;
+        FrameFifoBmi270 letti[MAX_FRAME];
+        std::vector<FrameFifoBmi270> frame;
+        size_t pos = 0;
+        while (pos < fifo.size())
+        {
+            int daLeggere = (int)(fifo.size() - pos) < lunghezza ? (int)(fifo.size() - pos) : lunghezza;
+            int n = decoder.decodifica(fifo.data() + pos, daLeggere, letti, MAX_FRAME);
+            frame.insert(frame.end(), letti, letti + n);
+            if (decoder.getByteConsumati() == 0)
+                break; // Non dovrebbe succedere: un frame sta sempre in un burst
+            pos += decoder.getByteConsumati();
+        }
+
+        bool ok = pos == fifo.size() && frame.size() + 1 == riferimento.size() &&
+                  decoder.getFrameSaltati() == 5 && decoder.getFrameScartati() == 0;
+        for (size_t i = 0; ok && i < frame.size(); i++)
+            ok = uguali(frame[i], riferimento[i]);
+        if (!ok)
+        {
+            lunghezzeSbagliate++;
+            printf("Burst da %d byte: %zu frame, %zu byte consumati su %zu\n", lunghezza, frame.size(), pos, fifo.size());
+        }
+    }
+    VERIFICA(lunghezzeSbagliate == 0);
+}
+
+int main(int argc, char** argv)
+{
+    const char* percorso = argc > 1 ? argv[1] : "dati/FifoBmi270.txt";
+    std::vector<Burst> burst;
+    VERIFICA(leggiDump(percorso, burst));
+    VERIFICA(burst.size() == 4);
+    if (burst.size() != 4)
+        return fineVerifiche();
+
+    std::vector<FrameFifoBmi270> frame;
+    rigiocaDump(burst, frame);
+    controllaFrame(frame);
+    burstDiOgniLunghezza(burst, frame);
+    printf("%zu frame dal dump, sensortime e salti come attesi\n", frame.size());
+    return fineVerifiche();
+}
@@ -0,0 +1,237 @@
+// Kicco972.net
+
+
+// FiltroSensore su PC: media dei campioni del periodo, banda morta per asse e
+// banda 0, NaN, intervallo massimo (anche a cavallo del giro di millis()) e
+// controllo del Master da 6 e da 16 byte applicato ai filtri come fa lo sketch
+// del Sense (applicaControllo()).
+
+#include "FiltroSensore.h"
+#include "TramaSensori.h"
+#include "Verifica.h"
+#include <math.h>
+
+static bool vicino(float a, float b)
+{
+    return fabsf(a - b) < 1e-5f;
+}
+
+static void media()
+{
+    MediaCampioni m;
+    m.begin(3);
+    float media[3] = {-1, -1, -1};
+    VERIFICA(!m.chiudi(media)); // Nessun campione: la media non cambia
+    VERIFICA(media[0] == -1);
+
+    const float campioni[4][3] = {{20.0f, 50.0f, 101.0f}, {20.5f, 49.0f, 101.2f}, {21.0f, 51.0f, 101.1f}, {20.5f, 50.0f, 100.9f}};
+    for (int i = 0; i < 4; i++)
+        m.aggiungi(campioni[i]);
+    VERIFICA(m.getNumero() == 4);
+    VERIFICA(m.chiudi(media));
+    VERIFICA(vicino(media[0], 20.5f) && vicino(media[1], 50.0f) && vicino(media[2], 101.05f));
+    VERIFICA(m.getNumero() == 0 && !m.chiudi(media)); // Nuovo periodo
+
+    // Un solo asse: gli altri valori non vengono toccati
+    MediaCampioni s;
+    s.begin(0);
+    s.aggiungi(3.0f);
+    s.aggiungi(4.0f);
+    float uno[3] = {0, 7, 7};
+    VERIFICA(s.chiudi(uno) && uno[0] == 3.5f && uno[1] == 7 && uno[2] == 7);
+
+    // Più assi del massimo: si ferma a MAX_ASSI_FILTRO
+    MediaCampioni t;
+    t.begin(MAX_ASSI_FILTRO + 2);
+    float v[MAX_ASSI_FILTRO + 2] = {1, 2, 3, 4, 5};
+    t.aggiungi(v);
+    float r[MAX_ASSI_FILTRO + 2] = {0, 0, 0, 9, 9};
+    VERIFICA(t.chiudi(r) && r[2] == 3 && r[3] == 9);
+}
+
+static void bandaPerAsse()
+{
+    BandaMorta b;
+    b.begin(3);
+    b.setBanda(0, 0.05f);
+    b.setBanda(1, -0.3f); // Il segno non conta
+    b.setBanda(2, 0.01f);
+    b.setIntervalloMassimo(60000);
+
+    float v[3] = {20.0f, 50.0f, 101.0f};
+    VERIFICA(b.daInviare(v, 0)); // Il primo valore parte sempre
+    b.inviato(v, 0);
+    VERIFICA(!b.daInviare(v, 1000));
+
+    // Ogni asse con la sua banda: 0.2 % di umidità non basta, 0.06 °C sì
+    float u[3] = {20.0f, 50.2f, 101.0f};
+    VERIFICA(!b.daInviare(u, 1000));
+    u[1] = 49.6f;
+    VERIFICA(b.daInviare(u, 1000));
+    float t[3] = {20.06f, 50.0f, 101.0f};
+    VERIFICA(b.daInviare(t, 1000));
+
+    // Lo scostamento è dall'ultimo valore inviato, non dall'ultimo calcolato:
+    // una deriva lenta parte quando supera la banda
+    float d[3] = {20.0f, 50.0f, 101.0f};
+    int invii = 0;
+    for (int i = 1; i <= 10; i++)
+    {
+        d[2] = 101.0f + 0.004f * i;
+        if (b.daInviare(d, 1000 + i))
+        {
+            b.inviato(d, 1000 + i);
+            invii++;
+        }
+    }
+    VERIFICA(invii == 3); // 101.012, 101.024, 101.036
+
+    // Nuova connessione: il prossimo valore parte comunque
+    b.dimentica();
+    VERIFICA(b.daInviare(d, 2000));
+}
+
+static void bandaZero()
+{
+    BandaMorta b;
+    b.begin(3);
+    b.setIntervalloMassimo(60000);
+    float v[3] = {1, 2, 3};
+    int invii = 0;
+    for (unsigned long t = 0; t < 10; t++)
+    {
+        if (b.daInviare(v, t))
+        {
+            b.inviato(v, t);
+            invii++;
+        }
+    }
+    VERIFICA(invii == 10); // Banda 0 = ogni periodo, anche a valori fermi
+}
+
+static void valoriNan()
+{
+    BandaMorta b;
+    b.begin(3);
+    for (int i = 0; i < 3; i++)
+        b.setBanda(i, 1.0f);
+    b.setIntervalloMassimo(60000);
+    float v[3] = {20.0f, 50.0f, 101.0f};
+    b.inviato(v, 0);
+
+    // Il sensore si guasta: parte subito, così il Master lo sa
+    float g[3] = {20.0f, NAN, 101.0f};
+    VERIFICA(b.daInviare(g, 100));
+    b.inviato(g, 100);
+    // Torna a funzionare con lo stesso valore di prima: parte anche questo
+    VERIFICA(b.daInviare(v, 200));
+    b.inviato(v, 200);
+    VERIFICA(!b.daInviare(v, 300));
+}
+
+// Il Master deve sapere che il Sense è vivo anche a valori fermi
+static void intervalloMassimo()
+{
+    BandaMorta b;
+    b.begin(1);
+    b.setBanda(0, 1.0f);
+    b.setIntervalloMassimo(10000);
+    float v = 5.0f;
+    b.inviato(&v, 1000);
+    VERIFICA(!b.daInviare(&v, 10999));
+    VERIFICA(b.daInviare(&v, 11000));
+
+    // Ultimo invio 4 s prima del giro dei 32 bit di millis()
+    unsigned long prima = 0xFFFFF060ul;
+    b.inviato(&v, prima);
+    VERIFICA(!b.daInviare(&v, 0));
+    VERIFICA(!b.daInviare(&v, (uint32_t)(prima + 9999)));
+    VERIFICA(b.daInviare(&v, (uint32_t)(prima + 10000)));
+    VERIFICA(b.getUltimoInvioMs() == prima);
+}
+
+// Come applicaControllo() nello sketch del Sense
+static void applica(const ControlloSense& c, BandaMorta& ambiente, BandaMorta& mag)
+{
+    ambiente.setBanda(0, c.bandaTemperatura);
+    ambiente.setBanda(1, c.bandaUmidita);
+    ambiente.setBanda(2, c.bandaPressione);
+    for (int i = 0; i < 3; i++)
+        mag.setBanda(i, c.bandaMag);
+    ambiente.setIntervalloMassimo(c.intervalloMassimoMs);
+    mag.setIntervalloMassimo(c.intervalloMassimoMs);
+}
+
+static void controllo()
+{
+    ControlloSense scritto;
+    controlloSenseDefault(scritto);
+    scritto.periodoMagMs = 100;
+    scritto.periodoAmbienteMs = 1000;
+    scritto.bandaTemperatura = 0.5f;
+    scritto.bandaUmidita = 0.0f;
+    scritto.bandaPressione = 0.02f;
+    scritto.bandaMag = 2.0f;
+    scritto.intervalloMassimoMs = 5000;
+    uint8_t buf[CONTROLLO_SENSE_DIMENSIONE];
+    VERIFICA(codificaControlloSense(scritto, buf, sizeof(buf)) == CONTROLLO_SENSE_DIMENSIONE);
+
+    // 16 byte: bande e intervallo dal Master
+    ControlloSense c;
+    BandaMorta ambiente, mag;
+    ambiente.begin(3);
+    mag.begin(3);
+    VERIFICA(decodificaControlloSense(buf, CONTROLLO_SENSE_DIMENSIONE, c));
+    VERIFICA(c.periodoMagMs == 100 && c.periodoAmbienteMs == 1000 && c.intervalloMassimoMs == 5000);
+    VERIFICA(vicino(c.bandaTemperatura, 0.5f) && c.bandaUmidita == 0 && vicino(c.bandaPressione, 0.02f) && vicino(c.bandaMag, 2.0f));
+    applica(c, ambiente, mag);
+    float a[3] = {20.0f, 50.0f, 101.0f};
+    ambiente.inviato(a, 0);
+    float b[3] = {20.3f, 50.0f, 101.0f};
+    VERIFICA(ambiente.daInviare(b, 1000)); // Umidità con banda 0: ogni periodo
+    float m[3] = {10.0f, 10.0f, 10.0f};
+    mag.inviato(m, 0);
+    float n[3] = {11.5f, 10.0f, 8.5f};
+    VERIFICA(!mag.daInviare(n, 100));
+    VERIFICA(mag.daInviare(n, 5000));
+
+    // 6 byte (Master precedenti): periodi dal Master, bande e intervallo di default
+    VERIFICA(decodificaControlloSense(buf, CONTROLLO_SENSE_DIMENSIONE_MINIMA, c));
+    VERIFICA(c.periodoMagMs == 100 && c.periodoAmbienteMs == 1000);
+    VERIFICA(c.bandaTemperatura == BANDA_TEMPERATURA_DEFAULT && c.bandaUmidita == BANDA_UMIDITA_DEFAULT);
+    VERIFICA(c.bandaPressione == BANDA_PRESSIONE_DEFAULT && c.bandaMag == BANDA_MAG_DEFAULT);
+    VERIFICA(c.intervalloMassimoMs == INTERVALLO_MASSIMO_DEFAULT_MS);
+    applica(c, ambiente, mag);
+    ambiente.inviato(a, 0);
+    VERIFICA(!ambiente.daInviare(a, INTERVALLO_MASSIMO_DEFAULT_MS - 1));
+    float h[3] = {20.0f, 50.2f, 101.0f};
+    VERIFICA(!ambiente.daInviare(h, 1000)); // Sotto la banda di umidità di default
+    h[1] = 50.31f;
+    VERIFICA(ambiente.daInviare(h, 1000));
+
+    // Troppo corto o versione sconosciuta: rifiutato
+    VERIFICA(!decodificaControlloSense(buf, CONTROLLO_SENSE_DIMENSIONE_MINIMA - 1, c));
+    buf[0] = CONTROLLO_SENSE_VERSIONE + 1;
+    VERIFICA(!decodificaControlloSense(buf, CONTROLLO_SENSE_DIMENSIONE, c));
+    buf[0] = CONTROLLO_SENSE_VERSIONE;
+
+    // Periodi sotto il minimo alzati, intervallo massimo non sotto il periodo ambientale
+    tramaScrivi16(buf + 2, 1);
+    tramaScrivi16(buf + 4, 20000);
+    tramaScrivi16(buf + 14, 3000);
+    VERIFICA(decodificaControlloSense(buf, CONTROLLO_SENSE_DIMENSIONE, c));
+    VERIFICA(c.periodoMagMs == PERIODO_MINIMO_MS && c.intervalloMassimoMs == 20000);
+    VERIFICA(decodificaControlloSense(buf, CONTROLLO_SENSE_DIMENSIONE_MINIMA, c));
+    VERIFICA(c.intervalloMassimoMs == 20000); // Anche con il default (10 s) di un controllo da 6 byte
+}
+
+int main()
+{
+    media();
+    bandaPerAsse();
+    bandaZero();
+    valoriNan();
+    intervalloMassimo();
+    controllo();
+    return fineVerifiche();
+}
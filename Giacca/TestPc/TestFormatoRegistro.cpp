@@ -0,0 +1,142 @@
+// Kicco972.net
+
+
+// Record del registro binario su PC: andata e ritorno entro mezzo passo di
+// quantizzazione, ogni singolo bit cambiato rifiutato dal CRC, NaN per ogni
+// misura (il valore riservato non deve diventare un fondo scala), saturazione
+// ai limiti senza cadere sui valori riservati, intestazione e record interi.
+
+#include "FormatoRegistro.h"
+#include "Verifica.h"
+#include <math.h>
+
+static bool entro(float letto, float scritto, float passo)
+{
+    return fabsf(letto - scritto) <= passo / 2 + 1e-4f;
+}
+
+static void andataERitorno()
+{
+    uint8_t buf[REGISTRO_RECORD];
+    CampioneStorico c, l;
+    bool tutti = true;
+    for (int i = 0; i < 2000; i++)
+    {
+        c.epoch = 1735689600u + 60u * i;
+        c.temperatura = -40.0f + 0.0437f * i;
+        c.umidita = 0.05f * i;
+        c.pressione = 30.0f + 0.0391f * i;
+        codificaRecordRegistro(c, buf);
+        bool ok = decodificaRecordRegistro(buf, l) && l.epoch == c.epoch &&
+                  entro(l.temperatura, c.temperatura, 0.01f) && entro(l.umidita, c.umidita, 0.01f) &&
+                  entro(l.pressione, c.pressione, 0.002f);
+        if (!ok)
+            printf("Record %d: %.4f %.4f %.4f letti come %.4f %.4f %.4f\n", i, c.temperatura, c.umidita,
+                   c.pressione, l.temperatura, l.umidita, l.pressione);
+        tutti = tutti && ok;
+    }
+    VERIFICA(tutti);
+
+    // Valori esatti sulla griglia tornano identici
+    c.epoch = 0xFFFFFFFFu;
+    c.temperatura = -12.34f;
+    c.umidita = 56.78f;
+    c.pressione = 101.326f;
+    codificaRecordRegistro(c, buf);
+    VERIFICA(tramaLeggi16(buf + 4) == (uint16_t)(int16_t)-1234);
+    VERIFICA(tramaLeggi16(buf + 6) == 5678 && tramaLeggi16(buf + 8) == 50663);
+    VERIFICA(decodificaRecordRegistro(buf, l) && l.epoch == 0xFFFFFFFFu);
+}
+
+static void bitCambiati()
+{
+    CampioneStorico c = {1735689600u, 21.5f, 45.0f, 101.3f};
+    uint8_t buf[REGISTRO_RECORD];
+    codificaRecordRegistro(c, buf);
+    CampioneStorico l = {};
+    int accettati = 0;
+    for (int bit = 0; bit < REGISTRO_RECORD * 8; bit++)
+    {
+        buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        if (decodificaRecordRegistro(buf, l))
+            accettati++;
+        buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    }
+    VERIFICA(accettati == 0);
+    VERIFICA(decodificaRecordRegistro(buf, l));
+
+    // Flash cancellata (tutti 0xFF) e record azzerato: non sono campioni
+    uint8_t vuoto[REGISTRO_RECORD];
+    memset(vuoto, 0xFF, sizeof(vuoto));
+    VERIFICA(!decodificaRecordRegistro(vuoto, l));
+    memset(vuoto, 0x00, sizeof(vuoto));
+    VERIFICA(!decodificaRecordRegistro(vuoto, l));
+}
+
+static void valoriNan()
+{
+    uint8_t buf[REGISTRO_RECORD];
+    CampioneStorico l = {};
+    for (int i = 0; i < 3; i++)
+    {
+        CampioneStorico c = {1735689600u, 21.5f, 45.0f, 101.3f};
+        float* campo = i == 0 ? &c.temperatura : i == 1 ? &c.umidita : &c.pressione;
+        *campo = NAN;
+        codificaRecordRegistro(c, buf);
+        VERIFICA(tramaLeggi16(buf + 4 + 2 * i) == (i == 0 ? REGISTRO_TEMPERATURA_NULLA : REGISTRO_NULLO));
+        VERIFICA(decodificaRecordRegistro(buf, l));
+        VERIFICA(isnan(l.temperatura) == (i == 0) && isnan(l.umidita) == (i == 1) && isnan(l.pressione) == (i == 2));
+    }
+}
+
+static void saturazione()
+{
+    uint8_t buf[REGISTRO_RECORD];
+    CampioneStorico l = {};
+
+    // Oltre i limiti si satura al fondo scala, mai sul valore riservato
+    CampioneStorico alto = {1, 1000.0f, 1000.0f, 500.0f};
+    codificaRecordRegistro(alto, buf);
+    VERIFICA(tramaLeggi16(buf + 4) == 32767 && tramaLeggi16(buf + 6) == 65534 && tramaLeggi16(buf + 8) == 65534);
+    VERIFICA(decodificaRecordRegistro(buf, l));
+    VERIFICA(!isnan(l.temperatura) && !isnan(l.umidita) && !isnan(l.pressione));
+    VERIFICA(entro(l.temperatura, 327.67f, 0.01f) && entro(l.umidita, 655.34f, 0.01f) && entro(l.pressione, 131.068f, 0.002f));
+
+    CampioneStorico basso = {1, -1000.0f, -5.0f, -1.0f};
+    codificaRecordRegistro(basso, buf);
+    VERIFICA(tramaLeggi16(buf + 4) == (uint16_t)(int16_t)-32767);
+    VERIFICA(tramaLeggi16(buf + 6) == 0 && tramaLeggi16(buf + 8) == 0);
+    VERIFICA(decodificaRecordRegistro(buf, l) && !isnan(l.temperatura));
+    VERIFICA(entro(l.temperatura, -327.67f, 0.01f) && l.umidita == 0 && l.pressione == 0);
+
+    // Infiniti come i fondo scala
+    CampioneStorico infinito = {1, -INFINITY, INFINITY, INFINITY};
+    codificaRecordRegistro(infinito, buf);
+    VERIFICA(tramaLeggi16(buf + 4) == (uint16_t)(int16_t)-32767 && tramaLeggi16(buf + 6) == 65534);
+}
+
+static void intestazione()
+{
+    uint8_t buf[REGISTRO_INTESTAZIONE];
+    codificaIntestazioneRegistro(buf, 0x1234);
+    VERIFICA(verificaIntestazioneRegistro(buf, sizeof(buf)));
+    VERIFICA(tramaLeggi16(buf + 6) == 0x1234);
+    VERIFICA(!verificaIntestazioneRegistro(buf, sizeof(buf) - 1));
+    buf[4]++;
+    VERIFICA(!verificaIntestazioneRegistro(buf, sizeof(buf)));
+
+    VERIFICA(registroRecordInteri(0) == 0 && registroRecordInteri(REGISTRO_INTESTAZIONE) == 0);
+    VERIFICA(registroRecordInteri(REGISTRO_INTESTAZIONE + REGISTRO_RECORD - 1) == 0); // Record troncato
+    VERIFICA(registroRecordInteri(registroPosizione(5)) == 5);
+    VERIFICA(registroRecordInteri(registroPosizione(5) + 7) == 5);
+}
+
+int main()
+{
+    andataERitorno();
+    bitCambiati();
+    valoriNan();
+    saturazione();
+    intestazione();
+    return fineVerifiche();
+}
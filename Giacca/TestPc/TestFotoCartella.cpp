@@ -0,0 +1,156 @@
+// Kicco972.net
+
+
+// FotoCartella su PC: i tre ordini con il nome (senza maiuscole) a decidere
+// le parità, qualunque sia l'ordine della readdir; voci omesse quando finiscono
+// le voci e quando finisce lo spazio dei nomi; giro degli ordini come in
+// Memoria::cycleFileSort(), con la selezione ritrovata da cerca() dopo ogni
+// riordino.
+
+#include "FotoCartella.h"
+#include "Verifica.h"
+#include <string.h>
+
+#define VOCI_PROVA 8
+#define SPAZIO_PROVA 128
+
+struct FileFinto {
+    const char* nome;
+    uint32_t dimensione;
+    uint32_t data;
+};
+
+// Date e dimensioni ripetute: le parità le decide il nome
+static const FileFinto CARTELLA[] = {
+    {"Log.csv", 5000, 300},
+    {"b.txt", 100, 200},
+    {"A.txt", 100, 300},
+    {"c.bin", 9000, 100},
+    {"Dati.csv", 5000, 200},
+};
+#define NUMERO_FILE ((int)(sizeof(CARTELLA) / sizeof(CARTELLA[0])))
+
+static VoceCartella voci[VOCI_PROVA];
+static char nomi[SPAZIO_PROVA];
+
+// Riempie la fotografia partendo dal file primo, come una readdir in un altro ordine
+static void riempi(FotoCartella& f, int primo)
+{
+    f.azzera();
+    for (int i = 0; i < NUMERO_FILE; i++)
+    {
+        const FileFinto& c = CARTELLA[(primo + i) % NUMERO_FILE];
+        VERIFICA(f.aggiungi(c.nome, c.dimensione, c.data));
+    }
+}
+
+static bool inOrdine(const FotoCartella& f, const char* const* atteso)
+{
+    for (int i = 0; i < f.getNumero(); i++)
+    {
+        if (strcmp(f.getNome(i), atteso[i]) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void ordini()
+{
+    const char* perNome[] = {"A.txt", "b.txt", "c.bin", "Dati.csv", "Log.csv"};
+    const char* perData[] = {"A.txt", "Log.csv", "b.txt", "Dati.csv", "c.bin"};
+    const char* perDimensione[] = {"c.bin", "Dati.csv", "Log.csv", "A.txt", "b.txt"};
+
+    FotoCartella f;
+    f.begin(voci, VOCI_PROVA, nomi, SPAZIO_PROVA);
+    VERIFICA(f.getNumero() == 0 && f.getOrdine() == ORDINE_NOME);
+    bool stabile = true;
+    for (int primo = 0; primo < NUMERO_FILE; primo++)
+    {
+        riempi(f, primo);
+        f.ordina(ORDINE_NOME);
+        stabile = stabile && inOrdine(f, perNome);
+        f.ordina(ORDINE_DATA);
+        stabile = stabile && inOrdine(f, perData);
+        f.ordina(ORDINE_DIMENSIONE);
+        stabile = stabile && inOrdine(f, perDimensione);
+    }
+    VERIFICA(stabile);
+    VERIFICA(f.getNumero() == NUMERO_FILE && f.getOmesse() == 0 && f.getOrdine() == ORDINE_DIMENSIONE);
+
+    // Dimensione e data seguono il proprio nome
+    int i = f.cerca("c.bin");
+    VERIFICA(i == 0 && f.getDimensione(i) == 9000 && f.getData(i) == 100);
+    i = f.cerca("A.txt");
+    VERIFICA(i == 3 && f.getDimensione(i) == 100 && f.getData(i) == 300);
+
+    // cerca() distingue le maiuscole, l'ordine no
+    VERIFICA(f.cerca("a.txt") == -1 && f.cerca("") == -1 && f.cerca("Assente") == -1);
+}
+
+static void omesse()
+{
+    // Voci finite: le altre si contano soltanto
+    FotoCartella f;
+    f.begin(voci, 3, nomi, SPAZIO_PROVA);
+    for (int i = 0; i < NUMERO_FILE; i++)
+        f.aggiungi(CARTELLA[i].nome, CARTELLA[i].dimensione, CARTELLA[i].data);
+    VERIFICA(f.getNumero() == 3 && f.getOmesse() == 2);
+    VERIFICA(f.cerca("Dati.csv") == -1 && f.cerca("A.txt") >= 0);
+
+    // Spazio dei nomi finito: un nome lungo non entra, uno corto dopo sì
+    char lungo[40];
+    memset(lungo, 'x', sizeof(lungo) - 1);
+    lungo[sizeof(lungo) - 1] = '\0';
+    f.begin(voci, VOCI_PROVA, nomi, 2 * sizeof(lungo) + 4);
+    VERIFICA(f.aggiungi(lungo, 1, 1) && f.aggiungi(lungo, 2, 2));
+    VERIFICA(!f.aggiungi(lungo, 3, 3));
+    VERIFICA(f.aggiungi("abc", 4, 4)); // Proprio lo spazio rimasto, terminatore compreso
+    VERIFICA(!f.aggiungi("d", 5, 5));
+    VERIFICA(f.getNumero() == 3 && f.getOmesse() == 2);
+    VERIFICA(strcmp(f.getNome(2), "abc") == 0 && f.getDimensione(2) == 4);
+
+    // Nuova lettura: tutto da capo
+    f.azzera();
+    VERIFICA(f.getNumero() == 0 && f.getOmesse() == 0 && f.aggiungi(lungo, 1, 1));
+
+    // Senza memorie non entra niente
+    FotoCartella vuota;
+    vuota.begin(nullptr, VOCI_PROVA, nomi, SPAZIO_PROVA);
+    VERIFICA(!vuota.aggiungi("a", 1, 1) && vuota.getNumero() == 0 && vuota.getOmesse() == 1);
+}
+
+static void giroDegliOrdini()
+{
+    // Come Memoria::cycleFileSort(): il puntatore al nome selezionato resta valido
+    // dopo il riordino (si spostano le voci, non i nomi) e cerca() ritrova la riga
+    FotoCartella f;
+    f.begin(voci, VOCI_PROVA, nomi, SPAZIO_PROVA);
+    riempi(f, 2);
+    f.ordina(ORDINE_NOME);
+    int selezione = f.cerca("Dati.csv");
+    VERIFICA(selezione == 3);
+    const int attese[NUMERO_ORDINI] = {3, 1, 3}; // Per data, per dimensione, di nuovo per nome
+    for (int giro = 0; giro < 2 * NUMERO_ORDINI; giro++)
+    {
+        const char* selezionato = f.getNome(selezione);
+        f.ordina((OrdineCartella)((f.getOrdine() + 1) % NUMERO_ORDINI));
+        selezione = f.cerca(selezionato);
+        VERIFICA(selezione == attese[giro % NUMERO_ORDINI] && strcmp(f.getNome(selezione), "Dati.csv") == 0);
+    }
+    VERIFICA(f.getOrdine() == ORDINE_NOME);
+
+    // Nomi uguali a meno delle maiuscole: l'ordine li mette vicini, cerca() prende quello giusto
+    VERIFICA(f.aggiungi("a.TXT", 7, 7));
+    f.ordina(ORDINE_NOME);
+    int grande = f.cerca("A.txt"), piccolo = f.cerca("a.TXT");
+    VERIFICA(grande >= 0 && piccolo >= 0 && grande + piccolo == 1);
+    VERIFICA(f.getDimensione(piccolo) == 7 && f.getDimensione(grande) == 100);
+}
+
+int main()
+{
+    ordini();
+    omesse();
+    giroDegliOrdini();
+    return fineVerifiche();
+}
@@ -0,0 +1,126 @@
+// Kicco972.net
+
+
+// Fusione IMU su PC: rigioca una registrazione di campioni (CSV nel formato di
+// CampioneImu) attraverso AssettoImu e controlla l'assetto finale, poi misura
+// il costo di un passo di FusioneAhrs a 6 e 9 assi.
+//   TestFusione [registrazione.csv pitch roll yaw]
+// Senza argomenti usa dati/ImuRotazione.csv (60 gradi attorno a X dopo la tara).
+
+#include "AssettoImu.h"
+#include "Verifica.h"
+#include <stdlib.h>
+#include <vector>
+
+#define CAMPIONI_TARA 400 // 1 s fermo prima della tara
+#define TOLLERANZA_GRADI 2.0f
+#define PASSI_BENCHMARK 1000000
+
+static bool leggiRegistrazione(const char* percorso, std::vector<CampioneImu>& campioni)
+{
+    FILE* f = fopen(percorso, "r");
+    if (!f)
+        return false;
+    char riga[160];
+    while (fgets(riga, sizeof(riga), f))
+    {
+        CampioneImu c;
+        unsigned long tempo;
+        // Commenti e intestazione non hanno 7 campi numerici
+        if (sscanf(riga, "%lu;%f;%f;%f;%f;%f;%f", &tempo, &c.ax, &c.ay, &c.az, &c.gx, &c.gy, &c.gz) != 7)
+            continue;
+        c.tempoUs = (uint32_t)tempo;
+        c.accValido = true;
+        campioni.push_back(c);
+    }
+    fclose(f);
+    return true;
+}
+
+static float differenzaAngoli(float a, float b)
+{
+    float d = fmodf(a - b + 540.0f, 360.0f) - 180.0f;
+    return fabsf(d);
+}
+
+static void verificaRegistrazione(const char* percorso, float pitch, float roll, float yaw)
+{
+    std::vector<CampioneImu> campioni;
+    VERIFICA(leggiRegistrazione(percorso, campioni));
+    VERIFICA(campioni.size() > CAMPIONI_TARA);
+    if (campioni.size() <= CAMPIONI_TARA)
+        return;
+
+    AssettoImu assetto;
+    float derivaMax = 0;
+    for (size_t i = 0; i < campioni.size(); i++)
+    {
+        assetto.fondi(campioni[i]);
+        if (i + 1 == CAMPIONI_TARA)
+        {
+            // Fermo e in piano: l'assetto assoluto non si è mosso dall'identità
+            const StatoAssetto& s = assetto.getStato();
+            derivaMax = fmaxf(fabsf(s.pitch), fabsf(s.roll));
+            assetto.tara();
+        }
+    }
+    VERIFICA(derivaMax < TOLLERANZA_GRADI);
+
+    const StatoAssetto& s = assetto.getStato();
+    const Quaternione& q = s.relativo;
+    float norma = sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    printf("%s: %zu campioni, pitch %.2f roll %.2f yaw %.2f (atteso %.1f %.1f %.1f)\n",
+           percorso, campioni.size(), s.pitch, s.roll, s.yaw, pitch, roll, yaw);
+    VERIFICA(s.campioniFusi == campioni.size());
+    VERIFICA(fabsf(norma - 1.0f) < 1e-4f);
+    VERIFICA(differenzaAngoli(s.pitch, pitch) < TOLLERANZA_GRADI);
+    VERIFICA(differenzaAngoli(s.roll, roll) < TOLLERANZA_GRADI);
+    VERIFICA(differenzaAngoli(s.yaw, yaw) < TOLLERANZA_GRADI);
+}
+
+// Il buco nella registrazione va colmato con più passi, non con uno solo
+static void verificaBuco()
+{
+    AssettoImu conBuco, senzaBuco;
+    CampioneImu c = {0, 0, 0, 1, 30, 0, 0, true};
+    for (int i = 0; i < 400; i++)
+    {
+        c.tempoUs = i * 2500;
+        senzaBuco.fondi(c);
+        if (i % 10 == 0)
+            conBuco.fondi(c); // Un campione su dieci arriva
+    }
+    VERIFICA(differenzaAngoli(conBuco.getStato().pitch, senzaBuco.getStato().pitch) < 1.0f);
+}
+
+static void benchmark()
+{
+    volatile float pozzo = 0;
+    FusioneAhrs f(FREQUENZA_FUSIONE, BETA_FUSIONE);
+
+    double t0 = adessoUs();
+    for (int i = 0; i < PASSI_BENCHMARK; i++)
+        f.aggiornaImu(0.01f * (i % 7), -0.02f, 0.03f, 0.05f, -0.02f, 0.98f);
+    double t6 = adessoUs() - t0;
+    pozzo = pozzo + f.getQuaternione().w;
+
+    t0 = adessoUs();
+    for (int i = 0; i < PASSI_BENCHMARK; i++)
+        f.aggiorna(0.01f * (i % 7), -0.02f, 0.03f, 0.05f, -0.02f, 0.98f, 22.0f, -5.0f, -40.0f);
+    double t9 = adessoUs() - t0;
+    pozzo = pozzo + f.getQuaternione().w;
+
+    printf("Fusione, %d passi: 6 assi %.1f ns/passo, 9 assi %.1f ns/passo\n",
+           PASSI_BENCHMARK, t6 * 1000.0 / PASSI_BENCHMARK, t9 * 1000.0 / PASSI_BENCHMARK);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 5)
+        verificaRegistrazione(argv[1], atof(argv[2]), atof(argv[3]), atof(argv[4]));
+    else
+        verificaRegistrazione("dati/ImuRotazione.csv", 60, 0, 0);
+    verificaBuco();
+    benchmark();
+    return fineVerifiche();
+}
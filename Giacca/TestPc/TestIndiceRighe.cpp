@@ -0,0 +1,216 @@
+// Kicco972.net
+
+
+// IndiceRighe su PC, su file veri in bin/: indice costruito a pezzi di
+// dimensione variabile (anche a metà riga e oltre il buffer da 512 byte), con
+// ogni riga raggiunta da cerca() più il salto di Memoria.cpp confrontata con
+// una lettura del file da capo con fgets(), prima e dopo che il passo raddoppia
+// (voci esaurite); righe contate a indice incompleto, ultima riga senza '\n',
+// file vuoto e file sparito.
+
+#include "IndiceRighe.h"
+#include "Verifica.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define PERCORSO_PROVA "bin/Righe.csv"
+#define RIGHE_PROVA 70000              // Passo da 8 a 64: tre raddoppi
+
+// La lettura da capo: inizio e testo di ogni riga
+struct Riferimento {
+    std::vector<long> inizi;
+    std::vector<std::string> righe;
+};
+
+// Come in Memoria.cpp (drawFileContent(), benchmarkIndice())
+static void saltaRighe(FILE* f, uint32_t righe)
+{
+    int c;
+    while (righe > 0 && (c = fgetc(f)) != EOF)
+    {
+        if (c == '\n')
+            righe--;
+    }
+}
+
+static void scriviFile(int righe, bool ultimaAperta)
+{
+    FILE* f = fopen(PERCORSO_PROVA, "wb");
+    uint32_t caso = 12345;
+    for (int i = 0; i < righe; i++)
+    {
+        caso = caso * 1103515245u + 12345u;
+        // Righe vuote, corte, e ogni tanto più lunghe del buffer di costruisci()
+        int lunghezza = (caso >> 16) % 41 == 0 ? 700 : (int)((caso >> 16) % 60);
+        std::string s = std::to_string(i) + ";";
+        if (lunghezza == 0)
+            s.clear();
+        while ((int)s.size() < lunghezza)
+            s += (char)('a' + s.size() % 26);
+        fputs(s.c_str(), f);
+        if (i < righe - 1 || !ultimaAperta)
+            fputc('\n', f);
+    }
+    fclose(f);
+}
+
+static Riferimento leggiDaCapo()
+{
+    Riferimento r;
+    FILE* f = fopen(PERCORSO_PROVA, "rb");
+    char buf[1024];
+    long inizio = 0;
+    while (fgets(buf, sizeof(buf), f))
+    {
+        r.inizi.push_back(inizio);
+        r.righe.push_back(buf);
+        inizio = ftell(f);
+    }
+    fclose(f);
+    return r;
+}
+
+// Tutte le righe coperte dall'indice, con una sola voce da cerca() e al più passo - 1 righe saltate
+static bool verificaTutte(const IndiceRighe& indice, const Riferimento& r)
+{
+    FILE* f = fopen(PERCORSO_PROVA, "rb");
+    char buf[1024];
+    int sbagliate = 0;
+    for (uint32_t riga = 0; riga < indice.getRighe(); riga++)
+    {
+        uint32_t rigaVoce;
+        long posizione = indice.cerca(riga, rigaVoce);
+        bool giusta = rigaVoce <= riga && riga - rigaVoce < indice.getPasso();
+        fseek(f, posizione, SEEK_SET);
+        saltaRighe(f, riga - rigaVoce);
+        giusta = giusta && ftell(f) == r.inizi[riga];
+        giusta = giusta && fgets(buf, sizeof(buf), f) && r.righe[riga] == buf;
+        if (!giusta && sbagliate++ < 5)
+            printf("Riga %u: voce %u a %ld, passo %u\n", riga, rigaVoce, posizione, indice.getPasso());
+    }
+    fclose(f);
+    return sbagliate == 0;
+}
+
+static uint32_t fineRigaFinoA(const Riferimento& r, long byte)
+{
+    // Righe che finiscono entro byte (con il loro '\n')
+    uint32_t n = 0;
+    while (n < r.inizi.size() && r.inizi[n] + (long)r.righe[n].size() <= byte && r.righe[n].back() == '\n')
+        n++;
+    return n;
+}
+
+static void aPezzi()
+{
+    scriviFile(RIGHE_PROVA, false);
+    Riferimento r = leggiDaCapo();
+    VERIFICA(r.righe.size() == RIGHE_PROVA);
+
+    IndiceRighe indice;
+    indice.begin(PERCORSO_PROVA);
+    VERIFICA(!indice.isCompleto() && indice.getRighe() == 0 && indice.getPasso() == PASSO_INDICE_INIZIALE);
+
+    // Pezzi da 1 byte a oltre 8 KB, che cadono dove capita rispetto alle righe
+    const long pezzi[] = {1, 7, 511, 512, 513, 100, 8192, 3000, 65536, 17};
+    int k = 0;
+    bool coerente = true, primaDelRaddoppio = false;
+    while (!indice.isCompleto())
+    {
+        uint32_t passo = indice.getPasso();
+        indice.costruisci(pezzi[k++ % 10]);
+        coerente = coerente && indice.getRighe() == fineRigaFinoA(r, indice.getByteLetti());
+        if (!primaDelRaddoppio && passo == PASSO_INDICE_INIZIALE && indice.getRighe() > RIGHE_PROVA / 8)
+        {
+            primaDelRaddoppio = true;
+            VERIFICA(verificaTutte(indice, r));
+        }
+    }
+    VERIFICA(coerente && primaDelRaddoppio);
+    VERIFICA(indice.getRighe() == RIGHE_PROVA);
+    VERIFICA(indice.getPasso() == 8 * PASSO_INDICE_INIZIALE);
+    VERIFICA(verificaTutte(indice, r));
+
+    // Oltre l'ultima riga: l'ultima voce
+    uint32_t rigaVoce;
+    long posizione = indice.cerca(RIGHE_PROVA + 1000, rigaVoce);
+    VERIFICA(rigaVoce <= RIGHE_PROVA && posizione == r.inizi[rigaVoce]);
+
+    // Completo: altri pezzi non fanno niente
+    VERIFICA(!indice.costruisci(1000) && indice.getRighe() == RIGHE_PROVA);
+}
+
+static void raddoppio()
+{
+    // Il primo raddoppio arriva proprio con la riga VOCI_INDICE_RIGHE * PASSO_INDICE_INIZIALE
+    const uint32_t soglia = VOCI_INDICE_RIGHE * PASSO_INDICE_INIZIALE;
+    scriviFile(soglia + 100, false);
+    Riferimento r = leggiDaCapo();
+    IndiceRighe indice;
+    indice.begin(PERCORSO_PROVA);
+    indice.costruisci(r.inizi[soglia - 1]);
+    VERIFICA(indice.getRighe() == soglia - 1 && indice.getPasso() == PASSO_INDICE_INIZIALE);
+    VERIFICA(verificaTutte(indice, r));
+    indice.costruisci(r.righe[soglia - 1].size());
+    VERIFICA(indice.getRighe() == soglia && indice.getPasso() == 2 * PASSO_INDICE_INIZIALE);
+    VERIFICA(verificaTutte(indice, r));
+
+    // La voce della riga soglia c'è già: la riga appena dopo si raggiunge senza salti
+    uint32_t rigaVoce;
+    VERIFICA(indice.cerca(soglia, rigaVoce) == r.inizi[soglia] && rigaVoce == soglia);
+    while (!indice.costruisci(777))
+        ;
+    VERIFICA(indice.getRighe() == soglia + 100);
+    VERIFICA(verificaTutte(indice, r));
+}
+
+static void ultimaSenzaFineRiga()
+{
+    scriviFile(1000, true);
+    Riferimento r = leggiDaCapo();
+    VERIFICA(r.righe.size() == 1000 && r.righe.back().back() != '\n');
+
+    // Letto tutto ma non ancora visto la fine: l'ultima riga potrebbe continuare
+    long dimensione = r.inizi.back() + (long)r.righe.back().size();
+    IndiceRighe indice;
+    indice.begin(PERCORSO_PROVA);
+    VERIFICA(!indice.costruisci(dimensione) && indice.getByteLetti() == dimensione);
+    VERIFICA(indice.getRighe() == 999);
+    VERIFICA(indice.costruisci(1) && indice.getRighe() == 1000);
+    VERIFICA(verificaTutte(indice, r));
+
+    // Un solo testo senza '\n', e file vuoto
+    FILE* f = fopen(PERCORSO_PROVA, "wb");
+    fputs("abc", f);
+    fclose(f);
+    indice.begin(PERCORSO_PROVA);
+    VERIFICA(indice.costruisci(100) && indice.getRighe() == 1);
+    f = fopen(PERCORSO_PROVA, "wb");
+    fclose(f);
+    indice.begin(PERCORSO_PROVA);
+    VERIFICA(indice.costruisci(100) && indice.getRighe() == 0);
+    uint32_t rigaVoce;
+    VERIFICA(indice.cerca(5, rigaVoce) == 0 && rigaVoce == 0);
+}
+
+static void fileSparito()
+{
+    scriviFile(500, false);
+    Riferimento r = leggiDaCapo();
+    IndiceRighe indice;
+    indice.begin(PERCORSO_PROVA);
+    indice.costruisci(r.inizi[300]);
+    remove(PERCORSO_PROVA);
+    // L'indice resta quello costruito fin qui
+    VERIFICA(indice.costruisci(1000) && indice.isCompleto() && indice.getRighe() == 300);
+}
+
+int main()
+{
+    aPezzi();
+    raddoppio();
+    ultimaSenzaFineRiga();
+    fileSparito();
+    return fineVerifiche();
+}
@@ -0,0 +1,154 @@
+// Kicco972.net
+
+
+// PoliticaBle su PC: un profilo più ricco si applica subito, uno più povero solo
+// dopo RITARDO_RIDUZIONE_MS di contesto stabile; passare avanti e indietro tra le
+// schermate non cambia il profilo a ogni passaggio. Poi i parametri di connessione
+// di tutti i profili devono essere accettati dal controller BLE (Core Spec, Vol 6,
+// Part B, 4.5.2): intervallo 7.5 ms - 4 s, timeout 100 ms - 32 s e maggiore del
+// doppio dell'intervallo massimo (latenza 0, come in BleNetwork::aggiornaIntervallo).
+
+#include "PoliticaBle.h"
+#include "Verifica.h"
+
+static void aumentoImmediato()
+{
+    PoliticaBle p;
+    VERIFICA(p.getContesto() == CONTESTO_BASE);
+    VERIFICA(!p.update(0));
+
+    p.setContesto(CONTESTO_BUSSOLA, 1000);
+    VERIFICA(p.update(1000));
+    VERIFICA(p.getContesto() == CONTESTO_BUSSOLA);
+    VERIFICA(p.getProfilo().periodoMagMs == PoliticaBle::profiloPer(CONTESTO_BUSSOLA).periodoMagMs);
+    VERIFICA(!p.update(1001)); // Già applicato
+
+    // Dalla memoria alla base: i dati ambientali tornano più frequenti, nessuna attesa
+    PoliticaBle m;
+    m.setContesto(CONTESTO_MEMORIA, 0);
+    m.update(RITARDO_RIDUZIONE_MS);
+    VERIFICA(m.getContesto() == CONTESTO_MEMORIA);
+    m.setContesto(CONTESTO_BASE, 10000);
+    VERIFICA(m.update(10000) && m.getContesto() == CONTESTO_BASE);
+
+    // Dall'IMU alla bussola: magnetometro più veloce, subito
+    PoliticaBle i;
+    i.setContesto(CONTESTO_IMU, 0);
+    VERIFICA(i.update(0));
+    i.setContesto(CONTESTO_BUSSOLA, 50);
+    VERIFICA(i.update(50) && i.getContesto() == CONTESTO_BUSSOLA);
+}
+
+static void riduzioneRitardata()
+{
+    PoliticaBle p;
+    p.setContesto(CONTESTO_BUSSOLA, 0);
+    p.update(0);
+
+    p.setContesto(CONTESTO_BASE, 5000);
+    VERIFICA(!p.update(5000));
+    VERIFICA(!p.update(5000 + RITARDO_RIDUZIONE_MS - 1));
+    VERIFICA(p.getContesto() == CONTESTO_BUSSOLA);
+    VERIFICA(p.update(5000 + RITARDO_RIDUZIONE_MS));
+    VERIFICA(p.getContesto() == CONTESTO_BASE);
+
+    // Dalla bussola all'IMU il magnetometro rallenta: è una riduzione
+    PoliticaBle i;
+    i.setContesto(CONTESTO_BUSSOLA, 0);
+    i.update(0);
+    i.setContesto(CONTESTO_IMU, 100);
+    VERIFICA(!i.update(100));
+    VERIFICA(i.update(100 + RITARDO_RIDUZIONE_MS) && i.getContesto() == CONTESTO_IMU);
+
+    // Un update in ritardo applica comunque l'ultimo contesto richiesto
+    PoliticaBle b;
+    b.setContesto(CONTESTO_MEMORIA, 0);
+    VERIFICA(b.update(60000) && b.getContesto() == CONTESTO_MEMORIA);
+}
+
+static void oscillazioni()
+{
+    // Avanti e indietro tra bussola e base ogni secondo per 20 s: un solo cambio
+    PoliticaBle p;
+    int cambi = 0;
+    for (unsigned long t = 0; t < 20000; t += 100)
+    {
+        if (t % 1000 == 0)
+            p.setContesto((t / 1000) % 2 == 0 ? CONTESTO_BUSSOLA : CONTESTO_BASE, t);
+        if (p.update(t))
+            cambi++;
+    }
+    VERIFICA(cambi == 1);
+    VERIFICA(p.getContesto() == CONTESTO_BUSSOLA);
+
+    // Tornare al contesto attivo annulla la riduzione in attesa; la successiva riparte da zero
+    p.setContesto(CONTESTO_BASE, 20000);
+    p.setContesto(CONTESTO_BUSSOLA, 22000);
+    VERIFICA(!p.update(23500));
+    p.setContesto(CONTESTO_BASE, 24000);
+    VERIFICA(!p.update(24000 + RITARDO_RIDUZIONE_MS - 1));
+    VERIFICA(p.update(24000 + RITARDO_RIDUZIONE_MS));
+
+    // Richiedere lo stesso contesto non sposta l'inizio dell'attesa
+    PoliticaBle q;
+    q.setContesto(CONTESTO_BUSSOLA, 0);
+    q.update(0);
+    q.setContesto(CONTESTO_MEMORIA, 1000);
+    q.setContesto(CONTESTO_MEMORIA, 2500);
+    VERIFICA(q.update(1000 + RITARDO_RIDUZIONE_MS));
+
+    // Una riduzione passa per il contesto più povero, non per quelli intermedi
+    PoliticaBle r;
+    r.setContesto(CONTESTO_BUSSOLA, 0);
+    r.update(0);
+    r.setContesto(CONTESTO_IMU, 100);
+    r.update(200);
+    r.setContesto(CONTESTO_MEMORIA, 300);
+    VERIFICA(!r.update(300 + RITARDO_RIDUZIONE_MS - 1));
+    VERIFICA(r.getContesto() == CONTESTO_BUSSOLA);
+    VERIFICA(r.update(300 + RITARDO_RIDUZIONE_MS) && r.getContesto() == CONTESTO_MEMORIA);
+}
+
+static bool parametriValidi(uint16_t intervalloMin, uint16_t intervalloMax, uint16_t timeout)
+{
+    return intervalloMin >= 6 && intervalloMax <= 3200 && intervalloMin <= intervalloMax &&
+           timeout >= 10 && timeout <= 3200 &&
+           timeout * 10.0f > 2.0f * intervalloMax * 1.25f;
+}
+
+static void timeoutDiSupervisione()
+{
+    bool ok = true;
+    for (int c = 0; c < NUM_CONTESTI_BLE; c++)
+    {
+        const ProfiloBle& p = PoliticaBle::profiloPer((ContestoBle)c);
+        bool valido = parametriValidi(p.intervalloMin, p.intervalloMax, p.timeout);
+        if (!valido)
+            printf("Profilo %s: intervallo %u-%u, timeout %u non validi\n", p.nome, p.intervalloMin, p.intervalloMax, p.timeout);
+        ok = ok && valido;
+    }
+    VERIFICA(ok);
+    VERIFICA(parametriValidi(INTERVALLO_COMANDI_MIN, INTERVALLO_COMANDI_MAX, TIMEOUT_COMANDI));
+    VERIFICA(parametriValidi(INTERVALLO_STORICO_MIN, INTERVALLO_STORICO_MAX, TIMEOUT_STORICO));
+
+    // Un timeout al limite è rifiutato: il controllo serve davvero
+    VERIFICA(!parametriValidi(160, 400, 100));
+
+    // Ogni profilo è una riduzione di se stesso, la bussola di nessun altro
+    for (int c = 0; c < NUM_CONTESTI_BLE; c++)
+    {
+        const ProfiloBle& p = PoliticaBle::profiloPer((ContestoBle)c);
+        VERIFICA(PoliticaBle::isRiduzione(p, p));
+        if (c != CONTESTO_BUSSOLA)
+            VERIFICA(!PoliticaBle::isRiduzione(p, PoliticaBle::profiloPer(CONTESTO_BUSSOLA)));
+    }
+}
+
+int main()
+{
+    aumentoImmediato();
+    riduzioneRitardata();
+    oscillazioni();
+    timeoutDiSupervisione();
+    return fineVerifiche();
+}
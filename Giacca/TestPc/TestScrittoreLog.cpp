@@ -0,0 +1,258 @@
+// Kicco972.net
+
+
+// ScrittoreLog su PC, su file veri in bin/: formattaRiga() confrontata con
+// strftime() per ogni giorno dal 1970 al 2100, valori con la virgola e celle NaN;
+// poi apri() che chiude una riga troncata (lettura e scrittura sullo stesso
+// stream "a+") e rigenera un file nel vecchio formato a virgole, fsync() solo se
+// l'apertura ha scritto qualcosa, righe perse a buffer pieno con il file che
+// non si apre, riapertura dopo abbandona() senza perdere le righe in attesa.
+
+#include "ScrittoreLog.h"
+#include "Verifica.h"
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PERCORSO_PROVA "bin/Log.csv"
+#define CARTELLA_ASSENTE "bin/LogAssente"
+#define INTESTAZIONE "Data;Ora;T;H;P\n"
+
+static std::string leggi(const char* percorso)
+{
+    std::string s;
+    FILE* f = fopen(percorso, "rb");
+    if (!f)
+        return s;
+    char buf[512];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        s.append(buf, n);
+    fclose(f);
+    return s;
+}
+
+static void scrivi(const char* percorso, const char* testo)
+{
+    FILE* f = fopen(percorso, "wb");
+    fputs(testo, f);
+    fclose(f);
+}
+
+static std::string riga(uint32_t epoch, float t)
+{
+    float valori[3] = {t, 50.0f, 101.3f};
+    char buf[RIGA_LOG_MASSIMA];
+    int n = ScrittoreLog::formattaRiga(buf, sizeof(buf), epoch, valori, 3);
+    return std::string(buf, n);
+}
+
+static bool aggiungi(ScrittoreLog& log, const std::string& r, unsigned long adessoMs)
+{
+    return log.aggiungi(r.c_str(), (int)r.size(), adessoMs);
+}
+
+static void dataEOra()
+{
+    // Ogni giorno dal 1/1/1970 al 31/12/2099, a mezzanotte, alle 23:59:59 e a un'ora che cambia
+    int sbagliate = 0;
+    const uint32_t fine = 4102444800u; // 1/1/2100
+    for (uint32_t giorno = 0; giorno * 86400u < fine; giorno++)
+    {
+        const uint32_t secondi[3] = {0, 86399, (giorno * 3607u) % 86400};
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t epoch = giorno * 86400u + secondi[k];
+            time_t t = (time_t)epoch;
+            struct tm tm;
+            gmtime_r(&t, &tm);
+            char atteso[32];
+            strftime(atteso, sizeof(atteso), "%d/%m/%Y;%H:%M:%S\n", &tm);
+            char buf[32];
+            int n = ScrittoreLog::formattaRiga(buf, sizeof(buf), epoch, nullptr, 0);
+            if (n != (int)strlen(atteso) || memcmp(buf, atteso, n) != 0)
+            {
+                if (sbagliate++ < 5)
+                    printf("Epoch %u: \"%.*s\" invece di \"%s\"\n", epoch, n, buf, atteso);
+            }
+        }
+    }
+    VERIFICA(sbagliate == 0);
+
+    // Giorni particolari
+    VERIFICA(riga(951782400u, 0).compare(0, 20, "29/02/2000;00:00:00;") == 0); // 2000 bisestile
+    VERIFICA(riga(4107542400u, 0).compare(0, 20, "01/03/2100;00:00:00;") == 0); // 2100 no
+    VERIFICA(riga(0xFFFFFFFFu, 0).compare(0, 20, "07/02/2106;06:28:15;") == 0); // Ultimo secondo a 32 bit
+}
+
+static void valori()
+{
+    float v[6] = {21.456f, -3.2f, 0.0f, 1013.25f, NAN, 3.0e7f};
+    char buf[RIGA_LOG_MASSIMA + 32];
+    int n = ScrittoreLog::formattaRiga(buf, sizeof(buf), 1735732800u, v, 6);
+    VERIFICA(std::string(buf, n) == "01/01/2025;12:00:00;21,46;-3,20;0,00;1013,25;nan;nan\n");
+
+    // Il caso peggiore sta nella riga dichiarata
+    float estremi[3] = {-2.0e7f, -2.0e7f, -2.0e7f};
+    n = ScrittoreLog::formattaRiga(buf, RIGA_LOG_MASSIMA, 0xFFFFFFFFu, estremi, 3);
+    VERIFICA(n > 0 && n <= RIGA_LOG_MASSIMA && buf[n - 1] == '\n');
+    VERIFICA(std::string(buf, n).find("-20000000,00") != std::string::npos);
+
+    // Buffer troppo piccolo: niente riga
+    VERIFICA(ScrittoreLog::formattaRiga(buf, 20, 0, v, 0) == 0);
+    VERIFICA(ScrittoreLog::formattaRiga(buf, 20 + 3 * 14, 0, v, 3) == 0);
+}
+
+static void fileNuovo()
+{
+    remove(PERCORSO_PROVA);
+    ScrittoreLog log;
+    log.begin(PERCORSO_PROVA, INTESTAZIONE);
+    std::string a = riga(1735689600u, 20.0f), b = riga(1735689601u, 20.5f);
+    VERIFICA(aggiungi(log, a, 0) && aggiungi(log, b, 100));
+    VERIFICA(!log.isAperto() && log.getInAttesa() == (int)(a.size() + b.size()));
+
+    // Nessuna scrittura prima di ATTESA_MASSIMA_LOG_MS dalla prima riga
+    log.update(ATTESA_MASSIMA_LOG_MS - 1);
+    VERIFICA(log.getInAttesa() > 0 && leggi(PERCORSO_PROVA).empty());
+    log.update(ATTESA_MASSIMA_LOG_MS);
+    VERIFICA(log.getInAttesa() == 0 && log.isAperto());
+    VERIFICA(log.sincronizza(ATTESA_MASSIMA_LOG_MS));
+    VERIFICA(leggi(PERCORSO_PROVA) == INTESTAZIONE + a + b);
+    VERIFICA(log.getStatistiche().righe == 2 && log.getStatistiche().scritture == 1);
+    VERIFICA(log.getStatistiche().sincronizzazioni == 1);
+    VERIFICA(log.chiudi(3000) && !log.isAperto());
+}
+
+static void rigaTroncata()
+{
+    // Una rimozione a metà scrittura ha lasciato l'ultima riga senza '\n'
+    std::string a = riga(1735689600u, 20.0f), b = riga(1735689601u, 21.0f);
+    std::string troncata = a.substr(0, 17);
+    scrivi(PERCORSO_PROVA, (INTESTAZIONE + a + troncata).c_str());
+    ScrittoreLog log;
+    log.begin(PERCORSO_PROVA, INTESTAZIONE);
+    VERIFICA(aggiungi(log, b, 0));
+    VERIFICA(log.sincronizza(0));
+    VERIFICA(leggi(PERCORSO_PROVA) == INTESTAZIONE + a + troncata + "\n" + b);
+    VERIFICA(log.chiudi(0));
+
+    // File già chiuso da '\n': nessuna riga vuota, e nessun fsync() per un'apertura che non scrive
+    std::string prima = leggi(PERCORSO_PROVA);
+    ScrittoreLog pulito;
+    pulito.begin(PERCORSO_PROVA, INTESTAZIONE);
+    VERIFICA(pulito.sincronizza(0) && pulito.isAperto());
+    VERIFICA(pulito.getStatistiche().sincronizzazioni == 0);
+    VERIFICA(aggiungi(pulito, a, 0) && pulito.sincronizza(0));
+    VERIFICA(leggi(PERCORSO_PROVA) == prima + a);
+    VERIFICA(pulito.getStatistiche().sincronizzazioni == 1);
+    VERIFICA(pulito.chiudi(0));
+
+    // Una riga chiusa dall'apertura va sincronizzata anche senza righe nuove
+    scrivi(PERCORSO_PROVA, (INTESTAZIONE + troncata).c_str());
+    ScrittoreLog riparato;
+    riparato.begin(PERCORSO_PROVA, INTESTAZIONE);
+    VERIFICA(riparato.sincronizza(0) && riparato.getStatistiche().sincronizzazioni == 1);
+    VERIFICA(leggi(PERCORSO_PROVA) == INTESTAZIONE + troncata + "\n");
+    VERIFICA(riparato.chiudi(0));
+}
+
+static void vecchioFormato()
+{
+    // Il vecchio logData() scriveva con le virgole: il file si rigenera
+    scrivi(PERCORSO_PROVA, "Data,Ora,Temperatura\n01/01/2024,10:00:00,21.5\n");
+    std::string a = riga(1735689600u, 20.0f);
+    ScrittoreLog log;
+    log.begin(PERCORSO_PROVA, INTESTAZIONE);
+    VERIFICA(aggiungi(log, a, 0) && log.sincronizza(0));
+    VERIFICA(leggi(PERCORSO_PROVA) == INTESTAZIONE + a);
+    VERIFICA(log.chiudi(0));
+
+    // Una riga con virgole decimali e punti e virgola è già nel formato nuovo
+    ScrittoreLog nuovo;
+    nuovo.begin(PERCORSO_PROVA, INTESTAZIONE);
+    VERIFICA(aggiungi(nuovo, a, 0) && nuovo.sincronizza(0));
+    VERIFICA(leggi(PERCORSO_PROVA) == INTESTAZIONE + a + a);
+    VERIFICA(nuovo.chiudi(0));
+}
+
+static void bufferPieno()
+{
+    // La cartella non c'è: il file non si apre, le righe restano in RAM finché c'è posto
+    rmdir(CARTELLA_ASSENTE);
+    ScrittoreLog log;
+    log.begin(CARTELLA_ASSENTE "/Log.csv", INTESTAZIONE);
+    std::string r = riga(1735689600u, 20.0f);
+    int accodate = 0;
+    while (aggiungi(log, r, 0))
+        accodate++;
+    VERIFICA(accodate == DIMENSIONE_BUFFER_LOG / (int)r.size());
+    VERIFICA(log.getStatistiche().perse == 1 && log.getStatistiche().errori == 1);
+
+    // Niente nuovi tentativi prima di RIPROVA_LOG_MS
+    VERIFICA(!aggiungi(log, r, RIPROVA_LOG_MS - 1));
+    VERIFICA(log.getStatistiche().perse == 2 && log.getStatistiche().errori == 1);
+    VERIFICA(!aggiungi(log, r, RIPROVA_LOG_MS));
+    VERIFICA(log.getStatistiche().perse == 3 && log.getStatistiche().errori == 2);
+    VERIFICA(!log.chiudi(RIPROVA_LOG_MS));
+
+    // La cartella torna: alla riapertura le righe in attesa arrivano tutte, le perse no
+    VERIFICA(mkdir(CARTELLA_ASSENTE, 0755) == 0);
+    VERIFICA(aggiungi(log, r, 2 * RIPROVA_LOG_MS));
+    VERIFICA(log.sincronizza(2 * RIPROVA_LOG_MS));
+    std::string atteso = INTESTAZIONE;
+    for (int i = 0; i <= accodate; i++)
+        atteso += r;
+    VERIFICA(leggi(CARTELLA_ASSENTE "/Log.csv") == atteso);
+    VERIFICA(log.getStatistiche().righe == (uint32_t)accodate + 1);
+    VERIFICA(log.chiudi(2 * RIPROVA_LOG_MS));
+    remove(CARTELLA_ASSENTE "/Log.csv");
+    rmdir(CARTELLA_ASSENTE);
+
+    // Riga più lunga del buffer: rifiutata subito
+    static char lunga[DIMENSIONE_BUFFER_LOG + 1];
+    memset(lunga, 'x', sizeof(lunga));
+    VERIFICA(!log.aggiungi(lunga, sizeof(lunga), 0) && !log.aggiungi(lunga, 0, 0));
+}
+
+static void dopoAbbandona()
+{
+    remove(PERCORSO_PROVA);
+    ScrittoreLog log;
+    log.begin(PERCORSO_PROVA, INTESTAZIONE);
+    std::string a = riga(1735689600u, 20.0f), b = riga(1735689601u, 21.0f), c = riga(1735689602u, 22.0f);
+    VERIFICA(aggiungi(log, a, 0) && log.sincronizza(0));
+
+    // Supporto tolto con una riga in attesa; prima di sparire ne aveva scritta metà di un'altra
+    VERIFICA(aggiungi(log, b, 100));
+    log.abbandona();
+    VERIFICA(!log.isAperto() && log.getInAttesa() == (int)b.size());
+    FILE* f = fopen(PERCORSO_PROVA, "ab");
+    fputs("01/01/20", f);
+    fclose(f);
+
+    // Al ritorno la riga a metà si chiude e quelle in attesa si scrivono
+    VERIFICA(aggiungi(log, c, 5000));
+    log.update(5000 + ATTESA_MASSIMA_LOG_MS);
+    VERIFICA(log.isAperto() && log.getInAttesa() == 0);
+    VERIFICA(log.sincronizza(5000 + ATTESA_MASSIMA_LOG_MS));
+    VERIFICA(leggi(PERCORSO_PROVA) == INTESTAZIONE + a + "01/01/20\n" + b + c);
+    VERIFICA(log.getStatistiche().errori == 0);
+    VERIFICA(log.chiudi(9000));
+    remove(PERCORSO_PROVA);
+}
+
+int main()
+{
+    dataEOra();
+    valori();
+    fileNuovo();
+    rigaTroncata();
+    vecchioFormato();
+    bufferPieno();
+    dopoAbbandona();
+    return fineVerifiche();
+}
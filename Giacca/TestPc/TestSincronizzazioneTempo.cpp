@@ -0,0 +1,253 @@
+// Kicco972.net
+
+
+// SincronizzazioneTempo su PC, su un collegamento simulato al millisecondo: il
+// Master ha l'ora vera, la periferica un millis() che parte da un valore scelto
+// e avanza con l'errore del suo quarzo (ppm); andata e ritorno hanno ritardi
+// fissi o casuali. Si controllano l'errore di epochDa() con percorso simmetrico e
+// asimmetrico (metà della differenza, come per l'NTP), la scelta dello scambio
+// più rapido della raffica, le risposte perse o in ritardo (timeout in
+// richiesta()), il segno e il valore di getDerivaPpm(), l'errore di previsione
+// e il giro del millis() della periferica, anche a metà raffica e a metà base
+// della deriva.
+
+#include "SincronizzazioneTempo.h"
+#include "Verifica.h"
+#include <math.h>
+#include <random>
+
+#define ORA_ZERO_MS 1735689600000ULL
+
+struct Collegamento {
+    double ppm = 0;                 // Positivo = quarzo della periferica in anticipo
+    uint64_t millisZero = 0;        // millis() della periferica all'istante 0
+    unsigned long andataMin = 15, andataMax = 15;
+    unsigned long ritornoMin = 15, ritornoMax = 15;
+    unsigned long nellaPeriferica = 2;
+    int perdiDa = -1, perdiA = -1;  // Scambi (contati dal primo) senza risposta
+    int lentoDa = -1;               // Scambio la cui risposta arriva dopo il timeout
+    std::mt19937 caso{12345};
+
+    uint32_t millisPeriferica(unsigned long t) const
+    {
+        return (uint32_t)(millisZero + (uint64_t)floor(t * (1.0 + ppm * 1e-6)));
+    }
+
+    unsigned long ritardo(unsigned long minimo, unsigned long massimo)
+    {
+        return minimo + caso() % (massimo - minimo + 1);
+    }
+};
+
+struct Simulazione {
+    SincronizzazioneTempo s;
+    Collegamento c;
+    unsigned long t = 0;
+    int scambi = 0;
+    bool inArrivo = false;
+    unsigned long arrivo = 0;
+    uint8_t risposta[RISPOSTA_TEMPO_DIMENSIONE];
+    int64_t peggiore = 0;           // Errore massimo di epochDa() da misuraDa in poi [ms]
+    unsigned long misuraDa = ~0ul;
+
+    int64_t errore(unsigned long istante) const
+    {
+        return (int64_t)s.epochDa(c.millisPeriferica(istante)) - (int64_t)(ORA_ZERO_MS + istante);
+    }
+
+    void avanza(unsigned long fine)
+    {
+        for (; t < fine; t++)
+        {
+            if (inArrivo && arrivo == t)
+            {
+                inArrivo = false;
+                s.risposta(risposta, sizeof(risposta), ORA_ZERO_MS + t, t);
+            }
+
+            uint8_t buf[RICHIESTA_TEMPO_DIMENSIONE];
+            int lunghezza = 0;
+            if (s.richiesta(t, ORA_ZERO_MS + t, buf, lunghezza))
+            {
+                // La periferica come lo sketch del Sense: T2 alla ricezione, T3 all'invio
+                RichiestaTempo r = {};
+                VERIFICA(decodificaRichiestaTempo(buf, lunghezza, r));
+                unsigned long ricevuta = t + c.ritardo(c.andataMin, c.andataMax);
+                unsigned long inviata = ricevuta + c.nellaPeriferica;
+                RispostaTempo a = {r.sequenza, r.t1, c.millisPeriferica(ricevuta), c.millisPeriferica(inviata)};
+                codificaRispostaTempo(a, risposta, sizeof(risposta));
+                arrivo = inviata + c.ritardo(c.ritornoMin, c.ritornoMax);
+                if (scambi == c.lentoDa)
+                    arrivo = t + TIMEOUT_SCAMBIO_MS + 200;
+                inArrivo = !(scambi >= c.perdiDa && scambi <= c.perdiA);
+                scambi++;
+            }
+
+            if (t >= misuraDa && t % 10 == 0 && s.isSincronizzata())
+            {
+                int64_t e = errore(t);
+                if (llabs(e) > llabs(peggiore))
+                    peggiore = e;
+            }
+        }
+    }
+};
+
+static void percorsoSimmetrico()
+{
+    Simulazione z;
+    z.c.millisZero = 123456;
+    VERIFICA(!z.s.isSincronizzata());
+    z.avanza(5000);
+    VERIFICA(z.s.isSincronizzata() && z.s.getSincronizzazioni() == 1 && z.s.getScambiPersi() == 0);
+    VERIFICA(z.s.getRitardoMs() == 30);
+    VERIFICA(llabs(z.errore(z.t)) <= 1);
+
+    // Raffiche ogni PERIODO_SINCRONIZZAZIONE_MS
+    z.avanza(5 * PERIODO_SINCRONIZZAZIONE_MS);
+    VERIFICA(z.s.getSincronizzazioni() == 5);
+    VERIFICA(z.scambi == 5 * CAMPIONI_SINCRONIZZAZIONE);
+    VERIFICA(abs(z.s.getErroreUs()) <= 1000 && z.s.getDerivaPpm() == 0);
+}
+
+static void percorsoAsimmetrico()
+{
+    // Andata 5 ms, ritorno 25 ms: lo scarto stimato sbaglia di (ritorno - andata) / 2 = 10 ms
+    Simulazione z;
+    z.c.andataMin = z.c.andataMax = 5;
+    z.c.ritornoMin = z.c.ritornoMax = 25;
+    z.avanza(5000);
+    int64_t e = z.errore(z.t);
+    VERIFICA(e >= 9 && e <= 11);
+    printf("Asimmetrico 5/25 ms: errore %lld ms (atteso 10)\n", (long long)e);
+
+    // Ritardi casuali: vale lo scambio più rapido, e l'errore non supera metà del suo ritardo
+    Simulazione r;
+    r.c.andataMin = r.c.ritornoMin = 8;
+    r.c.andataMax = r.c.ritornoMax = 60;
+    r.avanza(5000);
+    VERIFICA(r.s.isSincronizzata());
+    VERIFICA(r.s.getRitardoMs() <= 2 * 60);
+    VERIFICA(llabs(r.errore(r.t)) <= (int64_t)r.s.getRitardoMs() / 2 + 1);
+    int migliori = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        r.avanza(r.t + PERIODO_SINCRONIZZAZIONE_MS);
+        migliori += r.s.getRitardoMs() < 68 ? 1 : 0; // Il minimo di 4 scambi sta quasi sempre sotto la media (68 ms)
+        VERIFICA(llabs(r.errore(r.t)) <= (int64_t)r.s.getRitardoMs() / 2 + 1);
+    }
+    VERIFICA(migliori >= 15);
+}
+
+static void rispostePerse()
+{
+    // Timeout: nessuna nuova richiesta prima di TIMEOUT_SCAMBIO_MS, poi si passa al prossimo scambio
+    SincronizzazioneTempo s;
+    uint8_t buf[RICHIESTA_TEMPO_DIMENSIONE];
+    int lunghezza = 0;
+    VERIFICA(s.richiesta(0, ORA_ZERO_MS, buf, lunghezza) && lunghezza == RICHIESTA_TEMPO_DIMENSIONE);
+    VERIFICA(!s.richiesta(TIMEOUT_SCAMBIO_MS - 1, ORA_ZERO_MS, buf, lunghezza));
+    VERIFICA(s.richiesta(TIMEOUT_SCAMBIO_MS, ORA_ZERO_MS, buf, lunghezza));
+    VERIFICA(s.getScambiPersi() == 1);
+
+    // Uno scambio perso su quattro: la raffica conclude lo stesso
+    Simulazione z;
+    z.c.perdiDa = z.c.perdiA = 1;
+    z.avanza(5000);
+    VERIFICA(z.s.isSincronizzata() && z.s.getScambiPersi() == 1);
+    VERIFICA(llabs(z.errore(z.t)) <= 1);
+
+    // Ultimo scambio perso: la raffica si chiude al timeout
+    Simulazione u;
+    u.c.perdiDa = u.c.perdiA = CAMPIONI_SINCRONIZZAZIONE - 1;
+    u.avanza(5000);
+    VERIFICA(u.s.isSincronizzata() && u.s.getSincronizzazioni() == 1 && u.s.getScambiPersi() == 1);
+
+    // Tutta la prima raffica persa: non sincronizzata, si riprova al periodo successivo
+    Simulazione p;
+    p.c.perdiDa = 0;
+    p.c.perdiA = CAMPIONI_SINCRONIZZAZIONE - 1;
+    p.avanza(PERIODO_SINCRONIZZAZIONE_MS);
+    VERIFICA(!p.s.isSincronizzata() && p.s.getScambiPersi() == CAMPIONI_SINCRONIZZAZIONE);
+    VERIFICA(p.scambi == CAMPIONI_SINCRONIZZAZIONE);
+    p.avanza(PERIODO_SINCRONIZZAZIONE_MS + 5000);
+    VERIFICA(p.s.isSincronizzata() && llabs(p.errore(p.t)) <= 1);
+
+    // Risposta dopo il timeout: è di una richiesta vecchia e si scarta
+    Simulazione l;
+    l.c.lentoDa = 0;
+    l.avanza(6000);
+    VERIFICA(l.s.isSincronizzata() && l.s.getScambiPersi() == 1);
+    VERIFICA(llabs(l.errore(l.t)) <= 1);
+
+    // Risposta con T1 diverso da quello della richiesta
+    SincronizzazioneTempo v;
+    VERIFICA(v.richiesta(0, ORA_ZERO_MS, buf, lunghezza));
+    RichiestaTempo r = {};
+    VERIFICA(decodificaRichiestaTempo(buf, lunghezza, r));
+    RispostaTempo a = {r.sequenza, r.t1 + 1, 1000, 1002};
+    uint8_t risposta[RISPOSTA_TEMPO_DIMENSIONE];
+    codificaRispostaTempo(a, risposta, sizeof(risposta));
+    VERIFICA(!v.risposta(risposta, sizeof(risposta), ORA_ZERO_MS + 30, 30));
+    VERIFICA(!v.risposta(risposta, RISPOSTA_TEMPO_DIMENSIONE - 1, ORA_ZERO_MS + 30, 30));
+}
+
+// 40 minuti con ritardi BLE casuali: deriva stimata, errore di previsione e caso peggiore
+static void deriva(double ppm, uint64_t millisZero)
+{
+    Simulazione z;
+    z.c.ppm = ppm;
+    z.c.millisZero = millisZero;
+    z.c.andataMin = z.c.ritornoMin = 8;
+    z.c.andataMax = z.c.ritornoMax = 45;
+    z.avanza(BASE_DERIVA_MS + 60000);
+    VERIFICA(z.s.getDerivaPpm() != 0); // Prima misura dopo BASE_DERIVA_MS
+    z.misuraDa = z.t;
+    z.avanza(40 * 60000);
+    float stimata = z.s.getDerivaPpm();
+    VERIFICA((stimata > 0) == (ppm > 0));
+    VERIFICA(fabs(stimata - ppm) < 8);
+    VERIFICA(abs(z.s.getErroreUs()) < 30000);
+    VERIFICA(llabs(z.peggiore) <= 45);
+    printf("Quarzo %+.0f ppm%s: stimati %+.1f ppm, ultimo errore di previsione %.1f ms, errore peggiore %lld ms\n",
+           ppm, millisZero > 0xF0000000u ? " (giro di millis)" : "", stimata, z.s.getErroreUs() / 1000.0f, (long long)z.peggiore);
+}
+
+// Il millis() della periferica fa il giro dei 32 bit
+static void giroDiMillis()
+{
+    // Tra due raffiche: epochDa() per istanti prima e dopo il giro con la stessa stima
+    Simulazione z;
+    z.c.millisZero = 0x100000000ULL - 20000;
+    z.avanza(5000);
+    VERIFICA(z.s.isSincronizzata());
+    bool ok = true;
+    for (unsigned long t = 15000; t < 25000; t += 7)
+        ok = ok && llabs(z.errore(t)) <= 1;
+    VERIFICA(ok);
+    z.misuraDa = 0;
+    z.avanza(120000);
+    VERIFICA(z.s.getSincronizzazioni() == 4 && llabs(z.peggiore) <= 1);
+
+    // A metà raffica, e anche a metà di uno scambio (T2 prima del giro, T3 dopo)
+    Simulazione m;
+    m.c.millisZero = 0x100000000ULL - 16;
+    m.misuraDa = 0;
+    m.avanza(PERIODO_SINCRONIZZAZIONE_MS + 5000);
+    VERIFICA(m.s.getSincronizzazioni() == 2 && llabs(m.peggiore) <= 1);
+
+    // Un campione marcato poco prima del giro e convertito dopo la raffica successiva
+    VERIFICA(llabs(m.errore(5)) <= 1);
+}
+
+int main()
+{
+    percorsoSimmetrico();
+    percorsoAsimmetrico();
+    rispostePerse();
+    deriva(-35, 0);
+    deriva(+50, 777);
+    deriva(-35, 0x100000000ULL - 15 * 60000); // Giro a metà della base della deriva
+    giroDiMillis();
+    return fineVerifiche();
+}
@@ -0,0 +1,199 @@
+// Kicco972.net
+
+
+// StatisticheBle su PC: frequenza sulla finestra di FINESTRA_FREQUENZA_MS,
+// intervallo medio e jitter (RFC 3550) con arrivi regolari e irregolari, primo
+// intervallo di una nuova connessione ignorato, trame perse e buchi, anello
+// RSSI oltre CAMPIONI_RSSI con la somma corrente confrontata con un ricalcolo,
+// azzeramento che conserva la connessione in corso e indici fuori tabella.
+
+#include "StatisticheBle.h"
+#include "Verifica.h"
+#include <math.h>
+
+static void frequenza()
+{
+    StatisticheBle s;
+    s.connessa(0, 0);
+    // 25 Hz per 1 s, poi 10 Hz per 1 s
+    for (unsigned long t = 0; t < 1000; t += 40)
+        s.notifica(0, 0, t);
+    s.update(999);
+    VERIFICA(s.getPeriferica(0).caratteristiche[0].frequenzaHz == 0); // Finestra non ancora chiusa
+    s.update(1000);
+    VERIFICA(fabsf(s.getPeriferica(0).caratteristiche[0].frequenzaHz - 25.0f) < 0.01f);
+    for (unsigned long t = 1000; t < 2000; t += 100)
+        s.notifica(0, 0, t);
+    s.update(2000);
+    const StatisticaCaratteristica& c = s.getPeriferica(0).caratteristiche[0];
+    VERIFICA(fabsf(c.frequenzaHz - 10.0f) < 0.01f);
+    VERIFICA(c.notifiche == 35 && c.notificheFinestra == 0);
+
+    // Update in ritardo: la frequenza si divide per la durata vera della finestra
+    for (unsigned long t = 2000; t < 3000; t += 100)
+        s.notifica(0, 0, t);
+    s.update(4000);
+    VERIFICA(fabsf(s.getPeriferica(0).caratteristiche[0].frequenzaHz - 5.0f) < 0.01f);
+    VERIFICA(s.getPeriferica(0).caratteristiche[1].frequenzaHz == 0);
+}
+
+static void jitter()
+{
+    StatisticheBle s;
+    s.connessa(1, 0);
+    // Arrivi regolari ogni 50 ms: intervallo 50, jitter 0
+    unsigned long t = 0;
+    for (int i = 0; i < 100; i++, t += 50)
+        s.notifica(1, 2, t);
+    const StatisticaCaratteristica& c = s.getPeriferica(1).caratteristiche[2];
+    VERIFICA(c.intervalloMs == 50.0f && c.jitterMs == 0.0f);
+
+    // Alternati 40 e 60 ms: la media resta vicina a 50, il jitter converge a |scarto| medio,
+    // con la stessa ricorrenza di RFC 3550 (J += (|D| - J) / 16) calcolata qui a parte
+    float media = c.intervalloMs, atteso = c.jitterMs;
+    for (int i = 0; i < 400; i++)
+    {
+        unsigned long passo = i % 2 == 0 ? 40 : 60;
+        t += passo;
+        s.notifica(1, 2, t);
+        float scarto = passo - media;
+        media += scarto / 8.0f;
+        atteso += (fabsf(scarto) - atteso) / 16.0f;
+    }
+    VERIFICA(fabsf(c.intervalloMs - media) < 1e-3f && fabsf(c.jitterMs - atteso) < 1e-3f);
+    VERIFICA(fabsf(c.intervalloMs - 50.0f) < 2.0f);
+    VERIFICA(c.jitterMs > 9.0f && c.jitterMs < 11.0f);
+    printf("Arrivi 40/60 ms: intervallo %.2f ms, jitter %.2f ms\n", c.intervalloMs, c.jitterMs);
+}
+
+static void riconnessione()
+{
+    StatisticheBle s;
+    s.connessa(0, 0);
+    for (unsigned long t = 0; t <= 1000; t += 100)
+        s.notifica(0, 0, t);
+    s.disconnessa(0, 1000);
+    VERIFICA(!s.getPeriferica(0).connessa);
+    VERIFICA(s.getTempoConnessoMs(0, 5000) == 1000);
+
+    // 30 s scollegata: il primo arrivo della nuova connessione non è un intervallo di 30 s
+    s.connessa(0, 31000);
+    VERIFICA(!s.getPeriferica(0).caratteristiche[0].arrivoValido);
+    s.notifica(0, 0, 31050);
+    const StatisticaCaratteristica& c = s.getPeriferica(0).caratteristiche[0];
+    VERIFICA(c.intervalloMs == 100.0f && c.jitterMs == 0.0f);
+    s.notifica(0, 0, 31150);
+    VERIFICA(c.intervalloMs == 100.0f && c.jitterMs == 0.0f);
+    VERIFICA(s.getPeriferica(0).connessioni == 2);
+    VERIFICA(s.getTempoConnessoMs(0, 32000) == 2000);
+
+    // Disconnessione ripetuta: contata una volta sola
+    s.disconnessa(0, 32000);
+    s.disconnessa(0, 40000);
+    VERIFICA(s.getTempoConnessoMs(0, 50000) == 2000);
+
+    // Trame perse: totale e buchi
+    s.perse(0, 3);
+    s.perse(0, 0);
+    s.perse(0, 1);
+    VERIFICA(s.getPeriferica(0).perse == 4 && s.getPeriferica(0).buchi == 2);
+}
+
+static void anelloRssi()
+{
+    StatisticheBle s;
+    VERIFICA(!s.haRssi(0) && s.getRssiMedio(0) == RSSI_NON_VALIDO && s.getRssiUltimo(0) == RSSI_NON_VALIDO);
+
+    // Letture fallite o fuori scala: ignorate
+    s.campioneRssi(0, RSSI_NON_VALIDO);
+    s.campioneRssi(0, 0);
+    s.campioneRssi(0, -129);
+    VERIFICA(!s.haRssi(0));
+
+    // Tre giri dell'anello: somma corrente uguale a quella ricalcolata, sempre
+    bool coerente = true;
+    for (int i = 0; i < 3 * CAMPIONI_RSSI + 5; i++)
+    {
+        int rssi = -40 - (i * 7) % 50;
+        s.campioneRssi(0, rssi);
+        const StatisticaPeriferica& p = s.getPeriferica(0);
+        int somma = 0;
+        for (int k = 0; k < p.numRssi; k++)
+            somma += p.rssi[k];
+        coerente = coerente && somma == p.sommaRssi && s.getRssiUltimo(0) == rssi;
+    }
+    VERIFICA(coerente);
+    VERIFICA(s.getPeriferica(0).numRssi == CAMPIONI_RSSI);
+
+    // Ultimi CAMPIONI_RSSI: minimo e media arrotondata
+    int somma = 0, minimo = 0;
+    for (int i = 2 * CAMPIONI_RSSI + 5; i < 3 * CAMPIONI_RSSI + 5; i++)
+    {
+        int rssi = -40 - (i * 7) % 50;
+        somma += rssi;
+        if (rssi < minimo)
+            minimo = rssi;
+    }
+    VERIFICA(s.getRssiMinimo(0) == minimo);
+    VERIFICA(s.getRssiMedio(0) == (int)lroundf((float)somma / CAMPIONI_RSSI));
+
+    // Il caso peggiore (-128 su tutto l'anello) sta nella somma a 16 bit
+    for (int i = 0; i < CAMPIONI_RSSI; i++)
+        s.campioneRssi(1, -128);
+    VERIFICA(s.getRssiMedio(1) == -128 && s.getRssiMinimo(1) == -128);
+}
+
+static void azzeramento()
+{
+    StatisticheBle s;
+    s.connessa(0, 0);
+    s.connessa(1, 0);
+    s.disconnessa(1, 500);
+    for (unsigned long t = 0; t < 1000; t += 100)
+        s.notifica(0, 0, t);
+    s.perse(0, 5);
+    s.campioneRssi(0, -60);
+
+    s.azzera(10000);
+    const StatisticaPeriferica& p = s.getPeriferica(0);
+    VERIFICA(p.connessa && p.connessioni == 1 && p.perse == 0 && p.buchi == 0);
+    VERIFICA(p.caratteristiche[0].notifiche == 0 && !p.caratteristiche[0].arrivoValido);
+    VERIFICA(!s.haRssi(0));
+    VERIFICA(s.getTempoConnessoMs(0, 12000) == 2000); // Da adesso, non dall'inizio della connessione
+    VERIFICA(!s.getPeriferica(1).connessa && s.getPeriferica(1).connessioni == 0);
+    VERIFICA(s.getTempoConnessoMs(1, 12000) == 0);
+
+    // La finestra della frequenza riparte dall'azzeramento
+    s.notifica(0, 0, 10100);
+    s.update(10999);
+    VERIFICA(p.caratteristiche[0].notificheFinestra == 1);
+    s.update(11000);
+    VERIFICA(fabsf(p.caratteristiche[0].frequenzaHz - 1.0f) < 0.01f);
+}
+
+static void fuoriTabella()
+{
+    StatisticheBle s;
+    s.connessa(-1, 0);
+    s.connessa(MAX_PERIFERICHE_BLE, 0);
+    s.notifica(0, MAX_CARATTERISTICHE_TIPO, 0);
+    s.notifica(0, -1, 0);
+    s.campioneRssi(MAX_PERIFERICHE_BLE, -50);
+    VERIFICA(s.getPeriferica(MAX_PERIFERICHE_BLE).connessioni == 0);
+    VERIFICA(s.getTempoConnessoMs(-1, 1000) == 0 && !s.haRssi(MAX_PERIFERICHE_BLE));
+    uint32_t notifiche = 0;
+    for (int k = 0; k < MAX_CARATTERISTICHE_TIPO; k++)
+        notifiche += s.getPeriferica(0).caratteristiche[k].notifiche;
+    VERIFICA(notifiche == 0);
+}
+
+int main()
+{
+    frequenza();
+    jitter();
+    riconnessione();
+    anelloRssi();
+    azzeramento();
+    fuoriTabella();
+    return fineVerifiche();
+}
@@ -0,0 +1,358 @@
+// Kicco972.net
+
+
+// Recupero dell'arretrato del Sense su PC: TrasmettitoreStorico (Sense) e
+// RicevitoreStorico + UnioneStorico (Master) collegati da un finto collegamento
+// BLE che perde, rovina e riordina i pacchetti e perde le conferme. Il lato Master
+// ripete i passi di BleNetwork::aggiornaStorico(). Alla fine l'archivio deve
+// contenere tutti i campioni una volta sola, in ordine e con i valori giusti
+// (NaN compresi); per ogni prova si stampano i byte al secondo del trasferimento.
+//   1) collegamento pulito
+//   2) perdite, CRC errati, riordino e conferme perse
+//   3) conferma di STORICO_FINE persa
+//   4) trasferimento interrotto a metà e ripetuto: i doppioni si scartano e la
+//      diretta arrivata durante il primo tentativo aspetta la fine del secondo
+
+#include "TrasmettitoreStorico.h"
+#include "RicevitoreStorico.h"
+#include "UnioneStorico.h"
+#include "Verifica.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+#define CAMPIONI 2000
+#define SENSE_INIZIO_MS 100000000UL    // millis() del Sense alla connessione
+#define EPOCH_INIZIO 1760000000UL      // Ora del Master alla connessione
+#define EVENTO_MS 8                    // Intervallo di connessione (7.5 ms durante il recupero)
+#define PACCHETTI_PER_EVENTO 4
+#define LATENZA_MS 2
+#define DIMENSIONE_PACCHETTO 244
+#define DURATA_MASSIMA_MS 300000UL
+
+static uint32_t statoCaso = 12345;
+
+static double caso()
+{
+    statoCaso ^= statoCaso << 13;
+    statoCaso ^= statoCaso >> 17;
+    statoCaso ^= statoCaso << 5;
+    return (statoCaso >> 8) / 16777216.0;
+}
+
+// Un verso del collegamento: i pacchetti arrivano in ordine di istante di consegna
+struct Collegamento {
+    double perdita = 0;
+    double corruzione = 0;
+    int ritardoCasuale = 0;            // Fino a questo ritardo in più: riordino
+    std::multimap<unsigned long, std::vector<uint8_t>> inVolo;
+    uint32_t inviati = 0;
+    uint32_t persi = 0;
+    uint32_t rovinati = 0;
+
+    void invia(const uint8_t* dati, int lunghezza, unsigned long adessoMs)
+    {
+        inviati++;
+        if (caso() < perdita)
+        {
+            persi++;
+            return;
+        }
+        std::vector<uint8_t> p(dati, dati + lunghezza);
+        if (caso() < corruzione)
+        {
+            p[(size_t)(caso() * lunghezza)] ^= (uint8_t)(1u << (int)(caso() * 8));
+            rovinati++;
+        }
+        unsigned long arrivo = adessoMs + LATENZA_MS + (unsigned long)(caso() * (ritardoCasuale + 1));
+        inVolo.insert(std::make_pair(arrivo, p));
+    }
+
+    bool consegna(unsigned long adessoMs, std::vector<uint8_t>& p)
+    {
+        if (inVolo.empty() || inVolo.begin()->first > adessoMs)
+            return false;
+        p = inVolo.begin()->second;
+        inVolo.erase(inVolo.begin());
+        return true;
+    }
+};
+
+// Archivio su flash simulato
+class ArchivioFinto : public ScrittoreStorico {
+public:
+    std::vector<CampioneStorico> campioni;
+
+    bool scriviStorico(const CampioneStorico* c, int numero) override
+    {
+        campioni.insert(campioni.end(), c, c + numero);
+        return true;
+    }
+
+    uint32_t ultimoStorico() override { return campioni.empty() ? 0 : campioni.back().epoch; }
+};
+
+static CampioneSense originale(int i)
+{
+    CampioneSense c;
+    c.tempoMs = SENSE_INIZIO_MS - (uint32_t)(CAMPIONI - i) * PERIODO_STORICO_MS;
+    c.temperatura = i % 97 == 5 ? NAN : 15.0f + (i % 500) * 0.01f;
+    c.umidita = 40.0f + (i % 300) * 0.1f;
+    c.pressione = i % 101 == 7 ? NAN : 100.0f + (i % 200) * 0.004f;
+    return c;
+}
+
+// Epoch atteso del campione i: la conversione dal tempo del Sense arrotonda al secondo
+static uint32_t epochAtteso(int i)
+{
+    return EPOCH_INIZIO - (uint32_t)(CAMPIONI - i) * (PERIODO_STORICO_MS / 1000);
+}
+
+static bool stessoValore(float a, float b, float passo)
+{
+    if (isnan(a) || isnan(b))
+        return isnan(a) && isnan(b);
+    return fabsf(a - b) <= passo / 2 + 1e-4f;
+}
+
+struct Prova {
+    const char* nome;
+    double perdita;
+    double corruzione;
+    int ritardoCasuale;
+    double perditaConferme;
+    bool perdiConfermaFine;             // La prima conferma di STORICO_FINE non arriva
+    uint32_t interrompiDopo;            // Campioni ricevuti prima di una disconnessione (0 = mai)
+};
+
+class Simulazione {
+public:
+    explicit Simulazione(const Prova& prova) : _prova(prova), _adessoMs(0), _arretratoInCorso(false),
+                                               _connesso(false), _confermaFinePersa(false), _diretti(0)
+    {
+        for (int i = 0; i < CAMPIONI; i++)
+            _anello.aggiungi(originale(i));
+        _trasmettitore.begin(_anello);
+        _unione.begin(_archivio);
+        _dati.perdita = prova.perdita;
+        _dati.corruzione = prova.corruzione;
+        _dati.ritardoCasuale = prova.ritardoCasuale;
+        _conferme.perdita = prova.perditaConferme;
+        _conferme.ritardoCasuale = prova.ritardoCasuale;
+    }
+
+    void esegui()
+    {
+        connetti();
+        bool interrotto = false;
+        unsigned long riconnessione = 0;
+        while (_adessoMs < DURATA_MASSIMA_MS)
+        {
+            if (_connesso && _prova.interrompiDopo && !interrotto &&
+                _ricevitore.getStatistiche().campioni >= _prova.interrompiDopo)
+            {
+                disconnetti();
+                interrotto = true;
+                riconnessione = _adessoMs + 2000;
+                // Interrotto: l'anello del Sense resta intatto
+                VERIFICA(_anello.getNumero() == CAMPIONI);
+            }
+            if (!_connesso && _adessoMs == riconnessione)
+                connetti();
+            passo();
+            if (_connesso && !_trasmettitore.isAttivo() && !_arretratoInCorso)
+                break;
+        }
+        _unione.update();
+    }
+
+    void controlla()
+    {
+        const StatisticheStorico& s = _ricevitore.getStatistiche();
+        VERIFICA(!_trasmettitore.isAttivo());
+        VERIFICA(s.completato);
+        VERIFICA(_anello.getNumero() == 0); // Scartati solo a fine confermata
+
+        // Tutto l'arretrato, poi la diretta, una volta sola
+        VERIFICA(_archivio.campioni.size() == (size_t)(CAMPIONI + _diretti));
+        int epochSbagliati = 0, valoriSbagliati = 0, nonCrescenti = 0;
+        for (size_t i = 0; i < _archivio.campioni.size(); i++)
+        {
+            const CampioneStorico& c = _archivio.campioni[i];
+            if (i > 0 && c.epoch <= _archivio.campioni[i - 1].epoch)
+                nonCrescenti++;
+            if (i >= CAMPIONI)
+                continue;
+            CampioneSense o = originale((int)i);
+            int32_t scarto = (int32_t)(c.epoch - epochAtteso((int)i));
+            if (scarto < -1 || scarto > 1)
+                epochSbagliati++;
+            if (!stessoValore(c.temperatura, o.temperatura, 0.01f) || !stessoValore(c.umidita, o.umidita, 0.01f) ||
+                !stessoValore(c.pressione, o.pressione, 0.002f))
+                valoriSbagliati++;
+        }
+        VERIFICA(nonCrescenti == 0);
+        VERIFICA(epochSbagliati == 0);
+        VERIFICA(valoriSbagliati == 0);
+        VERIFICA(_archivio.campioni.size() > 7 && isnan(_archivio.campioni[5].temperatura) &&
+                 isnan(_archivio.campioni[7].pressione));
+
+        printf("%-22s %5lu ms, %6u B/s, pacchetti %u inviati / %u persi / %u rovinati, conferme %u inviate / %u perse, "
+               "ripetizioni %u, scartati %u, fuori ordine %u, doppioni %u\n",
+               _prova.nome, s.fineMs - s.inizioMs, _ricevitore.getVelocitaByteS(), _dati.inviati, _dati.persi,
+               _dati.rovinati, _conferme.inviati, _conferme.persi, _trasmettitore.getRipetizioni(), s.scartati,
+               s.fuoriOrdine, _unione.getDoppioni());
+    }
+
+    const StatisticheStorico& statistiche() const { return _ricevitore.getStatistiche(); }
+    uint32_t ripetizioni() const { return _trasmettitore.getRipetizioni(); }
+    uint32_t doppioni() const { return _unione.getDoppioni(); }
+    bool confermaFinePersa() const { return _confermaFinePersa; }
+
+private:
+    Prova _prova;
+    unsigned long _adessoMs;
+    AnelloStorico _anello;
+    TrasmettitoreStorico _trasmettitore;
+    RicevitoreStorico _ricevitore;
+    UnioneStorico _unione;
+    ArchivioFinto _archivio;
+    Collegamento _dati;
+    Collegamento _conferme;
+    bool _arretratoInCorso;
+    bool _connesso;
+    bool _confermaFinePersa;
+    int _diretti;
+
+    uint32_t tempoSense() const { return (uint32_t)(SENSE_INIZIO_MS + _adessoMs); }
+    uint32_t epoch() const { return (uint32_t)(EPOCH_INIZIO + _adessoMs / 1000); }
+
+    // Come BleNetwork::iniziaStorico() e gestisciRichiestaStorico() nel Sense
+    void connetti()
+    {
+        RichiestaStorico richiesta;
+        _ricevitore.inizia(0, DIMENSIONE_PACCHETTO, FINESTRA_STORICO_DEFAULT, _adessoMs, richiesta);
+        uint8_t buf[RICHIESTA_STORICO_DIMENSIONE];
+        codificaRichiestaStorico(richiesta, buf, sizeof(buf));
+        RichiestaStorico letta;
+        VERIFICA(decodificaRichiestaStorico(buf, sizeof(buf), letta) && letta.comando == RICHIESTA_INIZIA);
+        _trasmettitore.inizia(letta, _adessoMs);
+        _unione.iniziaArretrato();
+        _arretratoInCorso = true;
+        _connesso = true;
+    }
+
+    void disconnetti()
+    {
+        _trasmettitore.annulla();
+        _ricevitore.annulla(_adessoMs);
+        _dati.inVolo.clear();
+        _conferme.inVolo.clear();
+        _connesso = false;
+    }
+
+    void passo()
+    {
+        // Sense: qualche notifica per evento di connessione
+        if (_connesso && _adessoMs % EVENTO_MS == 0)
+        {
+            uint8_t buf[STORICO_PACCHETTO_MASSIMO];
+            int lunghezza;
+            for (int n = 0; n < PACCHETTI_PER_EVENTO &&
+                            _trasmettitore.prossimoPacchetto(buf, lunghezza, tempoSense(), _adessoMs); n++)
+                _dati.invia(buf, lunghezza, _adessoMs);
+        }
+
+        // Master: notifiche (gestore di evento)
+        std::vector<uint8_t> p;
+        while (_dati.consegna(_adessoMs, p))
+            _ricevitore.ricevi(p.data(), (int)p.size(), epoch(), _adessoMs);
+
+        // Sense: conferme scritte dal Master
+        while (_conferme.consegna(_adessoMs, p))
+        {
+            RichiestaStorico r;
+            if (decodificaRichiestaStorico(p.data(), (int)p.size(), r) && r.comando == RICHIESTA_CONFERMA)
+                _trasmettitore.conferma(r, _adessoMs);
+        }
+
+        // Master: loop, come BleNetwork::aggiornaStorico()
+        RichiestaStorico conferma;
+        if (_ricevitore.confermaDaInviare(conferma) && _connesso)
+        {
+            uint8_t buf[RICHIESTA_STORICO_DIMENSIONE];
+            codificaRichiestaStorico(conferma, buf, sizeof(buf));
+            if (_prova.perdiConfermaFine && !_confermaFinePersa && _ricevitore.getStatistiche().completato)
+                _confermaFinePersa = true;
+            else
+                _conferme.invia(buf, sizeof(buf), _adessoMs);
+        }
+        CampioneStorico c;
+        for (int n = 0; n < BLOCCO_SCRITTURA_STORICO && _ricevitore.estrai(c); n++)
+            _unione.arretrato(c);
+        if (_arretratoInCorso && !_ricevitore.isAttivo() && _ricevitore.getNumeroInCoda() == 0)
+        {
+            _arretratoInCorso = false;
+            _unione.fineArretrato(_ricevitore.getStatistiche().completato);
+        }
+
+        // Diretta durante il recupero: più recente di tutto l'arretrato, va scritta dopo
+        if (_connesso && _adessoMs == 100)
+        {
+            CampioneStorico d = {epoch() + 1, 20.0f, 50.0f, 101.0f};
+            _unione.diretto(d);
+            _diretti++;
+        }
+        VERIFICA(_unione.update());
+        _adessoMs++;
+    }
+};
+
+static void campioneNullo()
+{
+    CampioneSense c = {1234, NAN, NAN, 101.3f}, r;
+    uint8_t buf[STORICO_CAMPIONE_DIMENSIONE];
+    codificaCampioneSense(c, buf);
+    VERIFICA(tramaLeggi16(buf + 4) == TRAMA_INT16_NULLO); // Non più 327.67 °C
+    VERIFICA(tramaLeggi16(buf + 6) == TRAMA_UINT16_NULLO);
+    decodificaCampioneSense(buf, r);
+    VERIFICA(r.tempoMs == 1234 && isnan(r.temperatura) && isnan(r.umidita));
+    VERIFICA(fabsf(r.pressione - 101.3f) < 0.002f);
+
+    c.temperatura = 500.0f; // Fuori scala: satura senza diventare nullo
+    codificaCampioneSense(c, buf);
+    decodificaCampioneSense(buf, r);
+    VERIFICA(fabsf(r.temperatura - 327.67f) < 0.001f);
+}
+
+int main()
+{
+    campioneNullo();
+
+    const Prova prove[] = {
+        {"Pulito", 0, 0, 0, 0, false, 0},
+        {"Perdite e riordino", 0.10, 0.05, 20, 0.20, false, 0},
+        {"Conferma della fine", 0, 0, 0, 0, true, 0},
+        {"Interrotto e ripetuto", 0.05, 0.02, 10, 0.10, false, CAMPIONI / 2},
+    };
+
+    for (const Prova& prova : prove)
+    {
+        std::unique_ptr<Simulazione> s(new Simulazione(prova));
+        s->esegui();
+        s->controlla();
+        if (prova.perdita > 0)
+        {
+            VERIFICA(s->statistiche().scartati > 0);    // I CRC errati non passano
+            VERIFICA(s->statistiche().fuoriOrdine > 0);
+            VERIFICA(s->ripetizioni() > 0);
+        }
+        if (prova.perdiConfermaFine)
+            VERIFICA(s->confermaFinePersa() && s->ripetizioni() > 0);
+        if (prova.interrompiDopo)
+            VERIFICA(s->doppioni() >= prova.interrompiDopo); // Già scritti nel primo tentativo
+        else
+            VERIFICA(s->doppioni() == 0);
+    }
+    return fineVerifiche();
+}
@@ -0,0 +1,136 @@
+// Kicco972.net
+
+
+// TramaSensori su PC: andata e ritorno della trama del Sense (valori tipici,
+// estremi, fuori scala e NaN con il codice nullo), trame rifiutate e giro
+// della sequenza.
+
+#include "TramaSensori.h"
+#include "Verifica.h"
+#include <string.h>
+
+static bool vicino(float a, float b, float tolleranza)
+{
+    return fabsf(a - b) <= tolleranza;
+}
+
+static TramaSensori tipica()
+{
+    TramaSensori t;
+    t.sequenza = 1234;
+    t.tempoMs = 3000000123u;
+    t.ambienteValido = true;
+    t.temperatura = 21.37f;
+    t.umidita = 48.25f;
+    t.pressione = 101.325f;
+    t.magX = -23.4f;
+    t.magY = 5.1f;
+    t.magZ = 41.9f;
+    return t;
+}
+
+static bool andataRitorno(const TramaSensori& t, TramaSensori& r)
+{
+    uint8_t buf[TRAMA_SENSORI_DIMENSIONE];
+    if (codificaTramaSensori(t, buf, sizeof(buf)) != TRAMA_SENSORI_DIMENSIONE)
+        return false;
+    return decodificaTramaSensori(buf, sizeof(buf), r);
+}
+
+static void valoriTipici()
+{
+    TramaSensori t = tipica(), r;
+    VERIFICA(andataRitorno(t, r));
+    VERIFICA(r.sequenza == t.sequenza && r.tempoMs == t.tempoMs && r.ambienteValido);
+    // Mezzo passo di quantizzazione
+    VERIFICA(vicino(r.temperatura, t.temperatura, 0.005f));
+    VERIFICA(vicino(r.umidita, t.umidita, 0.005f));
+    VERIFICA(vicino(r.pressione, t.pressione, 0.001f));
+    VERIFICA(vicino(r.magX, t.magX, 0.05f) && vicino(r.magY, t.magY, 0.05f) && vicino(r.magZ, t.magZ, 0.05f));
+
+    t.ambienteValido = false;
+    VERIFICA(andataRitorno(t, r) && !r.ambienteValido);
+
+    // Nessun campo ricodificato cambia: la decodifica è esatta sui valori quantizzati
+    uint8_t a[TRAMA_SENSORI_DIMENSIONE], b[TRAMA_SENSORI_DIMENSIONE];
+    codificaTramaSensori(tipica(), a, sizeof(a));
+    decodificaTramaSensori(a, sizeof(a), r);
+    codificaTramaSensori(r, b, sizeof(b));
+    VERIFICA(memcmp(a, b, sizeof(a)) == 0);
+}
+
+static void valoriNulli()
+{
+    TramaSensori t = tipica(), r;
+    t.temperatura = NAN;
+    t.umidita = NAN;
+    t.pressione = NAN;
+    t.magX = NAN;
+    VERIFICA(andataRitorno(t, r));
+    VERIFICA(isnan(r.temperatura) && isnan(r.umidita) && isnan(r.pressione) && isnan(r.magX));
+    VERIFICA(!isnan(r.magY) && !isnan(r.magZ));
+
+    uint8_t buf[TRAMA_SENSORI_DIMENSIONE];
+    codificaTramaSensori(t, buf, sizeof(buf));
+    VERIFICA(tramaLeggi16(buf + 8) == TRAMA_INT16_NULLO);
+    VERIFICA(tramaLeggi16(buf + 10) == TRAMA_UINT16_NULLO);
+    VERIFICA(tramaLeggi16(buf + 12) == TRAMA_UINT16_NULLO);
+    VERIFICA(tramaLeggi16(buf + 14) == TRAMA_INT16_NULLO);
+}
+
+// Fuori scala si ferma un passo prima del codice nullo, in entrambi i versi
+static void saturazione()
+{
+    TramaSensori t = tipica(), r;
+    t.temperatura = -400.0f;
+    t.umidita = 1000.0f;
+    t.pressione = INFINITY;
+    t.magX = 5000.0f;
+    t.magY = -INFINITY;
+    t.magZ = -3276.8f; // Esattamente il codice nullo una volta scalato
+    VERIFICA(andataRitorno(t, r));
+    VERIFICA(vicino(r.temperatura, -327.67f, 0.001f));
+    VERIFICA(vicino(r.umidita, 655.34f, 0.001f));
+    VERIFICA(vicino(r.pressione, 131.068f, 0.001f));
+    VERIFICA(vicino(r.magX, 3276.7f, 0.01f));
+    VERIFICA(vicino(r.magY, -3276.7f, 0.01f));
+    VERIFICA(vicino(r.magZ, -3276.7f, 0.01f));
+
+    t.temperatura = 400.0f;
+    t.umidita = -5.0f;
+    t.pressione = -1.0f;
+    VERIFICA(andataRitorno(t, r));
+    VERIFICA(vicino(r.temperatura, 327.67f, 0.001f));
+    VERIFICA(r.umidita == 0.0f && r.pressione == 0.0f);
+}
+
+static void trameRifiutate()
+{
+    uint8_t buf[TRAMA_SENSORI_DIMENSIONE + 4];
+    TramaSensori r;
+    VERIFICA(codificaTramaSensori(tipica(), buf, TRAMA_SENSORI_DIMENSIONE - 1) == 0);
+    VERIFICA(codificaTramaSensori(tipica(), buf, sizeof(buf)) == TRAMA_SENSORI_DIMENSIONE);
+    VERIFICA(!decodificaTramaSensori(buf, TRAMA_SENSORI_DIMENSIONE - 1, r));
+    // Campi aggiunti in coda da versioni future: si leggono solo i primi 20 byte
+    VERIFICA(decodificaTramaSensori(buf, sizeof(buf), r));
+    buf[0] = TRAMA_SENSORI_VERSIONE + 1;
+    VERIFICA(!decodificaTramaSensori(buf, TRAMA_SENSORI_DIMENSIONE, r));
+}
+
+static void sequenza()
+{
+    VERIFICA(tramePerse(10, 11) == 0);
+    VERIFICA(tramePerse(10, 14) == 3);
+    VERIFICA(tramePerse(65535, 0) == 0);
+    VERIFICA(tramePerse(65534, 2) == 3);
+}
+
+int main()
+{
+    valoriTipici();
+    valoriNulli();
+    saturazione();
+    trameRifiutate();
+    sequenza();
+    return fineVerifiche();
+}
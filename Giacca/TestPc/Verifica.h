@@ -0,0 +1,38 @@
+/*
+  Verifica.h
+  Controlli minimi per i programmi di TestPc: ogni VERIFICA fallita stampa file,
+  riga e condizione; fineVerifiche() riassume e dà il codice di uscita per make.
+  adessoUs() misura i tempi dei benchmark.
+*/
+#ifndef VERIFICA_H
+#define VERIFICA_H
+
+#include <stdio.h>
+#include <chrono>
+
+static int verificheEseguite = 0;
+static int verificheFallite = 0;
+
+#define VERIFICA(condizione)                                                         \
+    do                                                                               \
+    {                                                                                \
+        verificheEseguite++;                                                         \
+        if (!(condizione))                                                           \
+        {                                                                            \
+            verificheFallite++;                                                      \
+            printf("%s:%d: VERIFICA fallita: %s\n", __FILE__, __LINE__, #condizione); \
+        }                                                                            \
+    } while (0)
+
+static inline int fineVerifiche()
+{
+    printf("%d verifiche, %d fallite\n", verificheEseguite, verificheFallite);
+    return verificheFallite ? 1 : 0;
+}
+
+static inline double adessoUs()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif